@@ -210,7 +210,7 @@ int main(int argc, const char **argv)
 
   global_print_banner();
 
-  SimpleMessenger *messenger = new SimpleMessenger(g_ceph_context);
+  SimpleMessenger *messenger = new SimpleMessenger(g_ceph_context, "mds");
   messenger->bind(g_conf->public_addr, getpid());
   cout << "starting " << g_conf->name << " at " << messenger->get_ms_addr()
        << std::endl;
@@ -352,7 +352,7 @@ int main(int argc, const char **argv)
   }
 
   // bind
-  SimpleMessenger *messenger = new SimpleMessenger(g_ceph_context);
+  SimpleMessenger *messenger = new SimpleMessenger(g_ceph_context, "mon");
   int rank = monmap.get_rank(g_conf->name.get_id());
 
   global_print_banner();
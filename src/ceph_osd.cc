@@ -270,10 +270,10 @@ int main(int argc, const char **argv)
 	 << TEXT_NORMAL << dendl;
   }
 
-  SimpleMessenger *client_messenger = new SimpleMessenger(g_ceph_context);
-  SimpleMessenger *cluster_messenger = new SimpleMessenger(g_ceph_context);
-  SimpleMessenger *messenger_hbin = new SimpleMessenger(g_ceph_context);
-  SimpleMessenger *messenger_hbout = new SimpleMessenger(g_ceph_context);
+  SimpleMessenger *client_messenger = new SimpleMessenger(g_ceph_context, "client");
+  SimpleMessenger *cluster_messenger = new SimpleMessenger(g_ceph_context, "cluster");
+  SimpleMessenger *messenger_hbin = new SimpleMessenger(g_ceph_context, "hbin");
+  SimpleMessenger *messenger_hbout = new SimpleMessenger(g_ceph_context, "hbout");
 
   client_messenger->bind(g_conf->public_addr, getpid());
   cluster_messenger->bind(g_conf->cluster_addr, getpid());
@@ -298,7 +298,8 @@ int main(int argc, const char **argv)
   messenger_hbin->register_entity(entity_name_t::OSD(whoami));
   messenger_hbout->register_entity(entity_name_t::OSD(whoami));
 
-  Throttle client_throttler(g_conf->osd_client_message_size_cap);
+  Throttle client_throttler(g_ceph_context, "osd_client_bytes",
+			    g_conf->osd_client_message_size_cap);
 
   uint64_t supported =
     CEPH_FEATURE_UID | 
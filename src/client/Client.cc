@@ -60,6 +60,7 @@ using namespace std;
 #include "osdc/Filer.h"
 #include "osdc/Objecter.h"
 #include "osdc/ObjectCacher.h"
+#include "osdc/ObjecterWriteback.h"
 
 #include "common/Cond.h"
 #include "common/Mutex.h"
@@ -160,9 +161,14 @@ Client::Client(Messenger *m, MonClient *mc)
   mdsmap = new MDSMap(m->cct);
   objecter = new Objecter(cct, messenger, monclient, osdmap, client_lock, timer);
   objecter->set_client_incarnation(0);  // client always 0, for now.
-  objectcacher = new ObjectCacher(cct, objecter, client_lock, 
+  writeback_handler = new ObjecterWriteback(objecter);
+  objectcacher = new ObjectCacher(cct, *writeback_handler, client_lock,
 				  client_flush_set_callback,    // all commit callback
-				  (void*)this);
+				  (void*)this,
+				  cct->_conf->client_oc_size,
+				  cct->_conf->client_oc_max_dirty,
+				  cct->_conf->client_oc_target_dirty,
+				  cct->_conf->client_oc_max_dirty_age);
   filer = new Filer(objecter);
 }
 
@@ -177,6 +183,7 @@ Client::~Client()
     delete objectcacher; 
     objectcacher = 0; 
   }
+  delete writeback_handler;
 
   if (filer) { delete filer; filer = 0; }
   if (objecter) { delete objecter; objecter = 0; }
@@ -4822,6 +4829,20 @@ Fh *Client::_create_fh(Inode *in, int flags, int cmode)
 
   ldout(cct, 10) << "_create_fh " << in->ino << " mode " << cmode << dendl;
 
+  // readahead is bounded by (and aligned to) the layout period
+  const md_config_t *conf = cct->_conf;
+  uint64_t period = (uint64_t)in->layout.fl_stripe_count * in->layout.fl_object_size;
+  uint64_t ra_max = conf->client_readahead_max_bytes;
+  if (conf->client_readahead_max_periods) {
+    uint64_t m = conf->client_readahead_max_periods * period;
+    ra_max = ra_max ? MIN(ra_max, m) : m;
+  }
+  f->readahead.set_window(conf->client_readahead_min, ra_max);
+  vector<uint64_t> align;
+  align.push_back(period);
+  align.push_back(in->layout.fl_stripe_unit);
+  f->readahead.set_alignments(align);
+
   if (in->snapid != CEPH_NOSNAP) {
     in->snap_cap_refs++;
     ldout(cct, 5) << "open success, fh is " << f << " combined IMMUTABLE SNAP caps " 
@@ -5037,19 +5058,6 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
     unlock_fh_pos(f);
   }
 
-  // adjust readahead state
-  if (f->last_pos != offset) {
-    f->nr_consec_read = f->consec_read_bytes = 0;
-  } else {
-    f->nr_consec_read++;
-  }
-  f->consec_read_bytes += bl->length();
-  ldout(cct, 10) << "readahead nr_consec_read " << f->nr_consec_read
-	   << " for " << f->consec_read_bytes << " bytes" 
-	   << " .. last_pos " << f->last_pos << " .. offset " << offset
-	   << dendl;
-  f->last_pos = offset+bl->length();
-
   // done!
   put_cap_ref(in, got);
   return r;
@@ -5057,79 +5065,41 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
 
 int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
 {
-  const md_config_t *conf = cct->_conf;
   Inode *in = f->inode;
-  bool readahead = true;
 
   ldout(cct, 10) << "_read_async " << *in << " " << off << "~" << len << dendl;
 
   // trim read based on file size?
   if (off >= in->size)
     return 0;
-  if (off + len > in->size) {
+  if (off + len > in->size)
     len = in->size - off;    
-    readahead = false;
-  }
 
   // we will populate the cache here
   if (in->cap_refs[CEPH_CAP_FILE_CACHE] == 0)
     in->get_cap_ref(CEPH_CAP_FILE_CACHE);
   
-  ldout(cct, 10) << "readahead=" << readahead << " nr_consec=" << f->nr_consec_read
-	   << " max_byes=" << conf->client_readahead_max_bytes
-	   << " max_periods=" << conf->client_readahead_max_periods << dendl;
-
   // readahead?
-  if (readahead &&
-      f->nr_consec_read &&
-      (conf->client_readahead_max_bytes ||
-       conf->client_readahead_max_periods)) {
-    loff_t l = f->consec_read_bytes * 2;
-    if (conf->client_readahead_min)
-      l = MAX(l, conf->client_readahead_min);
-    if (conf->client_readahead_max_bytes)
-      l = MIN(l, conf->client_readahead_max_bytes);
-    loff_t p = in->layout.fl_stripe_count * in->layout.fl_object_size;
-    if (conf->client_readahead_max_periods)
-      l = MIN(l, conf->client_readahead_max_periods * p);
-
-    if (l >= 2*p)
-      // align large readahead with period
-      l -= (off+l) % p;
-    else {
-      // align readahead with stripe unit if we cross su boundary
-      int su = in->layout.fl_stripe_unit;
-      if ((off+l)/su != off/su) l -= (off+l) % su;
-    }
-    
-    // don't read past end of file
-    if (off+l > in->size)
-      l = in->size - off;
-    
-    loff_t min = MIN((loff_t)len, l/2);
-
-    ldout(cct, 20) << "readahead " << f->nr_consec_read << " reads " 
-	     << f->consec_read_bytes << " bytes ... readahead " << off << "~" << l
-	     << " min " << min
-	     << " (caller wants " << off << "~" << len << ")" << dendl;
-    if (l > (loff_t)len) {
-      if (objectcacher->file_is_cached(&in->oset, &in->layout, in->snapid, off, min))
-	ldout(cct, 20) << "readahead already have min" << dendl;
-      else {
-	objectcacher->file_read(&in->oset, &in->layout, in->snapid, off, l, NULL, 0, 0);
-	ldout(cct, 20) << "readahead initiated" << dendl;
-      }
-    }
+  vector<Readahead::extent_t> ra;
+  f->readahead.update(off, len, in->size, ra);
+  for (vector<Readahead::extent_t>::iterator p = ra.begin(); p != ra.end(); ++p) {
+    ldout(cct, 20) << "readahead " << p->first << "~" << p->second
+		   << " window " << f->readahead.get_window()
+		   << " (caller wants " << off << "~" << len << ")" << dendl;
+    ObjectCacher::OSDRead *rd = objectcacher->prepare_read(in->snapid, NULL, 0);
+    filer->file_to_extents(in->ino, &in->layout, p->first, p->second, rd->extents);
+    objectcacher->readx(rd, &in->oset, NULL);
   }
-  
+
   // read (and possibly block)
   int r, rvalue = 0;
   Mutex flock("Client::_read_async flock");
   Cond cond;
   bool done = false;
   Context *onfinish = new C_SafeCond(&flock, &cond, &done, &rvalue);
-  r = objectcacher->file_read(&in->oset, &in->layout, in->snapid,
-                              off, len, bl, 0, onfinish);
+  ObjectCacher::OSDRead *rd = objectcacher->prepare_read(in->snapid, bl, 0);
+  filer->file_to_extents(in->ino, &in->layout, off, len, rd->extents);
+  r = objectcacher->readx(rd, &in->oset, onfinish);
   if (r == 0) {
     while (!done) 
       cond.Wait(client_lock);
@@ -5308,8 +5278,11 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
     objectcacher->wait_for_write(size, client_lock);
     
     // async, caching, non-blocking.
-    objectcacher->file_write(&in->oset, &in->layout, in->snaprealm->get_snap_context(),
-			     offset, size, bl, ceph_clock_now(cct), 0);
+    ObjectCacher::OSDWrite *wr =
+      objectcacher->prepare_write(in->snaprealm->get_snap_context(), bl,
+				  ceph_clock_now(cct), 0);
+    filer->file_to_extents(in->ino, &in->layout, offset, size, wr->extents);
+    objectcacher->writex(wr, &in->oset);
 
     put_cap_ref(in, CEPH_CAP_FILE_BUFFER);
   } else {
@@ -66,6 +66,7 @@ class InodeStat;
 class Filer;
 class Objecter;
 class ObjectCacher;
+class ObjecterWriteback;
 
 class PerfCounters;
 
@@ -262,6 +263,7 @@ public:
 protected:
   Filer                 *filer;     
   ObjectCacher          *objectcacher;
+  ObjecterWriteback     *writeback_handler;
   Objecter              *objecter;     // (non-blocking) osd interface
   
   // cache
@@ -2,6 +2,7 @@
 #define CEPH_CLIENT_FH_H
 
 #include "include/types.h"
+#include "common/Readahead.h"
 
 class Inode;
 class Cond;
@@ -20,13 +21,9 @@ struct Fh {
   bool pos_locked;           // pos is currently in use
   list<Cond*> pos_waiters;   // waiters for pos
 
-  // readahead state
-  loff_t last_pos;
-  loff_t consec_read_bytes;
-  int nr_consec_read;
+  Readahead readahead;
 
-  Fh() : inode(0), pos(0), mds(0), mode(0), append(false), pos_locked(false),
-	 last_pos(0), consec_read_bytes(0), nr_consec_read(0) {}
+  Fh() : inode(0), pos(0), mds(0), mode(0), append(false), pos_locked(false) {}
 };
 
 
@@ -45,6 +45,7 @@ class Cond {
   int Wait(Mutex &mutex)  { 
     assert(mutex.is_locked());
     --mutex.nlock;
+    if (mutex.prof_locked_at) mutex._prof_unlocked();
     int r = pthread_cond_wait(&_c, &mutex._m);
     ++mutex.nlock;
     return r;
@@ -54,6 +55,7 @@ class Cond {
     //cout << "Wait: " << s << endl;
     assert(mutex.is_locked());
     --mutex.nlock;
+    if (mutex.prof_locked_at) mutex._prof_unlocked();
     int r = pthread_cond_wait(&_c, &mutex._m);
     ++mutex.nlock;
     return r;
@@ -64,6 +66,7 @@ class Cond {
     struct timespec ts;
     when.to_timespec(&ts);
     --mutex.nlock;
+    if (mutex.prof_locked_at) mutex._prof_unlocked();
     int r = pthread_cond_timedwait(&_c, &mutex._m, &ts);
     ++mutex.nlock;
     return r;
@@ -90,6 +93,25 @@ class Cond {
   }
 };
 
+/*
+ * like C_SafeCond, for completions that already run with the waiter's
+ * lock held
+ */
+class C_Cond : public Context {
+  Cond *cond;
+  bool *done;
+  int *rval;
+public:
+  C_Cond(Cond *c, bool *d, int *r=0) : cond(c), done(d), rval(r) {
+    *done = false;
+  }
+  void finish(int r) {
+    if (rval) *rval = r;
+    *done = true;
+    cond->Signal();
+  }
+};
+
 class C_SafeCond : public Context {
   Mutex *lock;
   Cond *cond;
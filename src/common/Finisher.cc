@@ -1,5 +1,7 @@
 
 #include "common/config.h"
+#include "common/perf_counters.h"
+#include "common/Clock.h"
 #include "Finisher.h"
 
 #include "common/debug.h"
@@ -7,78 +9,179 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "finisher(" << this << ") "
 
+Finisher::Finisher(CephContext *cct_, string nm, int threads)
+  : cct(cct_), name(nm), logger(NULL)
+{
+  if (threads < 1)
+    threads = 1;
+  for (int i = 0; i < threads; i++)
+    lanes.push_back(new Lane(this));
+}
+
+Finisher::~Finisher()
+{
+  for (vector<Lane*>::iterator p = lanes.begin(); p != lanes.end(); ++p) {
+    assert((*p)->thread == NULL);
+    delete *p;
+  }
+}
+
 void Finisher::start()
 {
-  finisher_thread.create();
+  if (name.length()) {
+    PerfCountersBuilder plb(cct, string("finisher-") + name,
+			    l_finisher_first, l_finisher_last);
+    plb.add_u64(l_finisher_high_queue_len, "high_queue_len");
+    plb.add_u64(l_finisher_bulk_queue_len, "bulk_queue_len");
+    plb.add_fl_avg(l_finisher_high_lat, "high_latency");
+    plb.add_fl_avg(l_finisher_bulk_lat, "bulk_latency");
+    logger = plb.create_perf_counters();
+    cct->get_perfcounters_collection()->add(logger);
+  }
+
+  for (vector<Lane*>::iterator p = lanes.begin(); p != lanes.end(); ++p) {
+    Lane *lane = *p;
+    lane->stop = false;
+    lane->thread = new FinisherThread(this, lane);
+    lane->thread->create();
+  }
 }
 
 void Finisher::stop()
 {
-  finisher_lock.Lock();
-  finisher_stop = true;
-  finisher_cond.Signal();
-  finisher_lock.Unlock();
-  finisher_thread.join();
+  for (vector<Lane*>::iterator p = lanes.begin(); p != lanes.end(); ++p) {
+    Lane *lane = *p;
+    lane->lock.Lock();
+    lane->stop = true;
+    lane->cond.Signal();
+    lane->lock.Unlock();
+  }
+  for (vector<Lane*>::iterator p = lanes.begin(); p != lanes.end(); ++p) {
+    Lane *lane = *p;
+    lane->thread->join();
+    delete lane->thread;
+    lane->thread = NULL;
+  }
+
+  if (logger) {
+    cct->get_perfcounters_collection()->remove(logger);
+    delete logger;
+    logger = NULL;
+  }
 }
 
 void Finisher::wait_for_empty()
 {
-  finisher_lock.Lock();
-  while (!finisher_queue.empty() || finisher_running) {
-    ldout(cct, 10) << "wait_for_empty waiting" << dendl;
-    finisher_empty_cond.Wait(finisher_lock);
+  for (vector<Lane*>::iterator p = lanes.begin(); p != lanes.end(); ++p) {
+    Lane *lane = *p;
+    lane->lock.Lock();
+    while (!lane->empty() || lane->running) {
+      ldout(cct, 10) << "wait_for_empty waiting" << dendl;
+      lane->empty_cond.Wait(lane->lock);
+    }
+    lane->lock.Unlock();
   }
   ldout(cct, 10) << "wait_for_empty empty" << dendl;
-  finisher_lock.Unlock();
 }
 
-void *Finisher::finisher_thread_entry()
+utime_t Finisher::stamp()
+{
+  // only pay for the clock read when someone is looking at latencies
+  if (logger)
+    return ceph_clock_now(cct);
+  return utime_t();
+}
+
+void Finisher::_queue(Lane *lane, int prio, Context *c, int r)
 {
-  finisher_lock.Lock();
+  assert(lane->lock.is_locked());
+  lane->q[prio].push_back(Item(c, r, stamp()));
+}
+
+void Finisher::_queued(Lane *lane, int prio, int n)
+{
+  if (!n)
+    return;
+  if (prio == PRIO_HIGH)
+    lane->high_pending.add(n);
+  queue_len[prio].add(n);
+  if (logger)
+    logger->set(prio == PRIO_HIGH ? l_finisher_high_queue_len :
+		l_finisher_bulk_queue_len, queue_len[prio].read());
+  lane->cond.Signal();
+}
+
+/*
+ * Run a batch taken off one of the lane's queues.  A bulk batch checks
+ * for newly queued high-priority work between contexts and, if there is
+ * any, puts its unfinished tail back at the head of the bulk queue so
+ * that per-key order is preserved.
+ */
+void Finisher::run_batch(Lane *lane, int prio, vector<Item>& ls)
+{
+  ldout(cct, 10) << "finisher_thread doing " << ls.size()
+		 << (prio == PRIO_HIGH ? " high" : " bulk") << dendl;
+  utime_t now;
+  unsigned i;
+  for (i = 0; i < ls.size(); i++) {
+    if (prio == PRIO_BULK && lane->high_pending.read())
+      break;
+    Item& it = ls[i];
+    it.c->finish(it.r);
+    delete it.c;
+    if (logger) {
+      now = ceph_clock_now(cct);
+      now -= it.stamp;
+      logger->finc(prio == PRIO_HIGH ? l_finisher_high_lat :
+		   l_finisher_bulk_lat, (double)now);
+    }
+  }
+  queue_len[prio].sub(i);
+  if (logger)
+    logger->set(prio == PRIO_HIGH ? l_finisher_high_queue_len :
+		l_finisher_bulk_queue_len, queue_len[prio].read());
+
+  if (i < ls.size()) {
+    ldout(cct, 10) << "finisher_thread yielding to high with "
+		   << (ls.size() - i) << " bulk left" << dendl;
+    lane->lock.Lock();
+    lane->q[prio].insert(lane->q[prio].begin(), ls.begin() + i, ls.end());
+    lane->lock.Unlock();
+  }
+  ls.clear();
+}
+
+void *Finisher::finisher_thread_entry(Lane *lane)
+{
+  lane->lock.Lock();
   ldout(cct, 10) << "finisher_thread start" << dendl;
 
-  while (!finisher_stop) {
-    while (!finisher_queue.empty()) {
-      vector<Context*> ls;
-      list<pair<Context*,int> > ls_rval;
-      ls.swap(finisher_queue);
-      ls_rval.swap(finisher_queue_rval);
-      finisher_running = true;
-      finisher_lock.Unlock();
-      ldout(cct, 10) << "finisher_thread doing " << ls << dendl;
-
-      for (vector<Context*>::iterator p = ls.begin();
-	   p != ls.end();
-	   p++) {
-	if (*p) {
-	  (*p)->finish(0);
-	  delete *p;
-	} else {
-	  assert(!ls_rval.empty());
-	  Context *c = ls_rval.front().first;
-	  c->finish(ls_rval.front().second);
-	  delete c;
-	  ls_rval.pop_front();
-	}
-      }
-      ldout(cct, 10) << "finisher_thread done with " << ls << dendl;
-      ls.clear();
-
-      finisher_lock.Lock();
-      finisher_running = false;
+  while (!lane->stop) {
+    while (!lane->empty()) {
+      int prio = lane->q[PRIO_HIGH].empty() ? PRIO_BULK : PRIO_HIGH;
+      vector<Item> ls;
+      ls.swap(lane->q[prio]);
+      if (prio == PRIO_HIGH)
+	lane->high_pending.sub(ls.size());
+      lane->running = true;
+      lane->lock.Unlock();
+
+      run_batch(lane, prio, ls);
+
+      lane->lock.Lock();
+      lane->running = false;
     }
     ldout(cct, 10) << "finisher_thread empty" << dendl;
-    finisher_empty_cond.Signal();
-    if (finisher_stop)
+    lane->empty_cond.Signal();
+    if (lane->stop)
       break;
     
     ldout(cct, 10) << "finisher_thread sleeping" << dendl;
-    finisher_cond.Wait(finisher_lock);
+    lane->cond.Wait(lane->lock);
   }
-  finisher_empty_cond.Signal();
+  lane->empty_cond.Signal();
 
   ldout(cct, 10) << "finisher_thread stop" << dendl;
-  finisher_lock.Unlock();
+  lane->lock.Unlock();
   return 0;
 }
-
@@ -16,51 +16,123 @@
 #define CEPH_FINISHER_H
 
 #include "include/atomic.h"
+#include "include/utime.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
 
 class CephContext;
+class PerfCounters;
 
+enum {
+  l_finisher_first = 997000,
+  l_finisher_high_queue_len,
+  l_finisher_bulk_queue_len,
+  l_finisher_high_lat,
+  l_finisher_bulk_lat,
+  l_finisher_last,
+};
+
+/*
+ * Finisher - run completion Contexts on one or more threads.
+ *
+ * Each thread drains its own pair of queues: latency-sensitive (high)
+ * contexts always go ahead of bulk ones.  Contexts queued with the same
+ * key and priority run in queue order on the same thread; unkeyed
+ * contexts all use key 0, so a single-threaded Finisher, or one that is
+ * only ever fed unkeyed contexts, behaves exactly as it always has.
+ */
 class Finisher {
+public:
+  enum {
+    PRIO_HIGH = 0,
+    PRIO_BULK = 1,
+    NUM_PRIO
+  };
+
+private:
   CephContext *cct;
-  Mutex          finisher_lock;
-  Cond           finisher_cond, finisher_empty_cond;
-  bool           finisher_stop, finisher_running;
-  vector<Context*> finisher_queue;
-  list<pair<Context*,int> > finisher_queue_rval;
-  
-  void *finisher_thread_entry();
+  string name;
+
+  struct Item {
+    Context *c;
+    int r;
+    utime_t stamp;
+    Item(Context *c_, int r_, utime_t s) : c(c_), r(r_), stamp(s) {}
+  };
+
+  struct FinisherThread;
+
+  struct Lane {
+    Finisher *fin;
+    Mutex lock;
+    Cond cond, empty_cond;
+    vector<Item> q[NUM_PRIO];
+    atomic_t high_pending;  // high contexts queued; lets bulk batches yield
+    bool stop, running;
+    FinisherThread *thread;
+    Lane(Finisher *f)
+      : fin(f), lock("Finisher::Lane::lock"), stop(false), running(false),
+	thread(NULL) {}
+    bool empty() const {
+      return q[PRIO_HIGH].empty() && q[PRIO_BULK].empty();
+    }
+  };
 
   struct FinisherThread : public Thread {
-    Finisher *fin;    
-    FinisherThread(Finisher *f) : fin(f) {}
-    void* entry() { return (void*)fin->finisher_thread_entry(); }
-  } finisher_thread;
+    Finisher *fin;
+    Lane *lane;
+    FinisherThread(Finisher *f, Lane *l) : fin(f), lane(l) {}
+    void* entry() { return (void*)fin->finisher_thread_entry(lane); }
+  };
+
+  vector<Lane*> lanes;
+  atomic_t       queue_len[NUM_PRIO];
+  PerfCounters   *logger;
+
+  void *finisher_thread_entry(Lane *lane);
+  void run_batch(Lane *lane, int prio, vector<Item>& ls);
+
+  utime_t stamp();
+  void _queue(Lane *lane, int prio, Context *c, int r);
+  void _queued(Lane *lane, int prio, int n);
+
+  Lane *get_lane(uint64_t key) {
+    if (lanes.size() == 1)
+      return lanes[0];
+    // keys are often pointers; mix so the low (aligned) bits don't matter
+    key *= 0x9e3779b97f4a7c15ull;
+    return lanes[(key >> 32) % lanes.size()];
+  }
 
  public:
   void queue(Context *c, int r = 0) {
-    finisher_lock.Lock();
-    if (r) {
-      finisher_queue_rval.push_back(pair<Context*, int>(c, r));
-      finisher_queue.push_back(NULL);
-    } else
-      finisher_queue.push_back(c);
-    finisher_cond.Signal();
-    finisher_lock.Unlock();
+    queue(c, r, 0, PRIO_BULK);
+  }
+  /// queue @c behind everything previously queued with the same key and priority
+  void queue(Context *c, int r, uint64_t key, int prio = PRIO_BULK) {
+    Lane *lane = get_lane(key);
+    lane->lock.Lock();
+    _queue(lane, prio, c, r);
+    _queued(lane, prio, 1);
+    lane->lock.Unlock();
   }
   void queue(vector<Context*>& ls) {
-    finisher_lock.Lock();
-    finisher_queue.insert(finisher_queue.end(), ls.begin(), ls.end());
-    finisher_cond.Signal();
-    finisher_lock.Unlock();
+    Lane *lane = get_lane(0);
+    lane->lock.Lock();
+    for (vector<Context*>::iterator p = ls.begin(); p != ls.end(); ++p)
+      _queue(lane, PRIO_BULK, *p, 0);
+    _queued(lane, PRIO_BULK, ls.size());
+    lane->lock.Unlock();
     ls.clear();
   }
   void queue(deque<Context*>& ls) {
-    finisher_lock.Lock();
-    finisher_queue.insert(finisher_queue.end(), ls.begin(), ls.end());
-    finisher_cond.Signal();
-    finisher_lock.Unlock();
+    Lane *lane = get_lane(0);
+    lane->lock.Lock();
+    for (deque<Context*>::iterator p = ls.begin(); p != ls.end(); ++p)
+      _queue(lane, PRIO_BULK, *p, 0);
+    _queued(lane, PRIO_BULK, ls.size());
+    lane->lock.Unlock();
     ls.clear();
   }
   
@@ -69,8 +141,14 @@ class Finisher {
 
   void wait_for_empty();
 
-  Finisher(CephContext *cct_) : cct(cct_), finisher_lock("Finisher::finisher_lock"),
-	       finisher_stop(false), finisher_running(false), finisher_thread(this) {}
+  /**
+   * @param nm name; if non-empty, a "finisher-<nm>" perf counter set with
+   *           per-priority queue lengths and queue-to-completion latency
+   *           is registered while running
+   * @param threads number of finisher threads
+   */
+  Finisher(CephContext *cct_, string nm = string(), int threads = 1);
+  ~Finisher();
 };
 
 class C_OnFinisher : public Context {
@@ -30,6 +30,7 @@
 namespace ceph {
 
 Formatter::Formatter()
+  : m_flush_bl(NULL), m_flush_chunk(0)
 {
 }
 
@@ -37,6 +38,13 @@ Formatter::~Formatter()
 {
 }
 
+void Formatter::flush(bufferlist& bl)
+{
+  std::stringstream ss;
+  flush(ss);
+  bl.append(ss.str());
+}
+
 // -----------------------
 JSONFormatter::JSONFormatter(bool p)
   : m_pretty(p), m_is_pending_string(false)
@@ -157,6 +165,7 @@ void JSONFormatter::close_section()
   struct json_formatter_stack_entry_d& entry = m_stack.back();
   m_ss << (entry.is_array ? ']' : '}');
   m_stack.pop_back();
+  maybe_flush();
 }
 
 void JSONFormatter::finish_pending_string()
@@ -214,7 +223,7 @@ void JSONFormatter::dump_format(const char *name, const char *fmt, ...)
 
 int JSONFormatter::get_len() const
 {
-  return m_ss.str().size();
+  return const_cast<std::stringstream&>(m_ss).tellp();
 }
 
 void JSONFormatter::write_raw_data(const char *data)
@@ -276,6 +285,7 @@ void XMLFormatter::close_section()
   print_spaces(false);
   m_ss << "</" << m_sections.back() << ">";
   m_sections.pop_back();
+  maybe_flush();
 }
 
 void XMLFormatter::dump_unsigned(const char *name, uint64_t u)
@@ -339,7 +349,7 @@ void XMLFormatter::dump_format(const char *name, const char *fmt, ...)
 
 int XMLFormatter::get_len() const
 {
-  return m_ss.str().size();
+  return const_cast<std::stringstream&>(m_ss).tellp();
 }
 
 void XMLFormatter::write_raw_data(const char *data)
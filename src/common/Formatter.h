@@ -1,6 +1,8 @@
 #ifndef CEPH_FORMATTER_H
 #define CEPH_FORMATTER_H
 
+#include "include/buffer.h"
+
 #include <deque>
 #include <inttypes.h>
 #include <iostream>
@@ -18,8 +20,19 @@ class Formatter {
   virtual ~Formatter();
 
   virtual void flush(std::ostream& os) = 0;
+  void flush(bufferlist& bl);
   virtual void reset() = 0;
 
+  /*
+   * Stream into @a bl: whenever a section closes with at least @a chunk
+   * bytes buffered, they are appended to @a bl, so a big dump is never
+   * held in full by the formatter.  flush(bl) the remainder when done.
+   */
+  void set_flush_target(bufferlist *bl, unsigned chunk=65536) {
+    m_flush_bl = bl;
+    m_flush_chunk = chunk;
+  }
+
   virtual void open_array_section(const char *name) = 0;
   virtual void open_array_section_in_ns(const char *name, const char *ns) = 0;
   virtual void open_object_section(const char *name) = 0;
@@ -33,6 +46,16 @@ class Formatter {
   virtual void dump_format(const char *name, const char *fmt, ...) = 0;
   virtual int get_len() const = 0;
   virtual void write_raw_data(const char *data) = 0;
+
+ protected:
+  void maybe_flush() {
+    if (m_flush_bl && get_len() >= (int)m_flush_chunk)
+      flush(*m_flush_bl);
+  }
+
+ private:
+  bufferlist *m_flush_bl;
+  unsigned m_flush_chunk;
 };
 
 
@@ -40,6 +63,7 @@ class JSONFormatter : public Formatter {
  public:
   JSONFormatter(bool p=false);
 
+  using Formatter::flush;
   void flush(std::ostream& os);
   void reset();
   void open_array_section(const char *name);
@@ -80,6 +104,7 @@ class XMLFormatter : public Formatter {
   static const char *XML_1_DTD;
   XMLFormatter(bool pretty = false);
 
+  using Formatter::flush;
   void flush(std::ostream& os);
   void reset();
   void open_array_section(const char *name);
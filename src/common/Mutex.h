@@ -17,7 +17,9 @@
 
 #include "include/assert.h"
 #include "lockdep.h"
+#include "lockprof.h"
 
+#include <errno.h>
 #include <pthread.h>
 
 using namespace ceph;
@@ -33,6 +35,9 @@ private:
   pthread_mutex_t _m;
   int nlock;
 
+  int prof_id;
+  uint64_t prof_locked_at;  // start of a sampled hold, or 0
+
   // don't allow copying.
   void operator=(Mutex &M) {}
   Mutex( const Mutex &M ) {}
@@ -50,9 +55,29 @@ private:
     id = lockdep_will_unlock(name, id);
   }
 
+  int _prof_lock() {
+    if (prof_id < 0)
+      prof_id = lockprof_register(name);
+    uint64_t start = lockprof_now();
+    int r = pthread_mutex_trylock(&_m);
+    bool contended = (r == EBUSY);
+    if (contended)
+      r = pthread_mutex_lock(&_m);
+    uint64_t now = lockprof_now();
+    lockprof_wait(prof_id, contended, now - start);
+    if (!prof_locked_at)
+      prof_locked_at = now;
+    return r;
+  }
+  void _prof_unlocked() {  // about to drop the lock (or wait on a Cond)
+    lockprof_hold(prof_id, lockprof_now() - prof_locked_at);
+    prof_locked_at = 0;
+  }
+
 public:
   Mutex(const char *n, bool r = false, bool ld=true, bool bt=false) :
-    name(n), id(-1), recursive(r), lockdep(ld), backtrace(bt), nlock(0) {
+    name(n), id(-1), recursive(r), lockdep(ld), backtrace(bt), nlock(0),
+    prof_id(-1), prof_locked_at(0) {
     if (recursive) {
       // Mutexes of type PTHREAD_MUTEX_RECURSIVE do all the same checks as
       // mutexes of type PTHREAD_MUTEX_ERRORCHECK.
@@ -105,7 +130,11 @@ public:
 
   void Lock(bool no_lockdep=false) {
     if (lockdep && g_lockdep && !no_lockdep) _will_lock();
-    int r = pthread_mutex_lock(&_m);
+    int r;
+    if (g_lockprof && lockprof_sample())
+      r = _prof_lock();
+    else
+      r = pthread_mutex_lock(&_m);
     if (lockdep && g_lockdep) _locked();
     assert(r == 0);
     if (!recursive)
@@ -118,6 +147,7 @@ public:
     --nlock;
     if (!recursive)
       assert(nlock == 0);
+    if (prof_locked_at && nlock == 0) _prof_unlocked();
     if (lockdep && g_lockdep) _will_unlock();
     int r = pthread_mutex_unlock(&_m);
     assert(r == 0);
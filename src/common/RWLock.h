@@ -17,20 +17,42 @@
 #ifndef CEPH_RWLock_Posix__H
 #define CEPH_RWLock_Posix__H
 
+#include <errno.h>
 #include <pthread.h>
 #include "lockdep.h"
+#include "lockprof.h"
 
 class RWLock
 {
   mutable pthread_rwlock_t L;
   const char *name;
   int id;
+  int prof_id;
+  uint64_t prof_wlocked_at;  // start of a sampled write hold, or 0
+
+  void _prof_lock(bool write) {
+    if (prof_id < 0)
+      prof_id = lockprof_register(name);
+    uint64_t start = lockprof_now();
+    int r = write ? pthread_rwlock_trywrlock(&L) : pthread_rwlock_tryrdlock(&L);
+    bool contended = (r == EBUSY);
+    if (contended) {
+      if (write)
+	pthread_rwlock_wrlock(&L);
+      else
+	pthread_rwlock_rdlock(&L);
+    }
+    uint64_t now = lockprof_now();
+    lockprof_wait(prof_id, contended, now - start);
+    if (write)   // read holds overlap; only time exclusive ones
+      prof_wlocked_at = now;
+  }
 
 public:
   RWLock(const RWLock& other);
   const RWLock& operator=(const RWLock& other);
 
-  RWLock(const char *n) : name(n), id(-1) {
+  RWLock(const char *n) : name(n), id(-1), prof_id(-1), prof_wlocked_at(0) {
     pthread_rwlock_init(&L, NULL);
     if (g_lockdep) id = lockdep_register(name);
   }
@@ -42,13 +64,20 @@ public:
 
   void unlock() {
     if (g_lockdep) id = lockdep_will_unlock(name, id);
+    if (prof_wlocked_at) {
+      lockprof_hold(prof_id, lockprof_now() - prof_wlocked_at);
+      prof_wlocked_at = 0;
+    }
     pthread_rwlock_unlock(&L);
   }
 
   // read
   void get_read() {
     if (g_lockdep) id = lockdep_will_lock(name, id);
-    pthread_rwlock_rdlock(&L);    
+    if (g_lockprof && lockprof_sample())
+      _prof_lock(false);
+    else
+      pthread_rwlock_rdlock(&L);
     if (g_lockdep) id = lockdep_locked(name, id);
   }
   bool try_get_read() {
@@ -65,7 +94,10 @@ public:
   // write
   void get_write() {
     if (g_lockdep) id = lockdep_will_lock(name, id);
-    pthread_rwlock_wrlock(&L);
+    if (g_lockprof && lockprof_sample())
+      _prof_lock(true);
+    else
+      pthread_rwlock_wrlock(&L);
     if (g_lockdep) id = lockdep_locked(name, id);
   }
   bool try_get_write() {
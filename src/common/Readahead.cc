@@ -0,0 +1,174 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/Readahead.h"
+
+#include <algorithm>
+#include <functional>
+
+Readahead::Readahead()
+  : min_window(0), max_window(0),
+    last_off(0), last_len(0), stride(0), nr_consec(0), ra_end(0),
+    window(0), hits(0), waste(0)
+{
+}
+
+void Readahead::set_window(uint64_t min, uint64_t max)
+{
+  min_window = MIN(min, max);
+  max_window = max;
+  window = MAX(MIN(window, max_window), min_window);
+}
+
+void Readahead::set_alignments(const vector<uint64_t>& a)
+{
+  alignments.clear();
+  for (vector<uint64_t>::const_iterator p = a.begin(); p != a.end(); ++p)
+    if (*p)
+      alignments.push_back(*p);
+  sort(alignments.begin(), alignments.end(), greater<uint64_t>());
+}
+
+void Readahead::reset()
+{
+  last_off = last_len = 0;
+  stride = 0;
+  nr_consec = 0;
+  ra_end = 0;
+}
+
+void Readahead::update(uint64_t off, uint64_t len, uint64_t limit,
+		       vector<extent_t>& ra)
+{
+  if (!max_window || !len)
+    return;
+
+  bool cont;
+  if (!last_len)
+    cont = false;
+  else if (!stride)
+    cont = (off == last_off + last_len);
+  else
+    cont = (off == last_off + stride && len == last_len);
+
+  if (cont) {
+    nr_consec++;
+    if (!stride) {
+      if (ra_end > off)
+	hits += MIN(len, ra_end - off);
+    } else if (off < ra_end) {
+      hits += len;
+    }
+  } else {
+    _break_stream(off, len);
+  }
+  last_off = off;
+  last_len = len;
+
+  if (!stride && nr_consec >= 1)
+    _sequential(off, len, limit, ra);
+  else if (stride && nr_consec >= 2)
+    _strided(off, len, limit, ra);
+}
+
+void Readahead::_break_stream(uint64_t off, uint64_t len)
+{
+  if (last_len) {
+    uint64_t wasted = 0;
+    if (!stride) {
+      if (ra_end > last_off + last_len)
+	wasted = ra_end - (last_off + last_len);
+    } else {
+      uint64_t next = last_off + stride;
+      if (ra_end > next)
+	wasted = (ra_end - next) / stride * last_len;
+    }
+    waste += wasted;
+    if (waste > hits)
+      window = MAX(window / 2, min_window);
+    hits /= 2;
+    waste /= 2;
+  }
+  ra_end = 0;
+
+  // the read that broke the old stream may be the second of a new one
+  if (last_len && off == last_off + last_len) {
+    stride = 0;
+    nr_consec = 1;
+  } else if (last_len && off > last_off + last_len && len == last_len) {
+    stride = off - last_off;
+    nr_consec = 1;
+  } else {
+    stride = 0;
+    nr_consec = 0;
+  }
+}
+
+void Readahead::_maybe_grow(uint64_t cur)
+{
+  if (waste * 4 <= hits)
+    window = MIN(cur * 2, max_window);
+}
+
+void Readahead::_sequential(uint64_t off, uint64_t len, uint64_t limit,
+			    vector<extent_t>& ra)
+{
+  uint64_t end = off + len;
+  // big reads get at least twice their size ahead of them
+  uint64_t w = MAX(window, MIN(len * 2, max_window));
+
+  if (ra_end) {
+    if (ra_end >= end + w / 2)
+      return;  // still far enough ahead
+    // the reader caught up with the last prefetch
+    _maybe_grow(w);
+    w = MAX(window, w);
+  }
+
+  uint64_t start = MAX(ra_end, end);
+  uint64_t target = end + w;
+  for (vector<uint64_t>::iterator p = alignments.begin(); p != alignments.end(); ++p) {
+    uint64_t t = target - target % *p;
+    if (t > start && t >= end + w / 2) {
+      target = t;
+      break;
+    }
+  }
+  if (target > limit)
+    target = limit;
+  if (target <= start)
+    return;
+  ra.push_back(extent_t(start, target - start));
+  ra_end = target;
+}
+
+void Readahead::_strided(uint64_t off, uint64_t len, uint64_t limit,
+			 vector<extent_t>& ra)
+{
+  uint64_t w = MAX(window, len);
+  uint64_t n = w / len;  // records per window
+
+  if (ra_end) {
+    if (ra_end > off + stride * ((n + 1) / 2))
+      return;
+    _maybe_grow(w);
+    n = MAX(window, w) / len;
+  }
+
+  uint64_t r = MAX(ra_end, off + stride);
+  uint64_t last = off + n * stride;
+  for (; r <= last && r < limit; r += stride)
+    ra.push_back(extent_t(r, MIN(len, limit - r)));
+  ra_end = MAX(ra_end, r);
+}
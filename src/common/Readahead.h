@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_READAHEAD_H
+#define CEPH_READAHEAD_H
+
+#include "include/types.h"
+
+/*
+ * Readahead state for one stream of reads (a file handle, an image).
+ *
+ * Feed every read to update(); it tells you what to prefetch, if
+ * anything.  Two patterns are recognized: sequential reads, and
+ * strided reads (same length, same forward gap every time).  The
+ * window starts at the minimum and doubles each time the reader
+ * catches up with a prefetch while little has been wasted; whenever a
+ * stream breaks with prefetched data it never reached, that data is
+ * counted as waste and the window is halved if waste outweighs hits.
+ * Random readers therefore never trigger it, and short runs drive it
+ * back down to the minimum.
+ *
+ * Sequential prefetches are trimmed back to the largest alignment
+ * (e.g. layout period, then stripe unit) that still leaves at least
+ * half a window, so they end on object boundaries.
+ *
+ * There is no locking; the caller serializes access.
+ */
+class Readahead {
+public:
+  typedef pair<uint64_t, uint64_t> extent_t;  // offset, length
+
+  Readahead();
+
+  /// bounds for the window, in bytes; max 0 disables readahead
+  void set_window(uint64_t min, uint64_t max);
+  /// boundaries to end sequential prefetches on, any order
+  void set_alignments(const vector<uint64_t>& a);
+
+  /**
+   * Account for a read of [off, off+len) and return what to prefetch
+   * in @a ra.  Nothing at or past @a limit (e.g. the file size) is
+   * ever returned.
+   */
+  void update(uint64_t off, uint64_t len, uint64_t limit,
+	      vector<extent_t>& ra);
+
+  /// forget the current stream (e.g. the cache was dropped)
+  void reset();
+
+  uint64_t get_window() const { return window; }
+  uint64_t get_hits() const { return hits; }
+  uint64_t get_waste() const { return waste; }
+  bool is_strided() const { return stride > 0; }
+
+private:
+  uint64_t min_window, max_window;
+  vector<uint64_t> alignments;  // largest first
+
+  uint64_t last_off, last_len;
+  uint64_t stride;      // 0 for a sequential stream
+  unsigned nr_consec;   // reads so far that continued the stream
+  uint64_t ra_end;      // sequential: end of prefetched data;
+			// strided: first record not yet prefetched
+  uint64_t window;
+  uint64_t hits, waste; // bytes, decayed each time a stream breaks
+
+  void _break_stream(uint64_t off, uint64_t len);
+  void _sequential(uint64_t off, uint64_t len, uint64_t limit,
+		   vector<extent_t>& ra);
+  void _strided(uint64_t off, uint64_t len, uint64_t limit,
+		vector<extent_t>& ra);
+  void _maybe_grow(uint64_t cur);
+};
+
+#endif
@@ -0,0 +1,233 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/Throttle.h"
+#include "common/Clock.h"
+#include "common/perf_counters.h"
+#include "common/config.h"
+
+#include "common/debug.h"
+#define DOUT_SUBSYS throttle
+#undef dout_prefix
+#define dout_prefix *_dout << "throttle(" << name << " " << (void*)this << ") "
+
+Throttle::Throttle(CephContext *cct_, const std::string& n, int64_t m)
+  : cct(cct_), name(n), logger(NULL), count(0), max(m),
+    lock("Throttle::lock")
+{
+  assert(m >= 0);
+  if (name.length())
+    _init_logger();
+}
+
+Throttle::~Throttle()
+{
+  assert(cond.empty());
+  if (logger) {
+    cct->get_perfcounters_collection()->remove(logger);
+    delete logger;
+  }
+}
+
+void Throttle::_init_logger()
+{
+  PerfCountersBuilder b(cct, string("throttle-") + name,
+			l_throttle_first, l_throttle_last);
+  b.add_u64(l_throttle_val, "val");
+  b.add_u64(l_throttle_max, "max");
+  b.add_u64_counter(l_throttle_get, "get");
+  b.add_u64_counter(l_throttle_get_sum, "get_sum");
+  b.add_u64_counter(l_throttle_get_or_fail_fail, "get_or_fail_fail");
+  b.add_u64_counter(l_throttle_get_or_fail_success, "get_or_fail_success");
+  b.add_u64_counter(l_throttle_take, "take");
+  b.add_u64_counter(l_throttle_take_sum, "take_sum");
+  b.add_u64_counter(l_throttle_put, "put");
+  b.add_u64_counter(l_throttle_put_sum, "put_sum");
+  b.add_fl_avg(l_throttle_wait, "wait");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  logger->set(l_throttle_max, max);
+}
+
+void Throttle::_reset_max(int64_t m)
+{
+  if (m > max && !cond.empty())
+    cond.front()->SignalOne();
+  if (logger)
+    logger->set(l_throttle_max, m);
+  max = m;
+}
+
+double Throttle::_rate_delay(int64_t c)
+{
+  if (!c || (!unit_bucket.rate && !op_bucket.rate))
+    return 0;
+  utime_t now = ceph_clock_now(cct);
+  unit_bucket.refill(now);
+  op_bucket.refill(now);
+  double d = unit_bucket.delay(c);
+  double od = op_bucket.delay(1);
+  return d > od ? d : od;
+}
+
+void Throttle::_consume(int64_t c)
+{
+  if (!c)
+    return;
+  unit_bucket.consume(c);
+  op_bucket.consume(1);
+}
+
+bool Throttle::_wait(int64_t c)
+{
+  utime_t start;
+  bool waited = false;
+  if (_should_wait(c) || !cond.empty()) { // always wait behind other waiters.
+    Cond *cv = new Cond;
+    cond.push_back(cv);
+    if (logger)
+      start = ceph_clock_now(cct);
+    do {
+      waited = true;
+      ldout(cct, 2) << "_wait waiting for " << c << " (" << count << "/" << max
+		    << ", " << cond.size() << " waiters)" << dendl;
+      double delay;
+      if (cv == cond.front() && !_count_should_wait(c) &&
+	  (delay = _rate_delay(c)) > 0) {
+	// only the rate limit is in the way; nobody will signal us
+	utime_t interval;
+	interval.set_from_double(delay);
+	cv->WaitInterval(cct, lock, interval);
+      } else {
+	cv->Wait(lock);
+      }
+    } while (_should_wait(c) || cv != cond.front());
+    delete cv;
+    cond.pop_front();
+
+    // wake up the next guy
+    if (!cond.empty())
+      cond.front()->SignalOne();
+
+    if (logger) {
+      utime_t dur = ceph_clock_now(cct);
+      dur -= start;
+      logger->finc(l_throttle_wait, dur);
+    }
+  }
+  return waited;
+}
+
+void Throttle::reset_max(int64_t m)
+{
+  assert(m >= 0);
+  Mutex::Locker l(lock);
+  _reset_max(m);
+}
+
+void Throttle::set_rate(double per_sec, double ops_per_sec)
+{
+  assert(per_sec >= 0 && ops_per_sec >= 0);
+  Mutex::Locker l(lock);
+  utime_t now = ceph_clock_now(cct);
+  ldout(cct, 10) << "set_rate " << per_sec << "/s " << ops_per_sec << " ops/s" << dendl;
+  unit_bucket.set_rate(per_sec, now);
+  op_bucket.set_rate(ops_per_sec, now);
+  if (!cond.empty())
+    cond.front()->SignalOne();
+}
+
+bool Throttle::should_wait(int64_t c)
+{
+  Mutex::Locker l(lock);
+  return !cond.empty() || _should_wait(c);
+}
+
+bool Throttle::wait(int64_t m)
+{
+  Mutex::Locker l(lock);
+  if (m) {
+    assert(m > 0);
+    _reset_max(m);
+  }
+  return _wait(0);
+}
+
+int64_t Throttle::take(int64_t c)
+{
+  assert(c >= 0);
+  Mutex::Locker l(lock);
+  _consume(c);
+  count += c;
+  if (logger) {
+    logger->inc(l_throttle_take);
+    logger->inc(l_throttle_take_sum, c);
+    logger->set(l_throttle_val, count);
+  }
+  return count;
+}
+
+void Throttle::get(int64_t c, int64_t m)
+{
+  assert(c >= 0);
+  Mutex::Locker l(lock);
+  if (m) {
+    assert(m > 0);
+    _reset_max(m);
+  }
+  _wait(c);
+  _consume(c);
+  count += c;
+  if (logger) {
+    logger->inc(l_throttle_get);
+    logger->inc(l_throttle_get_sum, c);
+    logger->set(l_throttle_val, count);
+  }
+}
+
+bool Throttle::get_or_fail(int64_t c)
+{
+  assert (c >= 0);
+  Mutex::Locker l(lock);
+  if (!cond.empty() || _should_wait(c)) {
+    if (logger)
+      logger->inc(l_throttle_get_or_fail_fail);
+    return false;
+  }
+  _consume(c);
+  count += c;
+  if (logger) {
+    logger->inc(l_throttle_get_or_fail_success);
+    logger->set(l_throttle_val, count);
+  }
+  return true;
+}
+
+int64_t Throttle::put(int64_t c)
+{
+  assert(c >= 0);
+  Mutex::Locker l(lock);
+  if (c) {
+    if (!cond.empty())
+      cond.front()->SignalOne();
+    count -= c;
+    assert(count >= 0); //if count goes negative, we failed somewhere!
+    if (logger) {
+      logger->inc(l_throttle_put);
+      logger->inc(l_throttle_put_sum, c);
+      logger->set(l_throttle_val, count);
+    }
+  }
+  return count;
+}
@@ -3,48 +3,104 @@
 
 #include "Mutex.h"
 #include "Cond.h"
+#include "include/utime.h"
 
+#include <list>
+#include <string>
+
+class CephContext;
+class PerfCounters;
+
+enum {
+  l_throttle_first = 532430,
+  l_throttle_val,
+  l_throttle_max,
+  l_throttle_get,
+  l_throttle_get_sum,
+  l_throttle_get_or_fail_fail,
+  l_throttle_get_or_fail_success,
+  l_throttle_take,
+  l_throttle_take_sum,
+  l_throttle_put,
+  l_throttle_put_sum,
+  l_throttle_wait,
+  l_throttle_last,
+};
+
+/*
+ * Throttle - bound the amount of some resource in flight
+ *
+ * Blocked callers are served strictly in arrival order, so a large
+ * request can't be starved by a stream of small ones.  Optionally the
+ * rate at which the resource passes through get()/take() can also be
+ * capped, both in units (e.g. bytes) and in calls (ops) per second.
+ *
+ * A Throttle with a non-empty name registers a "throttle-<name>" perf counter set, including the time
+ * spent waiting; the name must be unique within the process.
+ */
 class Throttle {
-  int64_t count, max, waiting;
+  CephContext *cct;
+  std::string name;
+  PerfCounters *logger;
+  int64_t count, max;
   Mutex lock;
-  Cond cond;
-  
-public:
-  Throttle(int64_t m = 0) : count(0), max(m), waiting(0),
-			  lock("Throttle::lock") {
-    assert(m >= 0);
-  }
+  std::list<Cond*> cond;   // waiters, in FIFO order
 
-private:
-  void _reset_max(int64_t m) {
-    if (m < max)
-      cond.SignalOne();
-    max = m;
-  }
-  bool _should_wait(int64_t c) {
+  struct TokenBucket {
+    double rate;     // tokens/sec; 0 means unlimited
+    double tokens;   // may go negative: large requests borrow
+    utime_t last;
+    TokenBucket() : rate(0), tokens(0) {}
+    void set_rate(double r, utime_t now) {
+      rate = r;
+      tokens = r;
+      last = now;
+    }
+    void refill(utime_t now) {
+      if (!rate)
+	return;
+      utime_t elapsed = now;
+      elapsed -= last;
+      last = now;
+      tokens += rate * (double)elapsed;
+      if (tokens > rate)
+	tokens = rate;    // burst of at most one second's worth
+    }
+    /// seconds until c tokens can be taken; 0 if they can be now
+    double delay(double c) const {
+      if (!rate)
+	return 0;
+      if (c > rate)
+	c = rate;
+      if (tokens >= c)
+	return 0;
+      return (c - tokens) / rate;
+    }
+    void consume(double c) {
+      if (rate)
+	tokens -= c;
+    }
+  } unit_bucket, op_bucket;
+
+  void _init_logger();
+  void _reset_max(int64_t m);
+  bool _count_should_wait(int64_t c) {
     return
       max &&
       ((c < max && count + c > max) ||   // normally stay under max
        (c >= max && count > max));       // except for large c
   }
-  bool _wait(int64_t c) {
-    bool waited = false;
-    if (_should_wait(c)) {
-      waiting += c;
-      do {
-	waited = true;
-	cond.Wait(lock);
-      } while (_should_wait(c));
-      waiting -= c;
-
-      // wake up the next guy
-      if (waiting)
-	cond.SignalOne();
-    }
-    return waited;
+  double _rate_delay(int64_t c);
+  bool _should_wait(int64_t c) {
+    return _count_should_wait(c) || _rate_delay(c) > 0;
   }
+  bool _wait(int64_t c);
+  void _consume(int64_t c);
 
 public:
+  Throttle(CephContext *cct_, const std::string& n, int64_t m = 0);
+  ~Throttle();
+
   int64_t get_current() {
     Mutex::Locker l(lock);
     return count;
@@ -52,54 +108,30 @@ public:
 
   int64_t get_max() { return max; }
 
-  bool wait(int64_t m = 0) {
-    Mutex::Locker l(lock);
-    if (m) {
-      assert(m > 0);
-      _reset_max(m);
-    }
-    return _wait(0);
-  }
+  /// set max; 0 means no limit on the amount in flight
+  void reset_max(int64_t m);
 
-  int64_t take(int64_t c = 1) {
-    assert(c >= 0);
-    Mutex::Locker l(lock);
-    count += c;
-    return count;
-  }
+  /**
+   * limit the rate at which units and calls pass through get()/take()
+   *
+   * @param per_sec units per second, or 0 for no limit
+   * @param ops_per_sec get()/take() calls per second, or 0 for no limit
+   */
+  void set_rate(double per_sec, double ops_per_sec = 0);
 
-  void get(int64_t c = 1, int64_t m = 0) {
-    assert(c >= 0);
-    Mutex::Locker l(lock);
-    if (m) {
-      assert(m > 0);
-      _reset_max(m);
-    }
-    _wait(c);
-    count += c;
-  }
+  /// true if get(c) would block right now
+  bool should_wait(int64_t c = 1);
+
+  bool wait(int64_t m = 0);
+  int64_t take(int64_t c = 1);
+  void get(int64_t c = 1, int64_t m = 0);
 
   /* Returns true if it successfully got the requested amount,
    * or false if it would block.
    */
-  bool get_or_fail(int64_t c = 1) {
-    assert (c >= 0);
-    Mutex::Locker l(lock);
-    if (_should_wait(c)) return false;
-    count += c;
-    return true;
-  }
+  bool get_or_fail(int64_t c = 1);
 
-  int64_t put(int64_t c = 1) {
-    assert(c >= 0);
-    Mutex::Locker l(lock);
-    if (c) {
-      cond.SignalOne();
-      count -= c;
-      assert(count >= 0); //if count goes negative, we failed somewhere!
-    }
-    return count;
-  }
+  int64_t put(int64_t c = 1);
 };
 
 
@@ -28,6 +28,7 @@
 #include <signal.h>
 #include <sys/time.h>
 #include <math.h>
+#include <algorithm>
 
 
 class SafeTimerThread : public Thread {
@@ -42,19 +43,34 @@ public:
 
 
 
-typedef std::multimap < utime_t, Context *> scheduled_map_t;
-typedef std::map < Context*, scheduled_map_t::iterator > event_lookup_map_t;
-
 SafeTimer::SafeTimer(CephContext *cct_, Mutex &l)
   : cct(cct_), lock(l),
     thread(NULL),
+    wake_tick(0),
     stopping(false) 
 {
+  double tick = cct->_conf->timer_tick;
+  if (tick < .000001)
+    tick = .000001;
+  tick_us = (uint64_t)(tick * 1000000.0);
+  cur_tick = to_tick(ceph_clock_now(cct), false);
+  memset(wheel_map, 0, sizeof(wheel_map));
+  memset(level_count, 0, sizeof(level_count));
 }
 
 SafeTimer::~SafeTimer()
 {
   assert(thread == NULL);
+
+  // never started (or never shut down); drop what is left, but leave the
+  // callbacks alone as we always have.
+  for (__gnu_cxx::hash_map<Context*, TimerEvent*, hash_context>::iterator p = events.begin();
+       p != events.end();
+       ++p) {
+    wheel_remove(p->second);
+    delete p->second;
+  }
+  events.clear();
 }
 
 void SafeTimer::init()
@@ -80,34 +96,180 @@ void SafeTimer::shutdown()
   }
 }
 
+uint64_t SafeTimer::to_tick(utime_t t, bool round_up) const
+{
+  uint64_t us = (uint64_t)t.sec() * 1000000ull + t.usec();
+  if (round_up)
+    us += tick_us - 1;
+  return us / tick_us;
+}
+
+utime_t SafeTimer::from_tick(uint64_t tick) const
+{
+  uint64_t us = tick * tick_us;
+  return utime_t(us / 1000000ull, us % 1000000ull);
+}
+
+void SafeTimer::wheel_insert(TimerEvent *ev)
+{
+  uint64_t due = MAX(ev->tick, cur_tick);
+  uint64_t delta = due - cur_tick;
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 &&
+	 delta >= (1ull << (WHEEL_BITS * (level + 1))))
+    level++;
+  if (delta >= (1ull << (WHEEL_BITS * WHEEL_LEVELS))) {
+    // beyond the outermost wheel; park it in the last slot and let it be
+    // re-placed when that slot cascades.
+    due = cur_tick + (1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+  }
+  int slot = (due >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  ev->level = level;
+  ev->slot = slot;
+  wheel[level][slot].push_back(&ev->item);
+  wheel_map[level][slot / 64] |= 1ull << (slot % 64);
+  level_count[level]++;
+}
+
+void SafeTimer::wheel_remove(TimerEvent *ev)
+{
+  if (ev->level < 0) {
+    ev->item.remove_myself();  // expired
+    return;
+  }
+  xlist<TimerEvent*>& l = wheel[ev->level][ev->slot];
+  l.remove(&ev->item);
+  if (l.empty())
+    wheel_map[ev->level][ev->slot / 64] &= ~(1ull << (ev->slot % 64));
+  level_count[ev->level]--;
+  ev->level = ev->slot = -1;
+}
+
+void SafeTimer::cascade(int level, int slot)
+{
+  std::vector<TimerEvent*> ls;
+  xlist<TimerEvent*>& l = wheel[level][slot];
+  while (!l.empty()) {
+    TimerEvent *ev = l.front();
+    wheel_remove(ev);
+    ls.push_back(ev);
+  }
+  for (std::vector<TimerEvent*>::iterator p = ls.begin(); p != ls.end(); ++p)
+    wheel_insert(*p);
+}
+
+/*
+ * Process every tick up to and including @to, moving due events to the
+ * expired list.  Ticks with nothing to do (no due slot, no rotation
+ * boundary with something to cascade) are skipped.
+ */
+void SafeTimer::advance(uint64_t to)
+{
+  while (cur_tick <= to) {
+    uint64_t next = next_tick();
+    if (next > to) {
+      cur_tick = to + 1;  // nothing due, nothing to cascade
+      break;
+    }
+    cur_tick = next;
+
+    // cascade outer levels down first when the lower level wraps
+    for (int level = WHEEL_LEVELS - 1; level > 0; level--) {
+      int shift = WHEEL_BITS * level;
+      if ((cur_tick & ((1ull << shift) - 1)) == 0)
+	cascade(level, (cur_tick >> shift) & WHEEL_MASK);
+    }
+
+    int slot = cur_tick & WHEEL_MASK;
+    xlist<TimerEvent*>& l = wheel[0][slot];
+    while (!l.empty()) {
+      TimerEvent *ev = l.front();
+      wheel_remove(ev);
+      expired.push_back(&ev->item);
+    }
+    cur_tick++;
+  }
+}
+
+/*
+ * The first tick at or after cur_tick that has something to do: a due
+ * level 0 slot, or a rotation boundary of an outer level whose slot is
+ * non-empty.  (uint64_t)-1 if the wheel is empty.
+ */
+uint64_t SafeTimer::next_tick() const
+{
+  uint64_t best = (uint64_t)-1;
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    if (!level_count[level])
+      continue;
+    int shift = WHEEL_BITS * level;
+    uint64_t base = ((cur_tick + (1ull << shift) - 1) >> shift) << shift;
+    unsigned idx = (base >> shift) & WHEEL_MASK;
+    for (unsigned i = 0; i < WHEEL_SIZE; ) {
+      unsigned s = (idx + i) & WHEEL_MASK;
+      uint64_t w = wheel_map[level][s / 64] >> (s % 64);
+      if (w) {
+	uint64_t t = base + ((uint64_t)(i + __builtin_ctzll(w)) << shift);
+	if (t < best)
+	  best = t;
+	break;
+      }
+      i += 64 - (s % 64);
+    }
+  }
+  return best;
+}
+
+struct TimerEventWhenLess {
+  template<class T>
+  bool operator()(const T *a, const T *b) const {
+    return a->when < b->when;
+  }
+};
+
 void SafeTimer::timer_thread()
 {
   lock.Lock();
   ldout(cct,10) << "timer_thread starting" << dendl;
   while (!stopping) {
-    utime_t now = ceph_clock_now(cct);
-    
-    while (!schedule.empty()) {
-      scheduled_map_t::iterator p = schedule.begin();
+    advance(to_tick(ceph_clock_now(cct), false));
 
-      // is the future now?
-      if (p->first > now)
-	break;
+    if (!expired.empty()) {
+      // run the batch in time order; ties in insertion order
+      std::vector<TimerEvent*> ls;
+      ls.reserve(expired.size());
+      while (!expired.empty()) {
+	ls.push_back(expired.front());
+	expired.pop_front();
+      }
+      std::stable_sort(ls.begin(), ls.end(), TimerEventWhenLess());
+      for (std::vector<TimerEvent*>::iterator p = ls.begin(); p != ls.end(); ++p)
+	expired.push_back(&(*p)->item);
 
-      Context *callback = p->second;
-      events.erase(callback);
-      schedule.erase(p);
-      ldout(cct,10) << "timer_thread executing " << callback << dendl;
+      // a callback may cancel or add other events as we go
+      while (!expired.empty()) {
+	TimerEvent *ev = expired.front();
+	expired.pop_front();
+	Context *callback = ev->callback;
+	events.erase(callback);
+	delete ev;
+	ldout(cct,10) << "timer_thread executing " << callback << dendl;
       
-      callback->finish(0);
-      delete callback;
+	callback->finish(0);
+	delete callback;
+      }
     }
 
     ldout(cct,20) << "timer_thread going to sleep" << dendl;
-    if (schedule.empty())
+    uint64_t next = next_tick();
+    if (next == (uint64_t)-1) {
+      wake_tick = next;
       cond.Wait(lock);
-    else
-      cond.WaitUntil(lock, schedule.begin()->first);
+    } else {
+      wake_tick = next;
+      cond.WaitUntil(lock, from_tick(next));
+    }
+    wake_tick = 0;
     ldout(cct,20) << "timer_thread awake" << dendl;
   }
   ldout(cct,10) << "timer_thread exiting" << dendl;
@@ -128,36 +290,37 @@ void SafeTimer::add_event_at(utime_t when, Context *callback)
   assert(lock.is_locked());
   ldout(cct,10) << "add_event_at " << when << " -> " << callback << dendl;
 
-  scheduled_map_t::value_type s_val(when, callback);
-  scheduled_map_t::iterator i = schedule.insert(s_val);
-
-  event_lookup_map_t::value_type e_val(callback, i);
-  pair < event_lookup_map_t::iterator, bool > rval(events.insert(e_val));
+  TimerEvent *ev = new TimerEvent(callback, when, to_tick(when, true));
+  pair<__gnu_cxx::hash_map<Context*, TimerEvent*, hash_context>::iterator, bool> rval =
+    events.insert(make_pair(callback, ev));
 
   /* If you hit this, you tried to insert the same Context* twice. */
   assert(rval.second);
 
-  /* If the event we have just inserted comes before everything else, we need to
-   * adjust our timeout. */
-  if (i == schedule.begin())
-    cond.Signal();
+  wheel_insert(ev);
 
+  /* If the event we have just inserted comes before the timer thread's
+   * next wakeup, we need to adjust its timeout. */
+  if (ev->tick < wake_tick)
+    cond.Signal();
 }
 
 bool SafeTimer::cancel_event(Context *callback)
 {
   assert(lock.is_locked());
   
-  std::map<Context*, std::multimap<utime_t, Context*>::iterator>::iterator p = events.find(callback);
+  __gnu_cxx::hash_map<Context*, TimerEvent*, hash_context>::iterator p = events.find(callback);
   if (p == events.end()) {
     ldout(cct,10) << "cancel_event " << callback << " not found" << dendl;
     return false;
   }
 
-  ldout(cct,10) << "cancel_event " << p->second->first << " -> " << callback << dendl;
-  delete p->first;
+  TimerEvent *ev = p->second;
+  ldout(cct,10) << "cancel_event " << ev->when << " -> " << callback << dendl;
+  delete callback;
 
-  schedule.erase(p->second);
+  wheel_remove(ev);
+  delete ev;
   events.erase(p);
   return true;
 }
@@ -167,23 +330,27 @@ void SafeTimer::cancel_all_events()
   ldout(cct,10) << "cancel_all_events" << dendl;
   assert(lock.is_locked());
   
-  while (!events.empty()) {
-    std::map<Context*, std::multimap<utime_t, Context*>::iterator>::iterator p = events.begin();
-    ldout(cct,10) << " cancelled " << p->second->first << " -> " << p->first << dendl;
+  for (__gnu_cxx::hash_map<Context*, TimerEvent*, hash_context>::iterator p = events.begin();
+       p != events.end();
+       ++p) {
+    TimerEvent *ev = p->second;
+    ldout(cct,10) << " cancelled " << ev->when << " -> " << p->first << dendl;
     delete p->first;
-    schedule.erase(p->second);
-    events.erase(p);
+    wheel_remove(ev);
+    delete ev;
   }
+  events.clear();
 }
 
 void SafeTimer::dump(const char *caller) const
 {
   if (!caller)
     caller = "";
-  ldout(cct,10) << "dump " << caller << dendl;
+  ldout(cct,10) << "dump " << caller << " cur_tick " << cur_tick << dendl;
 
-  for (scheduled_map_t::const_iterator s = schedule.begin();
-       s != schedule.end();
-       ++s)
-    ldout(cct,10) << " " << s->first << "->" << s->second << dendl;
+  for (__gnu_cxx::hash_map<Context*, TimerEvent*, hash_context>::const_iterator p = events.begin();
+       p != events.end();
+       ++p)
+    ldout(cct,10) << " " << p->second->when << "->" << p->first
+		  << " level " << p->second->level << " slot " << p->second->slot << dendl;
 }
@@ -17,8 +17,10 @@
 
 #include "Cond.h"
 #include "Mutex.h"
+#include "include/xlist.h"
 
-#include <map>
+#include <ext/hash_map>
+#include <vector>
 
 class CephContext;
 class Context;
@@ -40,10 +42,54 @@ class SafeTimer
   void timer_thread();
   void _shutdown();
 
-  std::multimap<utime_t, Context*> schedule;
-  std::map<Context*, std::multimap<utime_t, Context*>::iterator> events;
+  /*
+   * Events live in a hierarchical timing wheel: WHEEL_LEVELS levels of
+   * WHEEL_SIZE slots, each slot an intrusive list.  Level 0 slots are one
+   * tick wide; each higher level slot covers a whole rotation of the
+   * level below and is cascaded down when the lower level wraps.  Add
+   * and cancel are O(1); the timer thread only wakes for ticks that have
+   * something to do.
+   */
+  struct TimerEvent {
+    Context *callback;
+    utime_t when;
+    uint64_t tick;      // first tick at or after when
+    int level, slot;    // -1 when on the expired list
+    xlist<TimerEvent*>::item item;
+    TimerEvent(Context *c, utime_t w, uint64_t t)
+      : callback(c), when(w), tick(t), level(-1), slot(-1), item(this) {}
+  };
+  struct hash_context {
+    size_t operator()(const Context *c) const {
+      return (size_t)c >> 3;
+    }
+  };
+
+  enum {
+    WHEEL_BITS = 8,
+    WHEEL_SIZE = 1 << WHEEL_BITS,
+    WHEEL_MASK = WHEEL_SIZE - 1,
+    WHEEL_LEVELS = 4,
+  };
+
+  uint64_t tick_us;
+  uint64_t cur_tick;    // next tick to be processed
+  uint64_t wake_tick;   // tick the timer thread is sleeping until, or 0
+  xlist<TimerEvent*> wheel[WHEEL_LEVELS][WHEEL_SIZE];
+  uint64_t wheel_map[WHEEL_LEVELS][WHEEL_SIZE / 64];  // non-empty slots
+  unsigned level_count[WHEEL_LEVELS];
+  xlist<TimerEvent*> expired;
+  __gnu_cxx::hash_map<Context*, TimerEvent*, hash_context> events;
   bool stopping;
 
+  uint64_t to_tick(utime_t t, bool round_up) const;
+  utime_t from_tick(uint64_t tick) const;
+  void wheel_insert(TimerEvent *ev);
+  void wheel_remove(TimerEvent *ev);
+  void cascade(int level, int slot);
+  void advance(uint64_t to);
+  uint64_t next_tick() const;
+
   void dump(const char *caller = 0) const;
 
 public:
@@ -80,5 +126,9 @@ public:
    */
   void cancel_all_events();
 
+  /// number of pending events
+  unsigned get_num_events() const {
+    return events.size();
+  }
 };
 #endif
@@ -26,7 +26,7 @@
 #define dout_prefix *_dout << name << " "
 
 
-void ThreadPool::worker()
+void ThreadPool::worker(WorkThread *wt)
 {
   _lock.Lock();
   ldout(cct,10) << "worker start" << dendl;
@@ -36,10 +36,21 @@ void ThreadPool::worker()
   heartbeat_handle_d *hb = cct->get_heartbeat_map()->add_worker(ss.str());
 
   while (!_stop) {
+    // one sharded item, then one classic item, so that neither kind of
+    // queue can starve the other
+    bool did = false;
+    if (sharded_queues.size()) {
+      _lock.Unlock();
+      if (_process_sharded(wt->shard, hb)) {
+	did = true;
+	cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+      }
+      _lock.Lock();
+    }
+
     if (!_pause && work_queues.size()) {
       WorkQueue_* wq;
       int tries = work_queues.size();
-      bool did = false;
       while (tries--) {
 	last_work_queue++;
 	last_work_queue %= work_queues.size();
@@ -62,13 +73,20 @@ void ThreadPool::worker()
 	  break;
 	}
       }
-      if (did)
-	continue;
     }
+    if (did)
+      continue;
 
     ldout(cct,15) << "worker waiting" << dendl;
     cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
-    _cond.WaitInterval(cct, _lock, utime_t(2, 0));
+    if (sharded_queues.size()) {
+      // sleep on our shard; classic queue() wakes us via _wake_shards()
+      _lock.Unlock();
+      _wait_sharded(wt->shard);
+      _lock.Lock();
+    } else {
+      _cond.WaitInterval(cct, _lock, utime_t(2, 0));
+    }
   }
   ldout(cct,1) << "worker finish" << dendl;
 
@@ -77,6 +95,200 @@ void ThreadPool::worker()
   _lock.Unlock();
 }
 
+void ThreadPool::_add_shard()
+{
+  std::stringstream ss;
+  ss << name << "::shard" << shards.size();
+  shards.push_back(new WorkShard(ss.str()));
+}
+
+/*
+ * Take one ready key from our home shard (oldest first), or steal one
+ * from another shard (newest first) if our own deque is empty, and
+ * process its next item.  Return false if there was nothing to do.
+ */
+bool ThreadPool::_process_sharded(unsigned me, heartbeat_handle_d *hb)
+{
+  unsigned n = shards.size();
+  unsigned home = me % n;
+  for (unsigned i = 0; i < n; i++) {
+    unsigned s = (home + i) % n;
+    WorkShard *sh = shards[s];
+    if (i == 0)
+      sh->lock.Lock();
+    else if (!sh->lock.TryLock())
+      continue;
+    if (sh->paused || sh->stopping || sh->ready.empty()) {
+      sh->lock.Unlock();
+      continue;
+    }
+
+    ShardKey *k;
+    if (i == 0) {
+      k = sh->ready.front();
+      sh->ready.pop_front();
+    } else {
+      k = sh->ready.back();
+      sh->ready.pop_back();
+    }
+    void *item = k->items.front();
+    k->items.pop_front();
+    k->running = true;
+    ShardedWorkQueue_ *wq = k->wq;
+    wq->queued[s]--;
+    sh->processing++;
+    sh->lock.Unlock();
+
+    ldout(cct,12) << "worker wq " << wq->name << " start processing " << item
+		  << " key " << k->key << " shard " << s
+		  << (i ? " (stolen)" : "") << dendl;
+    cct->get_heartbeat_map()->reset_timeout(hb, wq->timeout_interval, wq->suicide_interval);
+    wq->_void_process(item);
+    wq->_void_process_finish(item);
+    ldout(cct,15) << "worker wq " << wq->name << " done processing " << item << dendl;
+
+    sh->lock.Lock();
+    k->running = false;
+    if (k->items.empty()) {
+      sh->keys.erase(make_pair(wq, k->key));
+      delete k;
+    } else {
+      sh->ready.push_back(k);
+      sh->cond.SignalOne();
+    }
+    sh->processing--;
+    if (sh->waiters)
+      sh->wait_cond.Signal();
+    sh->lock.Unlock();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::_wait_sharded(unsigned me)
+{
+  WorkShard *sh = shards[me % shards.size()];
+  sh->lock.Lock();
+  if (!sh->wakeup && !sh->stopping && (sh->paused || sh->ready.empty())) {
+    sh->idle++;
+    num_idle.inc();
+    sh->cond.WaitInterval(cct, sh->lock, utime_t(2, 0));
+    num_idle.dec();
+    sh->idle--;
+  }
+  sh->wakeup = false;
+  sh->lock.Unlock();
+}
+
+/*
+ * Wake the workers sleeping on shards other than @skip.  With @one, only
+ * wake a single idle worker (so that it can steal); otherwise wake them
+ * all (new classic work, pause state changes).
+ */
+void ThreadPool::_wake_shards(int skip, bool one)
+{
+  for (unsigned i = 0; i < shards.size(); i++) {
+    if ((int)i == skip)
+      continue;
+    WorkShard *sh = shards[i];
+    sh->lock.Lock();
+    if (one && !sh->idle) {
+      sh->lock.Unlock();
+      continue;
+    }
+    sh->wakeup = true;
+    if (one)
+      sh->cond.SignalOne();
+    else
+      sh->cond.Signal();
+    sh->lock.Unlock();
+    if (one)
+      break;
+  }
+}
+
+void ThreadPool::sharded_queue(ShardedWorkQueue_ *wq, uint64_t key, void *item)
+{
+  unsigned s = _shard_of(key);
+  WorkShard *sh = shards[s];
+  sh->lock.Lock();
+  ShardKey *k;
+  map<pair<ShardedWorkQueue_*,uint64_t>, ShardKey*>::iterator p =
+    sh->keys.find(make_pair(wq, key));
+  if (p == sh->keys.end()) {
+    k = new ShardKey(wq, key);
+    sh->keys[make_pair(wq, key)] = k;
+  } else {
+    k = p->second;
+  }
+  k->items.push_back(item);
+  wq->queued[s]++;
+  if (!k->running && k->items.size() == 1)
+    sh->ready.push_back(k);
+  bool home_idle = sh->idle > 0;
+  sh->cond.SignalOne();
+  sh->lock.Unlock();
+
+  // the home worker is busy; let someone else steal it.
+  if (work_stealing && !home_idle && num_idle.read())
+    _wake_shards(s, true);
+}
+
+void ThreadPool::sharded_dequeue_all(ShardedWorkQueue_ *wq, list<void*>& ls)
+{
+  for (unsigned s = 0; s < shards.size(); s++) {
+    WorkShard *sh = shards[s];
+    sh->lock.Lock();
+    map<pair<ShardedWorkQueue_*,uint64_t>, ShardKey*>::iterator p = sh->keys.begin();
+    while (p != sh->keys.end()) {
+      ShardKey *k = p->second;
+      if (k->wq != wq) {
+	p++;
+	continue;
+      }
+      wq->queued[s] -= k->items.size();
+      ls.splice(ls.end(), k->items);
+      if (k->running) {
+	p++;  // the worker will clean it up
+	continue;
+      }
+      for (deque<ShardKey*>::iterator q = sh->ready.begin(); q != sh->ready.end(); q++)
+	if (*q == k) {
+	  sh->ready.erase(q);
+	  break;
+	}
+      sh->keys.erase(p++);
+      delete k;
+    }
+    assert(wq->queued[s] == 0);
+    sh->lock.Unlock();
+  }
+}
+
+bool ThreadPool::sharded_empty(ShardedWorkQueue_ *wq)
+{
+  for (unsigned s = 0; s < shards.size(); s++) {
+    Mutex::Locker l(shards[s]->lock);
+    if (wq->queued[s])
+      return false;
+  }
+  return true;
+}
+
+void ThreadPool::sharded_drain(ShardedWorkQueue_ *wq)
+{
+  ldout(cct,10) << "sharded_drain " << (wq ? wq->name : "") << dendl;
+  for (unsigned s = 0; s < shards.size(); s++) {
+    WorkShard *sh = shards[s];
+    sh->lock.Lock();
+    sh->waiters++;
+    while (sh->processing || (wq && wq->queued[s]))
+      sh->wait_cond.Wait(sh->lock);
+    sh->waiters--;
+    sh->lock.Unlock();
+  }
+}
+
 void ThreadPool::start()
 {
   ldout(cct,10) << "start" << dendl;
@@ -93,6 +305,11 @@ void ThreadPool::stop(bool clear_after)
   _stop = true;
   _cond.Signal();
   _lock.Unlock();
+  for (unsigned s = 0; s < shards.size(); s++) {
+    Mutex::Locker l(shards[s]->lock);
+    shards[s]->stopping = true;
+    shards[s]->cond.Signal();
+  }
   for (set<WorkThread*>::iterator p = _threads.begin();
        p != _threads.end();
        p++)
@@ -101,6 +318,22 @@ void ThreadPool::stop(bool clear_after)
   for (unsigned i=0; i<work_queues.size(); i++)
     work_queues[i]->_clear();
   _lock.Unlock();    
+  for (unsigned s = 0; s < shards.size(); s++) {
+    WorkShard *sh = shards[s];
+    sh->lock.Lock();
+    for (map<pair<ShardedWorkQueue_*,uint64_t>, ShardKey*>::iterator p = sh->keys.begin();
+	 p != sh->keys.end();
+	 p++) {
+      ShardKey *k = p->second;
+      k->wq->queued[s] -= k->items.size();
+      for (list<void*>::iterator q = k->items.begin(); q != k->items.end(); q++)
+	k->wq->_void_discard(*q);
+      delete k;
+    }
+    sh->keys.clear();
+    sh->ready.clear();
+    sh->lock.Unlock();
+  }
   ldout(cct,15) << "stopped" << dendl;
 }
 
@@ -114,6 +347,16 @@ void ThreadPool::pause()
   while (processing)
     _wait_cond.Wait(_lock);
   _lock.Unlock();
+  for (unsigned s = 0; s < shards.size(); s++) {
+    WorkShard *sh = shards[s];
+    sh->lock.Lock();
+    sh->paused = true;
+    sh->waiters++;
+    while (sh->processing)
+      sh->wait_cond.Wait(sh->lock);
+    sh->waiters--;
+    sh->lock.Unlock();
+  }
   ldout(cct,15) << "paused" << dendl;
 }
 
@@ -124,6 +367,10 @@ void ThreadPool::pause_new()
   assert(!_pause);
   _pause = true;
   _lock.Unlock();
+  for (unsigned s = 0; s < shards.size(); s++) {
+    Mutex::Locker l(shards[s]->lock);
+    shards[s]->paused = true;
+  }
 }
 
 void ThreadPool::unpause()
@@ -134,6 +381,12 @@ void ThreadPool::unpause()
   _pause = false;
   _cond.Signal();
   _lock.Unlock();
+  for (unsigned s = 0; s < shards.size(); s++) {
+    Mutex::Locker l(shards[s]->lock);
+    shards[s]->paused = false;
+    shards[s]->wakeup = true;
+    shards[s]->cond.Signal();
+  }
 }
 
 void ThreadPool::drain(WorkQueue_* wq)
@@ -145,5 +398,6 @@ void ThreadPool::drain(WorkQueue_* wq)
     _wait_cond.Wait(_lock);
   _draining--;
   _lock.Unlock();
+  sharded_drain();
 }
 
@@ -18,8 +18,12 @@
 #include "Mutex.h"
 #include "Cond.h"
 #include "Thread.h"
+#include "include/atomic.h"
 
 class CephContext;
+namespace ceph {
+  struct heartbeat_handle_d;
+}
 
 class ThreadPool {
   CephContext *cct;
@@ -45,6 +49,54 @@ class ThreadPool {
     virtual void _void_process_finish(void *) = 0;
   };  
 
+  /*
+   * Sharded (keyed) work queues.  Items are queued with a key; items
+   * sharing a key are processed serially and in order, while items with
+   * different keys may run concurrently.  Each key hashes to a home
+   * shard; in work stealing mode there is one shard per worker thread,
+   * and idle workers steal ready keys from the back of other shards'
+   * deques.  None of this touches the pool-wide _lock.
+   */
+  struct ShardedWorkQueue_;
+
+  struct ShardKey {
+    ShardedWorkQueue_ *wq;
+    uint64_t key;
+    list<void*> items;
+    bool running;
+    ShardKey(ShardedWorkQueue_ *w, uint64_t k) : wq(w), key(k), running(false) {}
+  };
+
+  struct WorkShard {
+    string lockname;
+    Mutex lock;
+    Cond cond;       // wakes the owning worker
+    Cond wait_cond;  // pause/drain waiters
+    deque<ShardKey*> ready;  // keys with items that are not running
+    map<pair<ShardedWorkQueue_*,uint64_t>, ShardKey*> keys;
+    int processing;
+    int waiters;     // pause/drain callers waiting on wait_cond
+    int idle;        // workers sleeping on cond
+    bool paused, stopping, wakeup;
+    WorkShard(string n)
+      : lockname(n),
+	lock(lockname.c_str()),  // safe due to declaration order
+	processing(0), waiters(0), idle(0),
+	paused(false), stopping(false), wakeup(false) {}
+  };
+
+  struct ShardedWorkQueue_ {
+    string name;
+    time_t timeout_interval, suicide_interval;
+    vector<int> queued;  // per shard, protected by that shard's lock
+    ShardedWorkQueue_(string n, time_t ti, time_t sti)
+      : name(n), timeout_interval(ti), suicide_interval(sti) {}
+    virtual ~ShardedWorkQueue_() {}
+    virtual void _void_process(void *) = 0;
+    virtual void _void_process_finish(void *) = 0;
+    virtual void _void_discard(void *) = 0;
+  };
+
 public:
   template<class T>
   class WorkQueue : public WorkQueue_ {
@@ -78,6 +130,8 @@ public:
       pool->_lock.Lock();
       bool r = _enqueue(item);
       pool->_cond.SignalOne();
+      if (pool->sharded_queues.size())
+	pool->_wake_shards(-1);
       pool->_lock.Unlock();
       return r;
     }
@@ -107,17 +161,77 @@ public:
 
   };
 
+  /*
+   * Keyed work queue.  Unlike WorkQueue, the pool owns the queued items,
+   * and _process() and _process_finish() are called without any pool
+   * lock held.  Items with the same key (by default the item pointer
+   * itself) never run concurrently.  Items still queued at stop() are
+   * passed to _discard().
+   */
+  template<class T>
+  class ShardedWorkQueue : public ShardedWorkQueue_ {
+    ThreadPool *pool;
+
+    virtual uint64_t _get_key(T *item) {
+      return (uint64_t)(uintptr_t)item;
+    }
+    virtual void _process(T *) = 0;
+    virtual void _process_finish(T *) {}
+    virtual void _discard(T *) {}
+
+    void _void_process(void *p) {
+      _process((T *)p);
+    }
+    void _void_process_finish(void *p) {
+      _process_finish((T *)p);
+    }
+    void _void_discard(void *p) {
+      _discard((T *)p);
+    }
+
+  public:
+    ShardedWorkQueue(string n, time_t ti, time_t sti, ThreadPool *p)
+      : ShardedWorkQueue_(n, ti, sti), pool(p) {
+      pool->add_sharded_queue(this);
+    }
+    ~ShardedWorkQueue() {
+      pool->remove_sharded_queue(this);
+    }
+
+    void queue(T *item) {
+      pool->sharded_queue(this, _get_key(item), (void *)item);
+    }
+    /// remove all queued (not yet running) items, in per-key order
+    void dequeue_all(list<T*>& ls) {
+      list<void*> items;
+      pool->sharded_dequeue_all(this, items);
+      for (list<void*>::iterator p = items.begin(); p != items.end(); ++p)
+	ls.push_back((T *)*p);
+    }
+    bool empty() {
+      return pool->sharded_empty(this);
+    }
+    void drain() {
+      pool->sharded_drain(this);
+    }
+  };
+
 private:
   vector<WorkQueue_*> work_queues;
   int last_work_queue;
- 
+
+  bool work_stealing;
+  vector<WorkShard*> shards;
+  vector<ShardedWorkQueue_*> sharded_queues;
+  atomic_t num_idle;
 
   // threads
   struct WorkThread : public Thread {
     ThreadPool *pool;
-    WorkThread(ThreadPool *p) : pool(p) {}
+    unsigned shard;
+    WorkThread(ThreadPool *p, unsigned s) : pool(p), shard(s) {}
     void *entry() {
-      pool->worker();
+      pool->worker(this);
       return 0;
     }
   };
@@ -125,10 +239,21 @@ private:
   set<WorkThread*> _threads;
   int processing;
 
-  void worker();
+  void worker(WorkThread *wt);
+
+  unsigned _shard_of(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key % shards.size();
+  }
+  bool _process_sharded(unsigned me, ceph::heartbeat_handle_d *hb);
+  void _wait_sharded(unsigned me);
+  void _wake_shards(int skip, bool one=false);
+  void _add_shard();
 
 public:
-  ThreadPool(CephContext *cct_, string nm, int n=1) :
+  ThreadPool(CephContext *cct_, string nm, int n=1, bool steal=false) :
     cct(cct_), name(nm),
     lockname(nm + "::lock"),
     _lock(lockname.c_str()),  // this should be safe due to declaration order
@@ -136,6 +261,7 @@ public:
     _pause(false),
     _draining(0),
     last_work_queue(0),
+    work_stealing(steal),
     processing(0) {
     set_num_threads(n);
   }
@@ -144,6 +270,10 @@ public:
 	 p != _threads.end();
 	 p++)
       delete *p;
+    for (unsigned i = 0; i < shards.size(); i++) {
+      assert(shards[i]->keys.empty());
+      delete shards[i];
+    }
   }
   
   void add_work_queue(WorkQueue_* wq) {
@@ -159,13 +289,41 @@ public:
     work_queues.resize(i-1);
   }
 
+  void add_sharded_queue(ShardedWorkQueue_ *wq) {
+    Mutex::Locker l(_lock);
+    wq->queued.resize(shards.size());
+    sharded_queues.push_back(wq);
+  }
+  void remove_sharded_queue(ShardedWorkQueue_ *wq) {
+    Mutex::Locker l(_lock);
+    vector<ShardedWorkQueue_*>::iterator p = sharded_queues.begin();
+    while (*p != wq)
+      p++;
+    sharded_queues.erase(p);
+  }
+
   void set_num_threads(unsigned n) {
+    assert(sharded_queues.empty());
     while (_threads.size() < n) {
-      WorkThread *t = new WorkThread(this);
+      unsigned s = _threads.size();
+      if (s == 0 || work_stealing)
+	_add_shard();
+      WorkThread *t = new WorkThread(this, s);
       _threads.insert(t);
     }
+    if (shards.empty())
+      _add_shard();
   }
 
+  bool is_work_stealing() const {
+    return work_stealing;
+  }
+
+  void sharded_queue(ShardedWorkQueue_ *wq, uint64_t key, void *item);
+  void sharded_dequeue_all(ShardedWorkQueue_ *wq, list<void*>& ls);
+  bool sharded_empty(ShardedWorkQueue_ *wq);
+  void sharded_drain(ShardedWorkQueue_ *wq = 0);
+
   void kick() {
     _cond.Signal();
   }
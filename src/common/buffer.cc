@@ -378,6 +378,12 @@ bool buffer_track_alloc = get_env_bool("CEPH_BUFFER_TRACK");
     return 0;
   }
 
+  bool buffer::ptr::is_zero() const
+  {
+    const char *data = c_str();
+    return !_len || (!data[0] && !memcmp(data, data + 1, _len - 1));
+  }
+
   void buffer::ptr::append(char c)
   {
     assert(_raw);
@@ -665,6 +671,16 @@ bool buffer_track_alloc = get_env_bool("CEPH_BUFFER_TRACK");
     return &(*_buffers.begin()) == &(*_buffers.rbegin());
   }
 
+  bool buffer::list::is_zero() const
+  {
+    for (std::list<ptr>::const_iterator it = _buffers.begin();
+	 it != _buffers.end();
+	 it++)
+      if (!it->is_zero())
+	return false;
+    return true;
+  }
+
   void buffer::list::rebuild()
   {
     ptr nb;
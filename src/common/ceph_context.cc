@@ -22,6 +22,8 @@
 #include "common/config.h"
 #include "common/debug.h"
 #include "common/HeartbeatMap.h"
+#include "common/Formatter.h"
+#include "common/lockprof.h"
 
 #include <iostream>
 #include <pthread.h>
@@ -109,6 +111,34 @@ public:
   }
 };
 
+// lock contention profiler hooks
+
+class LockProfHook : public AdminSocketHook {
+  CephContext *m_cct;
+
+public:
+  LockProfHook(CephContext *cct) : m_cct(cct) {}
+
+  bool call(std::string command, bufferlist& out) {
+    if (command == "lockprof_dump") {
+      JSONFormatter f(true);
+      lockprof_dump(&f, m_cct->_conf->lockprof_top);
+      ostringstream ss;
+      f.flush(ss);
+      out.append(ss.str());
+    } else if (command == "lockprof_reset") {
+      lockprof_reset();
+    } else if (command == "lockprof_on") {
+      g_lockprof = m_cct->_conf->lockprof_sample_rate;
+    } else if (command == "lockprof_off") {
+      g_lockprof = 0;
+    } else {
+      assert(0 == "registered under wrong command?");
+    }
+    return true;
+  }
+};
+
 
 CephContext::CephContext(uint32_t module_type_)
   : _conf(new md_config_t()),
@@ -132,6 +162,12 @@ CephContext::CephContext(uint32_t module_type_)
   _admin_socket->register_command("1", _perf_counters_hook, "");
   _admin_socket->register_command("perfcounters_schema", _perf_counters_hook, "dump perfcounters schema");
   _admin_socket->register_command("2", _perf_counters_hook, "");
+
+  _lockprof_hook = new LockProfHook(this);
+  _admin_socket->register_command("lockprof_dump", _lockprof_hook, "dump most contended locks");
+  _admin_socket->register_command("lockprof_reset", _lockprof_hook, "reset lock contention stats");
+  _admin_socket->register_command("lockprof_on", _lockprof_hook, "start sampling lock contention");
+  _admin_socket->register_command("lockprof_off", _lockprof_hook, "stop sampling lock contention");
 }
 
 CephContext::~CephContext()
@@ -144,6 +180,12 @@ CephContext::~CephContext()
   _admin_socket->unregister_command("2");
   delete _perf_counters_hook;
 
+  _admin_socket->unregister_command("lockprof_dump");
+  _admin_socket->unregister_command("lockprof_reset");
+  _admin_socket->unregister_command("lockprof_on");
+  _admin_socket->unregister_command("lockprof_off");
+  delete _lockprof_hook;
+
   delete _heartbeat_map;
 
   _conf->remove_observer(_admin_socket);
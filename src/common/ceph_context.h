@@ -29,6 +29,7 @@ class PerfCountersCollection;
 class md_config_obs_t;
 class md_config_t;
 class PerfCountersHook;
+class LockProfHook;
 
 namespace ceph {
   class HeartbeatMap;
@@ -98,6 +99,8 @@ private:
 
   PerfCountersHook *_perf_counters_hook;
 
+  LockProfHook *_lockprof_hook;
+
   ceph::HeartbeatMap *_heartbeat_map;
 };
 
@@ -37,6 +37,9 @@ OPTION(pid_file, OPT_STR, "")
 OPTION(chdir, OPT_STR, "/")
 OPTION(max_open_files, OPT_LONGLONG, 0)
 OPTION(debug, OPT_INT, 0)
+OPTION(lockprof, OPT_BOOL, false)            // profile lock contention from startup
+OPTION(lockprof_sample_rate, OPT_INT, 100)  // time 1 in N lock acquisitions per thread
+OPTION(lockprof_top, OPT_INT, 20)           // locks reported by lockprof_dump
 OPTION(debug_lockdep, OPT_INT, 0)
 OPTION(debug_context, OPT_INT, 0)
 OPTION(debug_crush, OPT_INT, 1)
@@ -66,6 +69,7 @@ OPTION(debug_paxos, OPT_INT, 0)
 OPTION(debug_tp, OPT_INT, 0)
 OPTION(debug_auth, OPT_INT, 1)
 OPTION(debug_finisher, OPT_INT, 1)
+OPTION(debug_throttle, OPT_INT, 1)
 OPTION(debug_heartbeatmap, OPT_INT, 1)
 OPTION(debug_perfcounter, OPT_INT, 1)
 OPTION(key, OPT_STR, "")
@@ -73,18 +77,24 @@ OPTION(keyfile, OPT_STR, "")
 OPTION(keyring, OPT_STR, "/etc/ceph/keyring,/etc/ceph/keyring.bin")
 OPTION(heartbeat_interval, OPT_INT, 5)
 OPTION(heartbeat_file, OPT_STR, "")
+OPTION(timer_tick, OPT_DOUBLE, .001)  // SafeTimer wheel granularity, in seconds
 OPTION(ms_tcp_nodelay, OPT_BOOL, true)
 OPTION(ms_initial_backoff, OPT_DOUBLE, .2)
 OPTION(ms_max_backoff, OPT_DOUBLE, 15.0)
 OPTION(ms_nocrc, OPT_BOOL, false)
 OPTION(ms_die_on_bad_msg, OPT_BOOL, false)
 OPTION(ms_dispatch_throttle_bytes, OPT_U64, 100 << 20)
+OPTION(ms_dispatch_throttle_bytes_per_sec, OPT_U64, 0)  // 0 = no rate limit
+OPTION(ms_dispatch_throttle_ops_per_sec, OPT_U64, 0)
 OPTION(ms_bind_ipv6, OPT_BOOL, false)
 OPTION(ms_rwthread_stack_bytes, OPT_U64, 1024 << 10)
 OPTION(ms_tcp_read_timeout, OPT_U64, 900)
 OPTION(ms_inject_socket_failures, OPT_U64, 0)
 OPTION(mon_data, OPT_STR, "")
 OPTION(mon_sync_fs_threshold, OPT_INT, 5)   // sync() when writing this many objects; 0 to disable.
+OPTION(mon_store_backend, OPT_STR, "file")  // new stores: file (a file per key) or log
+OPTION(mon_store_log_compact_min, OPT_U64, 64<<20)  // don't compact a smaller log
+OPTION(mon_store_log_compact_ratio, OPT_DOUBLE, 2.0) // compact when the log is this many times the live data
 OPTION(mon_tick_interval, OPT_INT, 5)
 OPTION(mon_subscribe_interval, OPT_DOUBLE, 300)
 OPTION(mon_osd_auto_mark_in, OPT_BOOL, true)    // automatically mark new osds 'in'
@@ -99,6 +109,7 @@ OPTION(mon_pg_create_interval, OPT_FLOAT, 30.0) // no more than every 30s
 OPTION(mon_osd_full_ratio, OPT_INT, 95) // what % full makes an OSD "full"
 OPTION(mon_osd_nearfull_ratio, OPT_INT, 85) // what % full makes an OSD near full
 OPTION(mon_globalid_prealloc, OPT_INT, 100)   // how many globalids to prealloc
+OPTION(mon_osd_cache_size, OPT_INT, 10)  // encoded osdmaps (full and incremental, each) kept for sending
 OPTION(mon_osd_report_timeout, OPT_INT, 900)    // grace period before declaring unresponsive OSDs dead
 OPTION(mon_force_standby_active, OPT_BOOL, true) // should mons force standby-replay mds to be active
 OPTION(mon_min_osdmap_epochs, OPT_INT, 500)
@@ -111,6 +122,8 @@ OPTION(paxos_max_join_drift, OPT_INT, 10)       // max paxos iterations before w
 OPTION(paxos_propose_interval, OPT_DOUBLE, 1.0)  // gather updates for this long before proposing a map update
 OPTION(paxos_min_wait, OPT_DOUBLE, 0.05)  // min time to gather updates for after period of inactivity
 OPTION(paxos_observer_timeout, OPT_DOUBLE, 5*60) // gather updates for this long before proposing a map update
+OPTION(paxos_max_inflight, OPT_INT, 1)  // uncommitted pgmap proposals at once; >1 needs every mon to support it
+OPTION(paxos_stale_reads, OPT_BOOL, true)  // peons answer read-only queries from their last lease while a new value is accepted
 OPTION(clock_offset, OPT_DOUBLE, 0) // how much to offset the system clock in Clock.cc
 OPTION(auth_supported, OPT_STR, "none")
 OPTION(auth_mon_ticket_ttl, OPT_DOUBLE, 60*60*12)
@@ -136,6 +149,7 @@ OPTION(client_oc, OPT_BOOL, true)
 OPTION(client_oc_size, OPT_INT, 1024*1024* 200)    // MB * n
 OPTION(client_oc_max_dirty, OPT_INT, 1024*1024* 100)    // MB * n  (dirty OR tx.. bigish)
 OPTION(client_oc_target_dirty, OPT_INT, 1024*1024* 8) // target dirty (keep this smallish)
+OPTION(client_oc_max_dirty_age, OPT_DOUBLE, 1.0)      // max age in cache before writeback
 // note: the max amount of "in flight" dirty data is roughly (max - target)
 OPTION(client_oc_max_sync_write, OPT_U64, 128*1024)   // sync writes >= this use wrlock
 OPTION(fuse_use_invalidate_cb, OPT_BOOL, false) // use fuse 2.8+ invalidate callback to keep page cache consistent
@@ -248,8 +262,12 @@ OPTION(osd_pool_default_size, OPT_INT, 2)
 OPTION(osd_pool_default_pg_num, OPT_INT, 8)
 OPTION(osd_pool_default_pgp_num, OPT_INT, 8)
 OPTION(osd_map_cache_max, OPT_INT, 250)
+OPTION(osd_map_cache_bl_size, OPT_INT, 50)  // encoded full maps kept to share with peers
+OPTION(osd_map_cache_bl_inc_size, OPT_INT, 100)  // encoded incrementals kept to share with peers
+OPTION(osd_map_mapping_threads, OPT_INT, 4)  // threads building the per-epoch pg mapping table in osd and mon (0 = no table)
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
+OPTION(osd_op_work_stealing, OPT_BOOL, false)  // per-thread op queues with work stealing
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_recovery_threads, OPT_INT, 1)
 OPTION(osd_op_thread_timeout, OPT_INT, 30)
@@ -267,6 +285,7 @@ OPTION(osd_mon_heartbeat_interval, OPT_INT, 30)  // if no peers, ping monitor
 OPTION(osd_heartbeat_grace, OPT_INT, 20)
 OPTION(osd_mon_report_interval_max, OPT_INT, 120)
 OPTION(osd_mon_report_interval_min, OPT_INT, 5)  // pg stats, failures, up_thru, boot.
+OPTION(osd_mon_report_stats_coalesce, OPT_DOUBLE, 0)  // hold pg stats that only changed counters for this long
 OPTION(osd_mon_ack_timeout, OPT_INT, 30) // time out a mon if it doesn't ack stats
 OPTION(osd_min_down_reporters, OPT_INT, 1)   // number of OSDs who need to report a down OSD for it to count
 OPTION(osd_min_down_reports, OPT_INT, 3)     // number of times a down OSD must be reported for it to count
@@ -275,6 +294,7 @@ OPTION(osd_preserve_trimmed_log, OPT_BOOL, true)
 OPTION(osd_auto_mark_unfound_lost, OPT_BOOL, false)
 OPTION(osd_recovery_delay_start, OPT_FLOAT, 15)
 OPTION(osd_recovery_max_active, OPT_INT, 5)
+OPTION(osd_recovery_max_ops_per_sec, OPT_U64, 0)  // 0 = no rate limit
 OPTION(osd_recovery_max_chunk, OPT_U64, 1<<20)  // max size of push chunk
 OPTION(osd_recovery_forget_lost_objects, OPT_BOOL, false)   // off for now
 OPTION(osd_max_scrubs, OPT_INT, 1)
@@ -310,9 +330,13 @@ OPTION(filestore_queue_max_ops, OPT_INT, 500)
 OPTION(filestore_queue_max_bytes, OPT_INT, 100 << 20)
 OPTION(filestore_queue_committing_max_ops, OPT_INT, 500)        // this is ON TOP of filestore_queue_max_*
 OPTION(filestore_queue_committing_max_bytes, OPT_INT, 100 << 20) //  "
+OPTION(filestore_queue_max_bytes_per_sec, OPT_U64, 0)  // 0 = no rate limit
+OPTION(filestore_queue_max_ops_per_sec, OPT_U64, 0)
 OPTION(filestore_op_threads, OPT_INT, 2)
 OPTION(filestore_op_thread_timeout, OPT_INT, 60)
 OPTION(filestore_op_thread_suicide_timeout, OPT_INT, 180)
+OPTION(filestore_ondisk_finisher_threads, OPT_INT, 1)
+OPTION(filestore_apply_finisher_threads, OPT_INT, 1)
 OPTION(filestore_commit_timeout, OPT_FLOAT, 600)
 OPTION(filestore_fiemap_threshold, OPT_INT, 4096)
 OPTION(filestore_merge_threshold, OPT_INT, 10)
@@ -358,6 +382,16 @@ OPTION(rgw_intent_log_object_name, OPT_STR, "%Y-%m-%d-%i-%n")  // man date to se
 OPTION(rgw_intent_log_object_name_utc, OPT_BOOL, false)
 OPTION(rgw_init_timeout, OPT_INT, 30) // time in seconds
 OPTION(rbd_writeback_window, OPT_INT, 0 /*8 << 20*/) // rbd writeback window size, bytes
+OPTION(rbd_sync_max_inflight, OPT_INT, 16) // objects a synchronous read/write keeps in flight
+OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // objects in flight during copy/import
+OPTION(rbd_object_map, OPT_BOOL, false) // track which objects exist in new images (not understood by the kernel client)
+OPTION(rbd_cache, OPT_BOOL, false) // whether to enable writeback caching
+OPTION(rbd_cache_size, OPT_LONGLONG, 32<<20)         // cache size in bytes
+OPTION(rbd_cache_max_dirty, OPT_LONGLONG, 24<<20)    // dirty limit in bytes
+OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in bytes
+OPTION(rbd_cache_max_dirty_age, OPT_DOUBLE, 1.0)     // seconds in cache before writeback starts
+OPTION(rbd_cache_readahead_min, OPT_LONGLONG, 64<<10)  // initial readahead window, bytes
+OPTION(rbd_cache_readahead_max, OPT_LONGLONG, 512<<10) // largest readahead window, bytes (0 = off)
 OPTION(rgw_mime_types_file, OPT_STR, "/etc/mime.types")
 
 // This will be set to true when it is safe to start threads.
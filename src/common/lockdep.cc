@@ -19,18 +19,7 @@
 #include "lockdep.h"
 
 #include <ext/hash_map>
-
-#if defined(__FreeBSD__) && defined(__LP64__)	// On FreeBSD pthread_t is a pointer.
-namespace __gnu_cxx {
-  template<>
-    struct hash<pthread_t>
-    {
-      size_t
-      operator()(pthread_t __x) const
-      { return (uintptr_t)__x; }
-    };
-}
-#endif
+#include <pthread.h>
 
 /******* Constants **********/
 #define DOUT_SUBSYS lockdep
@@ -38,6 +27,7 @@ namespace __gnu_cxx {
 #define DOUT_COND(cct, l) cct && l <= XDOUT_CONDVAR(cct, DOUT_SUBSYS)
 #define lockdep_dout(v) ldout(g_lockdep_ceph_ctx, v)
 #define MAX_LOCKS  100   // increase me as needed
+#define MAX_HELD   32    // per thread; deeper nesting goes unchecked
 #define BACKTRACE_SKIP 3
 
 /******* Globals **********/
@@ -48,15 +38,64 @@ struct lockdep_stopper_t {
     g_lockdep = 0;
   }
 };
+
+/*
+ * Locks held by a thread.  Only the owning thread modifies it, so the
+ * common lock/unlock paths don't touch lockdep_mutex at all; the global
+ * mutex is only taken to register a lock or to record a new dependency.
+ */
+struct lockdep_thread_t {
+  pthread_t thread;
+  int nheld;
+  int held[MAX_HELD];
+  BackTrace *bt[MAX_HELD];
+  bool overflowed;
+  lockdep_thread_t() : thread(pthread_self()), nheld(0), overflowed(false) {}
+};
+
 static pthread_mutex_t lockdep_mutex = PTHREAD_MUTEX_INITIALIZER;
 static CephContext *g_lockdep_ceph_ctx = NULL;
 static lockdep_stopper_t lockdep_stopper;
 static hash_map<const char *, int> lock_ids;
 static map<int, const char *> lock_names;
 static int last_id = 0;
-static hash_map<pthread_t, map<int,BackTrace*> > held;
+static set<lockdep_thread_t*> threads;
 static BackTrace *follows[MAX_LOCKS][MAX_LOCKS];       // follows[a][b] means b taken after a
 
+static __thread lockdep_thread_t *t_held = NULL;
+static pthread_key_t lockdep_thread_key;
+static pthread_once_t lockdep_thread_once = PTHREAD_ONCE_INIT;
+
+static void lockdep_thread_exit(void *p)
+{
+  lockdep_thread_t *t = (lockdep_thread_t *)p;
+  pthread_mutex_lock(&lockdep_mutex);
+  threads.erase(t);
+  pthread_mutex_unlock(&lockdep_mutex);
+  for (int i = 0; i < t->nheld; i++)
+    delete t->bt[i];
+  delete t;
+  t_held = NULL;
+}
+
+static void lockdep_thread_key_init()
+{
+  pthread_key_create(&lockdep_thread_key, lockdep_thread_exit);
+}
+
+static lockdep_thread_t *get_thread_held()
+{
+  if (!t_held) {
+    pthread_once(&lockdep_thread_once, lockdep_thread_key_init);
+    t_held = new lockdep_thread_t;
+    pthread_setspecific(lockdep_thread_key, t_held);
+    pthread_mutex_lock(&lockdep_mutex);
+    threads.insert(t_held);
+    pthread_mutex_unlock(&lockdep_mutex);
+  }
+  return t_held;
+}
+
 /******* Functions **********/
 void lockdep_register_ceph_context(CephContext *cct)
 {
@@ -69,16 +108,17 @@ int lockdep_dump_locks()
 {
   pthread_mutex_lock(&lockdep_mutex);
 
-  for (hash_map<pthread_t, map<int,BackTrace*> >::iterator p = held.begin();
-       p != held.end();
+  // other threads' held lists may be changing under us; this is only a
+  // debugging aid, typically called on the way to an assert.
+  for (set<lockdep_thread_t*>::iterator p = threads.begin();
+       p != threads.end();
        p++) {
-    lockdep_dout(0) << "--- thread " << p->first << " ---" << dendl;
-    for (map<int,BackTrace*>::iterator q = p->second.begin();
-	 q != p->second.end();
-	 q++) {
-      lockdep_dout(0) << "  * " << lock_names[q->first] << "\n";
-      if (q->second)
-	q->second->print(*_dout);
+    lockdep_thread_t *t = *p;
+    lockdep_dout(0) << "--- thread " << t->thread << " ---" << dendl;
+    for (int i = 0; i < t->nheld; i++) {
+      lockdep_dout(0) << "  * " << lock_names[t->held[i]] << "\n";
+      if (t->bt[i])
+	t->bt[i]->print(*_dout);
       *_dout << dendl;
     }
   }
@@ -146,49 +186,58 @@ static bool does_follow(int a, int b)
 
 int lockdep_will_lock(const char *name, int id)
 {
-  pthread_t p = pthread_self();
   if (id < 0) id = lockdep_register(name);
+  lockdep_thread_t *t = get_thread_held();
+
+  // fast path: no recursion and every dependency already known.  follows[]
+  // entries are only ever set (under lockdep_mutex), so a stale NULL just
+  // sends us down the slow path.
+  bool known = true;
+  for (int i = 0; i < t->nheld; i++) {
+    if (t->held[i] == id || !follows[t->held[i]][id]) {
+      known = false;
+      break;
+    }
+  }
+  if (known)
+    return id;
 
   pthread_mutex_lock(&lockdep_mutex);
   lockdep_dout(20) << "_will_lock " << name << " (" << id << ")" << dendl;
 
   // check dependency graph
-  map<int, BackTrace *> &m = held[p];
-  for (map<int, BackTrace *>::iterator p = m.begin();
-       p != m.end();
-       p++) {
-    if (p->first == id) {
+  for (int i = 0; i < t->nheld; i++) {
+    int h = t->held[i];
+    if (h == id) {
       lockdep_dout(0) << "\n";
       *_dout << "recursive lock of " << name << " (" << id << ")\n";
       BackTrace *bt = new BackTrace(BACKTRACE_SKIP);
       bt->print(*_dout);
-      if (p->second) {
+      if (t->bt[i]) {
 	*_dout << "\npreviously locked at\n";
-	p->second->print(*_dout);
+	t->bt[i]->print(*_dout);
       }
       *_dout << dendl;
       assert(0);
     }
-    else if (!follows[p->first][id]) {
+    else if (!follows[h][id]) {
       // new dependency
 
       // did we just create a cycle?
       BackTrace *bt = new BackTrace(BACKTRACE_SKIP);
-      if (does_follow(id, p->first)) {
-	lockdep_dout(0) << "new dependency " << lock_names[p->first]
-		<< " (" << p->first << ") -> " << name << " (" << id << ")"
+      if (does_follow(id, h)) {
+	lockdep_dout(0) << "new dependency " << lock_names[h]
+		<< " (" << h << ") -> " << name << " (" << id << ")"
 		<< " creates a cycle at\n";
 	bt->print(*_dout);
 	*_dout << dendl;
 
 	lockdep_dout(0) << "btw, i am holding these locks:" << dendl;
-	for (map<int, BackTrace *>::iterator q = m.begin();
-	     q != m.end();
-	     q++) {
-	  lockdep_dout(0) << "  " << lock_names[q->first] << " (" << q->first << ")" << dendl;
-	  if (q->second) {
+	for (int j = 0; j < t->nheld; j++) {
+	  lockdep_dout(0) << "  " << lock_names[t->held[j]] << " (" << t->held[j] << ")" << dendl;
+	  if (t->bt[j]) {
 	    lockdep_dout(0) << " ";
-	    q->second->print(*_dout);
+	    t->bt[j]->print(*_dout);
 	    *_dout << dendl;
 	  }
 	}
@@ -200,8 +249,8 @@ int lockdep_will_lock(const char *name, int id)
 
 	assert(0);  // actually, we should just die here.
       } else {
-	follows[p->first][id] = bt;
-	lockdep_dout(10) << lock_names[p->first] << " -> " << name << " at" << dendl;
+	follows[h][id] = bt;
+	lockdep_dout(10) << lock_names[h] << " -> " << name << " at" << dendl;
 	//bt->print(*_dout);
       }
     }
@@ -213,40 +262,48 @@ int lockdep_will_lock(const char *name, int id)
 
 int lockdep_locked(const char *name, int id, bool force_backtrace)
 {
-  pthread_t p = pthread_self();
-
   if (id < 0) id = lockdep_register(name);
+  lockdep_thread_t *t = get_thread_held();
 
-  pthread_mutex_lock(&lockdep_mutex);
-  lockdep_dout(20) << "_locked " << name << dendl;
+  if (t->nheld == MAX_HELD) {
+    if (!t->overflowed) {
+      t->overflowed = true;
+      lockdep_dout(0) << "more than " << MAX_HELD << " locks held; not tracking "
+		      << name << " (" << id << ")" << dendl;
+    }
+    return id;
+  }
+  t->held[t->nheld] = id;
   if (g_lockdep >= 2 || force_backtrace)
-    held[p][id] = new BackTrace(BACKTRACE_SKIP);
+    t->bt[t->nheld] = new BackTrace(BACKTRACE_SKIP);
   else
-    held[p][id] = 0;
-  pthread_mutex_unlock(&lockdep_mutex);
+    t->bt[t->nheld] = 0;
+  t->nheld++;
   return id;
 }
 
 int lockdep_will_unlock(const char *name, int id)
 {
-  pthread_t p = pthread_self();
-
   if (id < 0) {
     //id = lockdep_register(name);
     assert(id == -1);
     return id;
   }
 
-  pthread_mutex_lock(&lockdep_mutex);
-  lockdep_dout(20) << "_will_unlock " << name << dendl;
+  lockdep_thread_t *t = get_thread_held();
 
   // don't assert.. lockdep may be enabled at any point in time
-  //assert(held.count(p));
-  //assert(held[p].count(id));
-
-  delete held[p][id];
-  held[p].erase(id);
-  pthread_mutex_unlock(&lockdep_mutex);
+  for (int i = t->nheld - 1; i >= 0; i--) {
+    if (t->held[i] == id) {
+      delete t->bt[i];
+      for (int j = i + 1; j < t->nheld; j++) {
+	t->held[j-1] = t->held[j];
+	t->bt[j-1] = t->bt[j];
+      }
+      t->nheld--;
+      break;
+    }
+  }
   return id;
 }
 
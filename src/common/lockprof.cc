@@ -0,0 +1,146 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/environment.h"
+#include "common/Formatter.h"
+#include "common/simple_spin.h"
+#include "include/types.h"
+#include "lockprof.h"
+
+#include <pthread.h>
+#include <algorithm>
+
+#define MAX_PROF_LOCKS 1024   // the last slot collects any overflow
+
+int g_lockprof = get_env_int("CEPH_LOCKPROF");
+__thread int lockprof_countdown = 0;
+
+struct lockprof_stat_t {
+  string name;
+  simple_spinlock_t lock;
+  uint64_t samples, contended;
+  uint64_t wait_ns, wait_max_ns;
+  uint64_t holds, hold_ns, hold_max_ns;
+
+  lockprof_stat_t() : lock(SIMPLE_SPINLOCK_INITIALIZER) {
+    clear();
+  }
+  void clear() {
+    samples = contended = 0;
+    wait_ns = wait_max_ns = 0;
+    holds = hold_ns = hold_max_ns = 0;
+  }
+};
+
+static pthread_mutex_t lockprof_mutex = PTHREAD_MUTEX_INITIALIZER;
+static map<string, int> lockprof_ids;
+static lockprof_stat_t lockprof_stats[MAX_PROF_LOCKS];
+static int lockprof_num = 0;
+
+int lockprof_register(const char *name)
+{
+  pthread_mutex_lock(&lockprof_mutex);
+  int id;
+  map<string, int>::iterator p = lockprof_ids.find(name);
+  if (p != lockprof_ids.end()) {
+    id = p->second;
+  } else if (lockprof_num < MAX_PROF_LOCKS - 1) {
+    id = lockprof_num++;
+    lockprof_stats[id].name = name;
+    lockprof_ids[name] = id;
+  } else {
+    id = MAX_PROF_LOCKS - 1;
+    lockprof_stats[id].name = "(other)";
+  }
+  pthread_mutex_unlock(&lockprof_mutex);
+  return id;
+}
+
+void lockprof_wait(int id, bool contended, uint64_t wait_ns)
+{
+  lockprof_stat_t& s = lockprof_stats[id];
+  simple_spin_lock(&s.lock);
+  s.samples++;
+  if (contended) {
+    s.contended++;
+    s.wait_ns += wait_ns;
+    if (wait_ns > s.wait_max_ns)
+      s.wait_max_ns = wait_ns;
+  }
+  simple_spin_unlock(&s.lock);
+}
+
+void lockprof_hold(int id, uint64_t hold_ns)
+{
+  lockprof_stat_t& s = lockprof_stats[id];
+  simple_spin_lock(&s.lock);
+  s.holds++;
+  s.hold_ns += hold_ns;
+  if (hold_ns > s.hold_max_ns)
+    s.hold_max_ns = hold_ns;
+  simple_spin_unlock(&s.lock);
+}
+
+void lockprof_reset()
+{
+  pthread_mutex_lock(&lockprof_mutex);
+  for (int i = 0; i < MAX_PROF_LOCKS; i++) {
+    simple_spin_lock(&lockprof_stats[i].lock);
+    lockprof_stats[i].clear();
+    simple_spin_unlock(&lockprof_stats[i].lock);
+  }
+  pthread_mutex_unlock(&lockprof_mutex);
+}
+
+void lockprof_dump(ceph::Formatter *f, int top)
+{
+  vector<lockprof_stat_t> v;
+  pthread_mutex_lock(&lockprof_mutex);
+  v.reserve(lockprof_num + 1);
+  for (int i = 0; i < MAX_PROF_LOCKS; i++) {
+    if (i >= lockprof_num && i < MAX_PROF_LOCKS - 1)
+      continue;
+    simple_spin_lock(&lockprof_stats[i].lock);
+    if (lockprof_stats[i].samples)
+      v.push_back(lockprof_stats[i]);
+    simple_spin_unlock(&lockprof_stats[i].lock);
+  }
+  pthread_mutex_unlock(&lockprof_mutex);
+
+  // most total wait time first
+  vector<pair<uint64_t, int> > order;
+  for (unsigned i = 0; i < v.size(); i++)
+    order.push_back(make_pair(v[i].wait_ns, -(int)i));
+  sort(order.rbegin(), order.rend());
+
+  f->open_object_section("lockprof");
+  f->dump_int("sample_rate", g_lockprof);
+  f->open_array_section("locks");
+  for (unsigned i = 0; i < order.size() && (int)i < top; i++) {
+    lockprof_stat_t& s = v[-order[i].second];
+    f->open_object_section("lock");
+    f->dump_string("name", s.name);
+    f->dump_unsigned("samples", s.samples);
+    f->dump_unsigned("contended", s.contended);
+    f->dump_float("contended_ratio", (double)s.contended / (double)s.samples);
+    f->dump_float("wait_total", (double)s.wait_ns / 1000000000.0);
+    f->dump_float("wait_avg", s.contended ? (double)s.wait_ns / s.contended / 1000000000.0 : 0);
+    f->dump_float("wait_max", (double)s.wait_max_ns / 1000000000.0);
+    f->dump_float("hold_avg", s.holds ? (double)s.hold_ns / s.holds / 1000000000.0 : 0);
+    f->dump_float("hold_max", (double)s.hold_max_ns / 1000000000.0);
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
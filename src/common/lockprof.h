@@ -0,0 +1,58 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_LOCKPROF_H
+#define CEPH_LOCKPROF_H
+
+#include <stdint.h>
+#include <time.h>
+
+namespace ceph {
+  class Formatter;
+}
+
+/*
+ * Sampling lock contention profiler.
+ *
+ * When g_lockprof is N > 0, every Nth Mutex/RWLock acquisition on each
+ * thread is timed: we try the lock first, and only if that fails do we
+ * measure how long the blocking acquire took.  Sampled acquisitions also
+ * record how long the lock was held.  Stats are aggregated by lock name.
+ * Unsampled acquisitions cost a thread-local decrement.
+ */
+extern int g_lockprof;
+extern __thread int lockprof_countdown;
+
+extern int lockprof_register(const char *name);
+extern void lockprof_wait(int id, bool contended, uint64_t wait_ns);
+extern void lockprof_hold(int id, uint64_t hold_ns);
+extern void lockprof_reset();
+
+/// dump the @top locks with the most total wait time
+extern void lockprof_dump(ceph::Formatter *f, int top);
+
+static inline bool lockprof_sample() {
+  if (lockprof_countdown-- > 0)
+    return false;
+  lockprof_countdown = g_lockprof - 1;
+  return true;
+}
+
+static inline uint64_t lockprof_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif
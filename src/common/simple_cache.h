@@ -0,0 +1,118 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_SIMPLECACHE_H
+#define CEPH_SIMPLECACHE_H
+
+#include <map>
+#include <list>
+#include <utility>
+
+#include "common/Mutex.h"
+
+/*
+ * A small LRU of values by key, with its own lock.  Lookups hand back
+ * a copy of the value, so it is meant for values that are cheap to
+ * copy and share, like bufferlists.
+ *
+ * Pinned entries are kept regardless of size until clear_pinned()
+ * moves them into the LRU.
+ */
+template <class K, class V>
+class SimpleLRU {
+  Mutex lock;
+  size_t max_size;
+  std::map<K, typename std::list<std::pair<K, V> >::iterator> contents;
+  std::list<std::pair<K, V> > lru;
+  std::map<K, V> pinned;
+
+  void trim_cache() {
+    while (lru.size() > max_size) {
+      contents.erase(lru.back().first);
+      lru.pop_back();
+    }
+  }
+
+  void _add(const K& key, const V& value) {
+    typename std::map<K, typename std::list<std::pair<K, V> >::iterator>::iterator p =
+      contents.find(key);
+    if (p != contents.end()) {
+      p->second->second = value;
+      lru.splice(lru.begin(), lru, p->second);
+      return;
+    }
+    lru.push_front(std::make_pair(key, value));
+    contents[key] = lru.begin();
+    trim_cache();
+  }
+
+public:
+  SimpleLRU(size_t max_size) : lock("SimpleLRU::lock"), max_size(max_size) {}
+
+  void set_size(size_t new_size) {
+    Mutex::Locker l(lock);
+    max_size = new_size;
+    trim_cache();
+  }
+
+  size_t size() {
+    Mutex::Locker l(lock);
+    return lru.size() + pinned.size();
+  }
+
+  void add(const K& key, const V& value) {
+    Mutex::Locker l(lock);
+    _add(key, value);
+  }
+
+  /// keep @a value until clear_pinned() is called on its key
+  void pin(const K& key, const V& value) {
+    Mutex::Locker l(lock);
+    pinned[key] = value;
+  }
+
+  /// move pinned entries with keys <= @a key into the LRU
+  void clear_pinned(const K& key) {
+    Mutex::Locker l(lock);
+    while (!pinned.empty() && !(key < pinned.begin()->first)) {
+      _add(pinned.begin()->first, pinned.begin()->second);
+      pinned.erase(pinned.begin());
+    }
+  }
+
+  bool lookup(const K& key, V *out) {
+    Mutex::Locker l(lock);
+    typename std::map<K, V>::iterator q = pinned.find(key);
+    if (q != pinned.end()) {
+      *out = q->second;
+      return true;
+    }
+    typename std::map<K, typename std::list<std::pair<K, V> >::iterator>::iterator p =
+      contents.find(key);
+    if (p == contents.end())
+      return false;
+    *out = p->second->second;
+    lru.splice(lru.begin(), lru, p->second);
+    return true;
+  }
+
+  void clear() {
+    Mutex::Locker l(lock);
+    contents.clear();
+    lru.clear();
+    pinned.clear();
+  }
+};
+
+#endif
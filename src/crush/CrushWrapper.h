@@ -461,6 +461,15 @@ public:
 	  ::encode(((crush_bucket_straw*)crush->buckets[i])->straws[j], bl);
 	}
 	break;
+
+      case CRUSH_BUCKET_STRAW_TREE: {
+	crush_bucket_straw_tree *cbst = (crush_bucket_straw_tree*)crush->buckets[i];
+	::encode(cbst->fanout, bl);
+	::encode(cbst->num_nodes, bl);
+	for (unsigned j=0; j<cbst->num_nodes; j++)
+	  ::encode(cbst->node_weights[j], bl);
+	break;
+      }
       default:
 	assert(0);
 	break;
@@ -561,6 +570,9 @@ public:
       case CRUSH_BUCKET_STRAW:
 	size = sizeof(crush_bucket_straw);
 	break;
+      case CRUSH_BUCKET_STRAW_TREE:
+	size = sizeof(crush_bucket_straw_tree);
+	break;
       default: {
 	char str[128];
 	snprintf(str, sizeof(str), "unsupported bucket algorithm: %d", alg);
@@ -624,6 +636,26 @@ public:
 	break;
       }
 
+      case CRUSH_BUCKET_STRAW_TREE: {
+	crush_bucket_straw_tree* cbst = (crush_bucket_straw_tree*)bucket;
+	::decode(cbst->fanout, blp);
+	if (cbst->fanout < 2)
+	  throw buffer::malformed_input("bad straw_tree fanout");
+	::decode(cbst->num_nodes, blp);
+	__u32 start[CRUSH_STRAW_TREE_MAX_LEVELS];
+	__u32 count[CRUSH_STRAW_TREE_MAX_LEVELS];
+	int levels = crush_calc_straw_tree_levels(bucket->size, cbst->fanout,
+						  start, count);
+	if (levels < 0)
+	  throw buffer::malformed_input("too many straw_tree levels");
+	if (cbst->num_nodes != start[levels-1] + count[levels-1])
+	  throw buffer::malformed_input("bad straw_tree num_nodes");
+	cbst->node_weights = (__u32*)calloc(1, cbst->num_nodes * sizeof(__u32));
+	for (unsigned j = 0; j < cbst->num_nodes; ++j)
+	  ::decode(cbst->node_weights[j], blp);
+	break;
+      }
+
       default:
 	// We should have handled this case in the first switch statement
 	assert(0);
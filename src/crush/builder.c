@@ -419,6 +419,76 @@ crush_make_straw_bucket(int hash,
 
 
 
+/* straw_tree bucket */
+
+/*
+ * Recompute the group weights of a straw_tree bucket from its item
+ * weights (the first h.size node_weights).
+ */
+int crush_calc_straw_tree(struct crush_bucket_straw_tree *bucket)
+{
+	__u32 start[CRUSH_STRAW_TREE_MAX_LEVELS];
+	__u32 count[CRUSH_STRAW_TREE_MAX_LEVELS];
+	int levels = crush_calc_straw_tree_levels(bucket->h.size, bucket->fanout,
+						  start, count);
+	int fanout = bucket->fanout;
+	int l;
+	__u32 i;
+
+	if (levels < 0)
+		return -EINVAL;
+	bucket->num_nodes = start[levels-1] + count[levels-1];
+	bucket->node_weights = realloc(bucket->node_weights,
+				       sizeof(__u32)*bucket->num_nodes);
+
+	for (l = 1; l < levels; l++) {
+		__u32 *below = bucket->node_weights + start[l-1];
+		__u32 *w = bucket->node_weights + start[l];
+		memset(w, 0, sizeof(__u32)*count[l]);
+		for (i = 0; i < count[l-1]; i++)
+			w[i / fanout] += below[i];
+	}
+
+	bucket->h.weight = 0;
+	for (i = 0; i < count[levels-1]; i++)
+		bucket->h.weight += bucket->node_weights[start[levels-1] + i];
+	return 0;
+}
+
+struct crush_bucket_straw_tree *
+crush_make_straw_tree_bucket(int hash,
+			     int type,
+			     int size,
+			     int *items,
+			     int *weights)
+{
+	struct crush_bucket_straw_tree *bucket;
+	int i;
+
+	bucket = malloc(sizeof(*bucket));
+	memset(bucket, 0, sizeof(*bucket));
+	bucket->h.alg = CRUSH_BUCKET_STRAW_TREE;
+	bucket->h.hash = hash;
+	bucket->h.type = type;
+	bucket->h.size = size;
+	bucket->fanout = CRUSH_STRAW_TREE_FANOUT;
+
+	bucket->h.items = malloc(sizeof(__u32)*size);
+	bucket->h.perm = malloc(sizeof(__u32)*size);
+	bucket->node_weights = malloc(sizeof(__u32)*size);
+
+	for (i=0; i<size; i++) {
+		bucket->h.items[i] = items[i];
+		bucket->node_weights[i] = weights[i];
+	}
+
+	crush_calc_straw_tree(bucket);
+
+	return bucket;
+}
+
+
+
 struct crush_bucket*
 crush_make_bucket(int alg, int hash, int type, int size,
 		  int *items,
@@ -442,6 +512,9 @@ crush_make_bucket(int alg, int hash, int type, int size,
 
 	case CRUSH_BUCKET_STRAW:
 		return (struct crush_bucket *)crush_make_straw_bucket(hash, type, size, items, weights);
+
+	case CRUSH_BUCKET_STRAW_TREE:
+		return (struct crush_bucket *)crush_make_straw_tree_bucket(hash, type, size, items, weights);
 	}
 	return 0;
 }
@@ -528,6 +601,23 @@ int crush_add_straw_bucket_item(struct crush_bucket_straw *bucket, int item, int
 	return crush_calc_straw(bucket);
 }
 
+int crush_add_straw_tree_bucket_item(struct crush_bucket_straw_tree *bucket, int item, int weight)
+{
+	int newsize = bucket->h.size + 1;
+
+	bucket->h.items = realloc(bucket->h.items, sizeof(__u32)*newsize);
+	bucket->h.perm = realloc(bucket->h.perm, sizeof(__u32)*newsize);
+	/* groups are recomputed below; make room for one more item */
+	bucket->node_weights = realloc(bucket->node_weights,
+				       sizeof(__u32)*(bucket->num_nodes + 1));
+
+	bucket->h.items[newsize-1] = item;
+	bucket->node_weights[newsize-1] = weight;
+	bucket->h.size++;
+
+	return crush_calc_straw_tree(bucket);
+}
+
 int crush_bucket_add_item(struct crush_bucket *b, int item, int weight)
 {
 	/* invalidate perm cache */
@@ -542,6 +632,8 @@ int crush_bucket_add_item(struct crush_bucket *b, int item, int weight)
 		return crush_add_tree_bucket_item((struct crush_bucket_tree *)b, item, weight);
 	case CRUSH_BUCKET_STRAW:
 		return crush_add_straw_bucket_item((struct crush_bucket_straw *)b, item, weight);
+	case CRUSH_BUCKET_STRAW_TREE:
+		return crush_add_straw_tree_bucket_item((struct crush_bucket_straw_tree *)b, item, weight);
 	default:
 		return -1;
 	}
@@ -682,6 +774,32 @@ int crush_remove_straw_bucket_item(struct crush_bucket_straw *bucket, int item)
 	return crush_calc_straw(bucket);
 }
 
+int crush_remove_straw_tree_bucket_item(struct crush_bucket_straw_tree *bucket, int item)
+{
+	int newsize = bucket->h.size - 1;
+	unsigned i;
+
+	for (i = 0; i < bucket->h.size; i++)
+		if (bucket->h.items[i] == item)
+			break;
+	if (i == bucket->h.size)
+		return -ENOENT;
+
+	/*
+	 * move the last item into the hole rather than shifting
+	 * everything after it down, so that only that one item changes
+	 * group
+	 */
+	bucket->h.items[i] = bucket->h.items[newsize];
+	bucket->node_weights[i] = bucket->node_weights[newsize];
+	bucket->h.size--;
+
+	bucket->h.items = realloc(bucket->h.items, sizeof(__u32)*newsize);
+	bucket->h.perm = realloc(bucket->h.perm, sizeof(__u32)*newsize);
+
+	return crush_calc_straw_tree(bucket);
+}
+
 int crush_bucket_remove_item(struct crush_bucket *b, int item)
 {
 	/* invalidate perm cache */
@@ -696,6 +814,8 @@ int crush_bucket_remove_item(struct crush_bucket *b, int item)
 		return crush_remove_tree_bucket_item((struct crush_bucket_tree *)b, item);
 	case CRUSH_BUCKET_STRAW:
 		return crush_remove_straw_bucket_item((struct crush_bucket_straw *)b, item);
+	case CRUSH_BUCKET_STRAW_TREE:
+		return crush_remove_straw_tree_bucket_item((struct crush_bucket_straw_tree *)b, item);
 	default:
 		return -1;
 	}
@@ -784,6 +904,25 @@ int crush_adjust_straw_bucket_item_weight(struct crush_bucket_straw *bucket, int
 	return diff;
 }
 
+int crush_adjust_straw_tree_bucket_item_weight(struct crush_bucket_straw_tree *bucket, int item, int weight)
+{
+	unsigned idx;
+	int diff;
+
+	for (idx = 0; idx < bucket->h.size; idx++)
+		if (bucket->h.items[idx] == item)
+			break;
+	if (idx == bucket->h.size)
+		return 0;
+
+	diff = weight - bucket->node_weights[idx];
+	bucket->node_weights[idx] = weight;
+
+	crush_calc_straw_tree(bucket);
+
+	return diff;
+}
+
 int crush_bucket_adjust_item_weight(struct crush_bucket *b, int item, int weight)
 {
 	switch (b->alg) {
@@ -799,6 +938,9 @@ int crush_bucket_adjust_item_weight(struct crush_bucket *b, int item, int weight
 	case CRUSH_BUCKET_STRAW:
 		return crush_adjust_straw_bucket_item_weight((struct crush_bucket_straw *)b,
 							     item, weight);
+	case CRUSH_BUCKET_STRAW_TREE:
+		return crush_adjust_straw_tree_bucket_item_weight((struct crush_bucket_straw_tree *)b,
+								  item, weight);
 	default:
 		return -1;
 	}
@@ -883,6 +1025,21 @@ int crush_reweight_straw_bucket(struct crush_map *crush, struct crush_bucket_str
 	return 0;
 }
 
+int crush_reweight_straw_tree_bucket(struct crush_map *crush, struct crush_bucket_straw_tree *bucket)
+{
+	unsigned i;
+
+	for (i = 0; i < bucket->h.size; i++) {
+		int id = bucket->h.items[i];
+		if (id < 0) {
+			struct crush_bucket *c = crush->buckets[-1-id];
+			crush_reweight_bucket(crush, c);
+			bucket->node_weights[i] = c->weight;
+		}
+	}
+	return crush_calc_straw_tree(bucket);
+}
+
 int crush_reweight_bucket(struct crush_map *crush, struct crush_bucket *b)
 {
 	switch (b->alg) {
@@ -894,6 +1051,8 @@ int crush_reweight_bucket(struct crush_map *crush, struct crush_bucket *b)
 		return crush_reweight_tree_bucket(crush, (struct crush_bucket_tree *)b);
 	case CRUSH_BUCKET_STRAW:
 		return crush_reweight_straw_bucket(crush, (struct crush_bucket_straw *)b);
+	case CRUSH_BUCKET_STRAW_TREE:
+		return crush_reweight_straw_tree_bucket(crush, (struct crush_bucket_straw_tree *)b);
 	default:
 		return -1;
 	}
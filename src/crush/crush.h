@@ -95,12 +95,14 @@ struct crush_rule {
  *  list            O(n)       optimal      poor
  *  tree            O(log n)   good         good
  *  straw           O(n)       optimal      optimal
+ *  straw_tree      O(log n)   near-optimal near-optimal
  */
 enum {
 	CRUSH_BUCKET_UNIFORM = 1,
 	CRUSH_BUCKET_LIST = 2,
 	CRUSH_BUCKET_TREE = 3,
-	CRUSH_BUCKET_STRAW = 4
+	CRUSH_BUCKET_STRAW = 4,
+	CRUSH_BUCKET_STRAW_TREE = 5
 };
 extern const char *crush_bucket_alg_name(int alg);
 
@@ -146,6 +148,36 @@ struct crush_bucket_straw {
 	__u32 *straws;         /* 16-bit fixed point */
 };
 
+/*
+ * A straw_tree bucket draws among groups of at most fanout items,
+ * then among groups of those groups, and so on up to a single top
+ * group.  Selection starts at the top and draws once per level, so it
+ * costs O(fanout * log_fanout(n)) hashes instead of n.
+ *
+ * Each draw is an exponential race: every node scales the log of its
+ * hash by its weight and the highest wins, which picks nodes exactly
+ * in proportion to their weight (unlike straw lengths, which are only
+ * right when weights are similar, and group weights rarely are).  A
+ * node's draw depends only on its own weight, so a weight change only
+ * moves data into or out of the groups on that item's path.  Items
+ * keep their group as long as they keep their position, which is why
+ * items are appended, and a removal moves the last item into the
+ * hole.
+ *
+ * node_weights holds the items (level 0) first, then every level of
+ * groups below the top.  Node i of level l is in group i / fanout of
+ * level l + 1.
+ */
+#define CRUSH_STRAW_TREE_FANOUT     16
+#define CRUSH_STRAW_TREE_MAX_LEVELS 32
+
+struct crush_bucket_straw_tree {
+	struct crush_bucket h;
+	__u8 fanout;
+	__u32 num_nodes;
+	__u32 *node_weights;   /* 16-bit fixed point */
+};
+
 
 
 /*
@@ -178,6 +210,7 @@ extern void crush_destroy_bucket_uniform(struct crush_bucket_uniform *b);
 extern void crush_destroy_bucket_list(struct crush_bucket_list *b);
 extern void crush_destroy_bucket_tree(struct crush_bucket_tree *b);
 extern void crush_destroy_bucket_straw(struct crush_bucket_straw *b);
+extern void crush_destroy_bucket_straw_tree(struct crush_bucket_straw_tree *b);
 extern void crush_destroy_bucket(struct crush_bucket *b);
 extern void crush_destroy(struct crush_map *map);
 
@@ -186,4 +219,29 @@ static inline int crush_calc_tree_node(int i)
 	return ((i+1) << 1)-1;
 }
 
+/*
+ * Fill in where each level of a straw_tree bucket with @size items
+ * starts in its node arrays, and how many nodes it has.  Returns the
+ * number of levels (the last one is the top group), or -1 if it would
+ * take more than CRUSH_STRAW_TREE_MAX_LEVELS.
+ */
+static inline int crush_calc_straw_tree_levels(__u32 size, int fanout,
+					       __u32 *start, __u32 *count)
+{
+	int levels = 0;
+	__u32 off = 0;
+
+	for (;;) {
+		if (levels == CRUSH_STRAW_TREE_MAX_LEVELS)
+			return -1;
+		start[levels] = off;
+		count[levels] = size;
+		levels++;
+		if (size <= (__u32)fanout)
+			return levels;
+		off += size;
+		size = (size - 1) / fanout + 1;
+	}
+}
+
 #endif
@@ -100,6 +100,7 @@ struct crush_grammar : public grammar<crush_grammar>
       bucket_alg = str_p("alg") >> ( str_p("uniform") |
 				     str_p("list") |
 				     str_p("tree") |
+				     str_p("straw_tree") |   // before its prefix "straw"
 				     str_p("straw") );
       bucket_hash = str_p("hash") >> ( integer |
 				       str_p("rjenkins1") );
@@ -7,6 +7,20 @@
 #endif
 #include "hash.h"
 
+/*
+ * Vectorized rjenkins1 for crush_hash32_3_many.  These are chosen at
+ * compile time: every x86_64 build has SSE2, and AVX2 is used when
+ * the build targets it (e.g. -march=haswell).
+ */
+#if !defined(__KERNEL__) && defined(__AVX2__)
+# include <immintrin.h>
+# define CRUSH_HASH_AVX2
+#endif
+#if !defined(__KERNEL__) && defined(__SSE2__)
+# include <emmintrin.h>
+# define CRUSH_HASH_SSE2
+#endif
+
 /*
  * Robert Jenkins' function for mixing 32-bit values
  * http://burtleburtle.net/bob/hash/evahash.html
@@ -93,6 +107,73 @@ static __u32 crush_hash32_rjenkins1_5(__u32 a, __u32 b, __u32 c, __u32 d,
 }
 
 
+/*
+ * The same mix on vectors of 32-bit lanes, given the lane-wise
+ * subtract, xor and shifts of the instruction set.
+ */
+#define crush_hashmix_v(a, b, c, sub, xor, srl, sll) do {	\
+		a = sub(a, b);  a = sub(a, c);  a = xor(a, srl(c, 13));	\
+		b = sub(b, c);  b = sub(b, a);  b = xor(b, sll(a, 8));	\
+		c = sub(c, a);  c = sub(c, b);  c = xor(c, srl(b, 13));	\
+		a = sub(a, b);  a = sub(a, c);  a = xor(a, srl(c, 12));	\
+		b = sub(b, c);  b = sub(b, a);  b = xor(b, sll(a, 16));	\
+		c = sub(c, a);  c = sub(c, b);  c = xor(c, srl(b, 5));	\
+		a = sub(a, b);  a = sub(a, c);  a = xor(a, srl(c, 3));	\
+		b = sub(b, c);  b = sub(b, a);  b = xor(b, sll(a, 10));	\
+		c = sub(c, a);  c = sub(c, b);  c = xor(c, srl(b, 15));	\
+	} while (0)
+
+#ifdef CRUSH_HASH_SSE2
+# define crush_hashmix_sse2(a, b, c)					\
+	crush_hashmix_v(a, b, c, _mm_sub_epi32, _mm_xor_si128,		\
+			_mm_srli_epi32, _mm_slli_epi32)
+
+/* crush_hash32_rjenkins1_3(a, b[i], c) for i = 0..3 */
+static void crush_hash32_rjenkins1_3_x4(__u32 a, const __u32 *b, __u32 c,
+					__u32 *out)
+{
+	__m128i va = _mm_set1_epi32(a);
+	__m128i vb = _mm_loadu_si128((const __m128i *)b);
+	__m128i vc = _mm_set1_epi32(c);
+	__m128i x = _mm_set1_epi32(231232);
+	__m128i y = _mm_set1_epi32(1232);
+	__m128i hash = _mm_xor_si128(_mm_set1_epi32(crush_hash_seed ^ a ^ c),
+				     vb);
+	crush_hashmix_sse2(va, vb, hash);
+	crush_hashmix_sse2(vc, x, hash);
+	crush_hashmix_sse2(y, va, hash);
+	crush_hashmix_sse2(vb, x, hash);
+	crush_hashmix_sse2(y, vc, hash);
+	_mm_storeu_si128((__m128i *)out, hash);
+}
+#endif
+
+#ifdef CRUSH_HASH_AVX2
+# define crush_hashmix_avx2(a, b, c)					\
+	crush_hashmix_v(a, b, c, _mm256_sub_epi32, _mm256_xor_si256,	\
+			_mm256_srli_epi32, _mm256_slli_epi32)
+
+/* crush_hash32_rjenkins1_3(a, b[i], c) for i = 0..7 */
+static void crush_hash32_rjenkins1_3_x8(__u32 a, const __u32 *b, __u32 c,
+					__u32 *out)
+{
+	__m256i va = _mm256_set1_epi32(a);
+	__m256i vb = _mm256_loadu_si256((const __m256i *)b);
+	__m256i vc = _mm256_set1_epi32(c);
+	__m256i x = _mm256_set1_epi32(231232);
+	__m256i y = _mm256_set1_epi32(1232);
+	__m256i hash = _mm256_xor_si256(_mm256_set1_epi32(crush_hash_seed ^ a ^ c),
+					vb);
+	crush_hashmix_avx2(va, vb, hash);
+	crush_hashmix_avx2(vc, x, hash);
+	crush_hashmix_avx2(y, va, hash);
+	crush_hashmix_avx2(vb, x, hash);
+	crush_hashmix_avx2(y, vc, hash);
+	_mm256_storeu_si256((__m256i *)out, hash);
+}
+#endif
+
+
 __u32 crush_hash32(int type, __u32 a)
 {
 	switch (type) {
@@ -143,6 +224,28 @@ __u32 crush_hash32_5(int type, __u32 a, __u32 b, __u32 c, __u32 d, __u32 e)
 	}
 }
 
+void crush_hash32_3_many(int type, __u32 a, const __u32 *b, __u32 c,
+			 __u32 *out, int n)
+{
+	int i = 0;
+
+	if (type != CRUSH_HASH_RJENKINS1) {
+		for (; i < n; i++)
+			out[i] = crush_hash32_3(type, a, b[i], c);
+		return;
+	}
+#ifdef CRUSH_HASH_AVX2
+	for (; i + 8 <= n; i += 8)
+		crush_hash32_rjenkins1_3_x8(a, b + i, c, out + i);
+#endif
+#ifdef CRUSH_HASH_SSE2
+	for (; i + 4 <= n; i += 4)
+		crush_hash32_rjenkins1_3_x4(a, b + i, c, out + i);
+#endif
+	for (; i < n; i++)
+		out[i] = crush_hash32_rjenkins1_3(a, b[i], c);
+}
+
 const char *crush_hash_name(int type)
 {
 	switch (type) {
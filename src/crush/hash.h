@@ -14,4 +14,11 @@ extern __u32 crush_hash32_4(int type, __u32 a, __u32 b, __u32 c, __u32 d);
 extern __u32 crush_hash32_5(int type, __u32 a, __u32 b, __u32 c, __u32 d,
 			    __u32 e);
 
+/*
+ * out[i] = crush_hash32_3(type, a, b[i], c) for i < n, several at a
+ * time where the cpu allows; bit-identical to the one-at-a-time form.
+ */
+extern void crush_hash32_3_many(int type, __u32 a, const __u32 *b, __u32 c,
+				__u32 *out, int n);
+
 #endif
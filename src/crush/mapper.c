@@ -4,6 +4,7 @@
 # include <linux/slab.h>
 # include <linux/bug.h>
 # include <linux/kernel.h>
+# include <linux/math64.h>
 # ifndef dprintk
 #  define dprintk(args...)
 # endif
@@ -16,6 +17,9 @@
 # define dprintk(args...) /* printf(args) */
 # define kmalloc(x, f) malloc(x)
 # define kfree(x) free(x)
+# include <stdint.h>
+# define S64_MIN INT64_MIN
+# define div64_s64(a, b) ((a) / (b))
 #endif
 
 #include "crush.h"
@@ -216,26 +220,162 @@ static int bucket_tree_choose(struct crush_bucket_tree *bucket,
 
 /* straw */
 
+/* items hashed per crush_hash32_3_many call */
+#define CRUSH_HASH_BATCH 64
+
 static int bucket_straw_choose(struct crush_bucket_straw *bucket,
 			       int x, int r)
 {
-	__u32 i;
+	__u32 i, j, n;
 	int high = 0;
 	__u64 high_draw = 0;
 	__u64 draw;
-
-	for (i = 0; i < bucket->h.size; i++) {
-		draw = crush_hash32_3(bucket->h.hash, x, bucket->h.items[i], r);
-		draw &= 0xffff;
-		draw *= bucket->straws[i];
-		if (i == 0 || draw > high_draw) {
-			high = i;
-			high_draw = draw;
+	__u32 hash[CRUSH_HASH_BATCH];
+
+	for (i = 0; i < bucket->h.size; i += n) {
+		n = bucket->h.size - i;
+		if (n > CRUSH_HASH_BATCH)
+			n = CRUSH_HASH_BATCH;
+		crush_hash32_3_many(bucket->h.hash, x,
+				    (const __u32 *)bucket->h.items + i, r,
+				    hash, n);
+		for (j = 0; j < n; j++) {
+			draw = hash[j] & 0xffff;
+			draw *= bucket->straws[i + j];
+			if (i + j == 0 || draw > high_draw) {
+				high = i + j;
+				high_draw = draw;
+			}
 		}
 	}
 	return bucket->h.items[high];
 }
 
+/* straw_tree */
+
+/* log2(1 + k/256) in 16.16 fixed point, for k = 0..256 */
+static const __u32 crush_log2_tbl[257] = {
+	0x00000, 0x00171, 0x002e0, 0x0044e, 0x005ba, 0x00725, 0x0088e, 0x009f7,
+	0x00b5d, 0x00cc3, 0x00e27, 0x00f8a, 0x010eb, 0x0124b, 0x013aa, 0x01508,
+	0x01664, 0x017bf, 0x01919, 0x01a71, 0x01bc8, 0x01d1e, 0x01e73, 0x01fc6,
+	0x02119, 0x0226a, 0x023ba, 0x02508, 0x02656, 0x027a2, 0x028ed, 0x02a37,
+	0x02b80, 0x02cc8, 0x02e0f, 0x02f54, 0x03098, 0x031dc, 0x0331e, 0x0345f,
+	0x0359f, 0x036de, 0x0381b, 0x03958, 0x03a94, 0x03bce, 0x03d08, 0x03e41,
+	0x03f78, 0x040af, 0x041e4, 0x04319, 0x0444c, 0x0457f, 0x046b0, 0x047e1,
+	0x04910, 0x04a3f, 0x04b6c, 0x04c99, 0x04dc5, 0x04eef, 0x05019, 0x05142,
+	0x0526a, 0x05391, 0x054b7, 0x055dc, 0x05700, 0x05824, 0x05946, 0x05a68,
+	0x05b89, 0x05ca8, 0x05dc7, 0x05ee5, 0x06003, 0x0611f, 0x0623a, 0x06355,
+	0x0646f, 0x06588, 0x066a0, 0x067b7, 0x068ce, 0x069e4, 0x06af8, 0x06c0c,
+	0x06d20, 0x06e32, 0x06f44, 0x07055, 0x07165, 0x07274, 0x07383, 0x07490,
+	0x0759d, 0x076aa, 0x077b5, 0x078c0, 0x079ca, 0x07ad3, 0x07bdb, 0x07ce3,
+	0x07dea, 0x07ef0, 0x07ff6, 0x080fb, 0x081ff, 0x08302, 0x08405, 0x08507,
+	0x08608, 0x08709, 0x08809, 0x08908, 0x08a06, 0x08b04, 0x08c01, 0x08cfe,
+	0x08dfa, 0x08ef5, 0x08fef, 0x090e9, 0x091e2, 0x092db, 0x093d2, 0x094ca,
+	0x095c0, 0x096b6, 0x097ab, 0x098a0, 0x09994, 0x09a87, 0x09b7a, 0x09c6c,
+	0x09d5e, 0x09e4f, 0x09f3f, 0x0a02e, 0x0a11e, 0x0a20c, 0x0a2fa, 0x0a3e7,
+	0x0a4d4, 0x0a5c0, 0x0a6ab, 0x0a796, 0x0a881, 0x0a96a, 0x0aa53, 0x0ab3c,
+	0x0ac24, 0x0ad0c, 0x0adf2, 0x0aed9, 0x0afbe, 0x0b0a4, 0x0b188, 0x0b26c,
+	0x0b350, 0x0b433, 0x0b515, 0x0b5f7, 0x0b6d9, 0x0b7ba, 0x0b89a, 0x0b97a,
+	0x0ba59, 0x0bb38, 0x0bc16, 0x0bcf4, 0x0bdd1, 0x0bead, 0x0bf8a, 0x0c065,
+	0x0c140, 0x0c21b, 0x0c2f5, 0x0c3cf, 0x0c4a8, 0x0c580, 0x0c658, 0x0c730,
+	0x0c807, 0x0c8de, 0x0c9b4, 0x0ca8a, 0x0cb5f, 0x0cc34, 0x0cd08, 0x0cddc,
+	0x0ceaf, 0x0cf82, 0x0d054, 0x0d126, 0x0d1f7, 0x0d2c8, 0x0d399, 0x0d469,
+	0x0d538, 0x0d607, 0x0d6d6, 0x0d7a4, 0x0d872, 0x0d93f, 0x0da0c, 0x0dad9,
+	0x0dba5, 0x0dc70, 0x0dd3b, 0x0de06, 0x0ded0, 0x0df9a, 0x0e063, 0x0e12c,
+	0x0e1f5, 0x0e2bd, 0x0e385, 0x0e44c, 0x0e513, 0x0e5d9, 0x0e69f, 0x0e765,
+	0x0e82a, 0x0e8ef, 0x0e9b3, 0x0ea77, 0x0eb3b, 0x0ebfe, 0x0ecc1, 0x0ed83,
+	0x0ee45, 0x0ef06, 0x0efc8, 0x0f088, 0x0f149, 0x0f209, 0x0f2c8, 0x0f387,
+	0x0f446, 0x0f505, 0x0f5c3, 0x0f680, 0x0f73e, 0x0f7fb, 0x0f8b7, 0x0f973,
+	0x0fa2f, 0x0faea, 0x0fba5, 0x0fc60, 0x0fd1a, 0x0fdd4, 0x0fe8e, 0x0ff47,
+	0x10000,
+};
+
+/*
+ * log2(@u) for @u in [1, 0x10000], in 16.16 fixed point: the msb
+ * gives the integer part, and the table, interpolated, the rest.
+ */
+static __u32 crush_log2(__u32 u)
+{
+	__u32 e = 0;
+	__u32 m, k, f;
+
+	while ((u >> e) > 1)
+		e++;
+	m = u << (16 - e);		/* 1.16, in [1, 2) */
+	k = (m >> 8) & 0xff;
+	f = m & 0xff;
+	return (e << 16) + crush_log2_tbl[k] +
+		(((crush_log2_tbl[k + 1] - crush_log2_tbl[k]) * f) >> 8);
+}
+
+/*
+ * a node's entry in the race: log(u) / weight for u uniform in (0, 1]
+ * is largest for each node with probability proportional to its
+ * weight.
+ */
+static __s64 straw_tree_draw(__u32 hash, __u32 weight)
+{
+	__s64 ln;
+
+	if (weight == 0)
+		return S64_MIN;
+	ln = (__s64)crush_log2((hash & 0xffff) + 1) - 0x100000;	/* <= 0 */
+	return div64_s64(ln * (1LL << 24), weight);
+}
+
+static int bucket_straw_tree_choose(struct crush_bucket_straw_tree *bucket,
+				    int x, int r)
+{
+	__u32 start[CRUSH_STRAW_TREE_MAX_LEVELS];
+	__u32 count[CRUSH_STRAW_TREE_MAX_LEVELS];
+	int l = crush_calc_straw_tree_levels(bucket->h.size, bucket->fanout,
+					     start, count) - 1;
+	__u32 lo = 0, hi;
+	__u32 i, j, n;
+	__u32 high = 0;
+	__s64 high_draw = 0;
+	__s64 draw;
+	__u32 hash[CRUSH_HASH_BATCH];
+
+	if (l < 0)
+		return bucket->h.items[0];
+	hi = count[l];
+
+	for (;;) {
+		for (i = lo; i < hi; i += n) {
+			n = hi - i;
+			if (n > CRUSH_HASH_BATCH)
+				n = CRUSH_HASH_BATCH;
+			if (l == 0)
+				crush_hash32_3_many(bucket->h.hash, x,
+					(const __u32 *)bucket->h.items + i, r,
+					hash, n);
+			else
+				for (j = 0; j < n; j++)
+					hash[j] = crush_hash32_4(bucket->h.hash,
+						x, bucket->h.id,
+						(l << 24) | (i + j), r);
+			for (j = 0; j < n; j++) {
+				draw = straw_tree_draw(hash[j],
+					bucket->node_weights[start[l] + i + j]);
+				if (i + j == lo || draw > high_draw) {
+					high = i + j;
+					high_draw = draw;
+				}
+			}
+		}
+		if (l == 0)
+			return bucket->h.items[high];
+
+		/* descend into the winning group */
+		l--;
+		lo = high * bucket->fanout;
+		hi = lo + bucket->fanout;
+		if (hi > count[l])
+			hi = count[l];
+	}
+}
+
 static int crush_bucket_choose(struct crush_bucket *in, int x, int r)
 {
 	dprintk(" crush_bucket_choose %d x=%d r=%d\n", in->id, x, r);
@@ -252,6 +392,9 @@ static int crush_bucket_choose(struct crush_bucket *in, int x, int r)
 	case CRUSH_BUCKET_STRAW:
 		return bucket_straw_choose((struct crush_bucket_straw *)in,
 					   x, r);
+	case CRUSH_BUCKET_STRAW_TREE:
+		return bucket_straw_tree_choose(
+			(struct crush_bucket_straw_tree *)in, x, r);
 	default:
 		BUG_ON(1);
 		return in->items[0];
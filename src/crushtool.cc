@@ -22,6 +22,9 @@
 #include "common/debug.h"
 #include "common/errno.h"
 #include "common/config.h"
+#include "common/Clock.h"
+#include "common/Formatter.h"
+#include "common/Thread.h"
 
 #include "common/ceph_argparse.h"
 #include "global/global_context.h"
@@ -146,6 +149,8 @@ void parse_bucket(iter_t const& i, CrushWrapper &crush)
 	alg = CRUSH_BUCKET_TREE;
       else if (a == "straw")
 	alg = CRUSH_BUCKET_STRAW;
+      else if (a == "straw_tree")
+	alg = CRUSH_BUCKET_STRAW_TREE;
       else {
 	cerr << "unknown bucket alg '" << a << "'" << std::endl << std::endl;
 	usage();
@@ -579,6 +584,9 @@ static int decompile_crush_bucket_impl(int i,
     out << "\t# do not change pos for existing items unnecessarily";
     dopos = true;
     break;
+  case CRUSH_BUCKET_STRAW_TREE:
+    out << "\t# add new items at the end; do not change order unnecessarily";
+    break;
   }
   out << "\n";
 
@@ -768,6 +776,312 @@ int decompile_crush(CrushWrapper &crush, ostream &out)
 }
 
 
+/*
+ * Simulation: apply a list of edits to a copy of the map, map the
+ * same inputs (pgs) through both, and report how much moves and how
+ * evenly the data is spread before and after.
+ */
+
+// maps inputs first, first + step, ... with a private copy of the map,
+// since crush_do_rule caches permutations in the buckets
+class SimWorker : public Thread {
+public:
+  bufferlist crushbl;   // our own copy; shares the encoded buffers
+  int rule, num_rep, min_x;
+  const vector<__u32>& weight;
+  vector< vector<int> >& out;
+  unsigned first, step;
+
+  SimWorker(const bufferlist& c, int r, int n, int x, const vector<__u32>& w,
+	    vector< vector<int> >& o, unsigned f, unsigned s)
+    : crushbl(c), rule(r), num_rep(n), min_x(x), weight(w), out(o),
+      first(f), step(s) {}
+
+  void *entry() {
+    CrushWrapper crush;
+    bufferlist::iterator p = crushbl.begin();
+    crush.decode(p);
+    for (unsigned i = first; i < out.size(); i += step)
+      crush.do_rule(rule, min_x + i, out[i], num_rep, -1, weight);
+    return 0;
+  }
+};
+
+static void sim_map(CrushWrapper& crush, int rule, int num_rep, int min_x,
+		    const vector<__u32>& weight, vector< vector<int> >& out,
+		    int threads)
+{
+  bufferlist bl;
+  crush.encode(bl);
+  vector<SimWorker*> workers;
+  for (int i = 0; i < threads; i++) {
+    SimWorker *w = new SimWorker(bl, rule, num_rep, min_x, weight, out, i, threads);
+    w->create();
+    workers.push_back(w);
+  }
+  for (vector<SimWorker*>::iterator w = workers.begin(); w != workers.end(); ++w) {
+    (*w)->join();
+    delete *w;
+  }
+}
+
+/*
+ * Apply one line of an edit list:
+ *
+ *   add <id> <weight> <name> <type>=<bucket> [...]
+ *   remove <name>
+ *   reweight <name> <weight>
+ *   weight <id> <0.0-1.0>        (in/out weight, like --weight)
+ */
+static int sim_edit(CrushWrapper& crush, vector<__u32>& weight, const string& line,
+		    ostream& err)
+{
+  istringstream is(line);
+  string op;
+  is >> op;
+  if (op == "add") {
+    int id;
+    float w;
+    string name;
+    is >> id >> w >> name;
+    map<string,string> loc;
+    string l;
+    while (is >> l) {
+      size_t eq = l.find('=');
+      if (eq == string::npos) {
+	err << "bad location '" << l << "'";
+	return -EINVAL;
+      }
+      loc[l.substr(0, eq)] = l.substr(eq + 1);
+    }
+    if (!is.eof() || name.empty() || id < 0) {
+      err << "usage: add <id> <weight> <name> <type>=<bucket> ...";
+      return -EINVAL;
+    }
+    int r = crush.insert_item(g_ceph_context, id, w, name, loc);
+    if (r < 0)
+      return r;
+    if ((int)weight.size() <= id)
+      weight.resize(id + 1, 0x10000);
+    return 0;
+  }
+  if (op == "remove" || op == "reweight") {
+    string name;
+    float w = 0;
+    is >> name;
+    if (op == "reweight")
+      is >> w;
+    if (is.fail()) {
+      err << "usage: remove <name> | reweight <name> <weight>";
+      return -EINVAL;
+    }
+    if (!crush.name_exists(name.c_str()))
+      return -ENOENT;
+    int item = crush.get_item_id(name.c_str());
+    if (op == "remove")
+      return crush.remove_item(g_ceph_context, item);
+    return crush.adjust_item_weightf(g_ceph_context, item, w);
+  }
+  if (op == "weight") {
+    int id;
+    float w;
+    is >> id >> w;
+    if (is.fail() || id < 0) {
+      err << "usage: weight <id> <0.0-1.0>";
+      return -EINVAL;
+    }
+    if ((int)weight.size() <= id)
+      weight.resize(id + 1, 0x10000);
+    weight[id] = (__u32)(MAX(0.0, MIN(1.0, w)) * 0x10000);
+    return 0;
+  }
+  err << "unknown edit '" << op << "'";
+  return -EINVAL;
+}
+
+// each device's share of the data: its crush weight, scaled by its in/out weight
+static void sim_capacity(CrushWrapper& crush, const vector<__u32>& weight,
+			 vector<double>& cap)
+{
+  cap.assign(crush.get_max_devices(), 0);
+  for (int b = -1; b >= -crush.get_max_buckets(); b--) {
+    if (!crush.bucket_exists(b))
+      continue;
+    for (int j = 0; j < crush.get_bucket_size(b); j++) {
+      int item = crush.get_bucket_item(b, j);
+      if (item >= 0 && item < (int)cap.size())
+	cap[item] += (double)crush.get_bucket_item_weight(b, j) / 0x10000;
+    }
+  }
+  for (unsigned d = 0; d < cap.size(); d++)
+    cap[d] *= d < weight.size() ? (double)weight[d] / 0x10000 : 1.0;
+}
+
+// utilization is a device's bytes over its fair share; 1.0 is perfect
+static void sim_dump_utilization(Formatter *f, const char *name,
+				 const vector<double>& cap,
+				 const vector<uint64_t>& bytes)
+{
+  double total_cap = 0, total_bytes = 0;
+  for (unsigned d = 0; d < cap.size(); d++) {
+    total_cap += cap[d];
+    total_bytes += d < bytes.size() ? bytes[d] : 0;
+  }
+  unsigned n = 0;
+  double sum = 0, sumsq = 0, min = 0, max = 0;
+  for (unsigned d = 0; d < cap.size(); d++) {
+    if (cap[d] <= 0 || total_bytes == 0)
+      continue;
+    double u = (double)(d < bytes.size() ? bytes[d] : 0) /
+      (total_bytes * cap[d] / total_cap);
+    if (n == 0 || u < min)
+      min = u;
+    if (n == 0 || u > max)
+      max = u;
+    sum += u;
+    sumsq += u * u;
+    n++;
+  }
+  double mean = n ? sum / n : 0;
+  double var = n ? sumsq / n - mean * mean : 0;
+  f->open_object_section(name);
+  f->dump_unsigned("devices", n);
+  f->dump_float("utilization_mean", mean);
+  f->dump_float("utilization_variance", var);
+  f->dump_float("utilization_stddev", sqrt(MAX(var, 0.0)));
+  f->dump_float("utilization_min", min);
+  f->dump_float("utilization_max", max);
+  f->close_section();
+}
+
+static int simulate(CrushWrapper& crush, const string& editfn,
+		    const vector<__u32>& weight, const vector<uint64_t>& pg_sizes,
+		    uint64_t pg_bytes, int min_x, int max_x, int min_rule,
+		    int max_rule, int num_rep, int threads, bool verbose)
+{
+  ifstream in(editfn.c_str());
+  if (!in.is_open()) {
+    cerr << "error reading '" << editfn << "'" << std::endl;
+    return -ENOENT;
+  }
+
+  // the edited copy
+  CrushWrapper after;
+  {
+    bufferlist bl;
+    crush.encode(bl);
+    bufferlist::iterator p = bl.begin();
+    after.decode(p);
+  }
+  vector<__u32> after_weight = weight;
+
+  JSONFormatter jf(true);
+  Formatter *f = &jf;
+  f->open_object_section("simulation");
+  f->open_array_section("edits");
+  string line;
+  int lineno = 0;
+  while (getline(in, line)) {
+    lineno++;
+    size_t hash = line.find('#');
+    if (hash != string::npos)
+      line.resize(hash);
+    size_t end = line.find_last_not_of(" \t");
+    if (end == string::npos)
+      continue;
+    line.resize(end + 1);
+    ostringstream err;
+    int r = sim_edit(after, after_weight, line, err);
+    if (r < 0) {
+      cerr << editfn << ":" << lineno << ": " << line << ": "
+	   << (err.str().empty() ? cpp_strerror(r) : err.str()) << std::endl;
+      return r;
+    }
+    f->dump_string("edit", line);
+  }
+  f->close_section();
+  after.finalize();
+  after_weight.resize(after.get_max_devices(), 0x10000);
+
+  vector<double> cap_before, cap_after;
+  sim_capacity(crush, weight, cap_before);
+  sim_capacity(after, after_weight, cap_after);
+
+  f->dump_int("threads", threads);
+  f->open_array_section("rules");
+  for (int r = min_rule; r < crush.get_max_rules() && r <= max_rule; r++) {
+    if (!crush.rule_exists(r) || r >= after.get_max_rules() || !after.rule_exists(r))
+      continue;
+
+    unsigned n = max_x - min_x + 1;
+    vector< vector<int> > before_out(n), after_out(n);
+    utime_t start = ceph_clock_now(g_ceph_context);
+    sim_map(crush, r, num_rep, min_x, weight, before_out, threads);
+    sim_map(after, r, num_rep, min_x, after_weight, after_out, threads);
+    utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+
+    unsigned changed = 0;
+    uint64_t replicas = 0, replicas_moved = 0, bytes = 0, bytes_moved = 0;
+    vector<uint64_t> before_bytes(cap_before.size()), after_bytes(cap_after.size());
+    for (unsigned i = 0; i < n; i++) {
+      uint64_t b = i < pg_sizes.size() ? pg_sizes[i] : pg_bytes;
+      set<int> was(before_out[i].begin(), before_out[i].end());
+      bool moved = false;
+      for (unsigned j = 0; j < after_out[i].size(); j++) {
+	int d = after_out[i][j];
+	if (!was.count(d)) {
+	  replicas_moved++;
+	  bytes_moved += b;
+	  moved = true;
+	}
+	after_bytes[d] += b;
+      }
+      for (unsigned j = 0; j < before_out[i].size(); j++)
+	before_bytes[before_out[i][j]] += b;
+      if (moved || before_out[i].size() != after_out[i].size())
+	changed++;
+      replicas += after_out[i].size();
+      bytes += b * after_out[i].size();
+    }
+
+    f->open_object_section("rule");
+    f->dump_int("rule", r);
+    f->dump_string("name", crush.get_rule_name(r));
+    f->dump_unsigned("pgs", n);
+    f->dump_unsigned("pgs_changed", changed);
+    f->dump_float("pgs_changed_fraction", (double)changed / n);
+    f->dump_unsigned("replicas", replicas);
+    f->dump_unsigned("replicas_moved", replicas_moved);
+    f->dump_float("replicas_moved_fraction", replicas ? (double)replicas_moved / replicas : 0);
+    f->dump_unsigned("bytes", bytes);
+    f->dump_unsigned("bytes_moved", bytes_moved);
+    f->dump_float("bytes_moved_fraction", bytes ? (double)bytes_moved / bytes : 0);
+    f->dump_float("mapping_time", (double)elapsed);
+    sim_dump_utilization(f, "before", cap_before, before_bytes);
+    sim_dump_utilization(f, "after", cap_after, after_bytes);
+    if (verbose) {
+      f->open_array_section("devices");
+      for (unsigned d = 0; d < MAX(cap_before.size(), cap_after.size()); d++) {
+	f->open_object_section("device");
+	f->dump_int("id", d);
+	f->dump_float("capacity_before", d < cap_before.size() ? cap_before[d] : 0);
+	f->dump_float("capacity_after", d < cap_after.size() ? cap_after[d] : 0);
+	f->dump_unsigned("bytes_before", d < before_bytes.size() ? before_bytes[d] : 0);
+	f->dump_unsigned("bytes_after", d < after_bytes.size() ? after_bytes[d] : 0);
+	f->close_section();
+      }
+      f->close_section();
+    }
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+  f->flush(cout);
+  cout << std::endl;
+  return 0;
+}
+
+
 void usage()
 {
   cout << "usage: crushtool ...\n";
@@ -777,13 +1091,25 @@ void usage()
   cout << "                         specify output for for (de)compilation\n";
   cout << "   --build --num_osds N layer1 ...\n";
   cout << "                         build a new map, where each 'layer' is\n";
-  cout << "                           'name (uniform|straw|list|tree) size'\n";
+  cout << "                           'name (uniform|straw|straw_tree|list|tree) size'\n";
   cout << "   -i mapfn --test       test a range of inputs on the map\n";
   cout << "      [--min-x x] [--max-x x] [--x x]\n";
   cout << "      [--min-rule r] [--max-rule r] [--rule r]\n";
   cout << "      [--num-rep n]\n";
   cout << "      [--weight|-w devno weight]\n";
   cout << "                         where weight is 0 to 1.0\n";
+  cout << "      [--compare mapfn]\n";
+  cout << "                         also map each input with another map, and\n";
+  cout << "                         report how much data moves and the time\n";
+  cout << "                         each map takes\n";
+  cout << "   -i mapfn --simulate edits\n";
+  cout << "      [--min-x x] [--max-x x] [--min-rule r] [--max-rule r] [--rule r]\n";
+  cout << "      [--num-rep n] [--weight|-w devno weight] [--threads n]\n";
+  cout << "      [--pg-bytes bytes] [--pg-sizes file]\n";
+  cout << "                         apply the edits in the given file to a copy\n";
+  cout << "                         of the map, map inputs (pgs) through both, and\n";
+  cout << "                         report data movement and device utilization\n";
+  cout << "                         as JSON\n";
   cout << "   -i mapfn --add-item id weight name [--loc type name ...]\n";
   cout << "                         insert an item into the hierarchy at the\n";
   cout << "                         given location\n";
@@ -803,6 +1129,7 @@ struct bucket_types_t {
   { "uniform", CRUSH_BUCKET_UNIFORM },
   { "list", CRUSH_BUCKET_LIST },
   { "straw", CRUSH_BUCKET_STRAW },
+  { "straw_tree", CRUSH_BUCKET_STRAW_TREE },
   { "tree", CRUSH_BUCKET_TREE },
   { 0, 0 },
 };
@@ -820,6 +1147,9 @@ int main(int argc, const char **argv)
 
   const char *me = argv[0];
   std::string infn, srcfn, outfn, add_name, remove_name, reweight_name;
+  std::string comparefn, simulatefn, pgsizesfn;
+  uint64_t pg_bytes = 1;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
   bool compile = false;
   bool decompile = false;
   bool test = false;
@@ -865,6 +1195,19 @@ int main(int argc, const char **argv)
       compile = true;
     } else if (ceph_argparse_flag(args, i, "-t", "--test", (char*)NULL)) {
       test = true;
+    } else if (ceph_argparse_witharg(args, i, &val, "--compare", (char*)NULL)) {
+      comparefn = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--simulate", (char*)NULL)) {
+      simulatefn = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pg-sizes", (char*)NULL)) {
+      pgsizesfn = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pg-bytes", (char*)NULL)) {
+      pg_bytes = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_withint(args, i, &threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
     } else if (ceph_argparse_flag(args, i, "--reweight", (char*)NULL)) {
       reweight = true;
     } else if (ceph_argparse_withint(args, i, &add_item, &err, "--add_item", (char*)NULL)) {
@@ -970,7 +1313,7 @@ int main(int argc, const char **argv)
     usage();
   }
   if (!compile && !decompile && !build && !test && !reweight && add_item < 0 &&
-      remove_name.empty() && reweight_name.empty()) {
+      remove_name.empty() && reweight_name.empty() && simulatefn.empty()) {
     usage();
   }
   if ((!build) && (args.size() > 0)) {
@@ -1213,6 +1556,19 @@ int main(int argc, const char **argv)
   }
 
   if (test) {
+    CrushWrapper cmp;
+    if (!comparefn.empty()) {
+      bufferlist bl;
+      std::string error;
+      int r = bl.read_file(comparefn.c_str(), &error);
+      if (r < 0) {
+	cerr << me << ": error reading '" << comparefn << "': "
+	     << error << std::endl;
+	exit(1);
+      }
+      bufferlist::iterator p = bl.begin();
+      cmp.decode(p);
+    }
 
     // all osds in
     vector<__u32> weight;
@@ -1231,9 +1587,13 @@ int main(int argc, const char **argv)
       cout << "rule " << r << " (" << crush.get_rule_name(r) << "), x = " << min_x << ".." << max_x << std::endl;
       vector<int> per(crush.get_max_devices());
       map<int,int> sizes;
+      vector< vector<int> > outs(max_x - min_x + 1);
+      utime_t start = ceph_clock_now(g_ceph_context);
+      for (int x = min_x; x <= max_x; x++)
+	crush.do_rule(r, x, outs[x - min_x], num_rep, force, weight);
+      utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
       for (int x = min_x; x <= max_x; x++) {
-	vector<int> out;
-	crush.do_rule(r, x, out, num_rep, force, weight);
+	vector<int>& out = outs[x - min_x];
 	if (verbose)
 	  cout << "rule " << r << " x " << x << " " << out << std::endl;
 	for (unsigned i = 0; i < out.size(); i++)
@@ -1244,8 +1604,79 @@ int main(int argc, const char **argv)
 	cout << " device " << i << ":\t" << per[i] << std::endl;
       for (map<int,int>::iterator p = sizes.begin(); p != sizes.end(); p++)
 	cout << " result size " << p->first << "x:\t" << p->second << std::endl;
+
+      if (comparefn.empty())
+	continue;
+      if (r >= cmp.get_max_rules() || !cmp.rule_exists(r)) {
+	cout << " rule " << r << " dne in " << comparefn << std::endl;
+	continue;
+      }
+
+      // devices for the comparison map's weights are all in, too
+      vector<__u32> cmp_weight(cmp.get_max_devices(), 0x10000);
+      for (map<int,int>::iterator p = device_weight.begin(); p != device_weight.end(); ++p)
+	if (p->first < (int)cmp_weight.size())
+	  cmp_weight[p->first] = p->second;
+
+      vector< vector<int> > cmp_outs(outs.size());
+      start = ceph_clock_now(g_ceph_context);
+      for (int x = min_x; x <= max_x; x++)
+	cmp.do_rule(r, x, cmp_outs[x - min_x], num_rep, force, cmp_weight);
+      utime_t cmp_elapsed = ceph_clock_now(g_ceph_context) - start;
+
+      // a replica moves if its device is not in the other result at all
+      unsigned total = 0, moved = 0, changed = 0;
+      for (unsigned i = 0; i < outs.size(); i++) {
+	set<int> before(cmp_outs[i].begin(), cmp_outs[i].end());
+	for (unsigned j = 0; j < outs[i].size(); j++)
+	  if (!before.count(outs[i][j]))
+	    moved++;
+	total += outs[i].size();
+	if (outs[i] != cmp_outs[i]) {
+	  changed++;
+	  if (verbose)
+	    cout << "rule " << r << " x " << (min_x + i) << " " << cmp_outs[i]
+		 << " -> " << outs[i] << std::endl;
+	}
+      }
+      cout << " mapping time " << (double)elapsed * 1000000.0 / outs.size()
+	   << " us/x, " << (double)cmp_elapsed * 1000000.0 / outs.size()
+	   << " us/x for " << comparefn << std::endl;
+      cout << " compare changed " << changed << "/" << outs.size() << " inputs, moved "
+	   << moved << "/" << total << " replicas ("
+	   << (total ? (double)moved * 100.0 / total : 0.0) << "%)" << std::endl;
     }
   }
 
+
+  if (!simulatefn.empty()) {
+    vector<__u32> weight(crush.get_max_devices(), 0x10000);
+    for (map<int,int>::iterator p = device_weight.begin(); p != device_weight.end(); ++p)
+      if (p->first < (int)weight.size())
+	weight[p->first] = p->second;
+
+    // one size per line, for inputs min_x, min_x + 1, ...
+    vector<uint64_t> pg_sizes;
+    if (!pgsizesfn.empty()) {
+      ifstream in(pgsizesfn.c_str());
+      if (!in.is_open()) {
+	cerr << me << ": error reading '" << pgsizesfn << "'" << std::endl;
+	exit(1);
+      }
+      uint64_t size;
+      while (in >> size)
+	pg_sizes.push_back(size);
+    }
+
+    if (max_x < min_x) {
+      cerr << me << ": empty input range" << std::endl;
+      exit(1);
+    }
+    int r = simulate(crush, simulatefn, weight, pg_sizes, pg_bytes,
+		     min_x, max_x, min_rule, max_rule, num_rep,
+		     MAX(threads, 1), verbose);
+    if (r < 0)
+      exit(1);
+  }
   return 0;
 }
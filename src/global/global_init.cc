@@ -20,6 +20,7 @@
 #include "common/config.h"
 #include "common/debug.h"
 #include "common/errno.h"
+#include "common/lockprof.h"
 #include "common/safe_io.h"
 #include "common/signal.h"
 #include "common/version.h"
@@ -105,6 +106,12 @@ void global_init(std::vector < const char* >& args,
 	 << ") ***" << TEXT_NORMAL << std::endl;
     lockdep_register_ceph_context(cct);
   }
+  if (!g_lockprof && conf->lockprof)
+    g_lockprof = conf->lockprof_sample_rate;
+  if (g_lockprof) {
+    cout << TEXT_YELLOW << "*** lock profiling is enabled (1 in " << g_lockprof
+	 << ") ***" << TEXT_NORMAL << std::endl;
+  }
   register_assert_context(cct);
 }
 
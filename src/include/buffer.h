@@ -197,6 +197,7 @@ public:
     unsigned wasted();
 
     int cmp(const ptr& o);
+    bool is_zero() const;
 
     // modifiers
     void set_offset(unsigned o) { _off = o; }
@@ -355,6 +356,7 @@ public:
     void zero(unsigned o, unsigned l);
 
     bool is_contiguous();
+    bool is_zero() const;
     void rebuild();
     void rebuild_page_aligned();
 
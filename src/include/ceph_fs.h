@@ -51,6 +51,7 @@
 #define CEPH_FEATURE_PGID64         (1<<9)
 #define CEPH_FEATURE_INCSUBOSDMAP   (1<<10)
 #define CEPH_FEATURE_PGPOOL3        (1<<11)
+#define CEPH_FEATURE_PGSTATDELTA    (1<<12)
 
 /*
  * ceph_file_layout - describe data layout for a file/inode
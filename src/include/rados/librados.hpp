@@ -96,6 +96,28 @@ namespace librados
     AioCompletionImpl *pc;
   };
 
+  /*
+   * AioObjectList : asynchronous object listing
+   * Each next() fetches the following chunk of the pool's object names
+   * (and locator keys) into *entries and signals the completion with the
+   * number of entries fetched; 0 means the listing is done.  Only one
+   * next() may be outstanding at a time, and the list must outlive it.
+   */
+  class AioObjectList {
+  public:
+    ~AioObjectList();
+    int next(AioCompletion *c,
+	     std::list<std::pair<std::string, std::string> > *entries,
+	     int max_entries = 0);
+    bool at_end() const;
+  private:
+    AioObjectList(ObjListCtx *ctx_);
+    AioObjectList(const AioObjectList& rhs);
+    AioObjectList& operator=(const AioObjectList& rhs);
+    ObjListCtx *ctx;
+    friend class IoCtx;
+  };
+
   struct PoolAsyncCompletion {
     PoolAsyncCompletion(PoolAsyncCompletionImpl *pc_) : pc(pc_) {}
     int set_callback(void *cb_arg, callback_t cb);
@@ -304,11 +326,45 @@ namespace librados
     int aio_exec(const std::string& oid, AioCompletion *c, const char *cls, const char *method,
 	         bufferlist& inbl, bufferlist *outbl);
 
+    /*
+     * Asynchronous versions of the metadata operations above.  Output
+     * arguments are filled in before the completion fires and must stay
+     * valid until then.  The return values match the synchronous calls.
+     */
+    int aio_stat(const std::string& oid, AioCompletion *c, uint64_t *psize, time_t *pmtime);
+    int aio_remove(const std::string& oid, AioCompletion *c);
+    int aio_trunc(const std::string& oid, AioCompletion *c, uint64_t size);
+    int aio_getxattr(const std::string& oid, AioCompletion *c, const char *name,
+		     bufferlist *pbl);
+    int aio_getxattrs(const std::string& oid, AioCompletion *c,
+		      std::map<std::string, bufferlist> *pattrset);
+    int aio_setxattr(const std::string& oid, AioCompletion *c, const char *name,
+		     bufferlist& bl);
+    int aio_rmxattr(const std::string& oid, AioCompletion *c, const char *name);
+    int aio_tmap_update(const std::string& oid, AioCompletion *c, bufferlist& cmdbl);
+    int aio_tmap_put(const std::string& oid, AioCompletion *c, bufferlist& bl);
+    int aio_tmap_get(const std::string& oid, AioCompletion *c, bufferlist *pbl);
+
+    /// start an asynchronous listing of this pool; delete it when done
+    AioObjectList *aio_objects_list_open();
+
     // compound object operations
     int operate(const std::string& oid, ObjectWriteOperation *op);
     int operate(const std::string& oid, ObjectReadOperation *op, bufferlist *pbl);
     int aio_operate(const std::string& oid, AioCompletion *c, ObjectOperation *op);
 
+    /**
+     * Apply ops[i] to oids[i] for every i, with a single completion for
+     * the whole batch.  The completion is signalled once every op has
+     * been acked (and again once every op is safe); its return value is
+     * the first error seen, or 0.  If prvals is not NULL, (*prvals)[i]
+     * receives the result of ops[i]; it must stay valid until the
+     * completion is safe.
+     */
+    int aio_operate_batch(const std::vector<std::string>& oids,
+			  std::vector<ObjectWriteOperation*>& ops,
+			  AioCompletion *c, std::vector<int> *prvals);
+
     // watch/notify
     int watch(const std::string& o, uint64_t ver, uint64_t *handle,
 	      librados::WatchCtx *ctx);
@@ -67,6 +67,8 @@ void rbd_version(int *major, int *minor, int *extra);
 /* images */
 int rbd_list(rados_ioctx_t io, char *names, size_t *size);
 int rbd_create(rados_ioctx_t io, const char *name, uint64_t size, int *order);
+int rbd_clone(rados_ioctx_t io, const char *p_name, const char *p_snapname,
+	      const char *c_name, int *c_order);
 int rbd_remove(rados_ioctx_t io, const char *name);
 int rbd_remove_with_progress(rados_ioctx_t io, const char *name,
 			     librbd_progress_fn_t cb, void *cbdata);
@@ -25,11 +25,19 @@
  *   foo.00000000
  *   foo.00000001
  *   ...          - data
+ *   rb.x.y.map   - object map, if RBD_FLAG_OBJECT_MAP is set
+ *
+ * A clone's header has an rbd.parent xattr naming the parent image and
+ * snapshot.  rbd_children lists "<parent>@<snap>/<clone>" for every
+ * clone in the pool.
  */
 
 #define RBD_SUFFIX	 	".rbd"
 #define RBD_DIRECTORY           "rbd_directory"
 #define RBD_INFO                "rbd_info"
+#define RBD_OBJECT_MAP_SUFFIX   ".map"
+#define RBD_CHILDREN            "rbd_children"
+#define RBD_PARENT_ATTR         "rbd.parent"
 
 #define RBD_DEFAULT_OBJ_ORDER	22   /* 4MB */
 
@@ -39,6 +47,20 @@
 #define RBD_COMP_NONE		0
 #define RBD_CRYPT_NONE		0
 
+/*
+ * options.flags
+ *
+ * RBD_FLAG_OBJECT_MAP: the <block_name>.map object holds one byte per
+ * block, set before the block is first written.  A zero byte means the
+ * block object does not exist at the head or in any snapshot.
+ *
+ * RBD_FLAG_LAYERED: the image is a copy-on-write clone.  Blocks it has
+ * not written yet are read from the parent.  Always set together with
+ * RBD_FLAG_OBJECT_MAP.
+ */
+#define RBD_FLAG_OBJECT_MAP	1
+#define RBD_FLAG_LAYERED	2
+
 #define RBD_HEADER_TEXT		"<<< Rados Block Device Image >>>\n"
 #define RBD_HEADER_SIGNATURE	"RBD"
 #define RBD_HEADER_VERSION	"001.005"
@@ -61,7 +83,7 @@ struct rbd_obj_header_ondisk {
 		__u8 order;
 		__u8 crypt_type;
 		__u8 comp_type;
-		__u8 unused;
+		__u8 flags;
 	} __attribute__((packed)) options;
 	__le64 image_size;
 	__le64 snap_seq;
@@ -626,6 +626,9 @@ public:
   int operate(IoCtxImpl& io, const object_t& oid, ::ObjectOperation *o, time_t *pmtime);
   int operate_read(IoCtxImpl& io, const object_t& oid, ::ObjectOperation *o, bufferlist *pbl);
   int aio_operate(IoCtxImpl& io, const object_t& oid, ::ObjectOperation *o, AioCompletionImpl *c);
+  int aio_operate_batch(IoCtxImpl& io, const vector<object_t>& oids,
+			vector< ::ObjectOperation*>& ops, AioCompletionImpl *c,
+			vector<int> *prvals);
 
   struct C_aio_Ack : public Context {
     AioCompletionImpl *c;
@@ -719,6 +722,18 @@ public:
     }
   };
 
+  // one op of a batch: record its result, then check in with the gather
+  struct C_aio_BatchOp : public Context {
+    int *prval;
+    Context *sub;
+    void finish(int r) {
+      if (prval)
+	*prval = r;
+      sub->complete(r);
+    }
+    C_aio_BatchOp(int *p, Context *s) : prval(p), sub(s) {}
+  };
+
   int aio_read(IoCtxImpl& io, const object_t oid, AioCompletionImpl *c,
 			  bufferlist *pbl, size_t len, uint64_t off);
   int aio_read(IoCtxImpl& io, object_t oid, AioCompletionImpl *c,
@@ -734,6 +749,74 @@ public:
 		     const bufferlist& bl);
   int aio_exec(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
                const char *cls, const char *method, bufferlist& inbl, bufferlist *outbl);
+  int aio_stat(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+	       uint64_t *psize, time_t *pmtime);
+  int aio_remove(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c);
+  int aio_trunc(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c, uint64_t size);
+  int aio_getxattr(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+		   const char *name, bufferlist *pbl);
+  int aio_getxattrs(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+		    map<string, bufferlist> *pattrset);
+  int aio_setxattr(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+		   const char *name, bufferlist& bl);
+  int aio_rmxattr(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+		  const char *name);
+  int aio_tmap_update(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+		      bufferlist& cmdbl);
+  int aio_tmap_put(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+		   bufferlist& bl);
+  int aio_tmap_get(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+		   bufferlist *pbl);
+  int aio_list(Objecter::ListContext *context, int max_entries, AioCompletionImpl *c,
+	       std::list<pair<string, string> > *entries);
+
+  // convert the stat mtime for the caller, then complete
+  struct C_aio_stat_Ack : public Context {
+    Context *fin;
+    utime_t mtime;
+    time_t *pmtime;
+    void finish(int r) {
+      if (r >= 0 && pmtime)
+	*pmtime = mtime.sec();
+      fin->complete(r);
+    }
+    C_aio_stat_Ack(AioCompletionImpl *c, time_t *pm)
+      : fin(new C_aio_Ack(c)), pmtime(pm) {}
+  };
+
+  // like the synchronous getxattr, return the value length
+  struct C_aio_getxattr_Ack : public Context {
+    Context *fin;
+    bufferlist *pbl;
+    void finish(int r) {
+      if (r >= 0)
+	r = pbl->length();
+      fin->complete(r);
+    }
+    C_aio_getxattr_Ack(AioCompletionImpl *c, bufferlist *b)
+      : fin(new C_aio_Ack(c)), pbl(b) {}
+  };
+
+  // hand the chunk the objecter gathered to the caller
+  struct C_aio_list_Ack : public Context {
+    Objecter::ListContext *lc;
+    std::list<pair<string, string> > *entries;
+    Context *fin;
+    void finish(int r) {
+      if (r >= 0) {
+	r = lc->list.size();
+	for (std::list<pair<object_t, string> >::iterator p = lc->list.begin();
+	     p != lc->list.end();
+	     ++p)
+	  entries->push_back(make_pair(p->first.name, p->second));
+      }
+      lc->list.clear();
+      fin->complete(r);
+    }
+    C_aio_list_Ack(Objecter::ListContext *l, std::list<pair<string, string> > *e,
+		   AioCompletionImpl *c)
+      : lc(l), entries(e), fin(new C_aio_Ack(c)) {}
+  };
 
   struct C_PoolAsync_Safe : public Context {
     PoolAsyncCompletionImpl *c;
@@ -1024,6 +1107,12 @@ librados::RadosClient::~RadosClient()
 
 bool librados::RadosClient::ms_dispatch(Message *m)
 {
+  // op replies are handled under the objecter's own locks
+  if (m->get_type() == CEPH_MSG_OSD_OPREPLY) {
+    objecter->handle_osd_op_reply((MOSDOpReply*)m);
+    return true;
+  }
+
   lock.Lock();
   bool ret = _dispatch(m);
   lock.Unlock();
@@ -1054,9 +1143,6 @@ bool librados::RadosClient::_dispatch(Message *m)
 {
   switch (m->get_type()) {
   // OSD
-  case CEPH_MSG_OSD_OPREPLY:
-    objecter->handle_osd_op_reply((class MOSDOpReply*)m);
-    break;
   case CEPH_MSG_OSD_MAP:
     objecter->handle_osd_map((MOSDMap*)m);
     cond.Signal();
@@ -1441,9 +1527,7 @@ int librados::RadosClient::list(Objecter::ListContext *context, int max_entries)
 
   context->max_entries = max_entries;
 
-  lock.Lock();
   objecter->list_objects(context, new C_SafeCond(&mylock, &cond, &done, &r));
-  lock.Unlock();
 
   mylock.Lock();
   while(!done)
@@ -1453,6 +1537,25 @@ int librados::RadosClient::list(Objecter::ListContext *context, int max_entries)
   return r;
 }
 
+int librados::RadosClient::aio_list(Objecter::ListContext *context, int max_entries,
+				    AioCompletionImpl *c,
+				    std::list<pair<string, string> > *entries)
+{
+  Context *onack = new C_aio_list_Ack(context, entries, c);
+
+  context->list.clear();
+  if (context->at_end) {
+    onack->complete(0);
+    return 0;
+  }
+
+  context->max_entries = max_entries;
+
+  objecter->list_objects(context, onack);
+
+  return 0;
+}
+
 int librados::RadosClient::create(IoCtxImpl& io, const object_t& oid, bool exclusive)
 {
   utime_t ut = ceph_clock_now(cct);
@@ -1469,11 +1572,9 @@ int librados::RadosClient::create(IoCtxImpl& io, const object_t& oid, bool exclu
 
   Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
 
-  lock.Lock();
   objecter->create(oid, io.oloc,
 		  io.snapc, ut, 0, (exclusive ? CEPH_OSD_OP_FLAG_EXCL : 0),
 		  onack, NULL, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1505,9 +1606,7 @@ int librados::RadosClient::create(IoCtxImpl& io, const object_t& oid, bool exclu
   ::ObjectOperation o;
   o.create(exclusive ? CEPH_OSD_OP_FLAG_EXCL : 0, category);
 
-  lock.Lock();
   objecter->mutate(oid, io.oloc, o, io.snapc, ut, 0, onack, NULL, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1567,11 +1666,9 @@ int librados::RadosClient::write(IoCtxImpl& io, const object_t& oid, bufferlist&
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
   
-  lock.Lock();
   objecter->write(oid, io.oloc,
 		  off, len, io.snapc, bl, ut, 0,
 		  onack, NULL, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1605,11 +1702,9 @@ int librados::RadosClient::append(IoCtxImpl& io, const object_t& oid, bufferlist
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->append(oid, io.oloc,
 		  len, io.snapc, bl, ut, 0,
 		  onack, NULL, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1644,11 +1739,9 @@ int librados::RadosClient::write_full(IoCtxImpl& io, const object_t& oid, buffer
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->write_full(oid, io.oloc,
 		  io.snapc, bl, ut, 0,
 		  onack, NULL, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1680,12 +1773,10 @@ int librados::RadosClient::clone_range(IoCtxImpl& io,
 
   bufferlist outbl;
 
-  lock.Lock();
   ::ObjectOperation wr;
   prepare_assert_ops(&io, &wr);
   wr.clone_range(src_oid, src_offset, len, dst_offset);
   objecter->mutate(dst_oid, io.oloc, wr, io.snapc, ut, 0, onack, NULL, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1722,11 +1813,9 @@ int librados::RadosClient::operate(IoCtxImpl& io, const object_t& oid,
 
   Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
 
-  lock.Lock();
   objecter->mutate(oid, io.oloc,
 	           *o, io.snapc, ut, 0,
 	           onack, NULL, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1752,11 +1841,9 @@ int librados::RadosClient::operate_read(IoCtxImpl& io, const object_t& oid,
 
   Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
 
-  lock.Lock();
   objecter->read(oid, io.oloc,
 	           *o, io.snap_seq, pbl, 0,
 	           onack, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1781,12 +1868,46 @@ int librados::RadosClient::aio_operate(IoCtxImpl& io, const object_t& oid,
 
   io.queue_aio_write(c);
 
-  Mutex::Locker l(lock);
   objecter->mutate(oid, io.oloc, *o, io.snapc, ut, 0, onack, oncommit, &c->objver);
 
   return 0;
 }
 
+int librados::RadosClient::aio_operate_batch(IoCtxImpl& io, const vector<object_t>& oids,
+					     vector< ::ObjectOperation*>& ops,
+					     AioCompletionImpl *c, vector<int> *prvals)
+{
+  utime_t ut = ceph_clock_now(cct);
+  /* can't write to a snapshot */
+  if (io.snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+  if (oids.empty() || oids.size() != ops.size())
+    return -EINVAL;
+
+  if (prvals)
+    prvals->assign(oids.size(), 0);
+
+  // the gathers own c's ack/safe contexts; activating them before any
+  // op is submitted means they can only fire from the objecter.
+  C_GatherBuilder ack(cct, new C_aio_Ack(c));
+  C_GatherBuilder safe(cct, new C_aio_Safe(c));
+  vector<Objecter::Op*> batch(oids.size());
+  for (unsigned i = 0; i < oids.size(); i++) {
+    Context *onack = new C_aio_BatchOp(prvals ? &(*prvals)[i] : NULL, ack.new_sub());
+    Context *oncommit = safe.new_sub();
+    batch[i] = objecter->prepare_mutate_op(oids[i], io.oloc, *ops[i], io.snapc, ut, 0,
+					   onack, oncommit);
+  }
+  ack.activate();
+  safe.activate();
+
+  io.queue_aio_write(c);
+
+  objecter->op_submit_batch(batch);
+
+  return 0;
+}
+
 int librados::RadosClient::aio_read(IoCtxImpl& io, const object_t oid, AioCompletionImpl *c,
 				    bufferlist *pbl, size_t len, uint64_t off)
 {
@@ -1796,7 +1917,6 @@ int librados::RadosClient::aio_read(IoCtxImpl& io, const object_t oid, AioComple
 
   c->pbl = pbl;
 
-  Mutex::Locker l(lock);
   objecter->read(oid, io.oloc,
 		 off, len, io.snap_seq, &c->bl, 0,
 		 onack, &c->objver);
@@ -1811,7 +1931,6 @@ int librados::RadosClient::aio_read(IoCtxImpl& io, const object_t oid, AioComple
   c->buf = buf;
   c->maxlen = len;
 
-  Mutex::Locker l(lock);
   objecter->read(oid, io.oloc,
 		 off, len, io.snap_seq, &c->bl, 0,
 		 onack, &c->objver);
@@ -1831,7 +1950,6 @@ int librados::RadosClient::aio_sparse_read(IoCtxImpl& io, const object_t oid,
 
   c->pbl = NULL;
 
-  Mutex::Locker l(lock);
   objecter->sparse_read(oid, io.oloc,
 		 off, len, io.snap_seq, &c->bl, 0,
 		 onack);
@@ -1852,7 +1970,6 @@ int librados::RadosClient::aio_write(IoCtxImpl& io, const object_t &oid, AioComp
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(lock);
   objecter->write(oid, io.oloc,
 		  off, len, io.snapc, bl, ut, 0,
 		  onack, onsafe, &c->objver);
@@ -1874,7 +1991,6 @@ int librados::RadosClient::aio_append(IoCtxImpl& io, const object_t &oid, AioCom
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(lock);
   objecter->append(oid, io.oloc,
 		  len, io.snapc, bl, ut, 0,
 		  onack, onsafe, &c->objver);
@@ -1896,7 +2012,6 @@ int librados::RadosClient::aio_write_full(IoCtxImpl& io, const object_t &oid,
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(lock);
   objecter->write_full(oid, io.oloc,
 		  io.snapc, bl, ut, 0,
 		  onack, onsafe, &c->objver);
@@ -1922,11 +2037,9 @@ int librados::RadosClient::remove(IoCtxImpl& io, const object_t& oid)
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->remove(oid, io.oloc,
 		  io.snapc, ut, 0,
 		  onack, NULL, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1957,12 +2070,10 @@ int librados::RadosClient::trunc(IoCtxImpl& io, const object_t& oid, uint64_t si
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->trunc(oid, io.oloc,
 		  io.snapc, ut, 0,
 		  size, 0,
 		  onack, NULL, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1991,12 +2102,10 @@ int librados::RadosClient::tmap_update(IoCtxImpl& io, const object_t& oid, buffe
 
   bufferlist outbl;
 
-  lock.Lock();
   ::ObjectOperation wr;
   prepare_assert_ops(&io, &wr);
   wr.tmap_update(cmdbl);
   objecter->mutate(oid, io.oloc, wr, io.snapc, ut, 0, onack, NULL, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2025,12 +2134,10 @@ int librados::RadosClient::tmap_put(IoCtxImpl& io, const object_t& oid, bufferli
 
   bufferlist outbl;
 
-  lock.Lock();
   ::ObjectOperation wr;
   prepare_assert_ops(&io, &wr);
   wr.tmap_put(bl);
   objecter->mutate(oid, io.oloc, wr, io.snapc, ut, 0, onack, NULL, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2057,12 +2164,10 @@ int librados::RadosClient::tmap_get(IoCtxImpl& io, const object_t& oid, bufferli
 
   bufferlist outbl;
 
-  lock.Lock();
   ::ObjectOperation rd;
   prepare_assert_ops(&io, &rd);
   rd.tmap_get();
   objecter->read(oid, io.oloc, rd, io.snap_seq, &bl, 0, onack, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2087,12 +2192,10 @@ int librados::RadosClient::exec(IoCtxImpl& io, const object_t& oid,
   eversion_t ver;
 
 
-  lock.Lock();
   ::ObjectOperation rd;
   prepare_assert_ops(&io, &rd);
   rd.call(cls, method, inbl);
   objecter->read(oid, io.oloc, rd, io.snap_seq, &outbl, 0, onack, &ver);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2110,7 +2213,6 @@ int librados::RadosClient::aio_exec(IoCtxImpl& io, const object_t& oid, AioCompl
 {
   Context *onack = new C_aio_Ack(c);
 
-  Mutex::Locker l(lock);
   ::ObjectOperation rd;
   prepare_assert_ops(&io, &rd);
   rd.call(cls, method, inbl);
@@ -2119,6 +2221,199 @@ int librados::RadosClient::aio_exec(IoCtxImpl& io, const object_t& oid, AioCompl
   return 0;
 }
 
+int librados::RadosClient::aio_stat(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+				    uint64_t *psize, time_t *pmtime)
+{
+  C_aio_stat_Ack *onack = new C_aio_stat_Ack(c, pmtime);
+
+  ::ObjectOperation op;
+  ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
+  objecter->stat(oid, io.oloc,
+		 io.snap_seq, psize, &onack->mtime, 0,
+		 onack, &c->objver, pop);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_remove(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c)
+{
+  utime_t ut = ceph_clock_now(cct);
+
+  /* can't write to a snapshot */
+  if (io.snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  io.queue_aio_write(c);
+
+  Context *onack = new C_aio_Ack(c);
+  Context *onsafe = new C_aio_Safe(c);
+
+  ::ObjectOperation op;
+  ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
+  objecter->remove(oid, io.oloc,
+		   io.snapc, ut, 0,
+		   onack, onsafe, &c->objver, pop);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_trunc(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+				     uint64_t size)
+{
+  utime_t ut = ceph_clock_now(cct);
+
+  /* can't write to a snapshot */
+  if (io.snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  io.queue_aio_write(c);
+
+  Context *onack = new C_aio_Ack(c);
+  Context *onsafe = new C_aio_Safe(c);
+
+  ::ObjectOperation op;
+  ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
+  objecter->trunc(oid, io.oloc,
+		  io.snapc, ut, 0,
+		  size, 0,
+		  onack, onsafe, &c->objver, pop);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_getxattr(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+					const char *name, bufferlist *pbl)
+{
+  Context *onack = new C_aio_getxattr_Ack(c, pbl);
+
+  ::ObjectOperation op;
+  ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
+  objecter->getxattr(oid, io.oloc,
+		     name, io.snap_seq, pbl, 0,
+		     onack, &c->objver, pop);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_getxattrs(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+					 map<string, bufferlist> *pattrset)
+{
+  Context *onack = new C_aio_Ack(c);
+
+  pattrset->clear();
+
+  ::ObjectOperation op;
+  ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
+  objecter->getxattrs(oid, io.oloc, io.snap_seq,
+		      *pattrset,
+		      0, onack, &c->objver, pop);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_setxattr(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+					const char *name, bufferlist& bl)
+{
+  utime_t ut = ceph_clock_now(cct);
+
+  /* can't write to a snapshot */
+  if (io.snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  io.queue_aio_write(c);
+
+  Context *onack = new C_aio_Ack(c);
+  Context *onsafe = new C_aio_Safe(c);
+
+  ::ObjectOperation op;
+  ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
+  objecter->setxattr(oid, io.oloc, name,
+		     io.snapc, bl, ut, 0,
+		     onack, onsafe, &c->objver, pop);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_rmxattr(IoCtxImpl& io, const object_t& oid, AioCompletionImpl *c,
+				       const char *name)
+{
+  utime_t ut = ceph_clock_now(cct);
+
+  /* can't write to a snapshot */
+  if (io.snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  io.queue_aio_write(c);
+
+  Context *onack = new C_aio_Ack(c);
+  Context *onsafe = new C_aio_Safe(c);
+
+  ::ObjectOperation op;
+  ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
+  objecter->removexattr(oid, io.oloc, name,
+			io.snapc, ut, 0,
+			onack, onsafe, &c->objver, pop);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_tmap_update(IoCtxImpl& io, const object_t& oid,
+					   AioCompletionImpl *c, bufferlist& cmdbl)
+{
+  utime_t ut = ceph_clock_now(cct);
+
+  /* can't write to a snapshot */
+  if (io.snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  io.queue_aio_write(c);
+
+  Context *onack = new C_aio_Ack(c);
+  Context *onsafe = new C_aio_Safe(c);
+
+  ::ObjectOperation wr;
+  prepare_assert_ops(&io, &wr);
+  wr.tmap_update(cmdbl);
+  objecter->mutate(oid, io.oloc, wr, io.snapc, ut, 0, onack, onsafe, &c->objver);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_tmap_put(IoCtxImpl& io, const object_t& oid,
+					AioCompletionImpl *c, bufferlist& bl)
+{
+  utime_t ut = ceph_clock_now(cct);
+
+  /* can't write to a snapshot */
+  if (io.snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  io.queue_aio_write(c);
+
+  Context *onack = new C_aio_Ack(c);
+  Context *onsafe = new C_aio_Safe(c);
+
+  ::ObjectOperation wr;
+  prepare_assert_ops(&io, &wr);
+  wr.tmap_put(bl);
+  objecter->mutate(oid, io.oloc, wr, io.snapc, ut, 0, onack, onsafe, &c->objver);
+
+  return 0;
+}
+
+int librados::RadosClient::aio_tmap_get(IoCtxImpl& io, const object_t& oid,
+					AioCompletionImpl *c, bufferlist *pbl)
+{
+  Context *onack = new C_aio_Ack(c);
+
+  ::ObjectOperation rd;
+  prepare_assert_ops(&io, &rd);
+  rd.tmap_get();
+  objecter->read(oid, io.oloc, rd, io.snap_seq, pbl, 0, onack, &c->objver);
+
+  return 0;
+}
+
 int librados::RadosClient::read(IoCtxImpl& io, const object_t& oid,
 				bufferlist& bl, size_t len, uint64_t off)
 {
@@ -2133,11 +2428,9 @@ int librados::RadosClient::read(IoCtxImpl& io, const object_t& oid,
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->read(oid, io.oloc,
 	      off, len, io.snap_seq, &bl, 0,
               onack, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2170,11 +2463,9 @@ int librados::RadosClient::mapext(IoCtxImpl& io, const object_t& oid,
   int r;
   Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
 
-  lock.Lock();
   objecter->mapext(oid, io.oloc,
 	      off, len, io.snap_seq, &bl, 0,
               onack);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2204,11 +2495,9 @@ int librados::RadosClient::sparse_read(IoCtxImpl& io, const object_t& oid,
   int r;
   Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
 
-  lock.Lock();
   objecter->sparse_read(oid, io.oloc,
 	      off, len, io.snap_seq, &bl, 0,
               onack);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2244,11 +2533,9 @@ int librados::RadosClient::stat(IoCtxImpl& io, const object_t& oid, uint64_t *ps
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->stat(oid, io.oloc,
 	      io.snap_seq, psize, &mtime, 0,
               onack, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2279,11 +2566,9 @@ int librados::RadosClient::getxattr(IoCtxImpl& io, const object_t& oid,
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->getxattr(oid, io.oloc,
 	      name, io.snap_seq, &bl, 0,
               onack, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2318,11 +2603,9 @@ int librados::RadosClient::rmxattr(IoCtxImpl& io, const object_t& oid, const cha
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->removexattr(oid, io.oloc, name,
 		  io.snapc, ut, 0,
 		  onack, NULL, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2357,11 +2640,9 @@ int librados::RadosClient::setxattr(IoCtxImpl& io, const object_t& oid,
   ::ObjectOperation op;
   ::ObjectOperation *pop = prepare_assert_ops(&io, &op);
 
-  lock.Lock();
   objecter->setxattr(oid, io.oloc, name,
 		  io.snapc, bl, ut, 0,
 		  onack, NULL, &ver, pop);
-  lock.Unlock();
 
   mylock.Lock();
   while (!done)
@@ -2391,12 +2672,10 @@ int librados::RadosClient::getxattrs(IoCtxImpl& io, const object_t& oid,
 
   Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
 
-  lock.Lock();
   map<string, bufferlist> aset;
   objecter->getxattrs(oid, io.oloc, io.snap_seq,
 		      aset,
 		      0, onack, &ver, pop);
-  lock.Unlock();
 
   attrset.clear();
 
@@ -2627,6 +2906,31 @@ void librados::ObjectIterator::get_next()
 
 const librados::ObjectIterator librados::ObjectIterator::__EndObjectIterator(NULL);
 
+///////////////////////////// AioObjectList //////////////////////////////
+librados::AioObjectList::AioObjectList(ObjListCtx *ctx_)
+  : ctx(ctx_)
+{
+}
+
+librados::AioObjectList::~AioObjectList()
+{
+  delete ctx;
+}
+
+int librados::AioObjectList::next(AioCompletion *c,
+				  std::list<std::pair<std::string, std::string> > *entries,
+				  int max_entries)
+{
+  if (max_entries <= 0)
+    max_entries = RADOS_LIST_MAX_ENTRIES;
+  return ctx->ctx->client->aio_list(ctx->lc, max_entries, c->pc, entries);
+}
+
+bool librados::AioObjectList::at_end() const
+{
+  return ctx->lc->at_end;
+}
+
 ///////////////////////////// PoolAsyncCompletion //////////////////////////////
 int librados::PoolAsyncCompletion::PoolAsyncCompletion::set_callback(void *cb_arg,
 								     rados_callback_t cb)
@@ -2927,6 +3231,17 @@ int librados::IoCtx::aio_operate(const std::string& oid, AioCompletion *c, libra
   return io_ctx_impl->client->aio_operate(*io_ctx_impl, obj, (::ObjectOperation*)o->impl, c->pc);
 }
 
+int librados::IoCtx::aio_operate_batch(const std::vector<std::string>& oids,
+				       std::vector<ObjectWriteOperation*>& ops,
+				       AioCompletion *c, std::vector<int> *prvals)
+{
+  vector<object_t> objs(oids.begin(), oids.end());
+  vector< ::ObjectOperation*> o(ops.size());
+  for (unsigned i = 0; i < ops.size(); i++)
+    o[i] = (::ObjectOperation*)ops[i]->impl;
+  return io_ctx_impl->client->aio_operate_batch(*io_ctx_impl, objs, o, c->pc, prvals);
+}
+
 
 void librados::IoCtx::snap_set_read(snap_t seq)
 {
@@ -3028,6 +3343,82 @@ int librados::IoCtx::aio_exec(const std::string& oid, librados::AioCompletion *c
   return io_ctx_impl->client->aio_exec(*io_ctx_impl, obj, c->pc, cls, method, inbl, outbl);
 }
 
+int librados::IoCtx::aio_stat(const std::string& oid, librados::AioCompletion *c,
+			      uint64_t *psize, time_t *pmtime)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_stat(*io_ctx_impl, obj, c->pc, psize, pmtime);
+}
+
+int librados::IoCtx::aio_remove(const std::string& oid, librados::AioCompletion *c)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_remove(*io_ctx_impl, obj, c->pc);
+}
+
+int librados::IoCtx::aio_trunc(const std::string& oid, librados::AioCompletion *c,
+			       uint64_t size)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_trunc(*io_ctx_impl, obj, c->pc, size);
+}
+
+int librados::IoCtx::aio_getxattr(const std::string& oid, librados::AioCompletion *c,
+				  const char *name, bufferlist *pbl)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_getxattr(*io_ctx_impl, obj, c->pc, name, pbl);
+}
+
+int librados::IoCtx::aio_getxattrs(const std::string& oid, librados::AioCompletion *c,
+				   std::map<std::string, bufferlist> *pattrset)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_getxattrs(*io_ctx_impl, obj, c->pc, pattrset);
+}
+
+int librados::IoCtx::aio_setxattr(const std::string& oid, librados::AioCompletion *c,
+				  const char *name, bufferlist& bl)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_setxattr(*io_ctx_impl, obj, c->pc, name, bl);
+}
+
+int librados::IoCtx::aio_rmxattr(const std::string& oid, librados::AioCompletion *c,
+				 const char *name)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_rmxattr(*io_ctx_impl, obj, c->pc, name);
+}
+
+int librados::IoCtx::aio_tmap_update(const std::string& oid, librados::AioCompletion *c,
+				     bufferlist& cmdbl)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_tmap_update(*io_ctx_impl, obj, c->pc, cmdbl);
+}
+
+int librados::IoCtx::aio_tmap_put(const std::string& oid, librados::AioCompletion *c,
+				  bufferlist& bl)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_tmap_put(*io_ctx_impl, obj, c->pc, bl);
+}
+
+int librados::IoCtx::aio_tmap_get(const std::string& oid, librados::AioCompletion *c,
+				  bufferlist *pbl)
+{
+  object_t obj(oid);
+  return io_ctx_impl->client->aio_tmap_get(*io_ctx_impl, obj, c->pc, pbl);
+}
+
+librados::AioObjectList *librados::IoCtx::aio_objects_list_open()
+{
+  rados_list_ctx_t listh;
+  rados_objects_list_open(io_ctx_impl, &listh);
+  return new AioObjectList((ObjListCtx*)listh);
+}
+
 int librados::IoCtx::aio_sparse_read(const std::string& oid, librados::AioCompletion *c,
 				     std::map<uint64_t,uint64_t> *m, bufferlist *data_bl,
 				     size_t len, uint64_t off)
@@ -13,9 +13,13 @@
  */
 
 #include "common/Cond.h"
+#include "common/Finisher.h"
+#include "common/Readahead.h"
 #include "common/dout.h"
 #include "common/errno.h"
 #include "include/rbd/librbd.hpp"
+#include "osdc/ObjectCacher.h"
+#include "osdc/WritebackHandler.h"
 
 #include <errno.h>
 #include <inttypes.h>
@@ -35,6 +39,7 @@ namespace librbd {
   void rados_cb(rados_completion_t cb, void *arg);
   void rados_buffered_cb(rados_completion_t cb, void *arg);
   void rados_aio_sparse_read_cb(rados_completion_t cb, void *arg);
+  void rados_writeback_cb(rados_completion_t cb, void *arg);
 
   class WatchCtx;
 
@@ -44,7 +49,38 @@ namespace librbd {
     SnapInfo(snap_t _id, uint64_t _size) : id(_id), size(_size) {};
   };
 
+  /*
+   * What a clone was cloned from, kept in the rbd.parent xattr of its
+   * header.  overlap is how much of the parent the clone still sees;
+   * it only ever shrinks.
+   */
+  struct ParentSpec {
+    std::string name, snapname;
+    snap_t snapid;
+    uint64_t overlap;
+
+    ParentSpec() : snapid(CEPH_NOSNAP), overlap(0) {}
+
+    void encode(bufferlist& bl) const {
+      __u8 struct_v = 1;
+      ::encode(struct_v, bl);
+      ::encode(name, bl);
+      ::encode(snapname, bl);
+      ::encode(snapid, bl);
+      ::encode(overlap, bl);
+    }
+    void decode(bufferlist::iterator& p) {
+      __u8 struct_v;
+      ::decode(struct_v, p);
+      ::decode(name, p);
+      ::decode(snapname, p);
+      ::decode(snapid, p);
+      ::decode(overlap, p);
+    }
+  };
+
   struct AioCompletion;
+  struct ImageCtx;
 
   struct AioBlockCompletion {
     CephContext *cct;
@@ -54,16 +90,16 @@ namespace librbd {
     char *buf;
     map<uint64_t,uint64_t> m;
     bufferlist data_bl;
+    ImageCtx *clone;     // reads of a clone fall through to its parent
+    uint64_t image_ofs;
 
     AioBlockCompletion(CephContext *cct_, AioCompletion *aio_completion,
 		       uint64_t _ofs, size_t _len, char *_buf)
       : cct(cct_), completion(aio_completion),
-	ofs(_ofs), len(_len), buf(_buf) {}
+	ofs(_ofs), len(_len), buf(_buf), clone(NULL), image_ofs(0) {}
     void complete(ssize_t r);
   };
 
-  struct ImageCtx;
-
   struct AioBufferedCompletion {
     ImageCtx *ictx;
     AioBlockCompletion *block_completion;
@@ -74,6 +110,41 @@ namespace librbd {
       : ictx(i), block_completion(bc), len(l) {}
   };
 
+  /*
+   * ObjectCacher backend for an image.  librados calls back with its
+   * client lock held, so completions are bounced through a finisher
+   * thread, which takes the cache lock before handing them to the
+   * ObjectCacher.
+   */
+  class LibrbdWriteback : public WritebackHandler {
+  public:
+    LibrbdWriteback(ImageCtx *ictx, IoCtx& data_ctx, Mutex& lock);
+    virtual ~LibrbdWriteback();
+
+    virtual tid_t read(const object_t& oid, const object_locator_t& oloc,
+		       uint64_t off, uint64_t len, snapid_t snapid,
+		       bufferlist *pbl, uint64_t trunc_size, __u32 trunc_seq,
+		       Context *onfinish);
+    virtual tid_t write(const object_t& oid, const object_locator_t& oloc,
+			uint64_t off, uint64_t len, const SnapContext& snapc,
+			const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
+			__u32 trunc_seq, Context *oncommit);
+
+    // wait for all outstanding reads and writes; cache lock held
+    void drain();
+    void finish_request(Context *ctx, int r);
+
+    Finisher finisher;
+    ImageCtx *ictx;
+
+  private:
+    tid_t m_tid;
+    uint64_t m_inflight;
+    Mutex& m_lock;
+    Cond m_cond;
+    IoCtx& m_ioctx;
+  };
+
   struct ImageCtx {
     CephContext *cct;
     struct rbd_obj_header_ondisk header;
@@ -94,6 +165,31 @@ namespace librbd {
     uint64_t tx_unsafe_bytes, tx_pending_bytes, tx_window;
     int tx_rval;
 
+    // optional writeback cache (rbd_cache)
+    Mutex cache_lock; // protects the ObjectCacher and readahead state
+    ObjectCacher *object_cacher;
+    LibrbdWriteback *writeback_handler;
+    ObjectCacher::ObjectSet *object_set;
+    Readahead readahead;
+
+    // object map (RBD_FLAG_OBJECT_MAP): one byte per block, nonzero if
+    // the block object may exist.  object_map_lock is a leaf lock and is
+    // never held across a librados call.
+    Mutex object_map_lock;
+    bool object_map_enabled;
+    vector<uint8_t> object_map;
+    vector<bool> copied;  // clone blocks known to be copied up
+
+    // layering (RBD_FLAG_LAYERED): the parent image, open at the
+    // snapshot we were cloned from.  Blocks we have not written are
+    // read from it, up to parent_overlap bytes; past that they are
+    // zero.
+    ImageCtx *parent;
+    std::string parent_name, parent_snapname;
+    uint64_t parent_overlap;   // protected by lock
+    Finisher *parent_finisher; // issues parent reads for aio reads that miss
+    Mutex copyup_lock;         // serializes copyups
+
     ImageCtx(std::string imgname, IoCtx& p)
       : cct(p.cct()), snapid(CEPH_NOSNAP),
 	name(imgname),
@@ -101,14 +197,72 @@ namespace librbd {
 	refresh_lock("librbd::ImageCtx::refresh_lock"),
 	lock("librbd::ImageCtx::lock"),
 	tx_next(tx_queue.end()),
-	tx_unsafe_bytes(0), tx_pending_bytes(0), tx_window(0), tx_rval(0)
+	tx_unsafe_bytes(0), tx_pending_bytes(0), tx_window(0), tx_rval(0),
+	cache_lock("librbd::ImageCtx::cache_lock"),
+	object_cacher(NULL), writeback_handler(NULL), object_set(NULL),
+	object_map_lock("librbd::ImageCtx::object_map_lock"),
+	object_map_enabled(false),
+	parent(NULL), parent_overlap(0), parent_finisher(NULL),
+	copyup_lock("librbd::ImageCtx::copyup_lock")
     {
       md_ctx.dup(p);
       data_ctx.dup(p);
+
+      if (cct->_conf->rbd_cache) {
+	writeback_handler = new LibrbdWriteback(this, data_ctx, cache_lock);
+	object_cacher = new ObjectCacher(cct, *writeback_handler, cache_lock,
+					 NULL, NULL,
+					 cct->_conf->rbd_cache_size,
+					 cct->_conf->rbd_cache_max_dirty,
+					 cct->_conf->rbd_cache_target_dirty,
+					 cct->_conf->rbd_cache_max_dirty_age);
+	object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(), 0);
+	readahead.set_window(cct->_conf->rbd_cache_readahead_min,
+			     cct->_conf->rbd_cache_readahead_max);
+	object_cacher->start();
+      }
     }
 
     ~ImageCtx() {
       assert(tx_queue.empty());
+      if (object_cacher) {
+	object_cacher->stop();
+	cache_lock.Lock();
+	flush_cache();
+	writeback_handler->drain();
+	object_cacher->release_set(object_set);
+	cache_lock.Unlock();
+	delete object_cacher;
+	delete writeback_handler;
+	delete object_set;
+      }
+      delete parent_finisher;
+    }
+
+    // write back everything dirty and wait for it to commit; cache
+    // lock held, and ObjectCacher completes the flush under it
+    void flush_cache() {
+      assert(cache_lock.is_locked());
+      Cond cond;
+      bool done = false;
+      if (!object_cacher->flush_set(object_set, new C_Cond(&cond, &done))) {
+	while (!done)
+	  cond.Wait(cache_lock);
+      }
+    }
+
+    // drop everything we have cached, writing back dirty data first.
+    // used whenever the image header or the snapshot we read from changes.
+    void invalidate_cache() {
+      if (!object_cacher)
+	return;
+      cache_lock.Lock();
+      flush_cache();
+      writeback_handler->drain();
+      loff_t unclean = object_cacher->release_set(object_set);
+      assert(!unclean);
+      readahead.reset();
+      cache_lock.Unlock();
     }
 
     int snap_set(std::string snap_name)
@@ -338,6 +492,10 @@ namespace librbd {
   int snap_set(ImageCtx *ictx, const char *snap_name);
   int list(IoCtx& io_ctx, std::vector<string>& names);
   int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order);
+  int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order,
+	     uint8_t flags, const ParentSpec *parent);
+  int clone(IoCtx& io_ctx, const char *p_name, const char *p_snapname,
+	    const char *c_name, int *c_order);
   int rename(IoCtx& io_ctx, const char *srcname, const char *dstname);
   int info(ImageCtx *ictx, image_info_t& info, size_t image_size);
   int remove(IoCtx& io_ctx, const char *imgname, ProgressContext& prog_ctx);
@@ -371,12 +529,31 @@ namespace librbd {
   int rollback_image(ImageCtx *ictx, uint64_t snapid, ProgressContext& prog_ctx);
   void image_info(const ImageCtx& ictx, image_info_t& info, size_t info_size);
   string get_block_oid(const rbd_obj_header_ondisk &header, uint64_t num);
+  string get_object_map_oid(const rbd_obj_header_ondisk &header);
+  int object_map_load(ImageCtx *ictx);
+  bool object_may_exist(ImageCtx *ictx, uint64_t block);
+  void object_map_set(ImageCtx *ictx, uint64_t block);
+  int object_map_mark(ImageCtx *ictx, uint64_t block);
+  uint64_t get_block_num_from_oid(const string& oid);
+  int read_parent_spec(IoCtx& io_ctx, const string& md_oid, ParentSpec *spec);
+  int write_parent_spec(IoCtx& io_ctx, const string& md_oid, const ParentSpec& spec);
+  int children_update(IoCtx& io_ctx, __u8 op, const string& key);
+  int children_list(IoCtx& io_ctx, const string& prefix, vector<string>& keys);
+  int open_parent(ImageCtx *ictx);
+  ssize_t read_parent(ImageCtx *ictx, uint64_t off, size_t len, char *buf);
+  void aio_read_parent(ImageCtx *ictx, AioBlockCompletion *block_completion);
+  int copyup_block(ImageCtx *ictx, uint64_t block);
   uint64_t get_max_block(uint64_t size, int obj_order);
   uint64_t get_max_block(const rbd_obj_header_ondisk &header);
   uint64_t get_block_size(const rbd_obj_header_ondisk &header);
   uint64_t get_block_num(const rbd_obj_header_ondisk &header, uint64_t ofs);
   uint64_t get_block_ofs(const rbd_obj_header_ondisk &header, uint64_t ofs);
   int check_io(ImageCtx *ictx, uint64_t off, uint64_t len);
+  void image_to_extents(ImageCtx *ictx, uint64_t off, uint64_t len,
+			vector<ObjectExtent>& extents);
+  void cache_read(ImageCtx *ictx, uint64_t off, size_t len, bufferlist *pbl,
+		  Context *onfinish);
+  int cache_write(ImageCtx *ictx, uint64_t off, size_t len, bufferlist& bl);
   int init_rbd_info(struct rbd_info *info);
   void init_rbd_header(struct rbd_obj_header_ondisk& ondisk,
 			      uint64_t size, int *order, uint64_t bid);
@@ -411,6 +588,115 @@ namespace librbd {
     return c;
   }
 
+struct C_WritebackRequest : public Context {
+  LibrbdWriteback *wb;
+  Context *ctx;
+  C_WritebackRequest(LibrbdWriteback *w, Context *c) : wb(w), ctx(c) {}
+  void finish(int r) {
+    wb->finish_request(ctx, r);
+  }
+};
+
+/*
+ * A cached read of a clone that finds nothing there has to look in the
+ * parent.  That is a synchronous read, which is fine here: we run in
+ * the finisher without any locks held.
+ */
+struct C_WritebackRead : public C_WritebackRequest {
+  string oid;
+  uint64_t off, len;
+  bufferlist *pbl;
+  C_WritebackRead(LibrbdWriteback *w, Context *c, const string& o,
+		  uint64_t of, uint64_t l, bufferlist *p)
+    : C_WritebackRequest(w, c), oid(o), off(of), len(l), pbl(p) {}
+  void finish(int r) {
+    ImageCtx *ictx = wb->ictx;
+    if (r == -ENOENT && ictx->parent) {
+      ictx->lock.Lock();
+      uint64_t image_ofs = get_block_num_from_oid(oid) * get_block_size(ictx->header) + off;
+      ictx->lock.Unlock();
+      bufferptr bp(len);
+      r = read_parent(ictx, image_ofs, len, bp.c_str());
+      if (r >= 0) {
+	pbl->clear();
+	pbl->push_back(bp);
+      }
+    }
+    wb->finish_request(ctx, r);
+  }
+};
+
+void rados_writeback_cb(rados_completion_t c, void *arg)
+{
+  C_WritebackRequest *req = (C_WritebackRequest *)arg;
+  req->wb->finisher.queue(req, rados_aio_get_return_value(c));
+}
+
+LibrbdWriteback::LibrbdWriteback(ImageCtx *i, IoCtx& data_ctx, Mutex& lock)
+  : finisher(data_ctx.cct()), ictx(i), m_tid(0), m_inflight(0), m_lock(lock),
+    m_ioctx(data_ctx)
+{
+  finisher.start();
+}
+
+LibrbdWriteback::~LibrbdWriteback()
+{
+  assert(!m_inflight);
+  finisher.stop();
+}
+
+tid_t LibrbdWriteback::read(const object_t& oid, const object_locator_t& oloc,
+			    uint64_t off, uint64_t len, snapid_t snapid,
+			    bufferlist *pbl, uint64_t trunc_size, __u32 trunc_seq,
+			    Context *onfinish)
+{
+  // the snapid to read from is already set on the IoCtx
+  assert(m_lock.is_locked());
+  m_inflight++;
+  C_WritebackRequest *req = new C_WritebackRead(this, onfinish, oid.name, off, len, pbl);
+  librados::AioCompletion *rados_completion =
+    Rados::aio_create_completion(req, rados_writeback_cb, NULL);
+  int r = m_ioctx.aio_read(oid.name, rados_completion, pbl, len, off);
+  rados_completion->release();
+  if (r < 0)
+    finisher.queue(req, r);
+  return ++m_tid;
+}
+
+tid_t LibrbdWriteback::write(const object_t& oid, const object_locator_t& oloc,
+			     uint64_t off, uint64_t len, const SnapContext& snapc,
+			     const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
+			     __u32 trunc_seq, Context *oncommit)
+{
+  // so is the write snap context
+  assert(m_lock.is_locked());
+  m_inflight++;
+  C_WritebackRequest *req = new C_WritebackRequest(this, oncommit);
+  librados::AioCompletion *rados_completion =
+    Rados::aio_create_completion(req, NULL, rados_writeback_cb);
+  int r = m_ioctx.aio_write(oid.name, rados_completion, bl, len, off);
+  rados_completion->release();
+  if (r < 0)
+    finisher.queue(req, r);
+  return ++m_tid;
+}
+
+void LibrbdWriteback::finish_request(Context *ctx, int r)
+{
+  Mutex::Locker l(m_lock);
+  ctx->complete(r);
+  assert(m_inflight > 0);
+  if (--m_inflight == 0)
+    m_cond.Signal();
+}
+
+void LibrbdWriteback::drain()
+{
+  assert(m_lock.is_locked());
+  while (m_inflight)
+    m_cond.Wait(m_lock);
+}
+
 void WatchCtx::invalidate()
 {
   Mutex::Locker l(lock);
@@ -421,7 +707,16 @@ void WatchCtx::notify(uint8_t opcode, uint64_t ver, bufferlist& bl)
 {
   Mutex::Locker l(lock);
   ldout(ictx->cct, 1) <<  " got notification opcode=" << (int)opcode << " ver=" << ver << " cookie=" << cookie << dendl;
-  if (valid) {
+  if (!valid)
+    return;
+  if (bl.length()) {
+    // another client is about to write a new block; no need to
+    // reread the header for that
+    uint64_t block;
+    bufferlist::iterator p = bl.begin();
+    ::decode(block, p);
+    object_map_set(ictx, block);
+  } else {
     Mutex::Locker lictx(ictx->refresh_lock);
     ictx->needs_refresh = true;
   }
@@ -447,6 +742,7 @@ void init_rbd_header(struct rbd_obj_header_ondisk& ondisk,
   ondisk.options.order = *order;
   ondisk.options.crypt_type = RBD_CRYPT_NONE;
   ondisk.options.comp_type = RBD_COMP_NONE;
+  ondisk.options.flags = 0;
   ondisk.snap_seq = 0;
   ondisk.snap_count = 0;
   ondisk.reserved = 0;
@@ -463,6 +759,11 @@ void image_info(const ImageCtx& ictx, image_info_t& info, size_t infosize)
   memcpy(&info.block_name_prefix, &ictx.header.block_name, RBD_MAX_BLOCK_NAME_SIZE);
   info.parent_pool = -1;
   bzero(&info.parent_name, RBD_MAX_IMAGE_NAME_SIZE);
+  if (ictx.parent) {
+    info.parent_pool = ictx.parent->md_ctx.get_id();
+    string p = ictx.parent_name + "@" + ictx.parent_snapname;
+    strncpy(info.parent_name, p.c_str(), RBD_MAX_IMAGE_NAME_SIZE - 1);
+  }
 }
 
 string get_block_oid(const rbd_obj_header_ondisk &header, uint64_t num)
@@ -473,6 +774,304 @@ string get_block_oid(const rbd_obj_header_ondisk &header, uint64_t num)
   return o;
 }
 
+string get_object_map_oid(const rbd_obj_header_ondisk &header)
+{
+  return string(header.block_name) + RBD_OBJECT_MAP_SUFFIX;
+}
+
+int object_map_load(ImageCtx *ictx)
+{
+  bool enabled = ictx->header.options.flags & RBD_FLAG_OBJECT_MAP;
+  bufferlist bl;
+  if (enabled) {
+    int r = ictx->md_ctx.read(get_object_map_oid(ictx->header), bl, 0, 0);
+    if (r < 0 && r != -ENOENT) {
+      lderr(ictx->cct) << "error reading object map: " << cpp_strerror(-r) << dendl;
+      return r;
+    }
+  }
+
+  Mutex::Locker l(ictx->object_map_lock);
+  ictx->object_map_enabled = enabled;
+  ictx->object_map.clear();
+  ictx->copied.clear();
+  if (bl.length()) {
+    const char *p = bl.c_str();
+    ictx->object_map.assign(p, p + bl.length());
+  }
+  return 0;
+}
+
+bool object_may_exist(ImageCtx *ictx, uint64_t block)
+{
+  Mutex::Locker l(ictx->object_map_lock);
+  if (!ictx->object_map_enabled)
+    return true;
+  return block < ictx->object_map.size() && ictx->object_map[block];
+}
+
+void object_map_set(ImageCtx *ictx, uint64_t block)
+{
+  Mutex::Locker l(ictx->object_map_lock);
+  if (!ictx->object_map_enabled)
+    return;
+  if (block >= ictx->object_map.size())
+    ictx->object_map.resize(block + 1, 0);
+  ictx->object_map[block] = 1;
+}
+
+/*
+ * Record that a block is about to be written.  The on-disk map is
+ * updated before the data so that it never claims a written block is
+ * a hole; the other clients of the image hear about it through the
+ * header watch.
+ */
+int object_map_mark(ImageCtx *ictx, uint64_t block)
+{
+  if (object_may_exist(ictx, block))
+    return 0;
+
+  ldout(ictx->cct, 20) << "object_map_mark " << ictx << " block " << block << dendl;
+  bufferlist bl;
+  bl.append((char)1);
+  int r = ictx->md_ctx.write(get_object_map_oid(ictx->header), bl, 1, block);
+  if (r < 0) {
+    lderr(ictx->cct) << "error updating object map: " << cpp_strerror(-r) << dendl;
+    return r;
+  }
+  object_map_set(ictx, block);
+
+  bufferlist nbl;
+  ::encode(block, nbl);
+  ictx->md_ctx.notify(ictx->md_oid(), ictx->md_ctx.get_last_version(), nbl);
+  return 0;
+}
+
+uint64_t get_block_num_from_oid(const string& oid)
+{
+  size_t dot = oid.rfind('.');
+  assert(dot != string::npos);
+  return strtoull(oid.c_str() + dot + 1, NULL, 16);
+}
+
+int read_parent_spec(IoCtx& io_ctx, const string& md_oid, ParentSpec *spec)
+{
+  bufferlist bl;
+  int r = io_ctx.getxattr(md_oid, RBD_PARENT_ATTR, bl);
+  if (r < 0)
+    return r;
+  try {
+    bufferlist::iterator p = bl.begin();
+    spec->decode(p);
+  } catch (const buffer::error &err) {
+    return -EIO;
+  }
+  return 0;
+}
+
+int write_parent_spec(IoCtx& io_ctx, const string& md_oid, const ParentSpec& spec)
+{
+  bufferlist bl;
+  spec.encode(bl);
+  return io_ctx.setxattr(md_oid, RBD_PARENT_ATTR, bl);
+}
+
+int children_update(IoCtx& io_ctx, __u8 op, const string& key)
+{
+  bufferlist cmdbl, emptybl;
+  ::encode(op, cmdbl);
+  ::encode(key, cmdbl);
+  if (op == CEPH_OSD_TMAP_SET)
+    ::encode(emptybl, cmdbl);
+  return io_ctx.tmap_update(RBD_CHILDREN, cmdbl);
+}
+
+// the rbd_children keys starting with prefix
+int children_list(IoCtx& io_ctx, const string& prefix, vector<string>& keys)
+{
+  bufferlist bl;
+  int r = io_ctx.tmap_get(RBD_CHILDREN, bl);
+  if (r == -ENOENT)
+    return 0;
+  if (r < 0)
+    return r;
+  if (!bl.length())
+    return 0;
+
+  bufferlist::iterator p = bl.begin();
+  bufferlist header;
+  map<string,bufferlist> m;
+  ::decode(header, p);
+  ::decode(m, p);
+  for (map<string,bufferlist>::iterator q = m.lower_bound(prefix);
+       q != m.end() && q->first.compare(0, prefix.length(), prefix) == 0;
+       ++q)
+    keys.push_back(q->first);
+  return 0;
+}
+
+int open_parent(ImageCtx *ictx)
+{
+  ldout(ictx->cct, 20) << "open_parent " << ictx << " " << ictx->parent_name
+		       << "@" << ictx->parent_snapname << dendl;
+  ImageCtx *parent = new ImageCtx(ictx->parent_name, ictx->md_ctx);
+  int r = open_image(ictx->md_ctx, parent, ictx->parent_name.c_str(),
+		     ictx->parent_snapname.c_str());
+  if (r < 0) {
+    lderr(ictx->cct) << "error opening parent image " << ictx->parent_name
+		     << "@" << ictx->parent_snapname << ": " << cpp_strerror(-r) << dendl;
+    delete parent;
+    return r;
+  }
+  ictx->parent = parent;
+  ictx->parent_finisher = new Finisher(ictx->cct);
+  ictx->parent_finisher->start();
+  return 0;
+}
+
+/*
+ * Read what the parent has for [off, off+len) of a clone into buf.
+ * Anything past the overlap is zero.
+ */
+ssize_t read_parent(ImageCtx *ictx, uint64_t off, size_t len, char *buf)
+{
+  ictx->lock.Lock();
+  uint64_t overlap = ictx->parent_overlap;
+  ictx->lock.Unlock();
+
+  size_t plen = off < overlap ? min((uint64_t)len, overlap - off) : 0;
+  if (plen) {
+    ssize_t r = read(ictx->parent, off, plen, buf);
+    if (r < 0)
+      return r;
+  }
+  memset(buf + plen, 0, len - plen);
+  return len;
+}
+
+struct C_AioParentRead {
+  AioBlockCompletion *block_completion;
+  AioCompletion *completion;
+  C_AioParentRead(AioBlockCompletion *bc) : block_completion(bc), completion(NULL) {}
+};
+
+void rbd_parent_read_cb(completion_t c, void *arg)
+{
+  C_AioParentRead *req = (C_AioParentRead *)arg;
+  AioBlockCompletion *block_completion = req->block_completion;
+  ssize_t r = req->completion->get_return_value();
+  block_completion->completion->complete_block(block_completion,
+					      r < 0 ? r : block_completion->len);
+  delete block_completion;
+  req->completion->release();
+  delete req;
+}
+
+/*
+ * Serve an aio read of a block the clone does not have from the
+ * parent.  The block completion is completed either way.
+ */
+void aio_read_parent(ImageCtx *ictx, AioBlockCompletion *block_completion)
+{
+  ictx->lock.Lock();
+  uint64_t overlap = ictx->parent_overlap;
+  ictx->lock.Unlock();
+
+  uint64_t off = block_completion->image_ofs;
+  size_t len = block_completion->len;
+  size_t plen = off < overlap ? min((uint64_t)len, overlap - off) : 0;
+  memset(block_completion->buf + plen, 0, len - plen);
+  if (!plen) {
+    block_completion->completion->complete_block(block_completion, len);
+    delete block_completion;
+    return;
+  }
+
+  ldout(ictx->cct, 20) << "aio_read_parent " << ictx << " " << off << "~" << plen << dendl;
+  C_AioParentRead *req = new C_AioParentRead(block_completion);
+  req->completion = aio_create_completion(req, rbd_parent_read_cb);
+  int r = aio_read(ictx->parent, off, plen, block_completion->buf, req->completion);
+  if (r < 0) {
+    block_completion->completion->complete_block(block_completion, r);
+    delete block_completion;
+    req->completion->release();
+    delete req;
+  }
+}
+
+struct C_AioReadParent : public Context {
+  ImageCtx *ictx;
+  AioBlockCompletion *block_completion;
+  C_AioReadParent(ImageCtx *i, AioBlockCompletion *bc) : ictx(i), block_completion(bc) {}
+  void finish(int r) {
+    aio_read_parent(ictx, block_completion);
+  }
+};
+
+/*
+ * Before a clone first writes to a block, copy the parent's data for
+ * the whole block into it, so the rest of the block does not read back
+ * as zeros afterwards.  The object map is updated first, as for any
+ * other new block; if the object turns out to exist already (we
+ * crashed after creating it, say) we leave it alone.
+ */
+int copyup_block(ImageCtx *ictx, uint64_t block)
+{
+  if (!ictx->parent)
+    return 0;
+
+  ictx->lock.Lock();
+  uint64_t block_size = get_block_size(ictx->header);
+  uint64_t overlap = ictx->parent_overlap;
+  string oid = get_block_oid(ictx->header, block);
+  ictx->lock.Unlock();
+  uint64_t block_start = block * block_size;
+  if (block_start >= overlap)
+    return 0;
+
+  Mutex::Locker l(ictx->copyup_lock);
+  ictx->object_map_lock.Lock();
+  bool done = block < ictx->copied.size() && ictx->copied[block];
+  ictx->object_map_lock.Unlock();
+  if (done)
+    return 0;
+
+  int r = -ENOENT;
+  if (object_may_exist(ictx, block))
+    r = ictx->data_ctx.stat(oid, NULL, NULL);
+  if (r == -ENOENT) {
+    ldout(ictx->cct, 20) << "copyup_block " << ictx << " block " << block << dendl;
+    uint64_t len = min(block_size, overlap - block_start);
+    bufferptr bp(len);
+    r = read_parent(ictx, block_start, len, bp.c_str());
+    if (r < 0)
+      return r;
+    r = object_map_mark(ictx, block);
+    if (r < 0)
+      return r;
+
+    bufferlist bl;
+    bl.push_back(bp);
+    librados::ObjectWriteOperation op;
+    op.create(true);
+    if (!bl.is_zero())
+      op.write(0, bl);
+    r = ictx->data_ctx.operate(oid, &op);
+    if (r == -EEXIST)
+      r = 0;
+  }
+  if (r < 0) {
+    lderr(ictx->cct) << "error copying up " << oid << ": " << cpp_strerror(-r) << dendl;
+    return r;
+  }
+
+  Mutex::Locker ml(ictx->object_map_lock);
+  if (block >= ictx->copied.size())
+    ictx->copied.resize(block + 1);
+  ictx->copied[block] = true;
+  return 0;
+}
+
 uint64_t get_max_block(uint64_t size, int obj_order)
 {
   uint64_t block_size = 1 << obj_order;
@@ -519,7 +1118,23 @@ void trim_image(IoCtx& io_ctx, const rbd_obj_header_ondisk &header, uint64_t new
   uint64_t numseg = get_max_block(header);
   uint64_t start = get_block_num(header, newsize);
   ldout(cct, 2) << "trimming image data from " << numseg << " to " << start << " objects..." << dendl;
+
+  // with an object map, only blocks that were ever written need removing
+  bufferlist map_bl;
+  bool use_map = header.options.flags & RBD_FLAG_OBJECT_MAP;
+  if (use_map) {
+    int r = io_ctx.read(get_object_map_oid(header), map_bl, 0, 0);
+    if (r < 0 && r != -ENOENT) {
+      ldout(cct, 2) << "error reading object map, removing every object: "
+		    << cpp_strerror(-r) << dendl;
+      use_map = false;
+    }
+  }
+  const char *object_map = map_bl.length() ? map_bl.c_str() : NULL;
+
   for (uint64_t i=start; i<numseg; i++) {
+    if (use_map && (i >= map_bl.length() || !object_map[i]))
+      continue;
     string oid = get_block_oid(header, i);
     io_ctx.remove(oid);
     prog_ctx.update_progress(i * bsize, (numseg - start) * bsize);
@@ -667,6 +1282,8 @@ int rollback_image(ImageCtx *ictx, uint64_t snapid, ProgressContext& prog_ctx)
 
   for (uint64_t i = 0; i < numseg; i++) {
     int r;
+    if (!object_may_exist(ictx, i))
+      continue;
     string oid = get_block_oid(ictx->header, i);
     r = ictx->data_ctx.selfmanaged_snap_rollback(oid, snapid);
     ldout(ictx->cct, 10) << "selfmanaged_snap_rollback on " << oid << " to " << snapid << " returned " << r << dendl;
@@ -729,6 +1346,15 @@ int snap_remove(ImageCtx *ictx, const char *snap_name)
   if (snapid == CEPH_NOSNAP)
     return -ENOENT;
 
+  vector<string> children;
+  r = children_list(ictx->md_ctx, ictx->name + "@" + snap_name + "/", children);
+  if (r < 0)
+    return r;
+  if (!children.empty()) {
+    lderr(ictx->cct) << "snapshot has " << children.size() << " clones, not removing" << dendl;
+    return -EBUSY;
+  }
+
   r = rm_snap(ictx, snap_name);
   if (r < 0)
     return r;
@@ -744,6 +1370,16 @@ int snap_remove(ImageCtx *ictx, const char *snap_name)
 }
 
 int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order)
+{
+  CephContext *cct = io_ctx.cct();
+  uint8_t flags = 0;
+  if (cct->_conf->rbd_object_map)
+    flags |= RBD_FLAG_OBJECT_MAP;
+  return create(io_ctx, imgname, size, order, flags, NULL);
+}
+
+int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order,
+	   uint8_t flags, const ParentSpec *parent)
 {
   CephContext *cct = io_ctx.cct();
   ldout(cct, 20) << "create " << &io_ctx << " name = " << imgname << " size = " << size << dendl;
@@ -768,6 +1404,7 @@ int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order)
 
   struct rbd_obj_header_ondisk header;
   init_rbd_header(header, size, order, bid);
+  header.options.flags = flags;
 
   bufferlist bl;
   bl.append((const char *)&header, sizeof(header));
@@ -780,7 +1417,15 @@ int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order)
   }
 
   ldout(cct, 2) << "creating rbd image..." << dendl;
-  r = io_ctx.write(md_oid, bl, bl.length(), 0);
+  // a clone's header and parent link go in together
+  librados::ObjectWriteOperation op;
+  op.write(0, bl);
+  if (parent) {
+    bufferlist pbl;
+    parent->encode(pbl);
+    op.setxattr(RBD_PARENT_ATTR, pbl);
+  }
+  r = io_ctx.operate(md_oid, &op);
   if (r < 0) {
     lderr(cct) << "error writing header: " << cpp_strerror(-r) << dendl;
     return r;
@@ -790,6 +1435,58 @@ int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order)
   return 0;
 }
 
+/*
+ * Create c_name as a copy-on-write clone of p_name@p_snapname.  Nothing
+ * is copied; the clone starts out reading everything from the parent
+ * snapshot, which cannot be removed while the clone exists.  Both live
+ * in the same pool.
+ */
+int clone(IoCtx& io_ctx, const char *p_name, const char *p_snapname,
+	  const char *c_name, int *c_order)
+{
+  CephContext *cct = io_ctx.cct();
+  ldout(cct, 20) << "clone " << &io_ctx << " " << p_name << "@" << p_snapname
+		 << " -> " << c_name << dendl;
+
+  if (!p_snapname) {
+    lderr(cct) << "a clone needs a parent snapshot" << dendl;
+    return -EINVAL;
+  }
+
+  ImageCtx *p_ictx = new ImageCtx(p_name, io_ctx);
+  int r = open_image(io_ctx, p_ictx, p_name, p_snapname);
+  if (r < 0) {
+    lderr(cct) << "error opening parent image: " << cpp_strerror(-r) << dendl;
+    delete p_ictx;
+    return r;
+  }
+  ParentSpec spec;
+  spec.name = p_name;
+  spec.snapname = p_snapname;
+  p_ictx->lock.Lock();
+  spec.snapid = p_ictx->snapid;
+  spec.overlap = p_ictx->get_image_size();
+  int order = p_ictx->header.options.order;
+  p_ictx->lock.Unlock();
+  close_image(p_ictx);
+
+  if (!*c_order)
+    *c_order = order;
+
+  // register first, so removing the snapshot never misses a clone
+  string key = string(p_name) + "@" + p_snapname + "/" + c_name;
+  r = children_update(io_ctx, CEPH_OSD_TMAP_SET, key);
+  if (r < 0) {
+    lderr(cct) << "error registering clone: " << cpp_strerror(-r) << dendl;
+    return r;
+  }
+  r = create(io_ctx, c_name, spec.overlap, c_order,
+	     RBD_FLAG_LAYERED | RBD_FLAG_OBJECT_MAP, &spec);
+  if (r < 0)
+    children_update(io_ctx, CEPH_OSD_TMAP_RM, key);
+  return r;
+}
+
 int rename(IoCtx& io_ctx, const char *srcname, const char *dstname)
 {
   CephContext *cct = io_ctx.cct();
@@ -813,11 +1510,43 @@ int rename(IoCtx& io_ctx, const char *srcname, const char *dstname)
     lderr(cct) << "rbd image header " << dst_md_oid << " already exists" << dendl;
     return -EEXIST;
   }
+
+  // clones find their parent by name
+  vector<string> children;
+  r = children_list(io_ctx, imgname_str + "@", children);
+  if (r < 0)
+    return r;
+  if (!children.empty()) {
+    lderr(cct) << "image has clones, not renaming" << dendl;
+    return -EBUSY;
+  }
+  const rbd_obj_header_ondisk *ondisk = (const rbd_obj_header_ondisk *)header.c_str();
+  bool layered = ondisk->options.flags & RBD_FLAG_LAYERED;
+  ParentSpec spec;
+  if (layered) {
+    r = read_parent_spec(io_ctx, md_oid, &spec);
+    if (r < 0) {
+      lderr(cct) << "error reading parent: " << cpp_strerror(-r) << dendl;
+      return r;
+    }
+  }
+
   r = write_header(io_ctx, dst_md_oid, header);
   if (r < 0) {
     lderr(cct) << "error writing header: " << dst_md_oid << ": " << cpp_strerror(-r) << dendl;
     return r;
   }
+  if (layered) {
+    r = write_parent_spec(io_ctx, dst_md_oid, spec);
+    if (r < 0) {
+      io_ctx.remove(dst_md_oid);
+      lderr(cct) << "error writing parent: " << cpp_strerror(-r) << dendl;
+      return r;
+    }
+    string prefix = spec.name + "@" + spec.snapname + "/";
+    children_update(io_ctx, CEPH_OSD_TMAP_SET, prefix + dstname_str);
+    children_update(io_ctx, CEPH_OSD_TMAP_RM, prefix + imgname_str);
+  }
   r = tmap_set(io_ctx, dstname_str);
   if (r < 0) {
     io_ctx.remove(dst_md_oid);
@@ -887,7 +1616,16 @@ int remove(IoCtx& io_ctx, const char *imgname, ProgressContext& prog_ctx)
       lderr(cct) << "image has snapshots - not removing" << dendl;
       return -EBUSY;
     }
+    if (header.options.flags & RBD_FLAG_LAYERED) {
+      ParentSpec spec;
+      r = read_parent_spec(io_ctx, md_oid, &spec);
+      if (r == 0)
+	children_update(io_ctx, CEPH_OSD_TMAP_RM,
+			spec.name + "@" + spec.snapname + "/" + imgname);
+    }
     trim_image(io_ctx, header, 0, prog_ctx);
+    if (header.options.flags & RBD_FLAG_OBJECT_MAP)
+      io_ctx.remove(get_object_map_oid(header));
     ldout(cct, 2) << "removing header..." << dendl;
     io_ctx.remove(md_oid);
   }
@@ -916,7 +1654,35 @@ int resize_helper(ImageCtx *ictx, uint64_t size, ProgressContext& prog_ctx)
     ictx->header.image_size = size;
   } else {
     ldout(cct, 2) << "shrinking image " << size << " -> " << ictx->header.image_size << " objects" << dendl;
+    if (ictx->parent && size < ictx->parent_overlap) {
+      // once trimmed, the blocks read from the parent again, so the
+      // clone has to stop seeing that part of it.  snapshots would
+      // need their own overlap.
+      if (!ictx->snaps.empty()) {
+	lderr(cct) << "can't shrink a clone with snapshots below its parent overlap" << dendl;
+	return -EBUSY;
+      }
+      ParentSpec spec;
+      spec.name = ictx->parent_name;
+      spec.snapname = ictx->parent_snapname;
+      spec.snapid = ictx->parent->snapid;
+      spec.overlap = size;
+      int r = write_parent_spec(ictx->md_ctx, ictx->md_oid(), spec);
+      if (r < 0) {
+	lderr(cct) << "error updating parent overlap: " << cpp_strerror(-r) << dendl;
+	return r;
+      }
+      ictx->parent_overlap = size;
+    }
     trim_image(ictx->data_ctx, ictx->header, size, prog_ctx);
+    // snapshots may still hold the trimmed blocks, so only forget
+    // about them when there are none
+    if ((ictx->header.options.flags & RBD_FLAG_OBJECT_MAP) && ictx->snaps.empty()) {
+      uint64_t start = get_block_num(ictx->header, size);
+      int r = ictx->md_ctx.trunc(get_object_map_oid(ictx->header), start);
+      if (r < 0 && r != -ENOENT)
+	lderr(cct) << "error truncating object map: " << cpp_strerror(-r) << dendl;
+    }
     ictx->header.image_size = size;
   }
 
@@ -1059,11 +1825,37 @@ int ictx_refresh(ImageCtx *ictx, const char *snap_name)
     ldout(cct, 20) << "ictx_refresh " << ictx << " no snap" << dendl;
   }
 
+  // anything dirty was written under the old snap context; get it out
+  // before we switch.
+  ictx->invalidate_cache();
+
   int r = read_header(ictx->md_ctx, ictx->md_oid(), &(ictx->header), NULL);
   if (r < 0) {
     lderr(cct) << "Error reading header: " << cpp_strerror(-r) << dendl;
     return r;
   }
+  if (ictx->object_cacher) {
+    // end readahead on block object boundaries
+    vector<uint64_t> align;
+    align.push_back(get_block_size(ictx->header));
+    ictx->cache_lock.Lock();
+    ictx->readahead.set_alignments(align);
+    ictx->cache_lock.Unlock();
+  }
+  r = object_map_load(ictx);
+  if (r < 0)
+    return r;
+  if (ictx->header.options.flags & RBD_FLAG_LAYERED) {
+    ParentSpec spec;
+    r = read_parent_spec(ictx->md_ctx, ictx->md_oid(), &spec);
+    if (r < 0) {
+      lderr(cct) << "Error reading parent: " << cpp_strerror(-r) << dendl;
+      return r;
+    }
+    ictx->parent_name = spec.name;
+    ictx->parent_snapname = spec.snapname;
+    ictx->parent_overlap = spec.overlap;
+  }
   r = ictx->md_ctx.exec(ictx->md_oid(), "rbd", "snap_list", bl, bl2);
   if (r < 0) {
     lderr(cct) << "Error listing snapshots: " << cpp_strerror(-r) << dendl;
@@ -1193,17 +1985,41 @@ struct CopyProgressCtx {
   ImageCtx *destictx;
   uint64_t src_size;
   ProgressContext &prog_ctx;
+  deque<AioCompletion*> inflight;
+  size_t max_inflight;
+
+  int wait_for_oldest() {
+    AioCompletion *comp = inflight.front();
+    inflight.pop_front();
+    comp->wait_for_complete();
+    int r = comp->get_return_value();
+    comp->release();
+    return r;
+  }
 };
 
 int do_copy_extent(uint64_t offset, size_t len, const char *buf, void *data)
 {
   CopyProgressCtx *cp = reinterpret_cast<CopyProgressCtx*>(data);
   cp->prog_ctx.update_progress(offset, cp->src_size);
-  int ret = 0;
-  if (buf) {
-    ret = write(cp->destictx, offset, len, buf);
+
+  // holes, and data that happens to be zero, stay unallocated in the copy
+  if (!buf)
+    return 0;
+  bufferptr bp(buffer::create_static(len, (char *)buf));
+  if (bp.is_zero())
+    return 0;
+
+  AioCompletion *comp = aio_create_completion();
+  int r = aio_write(cp->destictx, offset, len, buf, comp);
+  if (r < 0) {
+    comp->release();
+    return r;
   }
-  return ret;
+  cp->inflight.push_back(comp);
+  if (cp->inflight.size() >= cp->max_inflight)
+    return cp->wait_for_oldest();
+  return 0;
 }
 
 int copy(ImageCtx& ictx, IoCtx& dest_md_ctx, const char *destname,
@@ -1223,6 +2039,7 @@ int copy(ImageCtx& ictx, IoCtx& dest_md_ctx, const char *destname,
 
   cp.destictx = new librbd::ImageCtx(destname, dest_md_ctx);
   cp.src_size = src_size;
+  cp.max_inflight = max(1, cct->_conf->rbd_concurrent_management_ops);
   r = open_image(dest_md_ctx, cp.destictx, destname, NULL);
   if (r < 0) {
     lderr(cct) << "failed to read newly created header" << dendl;
@@ -1231,6 +2048,12 @@ int copy(ImageCtx& ictx, IoCtx& dest_md_ctx, const char *destname,
 
   r = read_iterate(&ictx, 0, src_size, do_copy_extent, &cp);
 
+  while (!cp.inflight.empty()) {
+    int ret = cp.wait_for_oldest();
+    if (ret < 0 && r >= 0)
+      r = ret;
+  }
+
   if (r >= 0) {
     // don't return total bytes read, which may not fit in an int
     r = 0;
@@ -1249,6 +2072,7 @@ int snap_set(ImageCtx *ictx, const char *snap_name)
     return r;
 
   Mutex::Locker l(ictx->lock);
+  ictx->invalidate_cache();
   if (snap_name) {
     r = ictx->snap_set(snap_name);
     if (r < 0) {
@@ -1280,6 +2104,12 @@ int open_image(IoCtx& io_ctx, ImageCtx *ictx, const char *name, const char *snap
   if (r < 0)
     return r;
 
+  if (ictx->header.options.flags & RBD_FLAG_LAYERED) {
+    r = open_parent(ictx);
+    if (r < 0)
+      return r;
+  }
+
   WatchCtx *wctx = new WatchCtx(ictx);
   if (!wctx)
     return -ENOMEM;
@@ -1298,9 +2128,106 @@ void close_image(ImageCtx *ictx)
   ictx->md_ctx.unwatch(ictx->md_oid(), ictx->wctx->cookie);
   delete ictx->wctx;
   ictx->lock.Unlock();
+  if (ictx->parent) {
+    ictx->parent_finisher->stop();
+    close_image(ictx->parent);
+  }
   delete ictx;
 }
 
+/*
+ * One object's worth of a synchronous read.  Objects the object map
+ * says do not exist get no completion and read back as a hole, or
+ * from the parent of a clone.
+ */
+struct SyncRead {
+  librados::AioCompletion *completion;
+  uint64_t image_ofs, block_ofs, buf_ofs, len;
+  map<uint64_t, uint64_t> m;
+  bufferlist bl;
+
+  SyncRead(uint64_t io, uint64_t bo, uint64_t o, uint64_t l, bool exists)
+    : completion(exists ? Rados::aio_create_completion() : NULL),
+      image_ofs(io), block_ofs(bo), buf_ofs(o), len(l) {}
+  ~SyncRead() {
+    if (completion)
+      completion->release();
+  }
+
+  void wait() {
+    if (completion)
+      completion->wait_for_complete();
+  }
+
+  // wait for the read and feed what we got to cb
+  ssize_t finish(ImageCtx *ictx,
+		 int (*cb)(uint64_t, size_t, const char *, void *), void *arg) {
+    int r = -ENOENT;
+    if (completion) {
+      completion->wait_for_complete();
+      r = completion->get_return_value();
+      if (r < 0 && r != -ENOENT)
+	return r;
+    }
+    if (r == -ENOENT && ictx->parent) {
+      bufferptr bp(len);
+      r = read_parent(ictx, image_ofs, len, bp.c_str());
+      if (r < 0)
+	return r;
+      r = cb(buf_ofs, len, bp.c_str(), arg);
+      if (r < 0)
+	return r;
+      return len;
+    }
+    return handle_sparse_read(ictx->cct, bl, block_ofs, m, buf_ofs, len, cb, arg);
+  }
+};
+
+static bool buf_is_zero(const char *p, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    if (p[i])
+      return false;
+  return true;
+}
+
+/*
+ * Hand data read through the cache to cb.  The cache can't tell us
+ * where the holes are, so pass runs of zeroes as holes (NULL), like
+ * the sparse reads on the uncached path do.
+ */
+static int handle_zero_runs(uint64_t buf_ofs, bufferlist& bl,
+			    int (*cb)(uint64_t, size_t, const char *, void *),
+			    void *arg)
+{
+  const size_t piece = 4096;
+  size_t len = bl.length();
+  if (!len)
+    return 0;
+  const char *p = bl.c_str();
+  size_t run = 0;
+  bool run_zero = buf_is_zero(p, MIN(piece, len));
+  for (size_t o = piece; o < len; o += piece) {
+    bool zero = buf_is_zero(p + o, MIN(piece, len - o));
+    if (zero == run_zero)
+      continue;
+    int r = cb(buf_ofs + run, o - run, run_zero ? NULL : p + run, arg);
+    if (r < 0)
+      return r;
+    run = o;
+    run_zero = zero;
+  }
+  return cb(buf_ofs + run, len - run, run_zero ? NULL : p + run, arg);
+}
+
+static int wait_for_write(librados::AioCompletion *c)
+{
+  c->wait_for_complete();
+  int r = c->get_return_value();
+  c->release();
+  return r;
+}
+
 int64_t read_iterate(ImageCtx *ictx, uint64_t off, size_t len,
 		     int (*cb)(uint64_t, size_t, const char *, void *),
 		     void *arg)
@@ -1315,8 +2242,55 @@ int64_t read_iterate(ImageCtx *ictx, uint64_t off, size_t len,
   if (r < 0)
     return r;
 
-  int64_t ret;
+  if (ictx->object_cacher) {
+    // an object at a time, so we never hold more than that
+    uint64_t done_len = 0;
+    while (done_len < len) {
+      ictx->lock.Lock();
+      uint64_t block = get_block_num(ictx->header, off + done_len);
+      uint64_t block_ofs = get_block_ofs(ictx->header, off + done_len);
+      uint64_t block_size = get_block_size(ictx->header);
+      bool has_parent = ictx->parent != NULL;
+      ictx->lock.Unlock();
+      uint64_t read_len = min(block_size - block_ofs, len - done_len);
+
+      if (!has_parent && !object_may_exist(ictx, block)) {
+	r = cb(done_len, read_len, NULL, arg);
+      } else {
+	Mutex mylock("librbd::read_iterate::mylock");
+	Cond cond;
+	bool done = false;
+	int rval;
+	bufferlist bl;
+	cache_read(ictx, off + done_len, read_len, &bl,
+		   new C_SafeCond(&mylock, &cond, &done, &rval));
+	mylock.Lock();
+	while (!done)
+	  cond.Wait(mylock);
+	mylock.Unlock();
+	if (rval < 0)
+	  return rval;
+	if (bl.length() < read_len) {
+	  bufferptr bp(read_len - bl.length());
+	  bp.zero();
+	  bl.append(bp);
+	}
+	r = handle_zero_runs(done_len, bl, cb, arg);
+      }
+      if (r < 0)
+	return r;
+      done_len += read_len;
+    }
+    return len;
+  }
+
+  // keep up to rbd_sync_max_inflight objects in flight, but hand the
+  // data to cb in order.
+  size_t max_inflight = max(1, ictx->cct->_conf->rbd_sync_max_inflight);
+  deque<SyncRead*> inflight;
+  int64_t ret = 0;
   int64_t total_read = 0;
+  uint64_t total_issued = 0;
   ictx->lock.Lock();
   uint64_t start_block = get_block_num(ictx->header, off);
   uint64_t end_block = get_block_num(ictx->header, off + len - 1);
@@ -1324,33 +2298,51 @@ int64_t read_iterate(ImageCtx *ictx, uint64_t off, size_t len,
   ictx->lock.Unlock();
   uint64_t left = len;
 
-  for (uint64_t i = start_block; i <= end_block; i++) {
-    bufferlist bl;
+  for (uint64_t i = start_block; i <= end_block && ret >= 0; i++) {
     ictx->lock.Lock();
     string oid = get_block_oid(ictx->header, i);
-    uint64_t block_ofs = get_block_ofs(ictx->header, off + total_read);
+    uint64_t block_ofs = get_block_ofs(ictx->header, off + total_issued);
     ictx->lock.Unlock();
     uint64_t read_len = min(block_size - block_ofs, left);
 
-    map<uint64_t, uint64_t> m;
-    r = ictx->data_ctx.sparse_read(oid, m, bl, read_len, block_ofs);
-    if (r < 0 && r == -ENOENT)
-      r = 0;
+    SyncRead *req = new SyncRead(off + total_issued, block_ofs, total_issued,
+				 read_len, object_may_exist(ictx, i));
+    if (req->completion)
+      r = ictx->data_ctx.aio_sparse_read(oid, req->completion, &req->m, &req->bl,
+					 read_len, block_ofs);
     if (r < 0) {
-      return r;
+      delete req;
+      ret = r;
+      break;
     }
+    inflight.push_back(req);
+    total_issued += read_len;
+    left -= read_len;
 
-    r = handle_sparse_read(ictx->cct, bl, block_ofs, m, total_read, read_len, cb, arg);
-    if (r < 0) {
-      return r;
+    while (inflight.size() >= max_inflight ||
+	   (i == end_block && !inflight.empty())) {
+      req = inflight.front();
+      inflight.pop_front();
+      r = req->finish(ictx, cb, arg);
+      delete req;
+      if (r < 0) {
+	ret = r;
+	break;
+      }
+      total_read += r;
     }
+  }
 
-    total_read += r;
-    left -= r;
+  // on error, wait for whatever is still out there
+  while (!inflight.empty()) {
+    inflight.front()->wait();
+    delete inflight.front();
+    inflight.pop_front();
   }
-  ret = total_read;
 
-  return ret;
+  if (ret < 0)
+    return ret;
+  return total_read;
 }
 
 static int simple_read_cb(uint64_t ofs, size_t len, const char *buf, void *arg)
@@ -1385,6 +2377,18 @@ ssize_t write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf)
   if (r < 0)
     return r;
 
+  if (ictx->object_cacher) {
+    bufferlist bl;
+    bl.append(buf, len);
+    r = cache_write(ictx, off, len, bl);
+    if (r < 0)
+      return r;
+    return len;
+  }
+
+  // as with reads, fan out to up to rbd_sync_max_inflight objects at once
+  size_t max_inflight = max(1, ictx->cct->_conf->rbd_sync_max_inflight);
+  deque<librados::AioCompletion*> inflight;
   size_t total_write = 0;
   ictx->lock.Lock();
   uint64_t start_block = get_block_num(ictx->header, off);
@@ -1392,6 +2396,7 @@ ssize_t write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf)
   uint64_t block_size = get_block_size(ictx->header);
   ictx->lock.Unlock();
   uint64_t left = len;
+  int ret = 0;
 
   for (uint64_t i = start_block; i <= end_block; i++) {
     bufferlist bl;
@@ -1401,17 +2406,140 @@ ssize_t write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf)
     ictx->lock.Unlock();
     uint64_t write_len = min(block_size - block_ofs, left);
     bl.append(buf + total_write, write_len);
-    r = ictx->data_ctx.write(oid, bl, write_len, block_ofs);
-    if (r < 0)
-      return r;
-    if ((uint64_t)r != write_len)
-      return -EIO;
+
+    r = copyup_block(ictx, i);
+    if (r == 0)
+      r = object_map_mark(ictx, i);
+    if (r < 0) {
+      ret = r;
+      break;
+    }
+    librados::AioCompletion *rados_completion = Rados::aio_create_completion();
+    r = ictx->data_ctx.aio_write(oid, rados_completion, bl, write_len, block_ofs);
+    if (r < 0) {
+      rados_completion->release();
+      ret = r;
+      break;
+    }
+    inflight.push_back(rados_completion);
     total_write += write_len;
     left -= write_len;
+
+    if (inflight.size() >= max_inflight) {
+      r = wait_for_write(inflight.front());
+      inflight.pop_front();
+      if (r < 0) {
+	ret = r;
+	break;
+      }
+    }
+  }
+
+  while (!inflight.empty()) {
+    r = wait_for_write(inflight.front());
+    inflight.pop_front();
+    if (r < 0 && ret == 0)
+      ret = r;
   }
+
+  if (ret < 0)
+    return ret;
   return total_write;
 }
 
+void image_to_extents(ImageCtx *ictx, uint64_t off, uint64_t len,
+		      vector<ObjectExtent>& extents)
+{
+  assert(ictx->lock.is_locked());
+  uint64_t block_size = get_block_size(ictx->header);
+  object_locator_t oloc(ictx->data_ctx.get_id());
+  uint64_t buf_ofs = 0;
+  while (len > 0) {
+    uint64_t block_ofs = get_block_ofs(ictx->header, off);
+    uint64_t ex_len = min(block_size - block_ofs, len);
+    ObjectExtent ex(get_block_oid(ictx->header, get_block_num(ictx->header, off)),
+		    block_ofs, ex_len);
+    ex.oloc = oloc;
+    ex.buffer_extents[buf_ofs] = ex_len;
+    extents.push_back(ex);
+    off += ex_len;
+    len -= ex_len;
+    buf_ofs += ex_len;
+  }
+}
+
+/*
+ * Read [off, off+len) through the cache.  onfinish gets the length read
+ * and is always completed, possibly from the writeback finisher with the
+ * cache lock held.
+ *
+ * Sequential and strided readers get the data ahead of them
+ * prefetched as well; see Readahead.
+ */
+void cache_read(ImageCtx *ictx, uint64_t off, size_t len, bufferlist *pbl,
+		Context *onfinish)
+{
+  ldout(ictx->cct, 20) << "cache_read " << ictx << " off = " << off << " len = " << len << dendl;
+  ObjectCacher::OSDRead *rd = ictx->object_cacher->prepare_read(ictx->snapid, pbl, 0);
+  vector<ObjectCacher::OSDRead*> ra;
+
+  ictx->lock.Lock();
+  image_to_extents(ictx, off, len, rd->extents);
+  ictx->cache_lock.Lock();
+  vector<Readahead::extent_t> ra_extents;
+  ictx->readahead.update(off, len, ictx->get_image_size(), ra_extents);
+  for (vector<Readahead::extent_t>::iterator p = ra_extents.begin();
+       p != ra_extents.end(); ++p) {
+    ldout(ictx->cct, 20) << "cache_read readahead " << p->first << "~" << p->second
+			 << " window " << ictx->readahead.get_window() << dendl;
+    ObjectCacher::OSDRead *ra_rd = ictx->object_cacher->prepare_read(ictx->snapid, NULL, 0);
+    image_to_extents(ictx, p->first, p->second, ra_rd->extents);
+    ra.push_back(ra_rd);
+  }
+  ictx->lock.Unlock();
+
+  int r = ictx->object_cacher->readx(rd, ictx->object_set, onfinish);
+  for (vector<ObjectCacher::OSDRead*>::iterator p = ra.begin(); p != ra.end(); ++p)
+    ictx->object_cacher->readx(*p, ictx->object_set, NULL);
+  ictx->cache_lock.Unlock();
+
+  if (r != 0)
+    onfinish->complete(r);  // it was all cached
+}
+
+int cache_write(ImageCtx *ictx, uint64_t off, size_t len, bufferlist& bl)
+{
+  ldout(ictx->cct, 20) << "cache_write " << ictx << " off = " << off << " len = " << len << dendl;
+
+  // the writeback may happen much later, but the map has to be ahead
+  // of it
+  if (len) {
+    ictx->lock.Lock();
+    uint64_t start_block = get_block_num(ictx->header, off);
+    uint64_t end_block = get_block_num(ictx->header, off + len - 1);
+    ictx->lock.Unlock();
+    for (uint64_t i = start_block; i <= end_block; i++) {
+      int r = copyup_block(ictx, i);
+      if (r == 0)
+	r = object_map_mark(ictx, i);
+      if (r < 0)
+	return r;
+    }
+  }
+
+  ictx->lock.Lock();
+  ObjectCacher::OSDWrite *wr =
+    ictx->object_cacher->prepare_write(ictx->snapc, bl, ceph_clock_now(ictx->cct), 0);
+  image_to_extents(ictx, off, len, wr->extents);
+  ictx->lock.Unlock();
+
+  ictx->cache_lock.Lock();
+  ictx->object_cacher->wait_for_write(len, ictx->cache_lock);
+  ictx->object_cacher->writex(wr, ictx->object_set);
+  ictx->cache_lock.Unlock();
+  return 0;
+}
+
 ssize_t handle_sparse_read(CephContext *cct,
 			   bufferlist data_bl,
 			   uint64_t block_ofs,
@@ -1539,6 +2667,12 @@ int flush(ImageCtx *ictx)
   if (r < 0)
     return r;
 
+  if (ictx->object_cacher) {
+    ictx->cache_lock.Lock();
+    ictx->flush_cache();
+    ictx->cache_lock.Unlock();
+  }
+
   // flush any outstanding writes
   r = ictx->data_ctx.aio_flush();
 
@@ -1579,8 +2713,27 @@ int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
   if (r < 0)
     return r;
 
+  if (ictx->object_cacher) {
+    // the cache took it; there is nothing to wait for
+    bufferlist bl;
+    bl.append(buf, len);
+    r = cache_write(ictx, off, len, bl);
+    if (r < 0)
+      return r;
+    c->get();
+    c->finish_adding_completions();
+    c->put();
+    return 0;
+  }
+
   c->get();
   for (uint64_t i = start_block; i <= end_block; i++) {
+    r = copyup_block(ictx, i);
+    if (r == 0)
+      r = object_map_mark(ictx, i);
+    if (r < 0)
+      goto done;
+
     AioBlockCompletion *block_completion = new AioBlockCompletion(cct, c, off, len, NULL);
     c->add_block_completion(block_completion);
 
@@ -1613,10 +2766,44 @@ done:
   return r;
 }
 
+/*
+ * An aio read served by the cache.  This may run with the cache lock
+ * held, so the user's callback is left to the writeback finisher.
+ */
+struct C_CacheReadFinish : public Context {
+  AioBlockCompletion *block_completion;
+  C_CacheReadFinish(AioBlockCompletion *bc) : block_completion(bc) {}
+  void finish(int r) {
+    block_completion->completion->complete_block(block_completion, r);
+    delete block_completion;
+  }
+};
+
+struct C_CacheRead : public Context {
+  ImageCtx *ictx;
+  AioBlockCompletion *block_completion;
+  bufferlist bl;
+  C_CacheRead(ImageCtx *i, AioBlockCompletion *bc)
+    : ictx(i), block_completion(bc) {}
+  void finish(int r) {
+    if (r >= 0)
+      bl.copy(0, bl.length(), block_completion->buf);
+    ictx->writeback_handler->finisher.queue(new C_CacheReadFinish(block_completion), r);
+  }
+};
+
 void rados_aio_sparse_read_cb(rados_completion_t c, void *arg)
 {
   AioBlockCompletion *block_completion = (AioBlockCompletion *)arg;
-  block_completion->complete(rados_aio_get_return_value(c));
+  int r = rados_aio_get_return_value(c);
+  ImageCtx *clone = block_completion->clone;
+  if (r == -ENOENT && clone) {
+    // not copied up; we hold the librados client lock, so the parent
+    // read has to be issued from elsewhere
+    clone->parent_finisher->queue(new C_AioReadParent(clone, block_completion));
+    return;
+  }
+  block_completion->complete(r);
   delete block_completion;
 }
 
@@ -1634,6 +2821,18 @@ int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
   if (r < 0)
     return r;
 
+  if (ictx->object_cacher && len) {
+    c->get();
+    AioBlockCompletion *block_completion =
+      new AioBlockCompletion(ictx->cct, c, off, len, buf);
+    c->add_block_completion(block_completion);
+    C_CacheRead *req = new C_CacheRead(ictx, block_completion);
+    cache_read(ictx, off, len, &req->bl, req);
+    c->finish_adding_completions();
+    c->put();
+    return len;
+  }
+
   int64_t ret;
   int total_read = 0;
   ictx->lock.Lock();
@@ -1659,6 +2858,23 @@ int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
 	new AioBlockCompletion(ictx->cct, c, block_ofs, read_len, buf + total_read);
     c->add_block_completion(block_completion);
 
+    if (ictx->parent) {
+      block_completion->clone = ictx;
+      block_completion->image_ofs = off + total_read;
+    }
+    if (!object_may_exist(ictx, i)) {
+      // a hole, or the parent's; either way no need to ask the OSD
+      if (ictx->parent)
+	aio_read_parent(ictx, block_completion);
+      else {
+	block_completion->complete(0);
+	delete block_completion;
+      }
+      total_read += read_len;
+      left -= read_len;
+      continue;
+    }
+
     librados::AioCompletion *rados_completion =
       Rados::aio_create_completion(block_completion, rados_aio_sparse_read_cb, NULL);
     r = ictx->data_ctx.aio_sparse_read(oid, rados_completion,
@@ -1722,6 +2938,12 @@ int RBD::create(IoCtx& io_ctx, const char *name, uint64_t size, int *order)
   return r;
 }
 
+int RBD::clone(IoCtx& io_ctx, const char *p_name, const char *p_snapname,
+	       const char *c_name, int *c_order)
+{
+  return librbd::clone(io_ctx, p_name, p_snapname, c_name, c_order);
+}
+
 int RBD::remove(IoCtx& io_ctx, const char *name)
 {
   librbd::NoOpProgressContext prog_ctx;
@@ -1963,6 +3185,14 @@ extern "C" int rbd_create(rados_ioctx_t p, const char *name, uint64_t size, int
   return librbd::create(io_ctx, name, size, order);
 }
 
+extern "C" int rbd_clone(rados_ioctx_t p, const char *p_name, const char *p_snapname,
+			 const char *c_name, int *c_order)
+{
+  librados::IoCtx io_ctx;
+  librados::IoCtx::from_rados_ioctx_t(p, io_ctx);
+  return librbd::clone(io_ctx, p_name, p_snapname, c_name, c_order);
+}
+
 extern "C" int rbd_remove(rados_ioctx_t p, const char *name)
 {
   librados::IoCtx io_ctx;
@@ -28,16 +28,20 @@ struct MForward : public Message {
   PaxosServiceMessage *msg;
   entity_inst_t client;
   MonCaps client_caps;
+  unsigned con_features;  // features of the client's connection
   
-  MForward() : Message(MSG_FORWARD), tid(0), msg(NULL) {}
+  MForward() : Message(MSG_FORWARD), tid(0), msg(NULL), con_features(0) {}
   //the message needs to have caps filled in!
   MForward(uint64_t t, PaxosServiceMessage *m) :
     Message(MSG_FORWARD), tid(t), msg(m) {
     client = m->get_source_inst();
     client_caps = m->get_session()->caps;
+    con_features = m->get_connection()->get_features();
   }
-  MForward(uint64_t t, PaxosServiceMessage *m, MonCaps caps) :
-    Message(MSG_FORWARD), tid(t), msg(m), client_caps(caps) {
+  MForward(uint64_t t, PaxosServiceMessage *m, MonCaps caps,
+	   unsigned feat) :
+    Message(MSG_FORWARD), tid(t), msg(m), client_caps(caps),
+    con_features(feat) {
     client = m->get_source_inst();
   }
 private:
@@ -51,6 +55,8 @@ public:
     ::encode(client, payload);
     ::encode(client_caps, payload);
     encode_message(cct, msg, payload);
+    ::encode(con_features, payload);
+    header.version = 2;
   }
 
   void decode_payload(CephContext *cct) {
@@ -59,6 +65,13 @@ public:
     ::decode(client, p);
     ::decode(client_caps, p);
     msg = (PaxosServiceMessage *)decode_message(cct, p);
+    if (header.version >= 2) {
+      ::decode(con_features, p);
+    } else {
+      // an older mon did not tell us; assume everything, and let it
+      // re-encode the reply for the client when it routes it back
+      con_features = (unsigned)-1;
+    }
   }
 
   const char *get_type_name() { return "forward"; }
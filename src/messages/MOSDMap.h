@@ -26,6 +26,9 @@ class MOSDMap : public Message {
   map<epoch_t, bufferlist> maps;
   map<epoch_t, bufferlist> incremental_maps;
   epoch_t oldest_map, newest_map;
+  // if set, the features the maps are already encoded for (the sender
+  // keeps them encoded for old peers so it needn't redo it per message)
+  uint64_t encode_features;
 
   epoch_t get_first() {
     epoch_t e = 0;
@@ -53,10 +56,10 @@ class MOSDMap : public Message {
   }
 
 
-  MOSDMap() : Message(CEPH_MSG_OSD_MAP) { }
+  MOSDMap() : Message(CEPH_MSG_OSD_MAP), encode_features(0) { }
   MOSDMap(const uuid_d &f, OSDMap *oc=0)
     : Message(CEPH_MSG_OSD_MAP), fsid(f),
-      oldest_map(0), newest_map(0)
+      oldest_map(0), newest_map(0), encode_features(0)
   {
     if (oc)
       oc->encode(maps[oc->get_epoch()]);
@@ -84,34 +87,38 @@ public:
     header.version = 2;
     if (connection && (!connection->has_feature(CEPH_FEATURE_PGID64) ||
 		       !connection->has_feature(CEPH_FEATURE_PGPOOL3))) {
-      // reencode maps using old format
-      //
-      // FIXME: this can probably be done more efficiently higher up
-      // the stack, or maybe replaced with something that only
-      // includes the pools the client cares about.
-      for (map<epoch_t,bufferlist>::iterator p = incremental_maps.begin();
-	   p != incremental_maps.end();
-	   ++p) {
-	OSDMap::Incremental inc;
-	bufferlist::iterator q = p->second.begin();
-	inc.decode(q);
-	p->second.clear();
-	if (inc.fullmap.length()) {
-	  // embedded full map?
+      uint64_t mask = CEPH_FEATURE_PGID64 | CEPH_FEATURE_PGPOOL3;
+      if (!encode_features ||
+	  (encode_features & mask) != (connection->get_features() & mask)) {
+	// reencode maps using old format
+	//
+	// FIXME: this can probably be done more efficiently higher up
+	// the stack, or maybe replaced with something that only
+	// includes the pools the client cares about.
+	for (map<epoch_t,bufferlist>::iterator p = incremental_maps.begin();
+	     p != incremental_maps.end();
+	     ++p) {
+	  OSDMap::Incremental inc;
+	  bufferlist::iterator q = p->second.begin();
+	  inc.decode(q);
+	  p->second.clear();
+	  if (inc.fullmap.length()) {
+	    // embedded full map?
+	    OSDMap m;
+	    m.decode(inc.fullmap);
+	    inc.fullmap.clear();
+	    m.encode(inc.fullmap, connection->get_features());
+	  }
+	  inc.encode(p->second, connection->get_features());
+	}
+	for (map<epoch_t,bufferlist>::iterator p = maps.begin();
+	     p != maps.end();
+	     ++p) {
 	  OSDMap m;
-	  m.decode(inc.fullmap);
-	  inc.fullmap.clear();
-	  m.encode(inc.fullmap, connection->get_features());
+	  m.decode(p->second);
+	  p->second.clear();
+	  m.encode(p->second, connection->get_features());
 	}
-	inc.encode(p->second, connection->get_features());
-      }
-      for (map<epoch_t,bufferlist>::iterator p = maps.begin();
-	   p != maps.end();
-	   ++p) {
-	OSDMap m;
-	m.decode(p->second);
-	p->second.clear();
-	m.encode(p->second, connection->get_features());
       }
       header.version = 1;
     }
@@ -22,6 +22,7 @@ class MPGStats : public PaxosServiceMessage {
 public:
   uuid_d fsid;
   map<pg_t,pg_stat_t> pg_stat;
+  map<pg_t,pg_stat_delta_t> pg_stat_delta;  // against the last acked report
   osd_stat_t osd_stat;
   epoch_t epoch;
   utime_t had_map_for;
@@ -36,16 +37,21 @@ private:
 public:
   const char *get_type_name() { return "pg_stats"; }
   void print(ostream& out) {
-    out << "pg_stats(" << pg_stat.size() << " pgs tid " << get_tid() << " v " << version << ")";
+    out << "pg_stats(" << pg_stat.size();
+    if (pg_stat_delta.size())
+      out << "+" << pg_stat_delta.size() << " delta";
+    out << " pgs tid " << get_tid() << " v " << version << ")";
   }
 
   void encode_payload(CephContext *cct) {
+    header.version = 2;
     paxos_encode();
     ::encode(fsid, payload);
     ::encode(osd_stat, payload);
     ::encode(pg_stat, payload);
     ::encode(epoch, payload);
     ::encode(had_map_for, payload);
+    ::encode(pg_stat_delta, payload);
   }
   void decode_payload(CephContext *cct) {
     bufferlist::iterator p = payload.begin();
@@ -55,6 +61,8 @@ public:
     ::decode(pg_stat, p);
     ::decode(epoch, p);
     ::decode(had_map_for, p);
+    if (header.version >= 2)
+      ::decode(pg_stat_delta, p);
   }
 };
 
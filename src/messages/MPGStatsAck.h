@@ -19,7 +19,7 @@
 
 class MPGStatsAck : public Message {
 public:
-  map<pg_t,eversion_t> pg_stat;
+  map<pg_t,eversion_t> pg_stat;   // a zero version asks for a full report
   
   MPGStatsAck() : Message(MSG_PGSTATSACK) {}
 
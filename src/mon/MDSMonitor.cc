@@ -157,6 +157,15 @@ bool MDSMonitor::preprocess_query(PaxosServiceMessage *m)
   }
 }
 
+bool MDSMonitor::is_read_only(PaxosServiceMessage *m)
+{
+  if (m->get_type() != MSG_MON_COMMAND)
+    return false;
+  vector<string>& cmd = ((MMonCommand*)m)->cmd;
+  return cmd.size() > 1 &&
+    (cmd[1] == "stat" || cmd[1] == "dump" || cmd[1] == "getmap");
+}
+
 void MDSMonitor::_note_beacon(MMDSBeacon *m)
 {
   uint64_t gid = m->get_global_id();
@@ -76,6 +76,7 @@ class MDSMonitor : public PaxosService {
   void _updated(MMDSBeacon *m);
  
   bool preprocess_query(PaxosServiceMessage *m);  // true if processed.
+  bool is_read_only(PaxosServiceMessage *m);
   bool prepare_update(PaxosServiceMessage *m);
   bool should_propose(double& delay);
 
@@ -195,6 +195,11 @@ public:
     Mutex::Locker l(monc_lock);
     _reopen_session();
   }
+  /// does the mon we're talking to have feature @a f?
+  bool mon_has_feature(int f) {
+    Mutex::Locker l(monc_lock);
+    return cur_con && cur_con->has_feature(f);
+  }
 
   entity_addr_t get_my_addr() const {
     return my_addr;
@@ -636,6 +636,8 @@ void Monitor::handle_probe_data(MMonProbe *m)
   Paxos *pax = get_paxos_by_name(m->machine_name);
   assert(pax);
 
+  store->start_transaction();
+
   // trim old cruft?
   if (m->oldest_version > pax->get_first_committed())
     pax->trim_to(m->oldest_version, true);
@@ -660,6 +662,7 @@ void Monitor::handle_probe_data(MMonProbe *m)
   if (m->latest_version) {
     pax->stash_latest(m->latest_version, m->latest_value);
   }
+  store->commit_transaction();
 
   m->put();
 
@@ -1029,12 +1032,14 @@ void Monitor::forward_request_leader(PaxosServiceMessage *req)
     rr->client = req->get_source_inst();
     encode_message(g_ceph_context, req, rr->request_bl);
     rr->session = (MonSession *)session->get();
+    rr->con_features = req->get_connection()->get_features();
     routed_requests[rr->tid] = rr;
     session->routed_request_tids.insert(rr->tid);
     
     dout(10) << "forward_request " << rr->tid << " request " << *req << dendl;
 
-    MForward *forward = new MForward(rr->tid, req, rr->session->caps);
+    MForward *forward = new MForward(rr->tid, req, rr->session->caps,
+				     rr->con_features);
     forward->set_priority(req->get_priority());
     messenger->send_message(forward, monmap->get_inst(mon));
   } else {
@@ -1062,6 +1067,7 @@ void Monitor::handle_forward(MForward *m)
     c->set_priv(s);
     c->set_peer_addr(m->client.addr);
     c->set_peer_type(m->client.name.type());
+    c->set_features(m->con_features);
 
     s->caps = m->client_caps;
     s->proxy_con = m->get_connection()->get();
@@ -1176,7 +1182,8 @@ void Monitor::resend_routed_requests()
     PaxosServiceMessage *req = (PaxosServiceMessage *)decode_message(cct, q);
 
     dout(10) << " resend to mon." << mon << " tid " << rr->tid << " " << *req << dendl;
-    MForward *forward = new MForward(rr->tid, req, rr->session->caps);
+    MForward *forward = new MForward(rr->tid, req, rr->session->caps,
+				     rr->con_features);
     forward->client = rr->client;
     forward->set_priority(req->get_priority());
     messenger->send_message(forward, monmap->get_inst(mon));
@@ -1388,14 +1395,17 @@ bool Monitor::_ms_dispatch(Message *m)
 	  break;
 	}
 
-	// send it to the right paxos instance
+	// send it to the right paxos instance.  whatever it and the
+	// service write as a result is committed to the store at once.
 	assert(pm->machine_id < PAXOS_NUM);
 	Paxos *p = paxos[pm->machine_id];
+	store->start_transaction();
 	p->dispatch((PaxosServiceMessage*)m);
 
 	// make sure service finds out about any state changes
 	if (p->is_active())
 	  paxos_service[p->machine_id]->update_from_paxos();
+	store->commit_transaction();
       }
       break;
 
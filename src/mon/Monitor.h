@@ -254,7 +254,9 @@ public:
     entity_inst_t client;
     bufferlist request_bl;
     MonSession *session;
+    unsigned con_features;
 
+    RoutedRequest() : tid(0), session(NULL), con_features(0) {}
     ~RoutedRequest() {
       if (session)
 	session->put();
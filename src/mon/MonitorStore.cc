@@ -13,6 +13,7 @@
  */
 
 #include "MonitorStore.h"
+#include "MonitorStoreLog.h"
 #include "common/Clock.h"
 #include "common/debug.h"
 #include "common/entity_name.h"
@@ -45,6 +46,11 @@ static ostream& _prefix(std::ostream *_dout, const string& dir) {
 #include <sstream>
 #include <sys/file.h>
 
+MonitorStore::~MonitorStore()
+{
+  delete log;
+}
+
 int MonitorStore::mount()
 {
   char t[1024];
@@ -84,15 +90,63 @@ int MonitorStore::mount()
     dir += "/";
     dir += old;
   }
+
+  string logfn = dir + "/store.log";
+  struct stat st;
+  if (::stat(logfn.c_str(), &st) == 0) {
+    dout(1) << "using log " << logfn << dendl;
+    log = new MonitorStoreLog(logfn);
+    log->set_compaction(g_conf->mon_store_log_compact_min,
+			g_conf->mon_store_log_compact_ratio);
+    r = log->open();
+    if (r < 0) {
+      delete log;
+      log = 0;
+      return r;
+    }
+  }
   return 0;
 }
 
 int MonitorStore::umount()
 {
+  if (log) {
+    log->close();
+    delete log;
+    log = 0;
+  }
   ::close(lock_fd);
   return 0;
 }
 
+void MonitorStore::start_transaction()
+{
+  if (log)
+    log->start_transaction();
+}
+
+void MonitorStore::commit_transaction()
+{
+  if (!log)
+    return;
+  int r = log->commit_transaction();
+  if (r < 0) {
+    derr << "MonitorStore::commit_transaction: " << cpp_strerror(r) << dendl;
+    ceph_abort();
+  }
+}
+
+void MonitorStore::sync()
+{
+  if (!log)
+    return;
+  int r = log->sync();
+  if (r < 0) {
+    derr << "MonitorStore::sync: " << cpp_strerror(r) << dendl;
+    ceph_abort();
+  }
+}
+
 int MonitorStore::mkfs()
 {
   std::string ret = run_cmd("rm", "-rf", dir.c_str(), (char*)NULL);
@@ -109,6 +163,20 @@ int MonitorStore::mkfs()
     return -EIO;
   }
 
+  if (g_conf->mon_store_backend == "log") {
+    string logfn = dir + "/store.log";
+    int r = MonitorStoreLog::create(logfn);
+    if (r < 0) {
+      derr << "MonitorStore::mkfs: failed to create " << logfn << ": "
+	   << cpp_strerror(r) << dendl;
+      return r;
+    }
+  } else if (g_conf->mon_store_backend != "file") {
+    derr << "MonitorStore::mkfs: unknown mon_store_backend '"
+	 << g_conf->mon_store_backend << "'" << dendl;
+    return -EINVAL;
+  }
+
   dout(0) << "created monfs at " << dir.c_str() << " for "
 	  << g_conf->name.get_id() << dendl;
   return 0;
@@ -116,6 +184,16 @@ int MonitorStore::mkfs()
 
 version_t MonitorStore::get_int(const char *a, const char *b)
 {
+  if (log) {
+    bufferlist bl;
+    if (log->get(get_key(a, b), bl) <= 0)
+      return 0;
+    string s(bl.c_str(), bl.length());
+    version_t val = atoi(s.c_str());
+    dout(15) << "get_int " << get_key(a, b) << " = " << val << dendl;
+    return val;
+  }
+
   char fn[1024];
   if (b)
     snprintf(fn, sizeof(fn), "%s/%s/%s", dir.c_str(), a, b);
@@ -158,6 +236,21 @@ version_t MonitorStore::get_int(const char *a, const char *b)
 
 void MonitorStore::put_int(version_t val, const char *a, const char *b)
 {
+  if (log) {
+    dout(15) << "set_int " << get_key(a, b) << " = " << val << dendl;
+    char vs[30];
+    snprintf(vs, sizeof(vs), "%lld\n", (unsigned long long)val);
+    bufferlist bl;
+    bl.append(vs);
+    int r = log->put(get_key(a, b), bl);
+    if (r < 0) {
+      derr << "MonitorStore::put_int: failed to write " << get_key(a, b)
+	   << ": " << cpp_strerror(r) << dendl;
+      ceph_abort();
+    }
+    return;
+  }
+
   char fn[1024];
   snprintf(fn, sizeof(fn), "%s/%s", dir.c_str(), a);
   if (b) {
@@ -207,6 +300,11 @@ void MonitorStore::put_int(version_t val, const char *a, const char *b)
 
 bool MonitorStore::exists_bl_ss(const char *a, const char *b)
 {
+  if (log) {
+    dout(15) << "exists_bl " << get_key(a, b) << dendl;
+    return log->exists(get_key(a, b));
+  }
+
   char fn[1024];
   if (b) {
     dout(15) << "exists_bl " << a << "/" << b << dendl;
@@ -225,6 +323,11 @@ bool MonitorStore::exists_bl_ss(const char *a, const char *b)
 
 int MonitorStore::erase_ss(const char *a, const char *b)
 {
+  if (log) {
+    dout(15) << "erase_ss " << get_key(a, b) << dendl;
+    return log->erase(get_key(a, b));
+  }
+
   char fn[1024];
   char dr[1024];
   snprintf(dr, sizeof(dr), "%s/%s", dir.c_str(), a);
@@ -242,6 +345,12 @@ int MonitorStore::erase_ss(const char *a, const char *b)
 
 int MonitorStore::get_bl_ss(bufferlist& bl, const char *a, const char *b)
 {
+  if (log) {
+    int r = log->get(get_key(a, b), bl);
+    dout(15) << "get_bl " << get_key(a, b) << " = " << r << dendl;
+    return r;
+  }
+
   char fn[1024];
   if (b) {
     snprintf(fn, sizeof(fn), "%s/%s/%s", dir.c_str(), a, b);
@@ -294,6 +403,11 @@ int MonitorStore::get_bl_ss(bufferlist& bl, const char *a, const char *b)
 
 int MonitorStore::write_bl_ss_impl(bufferlist& bl, const char *a, const char *b, bool append)
 {
+  if (log && !append) {
+    dout(15) << "put_bl " << get_key(a, b) << " = " << bl.length() << " bytes" << dendl;
+    return log->put(get_key(a, b), bl);
+  }
+
   char fn[1024];
   snprintf(fn, sizeof(fn), "%s/%s", dir.c_str(), a);
   if (b) {
@@ -356,6 +470,14 @@ int MonitorStore::put_bl_sn_map(const char *a,
   version_t last = lastp->first;
   dout(15) <<  "put_bl_sn_map " << a << "/[" << first << ".." << last << "]" << dendl;
 
+  if (log) {
+    start_transaction();
+    for (map<version_t,bufferlist>::iterator p = start; p != end; ++p)
+      put_bl_sn(p->second, a, p->first);
+    commit_transaction();
+    return 0;
+  }
+
   // only do a big sync if there are several values, or if the feature is disabled.
   if (g_conf->mon_sync_fs_threshold <= 0 ||
       last - first < (unsigned)g_conf->mon_sync_fs_threshold) {
@@ -21,22 +21,58 @@
 #include <iosfwd>
 #include <string.h>
 
+class MonitorStoreLog;
+
+/*
+ * The monitor's key/value store.  Keys are "a" or "a/b".
+ *
+ * A store made with mon_store_backend = file keeps every key in its own
+ * file, written with write/fsync/rename.  With log, keys live in a
+ * single append-only log (see MonitorStoreLog) and the file-per-key
+ * layout is only used for the append_bl_ss text logs.  The backend is
+ * fixed at mkfs time; mount() uses whatever it finds.
+ *
+ * Puts and erases between start_transaction() and commit_transaction()
+ * reach the log backend's disk together, with one fsync, and atomically.
+ * The file backend syncs each put as it goes, so there the transaction
+ * calls are no-ops.
+ */
 class MonitorStore {
   string dir;
   int lock_fd;
+  MonitorStoreLog *log;
+
+  string get_key(const char *a, const char *b) {
+    string k = a;
+    if (b) {
+      k += "/";
+      k += b;
+    }
+    return k;
+  }
 
   int write_bl_ss_impl(bufferlist& bl, const char *a, const char *b,
 		       bool append);
   int write_bl_ss(bufferlist& bl, const char *a, const char *b,
 		  bool append);
 public:
-  MonitorStore(const std::string &d) : dir(d) { }
-  ~MonitorStore() { }
+  MonitorStore(const std::string &d) : dir(d), lock_fd(-1), log(0) { }
+  ~MonitorStore();
 
   int mkfs();  // wipe
   int mount();
   int umount();
 
+  /// group the following writes; transactions nest
+  void start_transaction();
+  /// write out everything since the outermost start_transaction()
+  void commit_transaction();
+  /**
+   * Make everything written so far durable, even mid-transaction.
+   * Call before telling a peer about a value (e.g. accepting it).
+   */
+  void sync();
+
   // ints (stored as ascii)
   version_t get_int(const char *a, const char *b=0);
   void put_int(version_t v, const char *a, const char *b=0);
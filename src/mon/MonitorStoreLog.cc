@@ -0,0 +1,393 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "MonitorStoreLog.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+#include "include/encoding.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define DOUT_SUBSYS mon
+#undef dout_prefix
+#define dout_prefix _prefix(_dout, fn)
+static ostream& _prefix(std::ostream *_dout, const string& fn) {
+  return *_dout << "storelog(" << fn << ") ";
+}
+
+#define LOG_MAGIC 0x6c6e6f6du       // "monl"
+#define HEADER_LEN 12               // magic, payload length, payload crc
+
+// live data per compaction transaction
+#define COMPACT_CHUNK (4 << 20)
+
+MonitorStoreLog::~MonitorStoreLog()
+{
+  close();
+}
+
+int MonitorStoreLog::create(const std::string& fn)
+{
+  int fd = ::open(fn.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0)
+    return -errno;
+  ::fsync(fd);
+  TEMP_FAILURE_RETRY(::close(fd));
+  return 0;
+}
+
+int MonitorStoreLog::open()
+{
+  assert(fd < 0);
+  fd = ::open(fn.c_str(), O_RDWR);
+  if (fd < 0) {
+    int err = -errno;
+    derr << "MonitorStoreLog::open: failed to open '" << fn << "': "
+	 << cpp_strerror(err) << dendl;
+    return err;
+  }
+  return _replay();
+}
+
+void MonitorStoreLog::close()
+{
+  if (fd < 0)
+    return;
+  assert(pending_bl.length() == 0);
+  TEMP_FAILURE_RETRY(::close(fd));
+  fd = -1;
+  index.clear();
+  end = live = live_records = 0;
+}
+
+int MonitorStoreLog::_replay()
+{
+  struct stat st;
+  if (::fstat(fd, &st) < 0)
+    return -errno;
+  uint64_t size = st.st_size;
+
+  index.clear();
+  end = live = live_records = 0;
+  unsigned ntrans = 0;
+  while (end + HEADER_LEN <= size) {
+    bufferlist hbl;
+    if (hbl.read_fd(fd, HEADER_LEN) != HEADER_LEN)
+      break;
+    bufferlist::iterator h = hbl.begin();
+    __u32 magic, len, crc;
+    ::decode(magic, h);
+    ::decode(len, h);
+    ::decode(crc, h);
+    if (magic != LOG_MAGIC || end + HEADER_LEN + len > size)
+      break;
+
+    bufferlist ops;
+    if (ops.read_fd(fd, len) != (ssize_t)len || ops.crc32c(0) != crc)
+      break;
+
+    uint64_t base = end + HEADER_LEN;
+    bool ok = true;
+    try {
+      bufferlist::iterator p = ops.begin();
+      while (!p.end()) {
+	__u8 op;
+	string key;
+	::decode(op, p);
+	::decode(key, p);
+	if (op == OP_PUT) {
+	  __u32 vlen;
+	  ::decode(vlen, p);
+	  _index_put(key, extent_t(base + p.get_off(), vlen));
+	  p.advance(vlen);
+	} else if (op == OP_ERASE) {
+	  _index_erase(key);
+	} else {
+	  ok = false;
+	  break;
+	}
+      }
+    }
+    catch (buffer::error& e) {
+      ok = false;
+    }
+    if (!ok) {
+      // the crc matched, so this was written this way
+      derr << "MonitorStoreLog: undecodable transaction at " << end << dendl;
+      return -EIO;
+    }
+    end = base + len;
+    ntrans++;
+  }
+
+  if (end < size) {
+    dout(0) << "discarding " << (size - end) << " bytes of torn log at "
+	    << end << dendl;
+    if (::ftruncate(fd, end) < 0)
+      return -errno;
+    ::fsync(fd);
+  }
+  dout(10) << "replayed " << ntrans << " transactions, " << index.size()
+	   << " keys, " << live << " of " << end << " bytes live" << dendl;
+  return 0;
+}
+
+void MonitorStoreLog::_index_put(const string& key, const extent_t& e)
+{
+  map<string, extent_t>::iterator p = index.find(key);
+  if (p != index.end()) {
+    live -= p->second.len;
+    live_records -= _record_len(key, p->second.len);
+    p->second = e;
+  } else {
+    index[key] = e;
+  }
+  live += e.len;
+  live_records += _record_len(key, e.len);
+}
+
+void MonitorStoreLog::_index_erase(const string& key)
+{
+  map<string, extent_t>::iterator p = index.find(key);
+  if (p == index.end())
+    return;
+  live -= p->second.len;
+  live_records -= _record_len(key, p->second.len);
+  index.erase(p);
+}
+
+bool MonitorStoreLog::exists(const std::string& key)
+{
+  if (pending_index.count(key))
+    return true;
+  if (pending_erase.count(key))
+    return false;
+  return index.count(key);
+}
+
+int MonitorStoreLog::get(const std::string& key, bufferlist& bl)
+{
+  bl.clear();
+  map<string, extent_t>::iterator p = pending_index.find(key);
+  if (p != pending_index.end()) {
+    pending_bl.copy(p->second.off, p->second.len, bl);
+    return p->second.len;
+  }
+  if (pending_erase.count(key))
+    return -ENOENT;
+
+  p = index.find(key);
+  if (p == index.end())
+    return -ENOENT;
+  bufferptr bp(p->second.len);
+  int r = safe_pread_exact(fd, bp.c_str(), p->second.len, p->second.off);
+  if (r < 0) {
+    derr << "MonitorStoreLog::get: failed to read " << key << " at "
+	 << p->second.off << "~" << p->second.len << ": "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  bl.append(bp);
+  return p->second.len;
+}
+
+int MonitorStoreLog::put(const std::string& key, bufferlist& bl)
+{
+  start_transaction();
+  __u8 op = OP_PUT;
+  ::encode(op, pending_bl);
+  ::encode(key, pending_bl);
+  ::encode((__u32)bl.length(), pending_bl);
+  pending_index[key] = extent_t(pending_bl.length(), bl.length());
+  pending_erase.erase(key);
+  pending_bl.append(bl);
+  return commit_transaction();
+}
+
+int MonitorStoreLog::erase(const std::string& key)
+{
+  if (!exists(key))
+    return -ENOENT;
+  start_transaction();
+  __u8 op = OP_ERASE;
+  ::encode(op, pending_bl);
+  ::encode(key, pending_bl);
+  pending_index.erase(key);
+  pending_erase.insert(key);
+  return commit_transaction();
+}
+
+int MonitorStoreLog::commit_transaction()
+{
+  assert(depth > 0);
+  if (--depth > 0)
+    return 0;
+  int r = _flush();
+  if (r < 0)
+    return r;
+  if (compact_min && end >= compact_min &&
+      end > _compacted_size() * compact_ratio)
+    r = compact();
+  return r;
+}
+
+/// what compact() would leave behind: the live records plus a
+/// transaction header per COMPACT_CHUNK of them
+uint64_t MonitorStoreLog::_compacted_size() const
+{
+  return live_records + HEADER_LEN * (live_records / COMPACT_CHUNK + 1);
+}
+
+int MonitorStoreLog::sync()
+{
+  return _flush();
+}
+
+int MonitorStoreLog::_write_transaction(int fd, bufferlist& ops)
+{
+  bufferlist bl;
+  ::encode((__u32)LOG_MAGIC, bl);
+  ::encode((__u32)ops.length(), bl);
+  ::encode((__u32)ops.crc32c(0), bl);
+  bl.append(ops);
+  return bl.write_fd(fd);
+}
+
+int MonitorStoreLog::_flush()
+{
+  if (pending_bl.length() == 0)
+    return 0;
+  assert(fd >= 0);
+
+  dout(15) << "flush " << pending_index.size() << " puts, "
+	   << pending_erase.size() << " erases, " << pending_bl.length()
+	   << " bytes at " << end << dendl;
+  if (::lseek64(fd, end, SEEK_SET) < 0)
+    return -errno;
+  int r = _write_transaction(fd, pending_bl);
+  if (r == 0 && ::fdatasync(fd) < 0)
+    r = -errno;
+  if (r < 0) {
+    derr << "MonitorStoreLog: failed to write transaction at " << end << ": "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  uint64_t base = end + HEADER_LEN;
+  for (set<string>::iterator p = pending_erase.begin(); p != pending_erase.end(); ++p)
+    _index_erase(*p);
+  for (map<string, extent_t>::iterator p = pending_index.begin();
+       p != pending_index.end();
+       ++p)
+    _index_put(p->first, extent_t(base + p->second.off, p->second.len));
+  end = base + pending_bl.length();
+
+  pending_bl.clear();
+  pending_index.clear();
+  pending_erase.clear();
+  return 0;
+}
+
+int MonitorStoreLog::compact()
+{
+  assert(depth == 0 && pending_bl.length() == 0);
+  dout(10) << "compact " << live << " of " << end << " bytes live, "
+	   << index.size() << " keys" << dendl;
+
+  string tfn = fn + ".compact";
+  int tfd = ::open(tfn.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (tfd < 0) {
+    int err = -errno;
+    derr << "MonitorStoreLog::compact: failed to open '" << tfn << "': "
+	 << cpp_strerror(err) << dendl;
+    return err;
+  }
+
+  // copy live values, a chunk per transaction; the new file only
+  // takes effect once it is all there.
+  map<string, extent_t> new_index;
+  uint64_t new_end = 0;
+  bufferlist ops;
+  vector<pair<string, uint32_t> > chunk_keys;   // key, value offset in ops
+  int r = 0;
+  map<string, extent_t>::iterator p = index.begin();
+  while (p != index.end() || ops.length()) {
+    if (p != index.end() && ops.length() < COMPACT_CHUNK) {
+      bufferlist v;
+      r = get(p->first, v);
+      if (r < 0)
+	break;
+      __u8 op = OP_PUT;
+      ::encode(op, ops);
+      ::encode(p->first, ops);
+      ::encode((__u32)v.length(), ops);
+      chunk_keys.push_back(make_pair(p->first, ops.length()));
+      ops.append(v);
+      ++p;
+      continue;
+    }
+    r = _write_transaction(tfd, ops);
+    if (r < 0)
+      break;
+    uint64_t base = new_end + HEADER_LEN;
+    for (unsigned i = 0; i < chunk_keys.size(); i++)
+      new_index[chunk_keys[i].first] =
+	extent_t(base + chunk_keys[i].second, index[chunk_keys[i].first].len);
+    new_end = base + ops.length();
+    ops.clear();
+    chunk_keys.clear();
+  }
+  if (r >= 0 && ::fsync(tfd) < 0)
+    r = -errno;
+  TEMP_FAILURE_RETRY(::close(tfd));
+  if (r >= 0 && ::rename(tfn.c_str(), fn.c_str()) < 0)
+    r = -errno;
+  if (r < 0) {
+    derr << "MonitorStoreLog::compact: failed: " << cpp_strerror(r) << dendl;
+    ::unlink(tfn.c_str());
+    return r;
+  }
+
+  // commit the rename
+  string dir = ".";
+  size_t slash = fn.rfind('/');
+  if (slash != string::npos)
+    dir = fn.substr(0, slash ? slash : 1);
+  int dirfd = ::open(dir.c_str(), O_RDONLY);
+  if (dirfd >= 0) {
+    ::fsync(dirfd);
+    TEMP_FAILURE_RETRY(::close(dirfd));
+  }
+
+  int nfd = ::open(fn.c_str(), O_RDWR);
+  if (nfd < 0) {
+    r = -errno;
+    derr << "MonitorStoreLog::compact: failed to reopen '" << fn << "': "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  TEMP_FAILURE_RETRY(::close(fd));
+  fd = nfd;
+
+  dout(10) << "compact " << end << " -> " << new_end << " bytes" << dendl;
+  index.swap(new_index);
+  end = new_end;
+  num_compactions++;
+  return 0;
+}
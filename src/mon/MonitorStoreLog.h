@@ -0,0 +1,120 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MON_MONITORSTORELOG_H
+#define CEPH_MON_MONITORSTORELOG_H
+
+#include "include/types.h"
+#include "include/buffer.h"
+
+#include <map>
+#include <string>
+
+/*
+ * A key/value store kept in a single append-only file, used by
+ * MonitorStore in place of a file per key.
+ *
+ * The file is a sequence of transactions, each a header (magic,
+ * length, crc32c) followed by its puts and erases.  Every key's
+ * current value is indexed in memory by its offset in the file, so
+ * reads are a single pread.  Puts and erases between
+ * start_transaction() and commit_transaction() are buffered and then
+ * written with one write and one fsync; a transaction torn by a crash
+ * fails its crc and is discarded (along with anything after it) when
+ * the log is next replayed.  Outside a transaction every put is its
+ * own transaction.
+ *
+ * Overwritten and erased values are dead space.  Once the file is at
+ * least compact_min bytes and more than compact_ratio times what the
+ * live keys would take in a fresh log, commit rewrites them to a new
+ * file and renames it over the old one.
+ *
+ * There is no locking; the caller serializes access.
+ */
+class MonitorStoreLog {
+public:
+  MonitorStoreLog(const std::string& fn)
+    : fn(fn), fd(-1), end(0), live(0), live_records(0), depth(0),
+      compact_min(0), compact_ratio(0), num_compactions(0) {}
+  ~MonitorStoreLog();
+
+  static int create(const std::string& fn);
+
+  /// open and replay the log; a torn tail is truncated away
+  int open();
+  void close();
+
+  bool exists(const std::string& key);
+  int get(const std::string& key, bufferlist& bl);
+  int put(const std::string& key, bufferlist& bl);
+  int erase(const std::string& key);
+
+  /// transactions nest; only the outermost commit writes
+  void start_transaction() { depth++; }
+  int commit_transaction();
+  /// write out and fsync whatever is buffered, even mid-transaction
+  int sync();
+
+  /// compact once the log is >= @a min bytes and > @a ratio x its compacted size
+  void set_compaction(uint64_t min, double ratio) {
+    compact_min = min;
+    compact_ratio = ratio;
+  }
+  int compact();
+
+  uint64_t get_size() const { return end; }
+  uint64_t get_live() const { return live; }
+  unsigned get_num_compactions() const { return num_compactions; }
+
+private:
+  enum {
+    OP_PUT = 1,
+    OP_ERASE = 2,
+  };
+
+  struct extent_t {
+    uint64_t off;
+    uint32_t len;
+    extent_t(uint64_t o=0, uint32_t l=0) : off(o), len(l) {}
+  };
+
+  std::string fn;
+  int fd;
+  uint64_t end;    // end of the last complete transaction
+  uint64_t live;   // bytes of indexed values
+  uint64_t live_records;  // ... plus their op, key and length encoding
+  map<string, extent_t> index;
+
+  // the open transaction
+  int depth;
+  bufferlist pending_bl;                     // encoded ops
+  map<string, extent_t> pending_index;       // offsets within pending_bl
+  set<string> pending_erase;
+
+  uint64_t compact_min;
+  double compact_ratio;
+  unsigned num_compactions;
+
+  static uint64_t _record_len(const string& key, uint32_t vlen) {
+    return 1 + 4 + key.length() + 4 + vlen;   // op, key, value length, value
+  }
+  uint64_t _compacted_size() const;
+  void _index_put(const string& key, const extent_t& e);
+  void _index_erase(const string& key);
+  int _flush();
+  int _replay();
+  static int _write_transaction(int fd, bufferlist& ops);
+};
+
+#endif
@@ -121,6 +121,15 @@ bool MonmapMonitor::preprocess_query(PaxosServiceMessage *m)
   }
 }
 
+bool MonmapMonitor::is_read_only(PaxosServiceMessage *m)
+{
+  if (m->get_type() != MSG_MON_COMMAND)
+    return false;
+  vector<string>& cmd = ((MMonCommand*)m)->cmd;
+  return cmd.size() > 1 &&
+    (cmd[1] == "stat" || cmd[1] == "dump" || cmd[1] == "getmap");
+}
+
 bool MonmapMonitor::preprocess_command(MMonCommand *m)
 {
   int r = -1;
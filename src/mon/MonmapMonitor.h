@@ -53,6 +53,7 @@ class MonmapMonitor : public PaxosService {
 
 
   bool preprocess_query(PaxosServiceMessage *m);
+  bool is_read_only(PaxosServiceMessage *m);
   bool prepare_update(PaxosServiceMessage *m);
 
   bool preprocess_join(MMonJoin *m);
@@ -56,8 +56,13 @@ static ostream& _prefix(std::ostream *_dout, Monitor *mon, OSDMap& osdmap) {
 
 
 /************ MAPS ****************/
+// the features that change how maps are encoded
+#define MAP_ENCODE_FEATURES (CEPH_FEATURE_PGID64 | CEPH_FEATURE_PGPOOL3)
+
 OSDMonitor::OSDMonitor(Monitor *mn, Paxos *p)
-  : PaxosService(mn, p)
+  : PaxosService(mn, p),
+    inc_cache(g_conf->mon_osd_cache_size),
+    full_cache(g_conf->mon_osd_cache_size)
 {
   // we need to trim this too
   p->add_extra_state_dir("osdmap_full");
@@ -112,11 +117,13 @@ bool OSDMonitor::update_from_paxos()
     dout(7) << "update_from_paxos  applying incremental " << osdmap.epoch+1 << dendl;
     OSDMap::Incremental inc(bl);
     osdmap.apply_incremental(inc);
+    inc_cache.add(make_pair(osdmap.epoch, (int)MAP_ENCODE_FEATURES), bl);
 
     // write out the full map for all past epochs
     bl.clear();
     osdmap.encode(bl);
     mon->store->put_bl_sn(bl, "osdmap_full", osdmap.epoch);
+    full_cache.add(make_pair(osdmap.epoch, (int)MAP_ENCODE_FEATURES), bl);
 
     // share
     dout(1) << osdmap << dendl;
@@ -128,6 +135,10 @@ bool OSDMonitor::update_from_paxos()
   // save latest
   paxos->stash_latest(paxosv, bl);
 
+  // PGMonitor maps every pg against each new epoch
+  if (g_conf->osd_map_mapping_threads)
+    osdmap.update_mapping(g_conf->osd_map_mapping_threads);
+
   // populate down -> out map
   for (int o = 0; o < osdmap.get_max_osd(); o++)
     if (osdmap.is_down(o) && osdmap.is_in(o) &&
@@ -319,7 +330,8 @@ void OSDMonitor::share_map_with_random_osd()
   MonSession *s = mon->session_map.get_random_osd_session();
   if (s) {
     dout(10) << "committed, telling random " << s->inst << " all about it" << dendl;
-    MOSDMap *m = build_incremental(osdmap.get_epoch() - 1, osdmap.get_epoch());  // whatev, they'll request more if they need it
+    MOSDMap *m = build_incremental(osdmap.get_epoch() - 1, osdmap.get_epoch(),  // whatev, they'll request more if they need it
+				   s->con->get_features());
     mon->messenger->send_message(m, s->inst);
   }
 }
@@ -359,6 +371,24 @@ bool OSDMonitor::preprocess_query(PaxosServiceMessage *m)
   }
 }
 
+bool OSDMonitor::is_read_only(PaxosServiceMessage *m)
+{
+  if (m->get_type() != MSG_MON_COMMAND)
+    return false;
+  vector<string>& cmd = ((MMonCommand*)m)->cmd;
+  if (cmd.size() < 2)
+    return false;
+  if (cmd[1] == "stat" || cmd[1] == "dump" || cmd[1] == "tree" ||
+      cmd[1] == "getmap" || cmd[1] == "getcrushmap" ||
+      cmd[1] == "getmaxosd" || cmd[1] == "lspools")
+    return true;
+  if (cmd.size() > 2 &&
+      ((cmd[1] == "blacklist" && cmd[2] == "ls") ||
+       (cmd[1] == "pool" && cmd[2] == "get")))
+    return true;
+  return false;
+}
+
 bool OSDMonitor::prepare_update(PaxosServiceMessage *m)
 {
   dout(7) << "prepare_update " << *m << " from " << m->get_orig_source_inst() << dendl;
@@ -930,30 +960,87 @@ void OSDMonitor::send_latest(PaxosServiceMessage *m, epoch_t start)
 }
 
 
-MOSDMap *OSDMonitor::build_latest_full()
+bool OSDMonitor::get_version(epoch_t e, bufferlist& bl, int features)
+{
+  features &= MAP_ENCODE_FEATURES;
+  if (inc_cache.lookup(make_pair(e, features), &bl))
+    return true;
+  bufferlist t;
+  if (features == MAP_ENCODE_FEATURES) {
+    if (mon->store->get_bl_sn(t, "osdmap", e) <= 0)
+      return false;
+  } else {
+    // an old peer; reencode once for all of them
+    bufferlist cur;
+    if (!get_version(e, cur))
+      return false;
+    OSDMap::Incremental inc;
+    bufferlist::iterator p = cur.begin();
+    inc.decode(p);
+    if (inc.fullmap.length()) {
+      // embedded full map?
+      OSDMap m;
+      m.decode(inc.fullmap);
+      inc.fullmap.clear();
+      m.encode(inc.fullmap, features);
+    }
+    inc.encode(t, features);
+  }
+  inc_cache.add(make_pair(e, features), t);
+  bl = t;
+  return true;
+}
+
+bool OSDMonitor::get_version_full(epoch_t e, bufferlist& bl, int features)
+{
+  features &= MAP_ENCODE_FEATURES;
+  if (full_cache.lookup(make_pair(e, features), &bl))
+    return true;
+  bufferlist t;
+  if (features == MAP_ENCODE_FEATURES) {
+    if (mon->store->get_bl_sn(t, "osdmap_full", e) <= 0)
+      return false;
+  } else {
+    bufferlist cur;
+    if (!get_version_full(e, cur))
+      return false;
+    OSDMap m;
+    m.decode(cur);
+    m.encode(t, features);
+  }
+  full_cache.add(make_pair(e, features), t);
+  bl = t;
+  return true;
+}
+
+MOSDMap *OSDMonitor::build_latest_full(int features)
 {
-  MOSDMap *r = new MOSDMap(mon->monmap->fsid, &osdmap);
+  MOSDMap *r = new MOSDMap(mon->monmap->fsid);
   r->oldest_map = paxos->get_first_committed();
   r->newest_map = osdmap.get_epoch();
+  r->encode_features = features;
+  if (!get_version_full(osdmap.get_epoch(), r->maps[osdmap.get_epoch()], features))
+    osdmap.encode(r->maps[osdmap.get_epoch()], features);
   return r;
 }
 
-MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
+MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to, int features)
 {
   dout(10) << "build_incremental [" << from << ".." << to << "]" << dendl;
   MOSDMap *m = new MOSDMap(mon->monmap->fsid);
   m->oldest_map = paxos->get_first_committed();
   m->newest_map = osdmap.get_epoch();
+  m->encode_features = features;
 
   for (epoch_t e = to;
        e >= from && e > 0;
        e--) {
     bufferlist bl;
-    if (mon->store->get_bl_sn(bl, "osdmap", e) > 0) {
+    if (get_version(e, bl, features)) {
       dout(20) << "build_incremental    inc " << e << " " << bl.length() << " bytes" << dendl;
       m->incremental_maps[e] = bl;
     } 
-    else if (mon->store->get_bl_sn(bl, "osdmap_full", e) > 0) {
+    else if (get_version_full(e, bl, features)) {
       dout(20) << "build_incremental   full " << e << " " << bl.length() << " bytes" << dendl;
       m->maps[e] = bl;
     }
@@ -967,32 +1054,35 @@ MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
 void OSDMonitor::send_full(PaxosServiceMessage *m)
 {
   dout(5) << "send_full to " << m->get_orig_source_inst() << dendl;
-  mon->send_reply(m, build_latest_full());
+  mon->send_reply(m, build_latest_full(m->get_connection()->get_features()));
 }
 
 void OSDMonitor::send_incremental(PaxosServiceMessage *req, epoch_t first)
 {
   dout(5) << "send_incremental [" << first << ".." << osdmap.get_epoch() << "]"
 	  << " to " << req->get_orig_source_inst() << dendl;
+  int features = req->get_connection()->get_features();
   if (first < paxos->get_first_committed()) {
     first = paxos->get_first_committed();
     bufferlist bl;
-    mon->store->get_bl_sn(bl, "osdmap_full", first);
+    get_version_full(first, bl, features);
     dout(20) << "send_incremental starting with base full " << first << " " << bl.length() << " bytes" << dendl;
     MOSDMap *m = new MOSDMap(osdmap.get_fsid());
     m->oldest_map = paxos->get_first_committed();
     m->newest_map = osdmap.get_epoch();
+    m->encode_features = features;
     m->maps[first] = bl;
     mon->send_reply(req, m);
     return;
   }
-  MOSDMap *m = build_incremental(first, osdmap.get_epoch());
+  MOSDMap *m = build_incremental(first, osdmap.get_epoch(), features);
   m->oldest_map = paxos->get_first_committed();
   m->newest_map = osdmap.get_epoch();
   mon->send_reply(req, m);
 }
 
-void OSDMonitor::send_incremental(epoch_t first, entity_inst_t& dest, bool onetime)
+void OSDMonitor::send_incremental(epoch_t first, entity_inst_t& dest, bool onetime,
+				  int features)
 {
   dout(5) << "send_incremental [" << first << ".." << osdmap.get_epoch() << "]"
 	  << " to " << dest << dendl;
@@ -1000,11 +1090,12 @@ void OSDMonitor::send_incremental(epoch_t first, entity_inst_t& dest, bool oneti
   if (first < paxos->get_first_committed()) {
     first = paxos->get_first_committed();
     bufferlist bl;
-    mon->store->get_bl_sn(bl, "osdmap_full", first);
+    get_version_full(first, bl, features);
     dout(20) << "send_incremental starting with base full " << first << " " << bl.length() << " bytes" << dendl;
     MOSDMap *m = new MOSDMap(osdmap.get_fsid());
     m->oldest_map = paxos->get_first_committed();
     m->newest_map = osdmap.get_epoch();
+    m->encode_features = features;
     m->maps[first] = bl;
     mon->messenger->send_message(m, dest);
     first++;
@@ -1012,7 +1103,7 @@ void OSDMonitor::send_incremental(epoch_t first, entity_inst_t& dest, bool oneti
 
   while (first <= osdmap.get_epoch()) {
     epoch_t last = MIN(first + g_conf->osd_map_message_max, osdmap.get_epoch());
-    MOSDMap *m = build_incremental(first, last);
+    MOSDMap *m = build_incremental(first, last, features);
     mon->messenger->send_message(m, dest);
     first = last + 1;
     if (onetime)
@@ -1047,10 +1138,12 @@ void OSDMonitor::check_subs()
 void OSDMonitor::check_sub(Subscription *sub)
 {
   if (sub->next <= osdmap.get_epoch()) {
+    int features = sub->session->con->get_features();
     if (sub->next >= 1)
-      send_incremental(sub->next, sub->session->inst, sub->incremental_onetime);
+      send_incremental(sub->next, sub->session->inst, sub->incremental_onetime,
+		       features);
     else
-      mon->messenger->send_message(build_latest_full(),
+      mon->messenger->send_message(build_latest_full(features),
 				   sub->session->inst);
     if (sub->onetime)
       mon->session_map.remove_sub(sub);
@@ -1281,7 +1374,7 @@ bool OSDMonitor::preprocess_command(MMonCommand *m)
       OSDMap *p = &osdmap;
       if (epoch) {
 	bufferlist b;
-	mon->store->get_bl_sn(b,"osdmap_full", epoch);
+	get_version_full(epoch, b);
 	if (!b.length()) {
 	  p = 0;
 	  r = -ENOENT;
@@ -1419,6 +1512,43 @@ bool OSDMonitor::preprocess_command(MMonCommand *m)
       ss << "listed " << osdmap.blacklist.size() << " entries";
       r = 0;
     }
+    else if (m->cmd.size() >= 3 && m->cmd[1] == "pool" && m->cmd[2] == "get") {
+      if (m->cmd.size() != 5) {
+	r = -EINVAL;
+	ss << "usage: osd pool get <poolname> <field>";
+	goto out;
+      }
+      int64_t pool = osdmap.lookup_pg_pool_name(m->cmd[3].c_str());
+      if (pool < 0) {
+	ss << "unrecognized pool '" << m->cmd[3] << "'";
+	r = -ENOENT;
+	goto out;
+      }
+
+      const pg_pool_t *p = osdmap.get_pg_pool(pool);
+      if (m->cmd[4] == "pg_num") {
+	ss << "PG_NUM: " << p->get_pg_num();
+	r = 0;
+	goto out;
+      }
+      if (m->cmd[4] == "pgp_num") {
+	ss << "PGP_NUM: " << p->get_pgp_num();
+	r = 0;
+	goto out;
+      }
+      if (m->cmd[4] == "lpg_num") {
+	ss << "LPG_NUM: " << p->get_lpg_num();
+	r = 0;
+	goto out;
+      }
+      if (m->cmd[4] == "lpgp_num") {
+	ss << "LPPG_NUM: " << p->get_lpgp_num();
+	r = 0;
+	goto out;
+      }
+      ss << "don't know how to get pool field " << m->cmd[4];
+      r = -EINVAL;
+    }
   }
  out:
   if (r != -1) {
@@ -2073,43 +2203,6 @@ bool OSDMonitor::prepare_command(MMonCommand *m)
 	  }
 	}
       }
-      else if (m->cmd[2] == "get") {
-	if (m->cmd.size() != 5) {
-	  err = -EINVAL;
-	  ss << "usage: osd pool get <poolname> <field>";
-	  goto out;
-	}
-	int64_t pool = osdmap.lookup_pg_pool_name(m->cmd[3].c_str());
-	if (pool < 0) {
-	  ss << "unrecognized pool '" << m->cmd[3] << "'";
-	  err = -ENOENT;
-	  goto out;
-	}
-
-	const pg_pool_t *p = osdmap.get_pg_pool(pool);
-	if (m->cmd[4] == "pg_num") {
-	  ss << "PG_NUM: " << p->get_pg_num();
-	  err = 0;
-	  goto out;
-	}
-	if (m->cmd[4] == "pgp_num") {
-	  ss << "PGP_NUM: " << p->get_pgp_num();
-	  err = 0;
-	  goto out;
-	}
-	if (m->cmd[4] == "lpg_num") {
-	  ss << "LPG_NUM: " << p->get_lpg_num();
-	  err = 0;
-	  goto out;
-	}
-	if (m->cmd[4] == "lpgp_num") {
-	  ss << "LPPG_NUM: " << p->get_lpgp_num();
-	  err = 0;
-	  goto out;
-	}
-	ss << "don't know how to get pool field " << m->cmd[4];
-	goto out;
-      }
     }
     else if ((m->cmd.size() > 1) &&
 	     (m->cmd[1] == "reweight-by-utilization")) {
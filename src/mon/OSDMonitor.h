@@ -29,6 +29,7 @@ using namespace std;
 
 #include "PaxosService.h"
 #include "Session.h"
+#include "common/simple_cache.h"
 
 class Monitor;
 class MOSDBoot;
@@ -43,6 +44,10 @@ public:
 private:
   map<epoch_t, list<PaxosServiceMessage*> > waiting_for_map;
 
+  // encoded maps, by epoch and by the features they are encoded for,
+  // so that a storm of subscribers share the same buffers
+  SimpleLRU<pair<epoch_t,int>, bufferlist> inc_cache, full_cache;
+
   // [leader]
   OSDMap::Incremental pending_inc;
   multimap<int, pair<int, int> > failed_notes; // <failed_osd, <reporter, #reports> >
@@ -64,16 +69,18 @@ private:
 
   void handle_query(PaxosServiceMessage *m);
   bool preprocess_query(PaxosServiceMessage *m);  // true if processed.
+  bool is_read_only(PaxosServiceMessage *m);
   bool prepare_update(PaxosServiceMessage *m);
   bool should_propose(double &delay);
 
   // ...
   void send_to_waiting();     // send current map to waiters.
-  MOSDMap *build_latest_full();
-  MOSDMap *build_incremental(epoch_t first, epoch_t last);
+  MOSDMap *build_latest_full(int features=-1);
+  MOSDMap *build_incremental(epoch_t first, epoch_t last, int features=-1);
   void send_full(PaxosServiceMessage *m);
   void send_incremental(PaxosServiceMessage *m, epoch_t first);
-  void send_incremental(epoch_t first, entity_inst_t& dest, bool onetime);
+  void send_incremental(epoch_t first, entity_inst_t& dest, bool onetime,
+			int features=-1);
 
   void remove_redundant_pg_temp();
   int reweight_by_utilization(int oload, std::string& out_str);
@@ -178,6 +185,10 @@ private:
 
   epoch_t blacklist(entity_addr_t a, utime_t until);
 
+  // encoded maps for a peer with the given features, via the cache
+  bool get_version(epoch_t e, bufferlist& bl, int features=-1);
+  bool get_version_full(epoch_t e, bufferlist& bl, int features=-1);
+
   void check_subs();
   void check_sub(Subscription *sub);
 
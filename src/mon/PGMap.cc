@@ -47,27 +47,11 @@ void PGMap::apply_incremental(const Incremental& inc)
       osd_stat.insert(v);
     }
     else {
-      stat_osd_sub(t->second);
+      stat_osd_sub(osd, t->second);
       t->second = new_stats;
     }
     
-    stat_osd_add(new_stats);
-    
-    //update the full/nearful_osd sets
-    int from = p->first;
-    float ratio = ((float)p->second.kb_used) / (float) p->second.kb;
-    if ( ratio > full_ratio ) {
-      full_osds.insert(from);
-      //sets don't double-insert so this might be a (very expensive) null-op
-    }
-    else if ( ratio > nearfull_ratio ) {
-      nearfull_osds.insert(from);
-      full_osds.erase(from);
-    }
-    else {//it's not full or near-full
-      full_osds.erase(from);
-      nearfull_osds.erase(from);
-    }
+    stat_osd_add(osd, new_stats);
   }
   for (set<pg_t>::const_iterator p = inc.pg_remove.begin();
        p != inc.pg_remove.end();
@@ -85,7 +69,7 @@ void PGMap::apply_incremental(const Incremental& inc)
        p++) {
     hash_map<int,osd_stat_t>::iterator t = osd_stat.find(*p);
     if (t != osd_stat.end()) {
-      stat_osd_sub(t->second);
+      stat_osd_sub(*p, t->second);
       osd_stat.erase(t);
     }
   }
@@ -119,6 +103,10 @@ void PGMap::stat_zero()
   pg_pool_sum.clear();
   pg_sum = pool_stat_t();
   osd_sum = osd_stat_t();
+  num_pg_by_osd.clear();
+  num_pg_by_last_epoch_clean.clear();
+  full_osds.clear();
+  nearfull_osds.clear();
 }
 
 void PGMap::stat_pg_add(const pg_t &pgid, const pg_stat_t &s)
@@ -127,6 +115,9 @@ void PGMap::stat_pg_add(const pg_t &pgid, const pg_stat_t &s)
   num_pg_by_state[s.state]++;
   pg_pool_sum[pgid.pool()].add(s);
   pg_sum.add(s);
+  num_pg_by_last_epoch_clean[s.last_epoch_clean]++;
+  for (vector<int>::const_iterator p = s.acting.begin(); p != s.acting.end(); ++p)
+    num_pg_by_osd[*p]++;
   if (s.state & PG_STATE_CREATING)
     creating_pgs.insert(pgid);
 }
@@ -138,33 +129,40 @@ void PGMap::stat_pg_sub(const pg_t &pgid, const pg_stat_t &s)
     num_pg_by_state.erase(s.state);
   pg_pool_sum[pgid.pool()].sub(s);
   pg_sum.sub(s);
+  if (--num_pg_by_last_epoch_clean[s.last_epoch_clean] == 0)
+    num_pg_by_last_epoch_clean.erase(s.last_epoch_clean);
+  for (vector<int>::const_iterator p = s.acting.begin(); p != s.acting.end(); ++p)
+    if (--num_pg_by_osd[*p] == 0)
+      num_pg_by_osd.erase(*p);
   if (s.state & PG_STATE_CREATING)
     creating_pgs.erase(pgid);
 }
 
-void PGMap::stat_osd_add(const osd_stat_t &s)
+void PGMap::stat_osd_add(int osd, const osd_stat_t &s)
 {
   num_osd++;
   osd_sum.add(s);
+
+  float ratio = ((float)s.kb_used) / (float)s.kb;
+  if (ratio > full_ratio)
+    full_osds.insert(osd);
+  else if (ratio > nearfull_ratio)
+    nearfull_osds.insert(osd);
 }
 
-void PGMap::stat_osd_sub(const osd_stat_t &s)
+void PGMap::stat_osd_sub(int osd, const osd_stat_t &s)
 {
   num_osd--;
   osd_sum.sub(s);
+  full_osds.erase(osd);
+  nearfull_osds.erase(osd);
 }
 
 epoch_t PGMap::calc_min_last_epoch_clean() const
 {
-  if (pg_stat.empty())
+  if (num_pg_by_last_epoch_clean.empty())
     return 0;
-  hash_map<pg_t,pg_stat_t>::const_iterator p = pg_stat.begin();
-  epoch_t min = p->second.last_epoch_clean;
-  for (++p; p != pg_stat.end(); ++p) {
-    if (p->second.last_epoch_clean < min)
-      min = p->second.last_epoch_clean;
-  }
-  return min;
+  return num_pg_by_last_epoch_clean.begin()->first;
 }
 
 void PGMap::encode(bufferlist &bl)
@@ -214,9 +212,7 @@ void PGMap::decode(bufferlist::iterator &bl)
   for (hash_map<int,osd_stat_t>::iterator p = osd_stat.begin();
        p != osd_stat.end();
        ++p)
-    stat_osd_add(p->second);
-  
-  redo_full_sets();
+    stat_osd_add(p->first, p->second);
 }
 
 void PGMap::dump(Formatter *f) const
@@ -280,6 +276,8 @@ void PGMap::dump_osd_stats(Formatter *f) const
        ++q) {
     f->open_object_section("osd_stat");
     f->dump_int("osd", q->first);
+    hash_map<int,int>::const_iterator n = num_pg_by_osd.find(q->first);
+    f->dump_int("num_pgs", n != num_pg_by_osd.end() ? n->second : 0);
     q->second.dump(f);
     f->close_section();
   }
@@ -287,6 +285,84 @@ void PGMap::dump_osd_stats(Formatter *f) const
 }
 
 
+#define FOR_EACH_PG(i) \
+  for (hash_map<pg_t,pg_stat_t>::const_iterator i = pg_stat.begin(); \
+       i != pg_stat.end(); \
+       ++i)
+
+void PGMap::encode_pg_stats_columns(bufferlist& bl) const
+{
+  __u8 v = 1;
+  ::encode(v, bl);
+  ::encode(version, bl);
+  ::encode((__u32)pg_stat.size(), bl);
+  FOR_EACH_PG(i) ::encode(i->first, bl);
+  FOR_EACH_PG(i) ::encode(i->second.state, bl);
+  FOR_EACH_PG(i) ::encode(i->second.version, bl);
+  FOR_EACH_PG(i) ::encode(i->second.reported, bl);
+  FOR_EACH_PG(i) ::encode(i->second.last_epoch_clean, bl);
+  FOR_EACH_PG(i) ::encode(i->second.last_scrub, bl);
+  FOR_EACH_PG(i) ::encode(i->second.last_scrub_stamp, bl);
+  FOR_EACH_PG(i) ::encode(i->second.log_size, bl);
+  FOR_EACH_PG(i) ::encode(i->second.ondisk_log_size, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_bytes, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_kb, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_objects, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_objects_missing_on_primary, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_objects_degraded, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_objects_unfound, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_rd, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_rd_kb, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_wr, bl);
+  FOR_EACH_PG(i) ::encode(i->second.stats.sum.num_wr_kb, bl);
+  FOR_EACH_PG(i) ::encode(i->second.up, bl);
+  FOR_EACH_PG(i) ::encode(i->second.acting, bl);
+}
+
+#undef FOR_EACH_PG
+
+version_t PGMap::decode_pg_stats_columns(bufferlist::iterator& p,
+					 map<pg_t,pg_stat_t>& pgs)
+{
+  __u8 v;
+  ::decode(v, p);
+  version_t ver;
+  ::decode(ver, p);
+  __u32 n;
+  ::decode(n, p);
+  vector<pg_stat_t*> col(n);
+  for (unsigned k = 0; k < n; k++) {
+    pg_t pgid;
+    ::decode(pgid, p);
+    col[k] = &pgs[pgid];
+  }
+#define DECODE_COLUMN(field) \
+  for (unsigned k = 0; k < n; k++) \
+    ::decode(col[k]->field, p)
+  DECODE_COLUMN(state);
+  DECODE_COLUMN(version);
+  DECODE_COLUMN(reported);
+  DECODE_COLUMN(last_epoch_clean);
+  DECODE_COLUMN(last_scrub);
+  DECODE_COLUMN(last_scrub_stamp);
+  DECODE_COLUMN(log_size);
+  DECODE_COLUMN(ondisk_log_size);
+  DECODE_COLUMN(stats.sum.num_bytes);
+  DECODE_COLUMN(stats.sum.num_kb);
+  DECODE_COLUMN(stats.sum.num_objects);
+  DECODE_COLUMN(stats.sum.num_objects_missing_on_primary);
+  DECODE_COLUMN(stats.sum.num_objects_degraded);
+  DECODE_COLUMN(stats.sum.num_objects_unfound);
+  DECODE_COLUMN(stats.sum.num_rd);
+  DECODE_COLUMN(stats.sum.num_rd_kb);
+  DECODE_COLUMN(stats.sum.num_wr);
+  DECODE_COLUMN(stats.sum.num_wr_kb);
+  DECODE_COLUMN(up);
+  DECODE_COLUMN(acting);
+#undef DECODE_COLUMN
+  return ver;
+}
+
 void PGMap::dump(ostream& ss) const
 {
   ss << "version " << version << std::endl;
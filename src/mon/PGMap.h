@@ -106,12 +106,14 @@ public:
   };
 
 
-  // aggregate stats (soft state)
+  // aggregate stats (soft state), kept up to date as stats come and go
   hash_map<int,int> num_pg_by_state;
   int64_t num_pg, num_osd;
   hash_map<int,pool_stat_t> pg_pool_sum;
   pool_stat_t pg_sum;
   osd_stat_t osd_sum;
+  hash_map<int,int> num_pg_by_osd;                 // pgs each osd is acting for
+  map<epoch_t,int> num_pg_by_last_epoch_clean;
 
   float full_ratio;
   float nearfull_ratio;
@@ -130,8 +132,8 @@ public:
   void stat_zero();
   void stat_pg_add(const pg_t &pgid, const pg_stat_t &s);
   void stat_pg_sub(const pg_t &pgid, const pg_stat_t &s);
-  void stat_osd_add(const osd_stat_t &s);
-  void stat_osd_sub(const osd_stat_t &s);
+  void stat_osd_add(int osd, const osd_stat_t &s);
+  void stat_osd_sub(int osd, const osd_stat_t &s);
   
   void encode(bufferlist &bl);
   void decode(bufferlist::iterator &bl);
@@ -143,6 +145,16 @@ public:
   void dump_osd_stats(Formatter *f) const;
   void dump(ostream& ss) const;
 
+  /*
+   * A compact dump of the per-pg stats for monitoring tools: the columns
+   * of the plain dump, each one encoded for every pg in turn.  The reader
+   * gets back pg_stat_t's with just those fields filled in, and the map
+   * version.
+   */
+  void encode_pg_stats_columns(bufferlist& bl) const;
+  static version_t decode_pg_stats_columns(bufferlist::iterator& p,
+				      map<pg_t,pg_stat_t>& pgs);
+
   void state_summary(ostream& ss) const;
   void recovery_summary(ostream& out) const;
   void print_summary(ostream& out) const;
@@ -76,6 +76,10 @@ PGMonitor::PGMonitor(Monitor *mn, Paxos *p)
 {
   ratio_monitor = new RatioMonitor(this);
   g_conf->add_observer(ratio_monitor);
+
+  // incrementals carry absolute stats, so the next one doesn't depend on
+  // the one before it committing
+  paxos->set_max_inflight(g_conf->paxos_max_inflight);
 }
 
 PGMonitor::~PGMonitor()
@@ -288,14 +292,14 @@ void PGMonitor::handle_osd_timeouts()
 void PGMonitor::create_pending()
 {
   pending_inc = PGMap::Incremental();
-  pending_inc.version = pg_map.version + 1;
+  pending_inc.version = paxos->get_next_version();
   dout(10) << "create_pending v " << pending_inc.version << dendl;
 }
 
 void PGMonitor::encode_pending(bufferlist &bl)
 {
   dout(10) << "encode_pending v " << pending_inc.version << dendl;
-  assert(paxos->get_version() + 1 == pending_inc.version);
+  assert(paxos->get_next_version() == pending_inc.version);
   pending_inc.encode(bl);
 }
 
@@ -323,6 +327,25 @@ bool PGMonitor::preprocess_query(PaxosServiceMessage *m)
   }
 }
 
+bool PGMonitor::is_read_only(PaxosServiceMessage *m)
+{
+  switch (m->get_type()) {
+  case CEPH_MSG_STATFS:
+  case MSG_GETPOOLSTATS:
+    return true;
+  case MSG_MON_COMMAND:
+    {
+      vector<string>& cmd = ((MMonCommand*)m)->cmd;
+      return cmd.size() > 1 &&
+	(cmd[1] == "stat" || cmd[1] == "getmap" ||
+	 cmd[1] == "dump" || cmd[1] == "dump_json" ||
+	 cmd[1] == "dump_pools_json" || cmd[1] == "map");
+    }
+  default:
+    return false;
+  }
+}
+
 bool PGMonitor::prepare_update(PaxosServiceMessage *m)
 {
   dout(10) << "prepare_update " << *m << " from " << m->get_orig_source_inst() << dendl;
@@ -461,6 +484,14 @@ bool PGMonitor::pg_stats_have_changed(int from, const MPGStats *stats) const
     if (t->second.reported != p->second.reported)
       return true;
   }
+  for (map<pg_t,pg_stat_delta_t>::const_iterator p = stats->pg_stat_delta.begin();
+       p != stats->pg_stat_delta.end(); ++p) {
+    hash_map<pg_t,pg_stat_t>::const_iterator t = pg_map.pg_stat.find(p->first);
+    if (t == pg_map.pg_stat.end())
+      return true;
+    if (t->second.reported != p->second.stat.reported)
+      return true;
+  }
 
   return false;
 }
@@ -494,6 +525,11 @@ bool PGMonitor::prepare_pg_stats(MPGStats *stats)
 	 ++p) {
       ack->pg_stat[p->first] = p->second.reported;
     }
+    for (map<pg_t,pg_stat_delta_t>::const_iterator p = stats->pg_stat_delta.begin();
+	 p != stats->pg_stat_delta.end();
+	 ++p) {
+      ack->pg_stat[p->first] = p->second.stat.reported;
+    }
     mon->send_reply(stats, ack);
     stats->put();
     return false;
@@ -514,9 +550,9 @@ bool PGMonitor::prepare_pg_stats(MPGStats *stats)
     time... that's just confusing.
 
   if (pg_map.osd_stat.count(from))
-    pg_map.stat_osd_sub(pg_map.osd_stat[from]);
+    pg_map.stat_osd_sub(from, pg_map.osd_stat[from]);
   pg_map.osd_stat[from] = stats->osd_stat;
-  pg_map.stat_osd_add(stats->osd_stat);
+  pg_map.stat_osd_add(from, stats->osd_stat);
   */
 
   // pg stats
@@ -528,32 +564,31 @@ bool PGMonitor::prepare_pg_stats(MPGStats *stats)
     pg_t pgid = p->first;
     ack->pg_stat[pgid] = p->second.reported;
 
-    if ((pg_map.pg_stat.count(pgid) && 
-	 pg_map.pg_stat[pgid].reported > p->second.reported)) {
-      dout(15) << " had " << pgid << " from " << pg_map.pg_stat[pgid].reported << dendl;
-      continue;
-    }
-    if (pending_inc.pg_stat_updates.count(pgid) && 
-	pending_inc.pg_stat_updates[pgid].reported > p->second.reported) {
-      dout(15) << " had " << pgid << " from " << pending_inc.pg_stat_updates[pgid].reported
-	       << " (pending)" << dendl;
-      continue;
-    }
-
-    if (pg_map.pg_stat.count(pgid) == 0) {
+    hash_map<pg_t,pg_stat_t>::iterator c = pg_map.pg_stat.find(pgid);
+    if (c == pg_map.pg_stat.end()) {
       dout(15) << " got " << pgid << " reported at " << p->second.reported
 	       << " state " << pg_state_string(p->second.state)
 	       << " but DNE in pg_map; pool was probably deleted."
 	       << dendl;
       continue;
     }
+    map<pg_t,pg_stat_t>::iterator q = pending_inc.pg_stat_updates.find(pgid);
+    const pg_stat_t& latest = q != pending_inc.pg_stat_updates.end() ? q->second : c->second;
+    if (latest.reported > p->second.reported) {
+      dout(15) << " had " << pgid << " from " << latest.reported
+	       << (q != pending_inc.pg_stat_updates.end() ? " (pending)" : "") << dendl;
+      continue;
+    }
       
     dout(15) << " got " << pgid
 	     << " reported at " << p->second.reported
-	     << " state " << pg_state_string(pg_map.pg_stat[pgid].state)
+	     << " state " << pg_state_string(c->second.state)
 	     << " -> " << pg_state_string(p->second.state)
 	     << dendl;
-    pending_inc.pg_stat_updates[pgid] = p->second;
+    if (q != pending_inc.pg_stat_updates.end())
+      q->second = p->second;
+    else
+      pending_inc.pg_stat_updates.insert(*p);
 
     /*
     // we don't care much about consistency, here; apply to live map.
@@ -562,6 +597,42 @@ bool PGMonitor::prepare_pg_stats(MPGStats *stats)
     pg_map.stat_pg_add(pgid, pg_map.pg_stat[pgid]);
     */
   }
+
+  // deltas only apply to the report they were made against
+  for (map<pg_t,pg_stat_delta_t>::iterator p = stats->pg_stat_delta.begin();
+       p != stats->pg_stat_delta.end();
+       ++p) {
+    pg_t pgid = p->first;
+    const pg_stat_delta_t& delta = p->second;
+    ack->pg_stat[pgid] = delta.stat.reported;
+
+    hash_map<pg_t,pg_stat_t>::iterator c = pg_map.pg_stat.find(pgid);
+    if (c == pg_map.pg_stat.end()) {
+      dout(15) << " got delta for " << pgid << " reported at " << delta.stat.reported
+	       << " but DNE in pg_map; pool was probably deleted." << dendl;
+      continue;
+    }
+    map<pg_t,pg_stat_t>::iterator q = pending_inc.pg_stat_updates.find(pgid);
+    const pg_stat_t& latest = q != pending_inc.pg_stat_updates.end() ? q->second : c->second;
+    if (latest.reported >= delta.stat.reported) {
+      dout(15) << " had " << pgid << " from " << latest.reported
+	       << (q != pending_inc.pg_stat_updates.end() ? " (pending)" : "") << dendl;
+      continue;
+    }
+    if (latest.reported != delta.base_reported) {
+      dout(10) << " got delta for " << pgid << " against " << delta.base_reported
+	       << " but have " << latest.reported << ", asking for full stats" << dendl;
+      ack->pg_stat[pgid] = eversion_t();
+      continue;
+    }
+
+    dout(15) << " got delta for " << pgid
+	     << " reported at " << delta.stat.reported
+	     << " fields " << hex << (int)delta.fields << dec << dendl;
+    if (q == pending_inc.pg_stat_updates.end())
+      q = pending_inc.pg_stat_updates.insert(make_pair(pgid, c->second)).first;
+    delta.apply(q->second);
+  }
   
   paxos->wait_for_commit(new C_Stats(this, stats, ack));
   return true;
@@ -609,13 +680,22 @@ void PGMonitor::check_osd_map(epoch_t epoch)
     return;
   }
 
+  // pg_map is only the committed state; with earlier incrementals still
+  // in flight we would apply the same osdmap epochs again and re-register
+  // pgs they already created, resetting their stats to creating.
+  if (!paxos->is_active()) {
+    dout(10) << "check_osd_map -- pgmap updates in flight, waiting" << dendl;
+    paxos->wait_for_active(new RetryCheckOSDMap(this, epoch));
+    return;
+  }
+
   // apply latest map(s)
   for (epoch_t e = pg_map.last_osdmap_epoch+1;
        e <= epoch;
        e++) {
     dout(10) << "check_osd_map applying osdmap e" << e << " to pg_map" << dendl;
     bufferlist bl;
-    mon->store->get_bl_sn(bl, "osdmap", e);
+    mon->osdmon()->get_version(e, bl);
     assert(bl.length());
     OSDMap::Incremental inc(bl);
     for (map<int32_t,uint32_t>::iterator p = inc.new_weight.begin();
@@ -868,16 +948,27 @@ bool PGMonitor::preprocess_command(MMonCommand *m)
       r = 0;
       if (format == "json")
 	f = new JSONFormatter(true);
-      else if (format == "plain")
+      else if (format == "plain" || format == "binary")
 	f = 0; //new PlainFormatter();
       else {
 	r = -EINVAL;
 	ss << "unknown format '" << format << "'";
       }
 
-      if (r == 0) {
+      if (r == 0 && format == "binary") {
+	if (what == "pgs") {
+	  pg_map.encode_pg_stats_columns(rdata);
+	  ss << "dumped " << what << " in format " << format;
+	} else {
+	  r = -EINVAL;
+	  ss << "only pgs can be dumped in format binary";
+	}
+      } else if (r == 0) {
 	stringstream ds;
 	if (f) {
+	  // stream straight into the reply rather than building it all
+	  // up in the formatter first
+	  f->set_flush_target(&rdata);
 	  if (what == "all") {
 	    f->open_object_section("pg_map");
 	    pg_map.dump(f);
@@ -897,15 +988,14 @@ bool PGMonitor::preprocess_command(MMonCommand *m)
 	    ss << "i don't know how to dump '" << what << "' is";
 	  }
 	  if (r == 0)
-	    f->flush(ds);
+	    f->flush(rdata);
 	  delete f;
 	} else {
 	  pg_map.dump(ds);
-	}
-	if (r == 0) {
 	  rdata.append(ds);
-	  ss << "dumped " << what << " in format " << format;
 	}
+	if (r == 0)
+	  ss << "dumped " << what << " in format " << format;
 	r = 0;
       }
     }
@@ -913,23 +1003,21 @@ bool PGMonitor::preprocess_command(MMonCommand *m)
       ss << "ok";
       r = 0;
       JSONFormatter jsf(true);
+      jsf.set_flush_target(&rdata);
       jsf.open_object_section("pg_map");
       pg_map.dump(&jsf);
       jsf.close_section();
-      stringstream ds;
-      jsf.flush(ds);
-      rdata.append(ds);
+      jsf.flush(rdata);
     }
     else if (m->cmd[1] == "dump_pools_json") {
       ss << "ok";
       r = 0;
       JSONFormatter jsf(true);
+      jsf.set_flush_target(&rdata);
       jsf.open_object_section("pg_map");
       pg_map.dump(&jsf);
       jsf.close_section();
-      stringstream ds;
-      jsf.flush(ds);
-      rdata.append(ds);
+      jsf.flush(rdata);
     }
     else if (m->cmd[1] == "map" && m->cmd.size() == 3) {
       pg_t pgid;
@@ -59,6 +59,7 @@ private:
   void update_logger();
 
   bool preprocess_query(PaxosServiceMessage *m);  // true if processed.
+  bool is_read_only(PaxosServiceMessage *m);
   bool prepare_update(PaxosServiceMessage *m);
 
   bool preprocess_pg_stats(MPGStats *stats);
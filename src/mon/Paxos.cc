@@ -60,19 +60,19 @@ void Paxos::collect(version_t oldpn)
   assert(mon->is_leader());
 
   // reset the number of lasts received
-  uncommitted_v = 0;
-  uncommitted_pn = 0;
-  uncommitted_value.clear();
+  uncommitted_values.clear();
+  uncommitted_pns.clear();
   peer_first_committed.clear();
   peer_last_committed.clear();
 
-  // look for uncommitted value
-  if (mon->store->exists_bl_sn(machine_name, last_committed+1)) {
-    uncommitted_v = last_committed+1;
-    uncommitted_pn = accepted_pn;
-    mon->store->get_bl_sn(uncommitted_value, machine_name, last_committed+1);
-    dout(10) << "learned uncommitted " << (last_committed+1)
-	     << " (" << uncommitted_value.length() << " bytes) from myself" 
+  // look for uncommitted values
+  for (version_t v = last_committed+1;
+       mon->store->exists_bl_sn(machine_name, v);
+       v++) {
+    mon->store->get_bl_sn(uncommitted_values[v], machine_name, v);
+    uncommitted_pns[v] = accepted_pn;
+    dout(10) << "learned uncommitted " << v
+	     << " (" << uncommitted_values[v].length() << " bytes) from myself"
 	     << dendl;
   }
 
@@ -81,6 +81,7 @@ void Paxos::collect(version_t oldpn)
   accepted_pn_from = last_committed;
   num_last = 1;
   dout(10) << "collect with pn " << accepted_pn << dendl;
+  mon->store->sync();
 
   // send collect
   for (set<int>::const_iterator p = mon->get_quorum().begin();
@@ -136,19 +137,22 @@ void Paxos::handle_collect(MMonPaxos *collect)
   if (collect->last_committed < last_committed)
     share_state(last, collect->first_committed, collect->last_committed);
 
-  // do we have an accepted but uncommitted value?
-  //  (it'll be at last_committed+1)
-  bufferlist bl;
-  if (mon->store->exists_bl_sn(machine_name, last_committed+1)) {
-    mon->store->get_bl_sn(bl, machine_name, last_committed+1);
+  // do we have accepted but uncommitted values?
+  //  (they'll be at last_committed+1 and on)
+  for (version_t v = last_committed+1;
+       mon->store->exists_bl_sn(machine_name, v);
+       v++) {
+    bufferlist bl;
+    mon->store->get_bl_sn(bl, machine_name, v);
     assert(bl.length() > 0);
-    dout(10) << " sharing our accepted but uncommitted value for " << last_committed+1 
+    dout(10) << " sharing our accepted but uncommitted value for " << v
 	     << " (" << bl.length() << " bytes)" << dendl;
-    last->values[last_committed+1] = bl;
+    last->values[v] = bl;
     last->uncommitted_pn = accepted_pn;
   }
 
   // send reply
+  mon->store->sync();  // our promise not to accept lower pns
   mon->messenger->send_message(last, collect->get_source_inst());
   collect->put();
 }
@@ -272,16 +276,22 @@ void Paxos::handle_last(MMonPaxos *last)
     dout(10) << " they accepted our pn, we now have " 
 	     << num_last << " peons" << dendl;
 
-    // did this person send back an accepted but uncommitted value?
-    if (last->uncommitted_pn &&
-	last->uncommitted_pn > uncommitted_pn) {
-      uncommitted_v = last->last_committed+1;
-      uncommitted_pn = last->uncommitted_pn;
-      uncommitted_value = last->values[uncommitted_v];
-      dout(10) << "we learned an uncommitted value for " << uncommitted_v 
-	       << " pn " << uncommitted_pn
-	       << " " << uncommitted_value.length() << " bytes"
-	       << dendl;
+    // did this person send back accepted but uncommitted values?
+    if (last->uncommitted_pn) {
+      for (map<version_t,bufferlist>::iterator p =
+	     last->values.upper_bound(last->last_committed);
+	   p != last->values.end();
+	   ++p) {
+	if (uncommitted_pns.count(p->first) &&
+	    last->uncommitted_pn <= uncommitted_pns[p->first])
+	  continue;
+	uncommitted_values[p->first] = p->second;
+	uncommitted_pns[p->first] = last->uncommitted_pn;
+	dout(10) << "we learned an uncommitted value for " << p->first
+		 << " pn " << last->uncommitted_pn
+		 << " " << p->second.length() << " bytes"
+		 << dendl;
+      }
     }
     
     // is that everyone?
@@ -308,11 +318,21 @@ void Paxos::handle_last(MMonPaxos *last)
       // almost...
       state = STATE_ACTIVE;
 
-      // did we learn an old value?
-      if (uncommitted_v == last_committed+1 &&
-	  uncommitted_value.length()) {
-	dout(10) << "that's everyone.  begin on old learned value" << dendl;
-	begin(uncommitted_value);
+      // did we learn old values?  only a run starting right after what
+      // we now know is committed matters; nothing past a gap can have
+      // committed anywhere, since commits happen in order.
+      map<version_t,bufferlist> learned;
+      for (version_t v = last_committed+1;
+	   uncommitted_values.count(v) && uncommitted_values[v].length();
+	   v++)
+	learned[v] = uncommitted_values[v];
+      uncommitted_values.clear();
+      uncommitted_pns.clear();
+
+      if (learned.size()) {
+	dout(10) << "that's everyone.  begin on " << learned.size()
+		 << " old learned value(s)" << dendl;
+	begin(learned);
       } else {
 	// active!
 	dout(10) << "that's everyone.  active!" << dendl;
@@ -344,39 +364,73 @@ void Paxos::collect_timeout()
 // leader
 void Paxos::begin(bufferlist& v)
 {
-  dout(10) << "begin for " << last_committed+1 << " " 
-	   << v.length() << " bytes"
-	   << dendl;
+  map<version_t,bufferlist> values;
+  values[get_next_version()] = v;
+  begin(values);
+}
+
+// leader
+void Paxos::begin(map<version_t,bufferlist>& values)
+{
+  dout(10) << "begin for " << values.begin()->first;
+  if (values.size() > 1)
+    *_dout << ".." << values.rbegin()->first;
+  *_dout << ", " << proposals.size() << " already in flight" << dendl;
 
   assert(mon->is_leader());
-  assert(is_active());
+  assert(is_active() || is_updating());
   state = STATE_UPDATING;
 
   // we must already have a majority for this to work.
   assert(mon->get_quorum().size() == 1 ||
 	 num_last > (unsigned)mon->monmap->size()/2);
   
-  // and no value, yet.
-  assert(new_value.length() == 0);
+  // and they must follow whatever is in flight.
+  assert(values.begin()->first == get_next_version());
   
-  // accept it ourselves
-  accepted.clear();
-  accepted.insert(mon->rank);
-  new_value = v;
-  mon->store->put_bl_sn(new_value, machine_name, last_committed+1);
+  // accept them ourselves
+  for (map<version_t,bufferlist>::iterator p = values.begin();
+       p != values.end();
+       ++p) {
+    Proposal& pr = proposals[p->first];
+    pr.value = p->second;
+    pr.accepted.insert(mon->rank);
+  }
 
   if (mon->get_quorum().size() == 1) {
-    // we're alone, take it easy
-    commit();
+    // we're alone, take it easy.  the values and the commits go to disk
+    // together, and before anyone waiting on them can reply to a client.
+    mon->store->start_transaction();
+    for (map<version_t,bufferlist>::iterator p = values.begin();
+	 p != values.end();
+	 ++p)
+      mon->store->put_bl_sn(p->second, machine_name, p->first);
+    erase_uncommitted_after(values.rbegin()->first);
+    while (!proposals.empty()) {
+      commit();
+      proposals.erase(proposals.begin());
+    }
+    mon->store->commit_transaction();
+
+    // whatever the services write as they catch up goes in one more.
+    mon->store->start_transaction();
     state = STATE_ACTIVE;
     finish_contexts(g_ceph_context, waiting_for_active);
-    finish_contexts(g_ceph_context, waiting_for_commit);
+    finish_waiting_for_commit(last_committed);
     finish_contexts(g_ceph_context, waiting_for_readable);
     finish_contexts(g_ceph_context, waiting_for_writeable);
     update_observers();
+    mon->store->commit_transaction();
     return;
   }
 
+  for (map<version_t,bufferlist>::iterator p = values.begin();
+       p != values.end();
+       ++p)
+    mon->store->put_bl_sn(p->second, machine_name, p->first);
+  erase_uncommitted_after(values.rbegin()->first);
+  mon->store->sync();
+
   // ask others to accept it to!
   for (set<int>::const_iterator p = mon->get_quorum().begin();
        p != mon->get_quorum().end();
@@ -385,7 +439,7 @@ void Paxos::begin(bufferlist& v)
     
     dout(10) << " sending begin to mon." << *p << dendl;
     MMonPaxos *begin = new MMonPaxos(mon->get_epoch(), MMonPaxos::OP_BEGIN, machine_id);
-    begin->values[last_committed+1] = new_value;
+    begin->values = values;
     begin->last_committed = last_committed;
     begin->pn = accepted_pn;
     
@@ -393,8 +447,23 @@ void Paxos::begin(bufferlist& v)
   }
 
   // set timeout event
-  accept_timeout_event = new C_AcceptTimeout(this);
-  mon->timer.add_event_after(g_conf->mon_accept_timeout, accept_timeout_event);
+  if (!accept_timeout_event) {
+    accept_timeout_event = new C_AcceptTimeout(this);
+    mon->timer.add_event_after(g_conf->mon_accept_timeout, accept_timeout_event);
+  }
+}
+
+/*
+ * Values stored past the ones just accepted are left over from an
+ * older leader's pipeline.  Recovery re-proposes every uncommitted
+ * value that could have committed anywhere, so these never did.
+ */
+void Paxos::erase_uncommitted_after(version_t v)
+{
+  for (version_t s = v+1; mon->store->exists_bl_sn(machine_name, s); s++) {
+    dout(10) << "erasing stale uncommitted value " << s << dendl;
+    mon->store->erase_sn(machine_name, s);
+  }
 }
 
 // peon
@@ -410,18 +479,26 @@ void Paxos::handle_begin(MMonPaxos *begin)
   }
   assert(begin->pn == accepted_pn);
   assert(begin->last_committed == last_committed);
+  assert(!begin->values.empty());
+  assert(begin->values.begin()->first > last_committed);
   
   // set state.
   state = STATE_UPDATING;
   lease_expire = utime_t();  // cancel lease
 
   // yes.
-  version_t v = last_committed+1;
-  dout(10) << "accepting value for " << v << " pn " << accepted_pn << dendl;
-  mon->store->put_bl_sn(begin->values[v], machine_name, v);
+  MMonPaxos *accept = new MMonPaxos(mon->get_epoch(), MMonPaxos::OP_ACCEPT, machine_id);
+  for (map<version_t,bufferlist>::iterator p = begin->values.begin();
+       p != begin->values.end();
+       ++p) {
+    dout(10) << "accepting value for " << p->first << " pn " << accepted_pn << dendl;
+    mon->store->put_bl_sn(p->second, machine_name, p->first);
+    accept->values[p->first];  // name what we accepted
+  }
+  erase_uncommitted_after(begin->values.rbegin()->first);
+  mon->store->sync();
   
   // reply
-  MMonPaxos *accept = new MMonPaxos(mon->get_epoch(), MMonPaxos::OP_ACCEPT, machine_id);
   accept->pn = accepted_pn;
   accept->last_committed = last_committed;
   mon->messenger->send_message(accept, begin->get_source_inst());
@@ -441,42 +518,68 @@ void Paxos::handle_accept(MMonPaxos *accept)
     accept->put();
     return;
   }
-  if (last_committed > 0 &&
-      accept->last_committed < last_committed-1) {
+
+  // which values?  (peers that don't say only accept one at a time)
+  set<version_t> versions;
+  if (accept->values.empty())
+    versions.insert(accept->last_committed+1);
+  for (map<version_t,bufferlist>::iterator p = accept->values.begin();
+       p != accept->values.end();
+       ++p)
+    versions.insert(p->first);
+
+  bool any = false;
+  for (set<version_t>::iterator v = versions.begin(); v != versions.end(); ++v) {
+    map<version_t,Proposal>::iterator p = proposals.find(*v);
+    if (p == proposals.end())
+      continue;
+    assert(p->second.accepted.count(from) == 0);
+    p->second.accepted.insert(from);
+    dout(10) << " now " << p->second.accepted << " have accepted " << *v << dendl;
+    any = true;
+  }
+  if (!any) {
     dout(10) << " this is from an old round, ignoring" << dendl;
     accept->put();
     return;
   }
-  assert(accept->last_committed == last_committed ||   // not committed
-	 accept->last_committed == last_committed-1);  // committed
-
   assert(state == STATE_UPDATING);
-  assert(accepted.count(from) == 0);
-  accepted.insert(from);
-  dout(10) << " now " << accepted << " have accepted" << dendl;
-
-  // new majority?
-  if (accepted.size() == (unsigned)mon->monmap->size()/2+1) {
-    // yay, commit!
-    // note: this may happen before the lease is reextended (below)
-    dout(10) << " got majority, committing" << dendl;
+
+  // new majority?  values commit in order.
+  // note: this may happen before the lease is reextended (below)
+  while (proposals.count(last_committed+1) &&
+	 proposals[last_committed+1].accepted.size() > (unsigned)mon->monmap->size()/2) {
+    dout(10) << " got majority for " << last_committed+1 << ", committing" << dendl;
     commit();
   }
 
-  // done?
-  if (accepted == mon->get_quorum()) {
-    dout(10) << " got quorum, done with update" << dendl;
+  // done?  retire, in order, what is committed and accepted by everyone.
+  version_t done = 0;
+  while (!proposals.empty() &&
+	 proposals.begin()->first <= last_committed &&
+	 proposals.begin()->second.accepted == mon->get_quorum()) {
+    done = proposals.begin()->first;
+    proposals.erase(proposals.begin());
+  }
+  if (done) {
+    dout(10) << " got quorum, done with update through " << done << dendl;
     // cancel timeout event
     mon->timer.cancel_event(accept_timeout_event);
     accept_timeout_event = 0;
 
     // yay!
-    state = STATE_ACTIVE;
+    if (proposals.empty()) {
+      state = STATE_ACTIVE;
+    } else {
+      accept_timeout_event = new C_AcceptTimeout(this);
+      mon->timer.add_event_after(g_conf->mon_accept_timeout, accept_timeout_event);
+    }
     extend_lease();
   
     // wake people up
-    finish_contexts(g_ceph_context, waiting_for_active);
-    finish_contexts(g_ceph_context, waiting_for_commit);
+    if (is_active())
+      finish_contexts(g_ceph_context, waiting_for_active);
+    finish_waiting_for_commit(done);
     finish_contexts(g_ceph_context, waiting_for_readable);
     finish_contexts(g_ceph_context, waiting_for_writeable);
   }
@@ -495,6 +598,8 @@ void Paxos::accept_timeout()
 void Paxos::commit()
 {
   dout(10) << "commit " << last_committed+1 << dendl;
+  map<version_t,Proposal>::iterator v = proposals.find(last_committed+1);
+  assert(v != proposals.end());
 
   // cancel lease - it was for the old value.
   //  (this would only happen if message layer lost the 'begin', but
@@ -518,19 +623,24 @@ void Paxos::commit()
 
     dout(10) << " sending commit to mon." << *p << dendl;
     MMonPaxos *commit = new MMonPaxos(mon->get_epoch(), MMonPaxos::OP_COMMIT, machine_id);
-    commit->values[last_committed] = new_value;
+    commit->values[last_committed] = v->second.value;
     commit->pn = accepted_pn;
     commit->last_committed = last_committed;
     
     mon->messenger->send_message(commit, mon->monmap->get_inst(*p));
   }
-
-  // get ready for a new round.
-  new_value.clear();
 }
 
-
-
+void Paxos::finish_waiting_for_commit(version_t upto, int r)
+{
+  list<Context*> ls;
+  while (!waiting_for_commit.empty() &&
+	 waiting_for_commit.begin()->first <= upto) {
+    ls.splice(ls.end(), waiting_for_commit.begin()->second);
+    waiting_for_commit.erase(waiting_for_commit.begin());
+  }
+  finish_contexts(g_ceph_context, ls, r);
+}
 
 void Paxos::handle_commit(MMonPaxos *commit)
 {
@@ -547,13 +657,13 @@ void Paxos::handle_commit(MMonPaxos *commit)
   
   commit->put();
 
-  finish_contexts(g_ceph_context, waiting_for_commit);
+  finish_waiting_for_commit((version_t)-1);
 }
 
 void Paxos::extend_lease()
 {
   assert(mon->is_leader());
-  assert(is_active());
+  assert(is_active() || is_updating());
 
   lease_expire = ceph_clock_now(g_ceph_context);
   lease_expire += g_conf->mon_lease;
@@ -582,6 +692,8 @@ void Paxos::extend_lease()
   }
 
   // set renew event
+  if (lease_renew_event)
+    mon->timer.cancel_event(lease_renew_event);
   lease_renew_event = new C_LeaseRenew(this);
   utime_t at = lease_expire;
   at -= g_conf->mon_lease;
@@ -625,6 +737,7 @@ void Paxos::handle_lease(MMonPaxos *lease)
   if (lease_expire < lease->lease_timestamp) {
     lease_expire = lease->lease_timestamp;
   }
+  stale_lease_expire = lease_expire;
   
   state = STATE_ACTIVE;
   
@@ -691,7 +804,7 @@ void Paxos::lease_ack_timeout()
 {
   dout(5) << "lease_ack_timeout -- calling new election" << dendl;
   assert(mon->is_leader());
-  assert(is_active());
+  assert(is_active() || is_updating());
 
   lease_ack_timeout_event = 0;
   mon->bootstrap();
@@ -789,14 +902,14 @@ void Paxos::cancel_events()
 void Paxos::leader_init()
 {
   cancel_events();
-  new_value.clear();
+  proposals.clear();
 
   if (mon->get_quorum().size() == 1) {
     state = STATE_ACTIVE;			    
     return;
   } 
   state = STATE_RECOVERING;
-  lease_expire = utime_t();
+  lease_expire = stale_lease_expire = utime_t();
   dout(10) << "leader_init -- starting paxos recovery" << dendl;
   collect(0);
 }
@@ -804,24 +917,24 @@ void Paxos::leader_init()
 void Paxos::peon_init()
 {
   cancel_events();
-  new_value.clear();
+  proposals.clear();
 
   state = STATE_RECOVERING;
-  lease_expire = utime_t();
+  lease_expire = stale_lease_expire = utime_t();
   dout(10) << "peon_init -- i am a peon" << dendl;
 
   // no chance to write now!
   finish_contexts(g_ceph_context, waiting_for_writeable, -1);
-  finish_contexts(g_ceph_context, waiting_for_commit, -1);
+  finish_waiting_for_commit((version_t)-1, -1);
 }
 
 void Paxos::restart()
 {
   dout(10) << "restart -- canceling timeouts" << dendl;
   cancel_events();
-  new_value.clear();
+  proposals.clear();
 
-  finish_contexts(g_ceph_context, waiting_for_commit, -1);
+  finish_waiting_for_commit((version_t)-1, -1);
   finish_contexts(g_ceph_context, waiting_for_active, -1);
 }
 
@@ -964,6 +1077,26 @@ bool Paxos::is_readable(version_t v)
      ceph_clock_now(g_ceph_context) < lease_expire);    // have lease
 }
 
+/*
+ * Like is_readable(), but a peon that is accepting (or has just
+ * committed) a new value carries on with last_committed for as long as
+ * its last lease would have lasted.  The answer may be missing the value
+ * in flight, but never more than mon_lease stale: a peon that stops
+ * hearing from the leader stops answering.
+ */
+bool Paxos::is_readable_stale(version_t v)
+{
+  if (is_readable(v))
+    return true;
+  if (!g_conf->paxos_stale_reads || v > last_committed)
+    return false;
+  return
+    mon->is_peon() &&
+    (is_active() || is_updating()) &&
+    last_committed > 0 &&
+    ceph_clock_now(g_ceph_context) < stale_lease_expire;
+}
+
 bool Paxos::read(version_t v, bufferlist &bl)
 {
   if (!mon->store->get_bl_sn(bl, machine_name, v))
@@ -988,8 +1121,8 @@ bool Paxos::is_writeable()
   if (mon->get_quorum().size() == 1) return true;
   return
     mon->is_leader() &&
-    is_active() &&
-    ceph_clock_now(g_ceph_context) < lease_expire;
+    ((is_active() && ceph_clock_now(g_ceph_context) < lease_expire) ||
+     (is_updating() && proposals.size() < max_inflight));
 }
 
 bool Paxos::propose_new_value(bufferlist& bl, Context *oncommit)
@@ -1007,15 +1140,16 @@ bool Paxos::propose_new_value(bufferlist& bl, Context *oncommit)
   }
   */
   
-  assert(mon->is_leader() && is_active());
+  assert(mon->is_leader() && can_propose());
 
   // cancel lease renewal and timeout events.
-  cancel_events();
+  if (is_active())
+    cancel_events();
 
   // ok!
-  dout(5) << "propose_new_value " << last_committed+1 << " " << bl.length() << " bytes" << dendl;
+  dout(5) << "propose_new_value " << get_next_version() << " " << bl.length() << " bytes" << dendl;
   if (oncommit)
-    waiting_for_commit.push_back(oncommit);
+    waiting_for_commit[get_next_version()].push_back(oncommit);
   begin(bl);
   
   return true;
@@ -38,7 +38,10 @@ e 12v
 
 /*
  * NOTE: This libary is based on the Paxos algorithm, but varies in a few key ways:
- *  1- Only a single new value is generated at a time, simplifying the recovery logic.
+ *  1- Values are committed strictly in order, simplifying the recovery logic.  By
+ *     default only a single new value is generated at a time; a service that builds
+ *     each value on top of the previous proposal may allow a few in flight at once
+ *     (see set_max_inflight()).
  *  2- Nodes track "committed" values, and share them generously (and trustingly)
  *  3- A 'leasing' mechism is built-in, allowing nodes to determine when it is safe to 
  *     "read" their copy of the last committed value.
@@ -116,6 +119,10 @@ private:
 
   // active (phase 2)
   utime_t lease_expire;
+  // the last lease we were granted.  unlike lease_expire, a peon does
+  // not cancel it when it starts accepting a new value, so read-only
+  // queries can go on being answered from last_committed.
+  utime_t stale_lease_expire;
   list<Context*> waiting_for_active;
   list<Context*> waiting_for_readable;
 
@@ -124,9 +131,10 @@ private:
   // -- leader --
   // recovery (paxos phase 1)
   unsigned   num_last;
-  version_t  uncommitted_v;
-  version_t  uncommitted_pn;
-  bufferlist uncommitted_value;
+  // accepted but uncommitted values learned during recovery, and the
+  // pn each was reported with
+  map<version_t,bufferlist> uncommitted_values;
+  map<version_t,version_t>  uncommitted_pns;
 
   Context    *collect_timeout_event;
 
@@ -137,13 +145,20 @@ private:
   Context    *lease_timeout_event;
 
   // updating (paxos phase 2)
-  bufferlist new_value;
-  set<int>   accepted;
+  // values proposed and not yet accepted by the whole quorum.  each
+  // commits once a majority has accepted it and everything before it
+  // has committed.
+  struct Proposal {
+    bufferlist value;
+    set<int> accepted;
+  };
+  map<version_t,Proposal> proposals;
+  unsigned max_inflight;
 
   Context    *accept_timeout_event;
 
   list<Context*> waiting_for_writeable;
-  list<Context*> waiting_for_commit;
+  map<version_t, list<Context*> > waiting_for_commit;  // by version
 
   // observers
   struct Observer {
@@ -211,12 +226,15 @@ private:
   void collect_timeout();
 
   void begin(bufferlist& value);
+  void begin(map<version_t,bufferlist>& values);
+  void erase_uncommitted_after(version_t v);
   void handle_begin(MMonPaxos*);
   void handle_accept(MMonPaxos*);
   void accept_timeout();
 
   void commit();
   void handle_commit(MMonPaxos*);
+  void finish_waiting_for_commit(version_t upto, int r=0);
   void extend_lease();
   void handle_lease(MMonPaxos*);
   void handle_lease_ack(MMonPaxos*);
@@ -241,6 +259,7 @@ public:
 		   lease_renew_event(0),
 		   lease_ack_timeout_event(0),
 		   lease_timeout_event(0),
+		   max_inflight(1),
 		   accept_timeout_event(0),
 		   clock_drift_warned(0) { }
 
@@ -273,6 +292,7 @@ public:
   // read
   version_t get_version() { return last_committed; }
   bool is_readable(version_t seen=0);
+  bool is_readable_stale(version_t seen=0);
   bool read(version_t v, bufferlist &bl);
   version_t read_current(bufferlist &bl);
   void wait_for_readable(Context *onreadable) {
@@ -283,17 +303,44 @@ public:
   // write
   bool is_leader();
   bool is_writeable();
+  /// may a new value be proposed now (active, or room in the pipeline)?
+  bool can_propose() {
+    return is_active() || (is_updating() && proposals.size() < max_inflight);
+  }
+  /// the version the next proposed value will get
+  version_t get_next_version() {
+    return proposals.empty() ? last_committed + 1 : proposals.rbegin()->first + 1;
+  }
+  /**
+   * Allow up to @a n values in flight at once.  Only for services whose
+   * next value doesn't depend on the previous one having committed
+   * (e.g. PGMonitor).  Every mon in the quorum must support it.
+   */
+  void set_max_inflight(unsigned n) {
+    max_inflight = n ? n : 1;
+  }
+  unsigned get_max_inflight() const { return max_inflight; }
   void wait_for_writeable(Context *c) {
     assert(!is_writeable());
     waiting_for_writeable.push_back(c);
   }
 
   bool propose_new_value(bufferlist& bl, Context *oncommit=0);
+  /*
+   * Wait for the value that changes made now will go out in: the next
+   * one proposed, or, if nothing more can be proposed yet, the last one
+   * in flight.
+   */
+  version_t get_commit_wait_version() {
+    if (proposals.empty() || can_propose())
+      return get_next_version();
+    return proposals.rbegin()->first;
+  }
   void wait_for_commit(Context *oncommit) {
-    waiting_for_commit.push_back(oncommit);
+    waiting_for_commit[get_commit_wait_version()].push_back(oncommit);
   }
   void wait_for_commit_front(Context *oncommit) {
-    waiting_for_commit.push_front(oncommit);
+    waiting_for_commit[get_commit_wait_version()].push_front(oncommit);
   }
 
   // if state values are incrementals, it is usefult to keep
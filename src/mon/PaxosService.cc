@@ -39,7 +39,8 @@ bool PaxosService::dispatch(PaxosServiceMessage *m)
 {
   dout(10) << "dispatch " << *m << " from " << m->get_orig_source_inst() << dendl;
   // make sure our map is readable and up to date
-  if (!paxos->is_readable(m->version)) {
+  if (!paxos->is_readable(m->version) &&
+      !(is_read_only(m) && paxos->is_readable_stale(m->version))) {
     dout(10) << " waiting for paxos -> readable (v" << m->version << ")" << dendl;
     paxos->wait_for_readable(new C_RetryMessage(this, m));
     return true;
@@ -108,7 +109,7 @@ void PaxosService::propose_pending()
 {
   dout(10) << "propose_pending" << dendl;
   assert(have_pending);
-  assert(mon->is_leader() && paxos->is_active());
+  assert(mon->is_leader() && paxos->can_propose());
 
   if (proposal_timer) {
     mon->timer.cancel_event(proposal_timer);
@@ -123,6 +124,13 @@ void PaxosService::propose_pending()
   // apply to paxos
   paxos->wait_for_commit_front(new C_Active(this));
   paxos->propose_new_value(bl);
+
+  // with a pipelined paxos we can keep preparing the next version while
+  // this one is in flight.
+  if (!have_pending && paxos->is_updating() && paxos->get_max_inflight() > 1) {
+    create_pending();
+    have_pending = true;
+  }
 }
 
 
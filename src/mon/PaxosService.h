@@ -126,6 +126,13 @@ public:
    */
   virtual bool preprocess_query(PaxosServiceMessage *m) = 0;
 
+  /*
+   * Return true if the query is a pure read (a status, dump or map
+   * fetch) that preprocess_query always answers.  A peon may answer
+   * these from slightly stale state; see Paxos::is_readable_stale().
+   */
+  virtual bool is_read_only(PaxosServiceMessage *m) { return false; }
+
   /*
    * This function is only called on the leader. Apply the message
    * to the pending state.
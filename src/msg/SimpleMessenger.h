@@ -62,7 +62,8 @@ using namespace __gnu_cxx;
   CEPH_FEATURE_OBJECTLOCATOR |	 \
   CEPH_FEATURE_PGID64 |		 \
   CEPH_FEATURE_INCSUBOSDMAP |	 \
-  CEPH_FEATURE_PGPOOL3
+  CEPH_FEATURE_PGPOOL3 |         \
+  CEPH_FEATURE_PGSTATDELTA
 
 class SimpleMessenger : public Messenger {
 public:
@@ -553,15 +554,23 @@ private:
   int timeout;
 
 public:
-  SimpleMessenger(CephContext *cct) :
+  /**
+   * @param mname if non-empty, names the dispatch throttler's perf
+   *              counters; must be unique within the process
+   */
+  SimpleMessenger(CephContext *cct, std::string mname = std::string()) :
     Messenger(cct, entity_name_t()),
     accepter(this),
     lock("SimpleMessenger::lock"), started(false), did_bind(false),
-    dispatch_throttler(cct->_conf->ms_dispatch_throttle_bytes), need_addr(true),
+    dispatch_throttler(cct, mname.length() ? string("msgr_dispatch_throttler-") + mname : mname,
+		       cct->_conf->ms_dispatch_throttle_bytes),
+    need_addr(true),
     destination_stopped(true), my_type(-1),
     global_seq_lock("SimpleMessenger::global_seq_lock"), global_seq(0),
     reaper_thread(this), reaper_started(false), reaper_stop(false), 
     dispatch_thread(this), msgr(this) {
+    dispatch_throttler.set_rate(cct->_conf->ms_dispatch_throttle_bytes_per_sec,
+				cct->_conf->ms_dispatch_throttle_ops_per_sec);
     // for local dmsg delivery
     dispatch_queue.local_pipe = new Pipe(this, Pipe::STATE_OPEN);
   }
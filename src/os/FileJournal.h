@@ -214,7 +214,8 @@ private:
   }
 
  public:
-  FileJournal(uuid_d fsid, Finisher *fin, Cond *sync_cond, const char *f, bool dio=false) : 
+  FileJournal(CephContext *cct, uuid_d fsid, Finisher *fin, Cond *sync_cond,
+	      const char *f, bool dio=false) :
     Journal(fsid, fin, sync_cond), fn(f),
     zero_buf(NULL),
     max_size(0), block_size(0),
@@ -226,6 +227,8 @@ private:
     fd(-1),
     writing_seq(0), journaled_seq(0),
     plug_journal_completions(false),
+    throttle_ops(cct, string()),
+    throttle_bytes(cct, string()),
     write_lock("FileJournal::write_lock"),
     write_stop(false),
     write_thread(this) { }
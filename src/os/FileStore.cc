@@ -597,13 +597,16 @@ FileStore::FileStore(const std::string &base, const std::string &jdev) :
   basedir_fd(-1), current_fd(-1),
   attrs(this), fake_attrs(false),
   collections(this), fake_collections(false),
-  ondisk_finisher(g_ceph_context),
+  ondisk_finisher(g_ceph_context, "filestore-ondisk", g_conf->filestore_ondisk_finisher_threads),
   lock("FileStore::lock"),
   force_sync(false), sync_epoch(0),
   sync_entry_timeo_lock("sync_entry_timeo_lock"),
   timer(g_ceph_context, sync_entry_timeo_lock),
   stop(false), sync_thread(this),
-  op_queue_len(0), op_queue_bytes(0), op_finisher(g_ceph_context), next_finish(0),
+  op_throttle_ops(g_ceph_context, "filestore_ops"),
+  op_throttle_bytes(g_ceph_context, "filestore_bytes"),
+  op_finisher(g_ceph_context, "filestore-apply", g_conf->filestore_apply_finisher_threads),
+  next_finish(0),
   op_tp(g_ceph_context, "FileStore::op_tp", g_conf->filestore_op_threads),
   op_wq(this, g_conf->filestore_op_thread_timeout,
 	g_conf->filestore_op_thread_suicide_timeout, &op_tp),
@@ -644,6 +647,9 @@ FileStore::FileStore(const std::string &base, const std::string &jdev) :
   sss << basedir << "/current/commit_op_seq";
   current_op_seq_fn = sss.str();
 
+  op_throttle_ops.set_rate(g_conf->filestore_queue_max_ops_per_sec);
+  op_throttle_bytes.set_rate(g_conf->filestore_queue_max_bytes_per_sec);
+
   // initialize logger
   PerfCountersBuilder plb(g_ceph_context, "filestore", l_os_first, l_os_last);
 
@@ -752,7 +758,8 @@ int FileStore::open_journal()
 {
   if (journalpath.length()) {
     dout(10) << "open_journal at " << journalpath << dendl;
-    journal = new FileJournal(fsid, &finisher, &sync_cond, journalpath.c_str(), m_journal_dio);
+    journal = new FileJournal(g_ceph_context, fsid, &finisher, &sync_cond,
+			      journalpath.c_str(), m_journal_dio);
     if (journal)
       journal->logger = logger;
   }
@@ -1869,25 +1876,19 @@ void FileStore::queue_op(OpSequencer *osr, Op *o)
 
   logger->inc(l_os_ops);
   logger->inc(l_os_bytes, o->bytes);
-  logger->set(l_os_oq_ops, op_queue_len);
-  logger->set(l_os_oq_bytes, op_queue_bytes);
+  logger->set(l_os_oq_ops, op_throttle_ops.get_current());
+  logger->set(l_os_oq_bytes, op_throttle_bytes.get_current());
 
   op_tp.unlock();
 
   dout(5) << "queue_op " << o << " seq " << o->op << " " << o->bytes << " bytes"
-	   << "   (queue has " << op_queue_len << " ops and " << op_queue_bytes << " bytes)"
+	   << "   (queue has " << op_throttle_ops.get_current() << " ops and "
+	   << op_throttle_bytes.get_current() << " bytes)"
 	   << dendl;
   op_wq.queue(osr);
 }
 
 void FileStore::op_queue_reserve_throttle(Op *o)
-{
-  op_tp.lock();
-  _op_queue_reserve_throttle(o, "op_queue_reserve_throttle");
-  op_tp.unlock();
-}
-
-void FileStore::_op_queue_reserve_throttle(Op *o, const char *caller)
 {
   // Do not call while holding the journal lock!
   uint64_t max_ops = m_filestore_queue_max_ops;
@@ -1901,25 +1902,21 @@ void FileStore::_op_queue_reserve_throttle(Op *o, const char *caller)
   logger->set(l_os_oq_max_ops, max_ops);
   logger->set(l_os_oq_max_bytes, max_bytes);
 
-  while ((max_ops && (op_queue_len + 1) > max_ops) ||
-	 (max_bytes && op_queue_bytes      // let single large ops through!
-	  && (op_queue_bytes + o->bytes) > max_bytes)) {
-    dout(2) << caller << " waiting: "
-	     << op_queue_len + 1 << " > " << max_ops << " ops || "
-	     << op_queue_bytes + o->bytes << " > " << max_bytes << dendl;
-    op_tp.wait(op_throttle_cond);
-  }
-
-  op_queue_len++;
-  op_queue_bytes += o->bytes;
+  // waiters are served in order; a single large op is let through
+  op_throttle_ops.reset_max(max_ops);
+  op_throttle_bytes.reset_max(max_bytes);
+  if (op_throttle_ops.should_wait(1) || op_throttle_bytes.should_wait(o->bytes))
+    dout(2) << "op_queue_reserve_throttle waiting: "
+	    << op_throttle_ops.get_current() + 1 << " > " << max_ops << " ops || "
+	    << op_throttle_bytes.get_current() + o->bytes << " > " << max_bytes << dendl;
+  op_throttle_ops.get(1);
+  op_throttle_bytes.get(o->bytes);
 }
 
-void FileStore::_op_queue_release_throttle(Op *o)
+void FileStore::op_queue_release_throttle(Op *o)
 {
-  // Called with op_tp lock!
-  op_queue_len--;
-  op_queue_bytes -= o->bytes;
-  op_throttle_cond.Signal();
+  op_throttle_ops.put(1);
+  op_throttle_bytes.put(o->bytes);
 }
 
 void FileStore::_do_op(OpSequencer *osr)
@@ -1934,7 +1931,7 @@ void FileStore::_do_op(OpSequencer *osr)
 	   << ", finisher " << o->onreadable << " " << o->onreadable_sync << dendl;
   
   /*dout(10) << "op_entry finished " << o->bytes << " bytes, queue now "
-	   << op_queue_len << " ops, " << op_queue_bytes << " bytes" << dendl;
+	   << op_throttle_ops.get_current() << " ops, " << op_throttle_bytes.get_current() << " bytes" << dendl;
   */
 }
 
@@ -1946,7 +1943,7 @@ void FileStore::_finish_op(OpSequencer *osr)
   osr->apply_lock.Unlock();  // locked in _do_op
 
   // called with tp lock held
-  _op_queue_release_throttle(o);
+  op_queue_release_throttle(o);
 
   utime_t lat = ceph_clock_now(g_ceph_context);
   lat -= o->start;
@@ -1956,7 +1953,7 @@ void FileStore::_finish_op(OpSequencer *osr)
     o->onreadable_sync->finish(0);
     delete o->onreadable_sync;
   }
-  op_finisher.queue(o->onreadable);
+  op_finisher.queue(o->onreadable, 0, (uint64_t)osr);
   delete o;
 }
 
@@ -2042,7 +2039,7 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
     onreadable_sync->finish(r);
     delete onreadable_sync;
   }
-  op_finisher.queue(onreadable, r);
+  op_finisher.queue(onreadable, r, (uint64_t)osr);
 
   op_submit_finish(op);
   op_apply_finish(op);
@@ -2065,7 +2062,7 @@ void FileStore::_journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk)
   // getting blocked behind an ondisk completion.
   if (ondisk) {
     dout(10) << " queueing ondisk " << ondisk << dendl;
-    ondisk_finisher.queue(ondisk);
+    ondisk_finisher.queue(ondisk, 0, (uint64_t)osr, Finisher::PRIO_HIGH);
   }
 }
 
@@ -3835,6 +3832,8 @@ const char** FileStore::get_tracked_conf_keys() const
     "filestore_max_sync_interval",
     "filestore_flusher_max_fds",
     "filestore_commit_timeout",
+    "filestore_queue_max_bytes_per_sec",
+    "filestore_queue_max_ops_per_sec",
     NULL
   };
   return KEYS;
@@ -3855,4 +3854,9 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
     Mutex::Locker l(sync_entry_timeo_lock);
     m_filestore_commit_timeout = conf->filestore_commit_timeout;
   }
+  if (changed.count("filestore_queue_max_bytes_per_sec") ||
+      changed.count("filestore_queue_max_ops_per_sec")) {
+    op_throttle_ops.set_rate(conf->filestore_queue_max_ops_per_sec);
+    op_throttle_bytes.set_rate(conf->filestore_queue_max_bytes_per_sec);
+  }
 }
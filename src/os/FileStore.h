@@ -23,6 +23,7 @@
 #include "common/WorkQueue.h"
 
 #include "common/Mutex.h"
+#include "common/Throttle.h"
 #include "HashIndex.h"
 #include "IndexManager.h"
 
@@ -178,8 +179,7 @@ class FileStore : public JournalingObjectStore,
   };
   Sequencer default_osr;
   deque<OpSequencer*> op_queue;
-  uint64_t op_queue_len, op_queue_bytes;
-  Cond op_throttle_cond;
+  Throttle op_throttle_ops, op_throttle_bytes;
   Finisher op_finisher;
   uint64_t next_finish;
 
@@ -223,8 +223,7 @@ class FileStore : public JournalingObjectStore,
 	       Context *onreadable, Context *onreadable_sync);
   void queue_op(OpSequencer *osr, Op *o);
   void op_queue_reserve_throttle(Op *o);
-  void _op_queue_reserve_throttle(Op *o, const char *caller = 0);
-  void _op_queue_release_throttle(Op *o);
+  void op_queue_release_throttle(Op *o);
   void _journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk);
   friend class C_JournaledAhead;
 
@@ -496,7 +496,7 @@ int OSD::peek_meta(const std::string &dev, std::string& magic,
 
 int OSD::peek_journal_fsid(string path, uuid_d& fsid)
 {
-  FileJournal j(fsid, 0, 0, path.c_str());
+  FileJournal j(g_ceph_context, fsid, 0, 0, path.c_str());
   return j.peek_fsid(fsid);
 }
 
@@ -525,7 +525,8 @@ OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
   dispatch_running(false),
   osd_compat(get_osd_compat_set()),
   state(STATE_BOOTING), boot_epoch(0), up_epoch(0), bind_epoch(0),
-  op_tp(external_messenger->cct, "OSD::op_tp", g_conf->osd_op_threads),
+  op_tp(external_messenger->cct, "OSD::op_tp", g_conf->osd_op_threads,
+	g_conf->osd_op_work_stealing),
   recovery_tp(external_messenger->cct, "OSD::recovery_tp", g_conf->osd_recovery_threads),
   disk_tp(external_messenger->cct, "OSD::disk_tp", g_conf->osd_disk_threads),
   command_tp(external_messenger->cct, "OSD::command_tp", 1),
@@ -542,6 +543,8 @@ OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
   map_lock("OSD::map_lock"),
   peer_map_epoch_lock("OSD::peer_map_epoch_lock"),
   map_cache_lock("OSD::map_cache_lock"),
+  map_bl_cache(g_conf->osd_map_cache_bl_size),
+  map_bl_inc_cache(g_conf->osd_map_cache_bl_inc_size),
   outstanding_pg_stats(false),
   up_thru_wanted(0), up_thru_pending(0),
   pg_stat_queue_lock("OSD::pg_stat_queue_lock"),
@@ -552,6 +555,7 @@ OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
   backlog_wq(this, g_conf->osd_backlog_thread_timeout, &disk_tp),
   command_wq(this, g_conf->osd_command_thread_timeout, &command_tp),
   recovery_ops_active(0),
+  recovery_throttle(g_ceph_context, "osd_recovery"),
   recovery_wq(this, g_conf->osd_recovery_thread_timeout, &recovery_tp),
   remove_list_lock("OSD::remove_list_lock"),
   replay_queue_lock("OSD::replay_queue_lock"),
@@ -568,6 +572,8 @@ OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
 {
   monc->set_messenger(client_messenger);
 
+  recovery_throttle.set_rate(g_conf->osd_recovery_max_ops_per_sec);
+
   map_in_progress_cond = new Cond();
   
 }
@@ -2114,7 +2120,7 @@ void OSD::send_still_alive(entity_inst_t i)
   monc->send_mon_message(m);
 }
 
-void OSD::send_pg_stats(const utime_t &now)
+void OSD::send_pg_stats(const utime_t &now, bool flush)
 {
   assert(osd_lock.is_locked());
 
@@ -2124,10 +2130,15 @@ void OSD::send_pg_stats(const utime_t &now)
   osd_stat_t cur_stat = osd_stat;
   stat_lock.Unlock();
    
+  // a mon that understands deltas only needs what changed since our
+  // last report, and we can sit on counter-only changes for a bit.
+  bool deltas = monc->mon_has_feature(CEPH_FEATURE_PGSTATDELTA);
+  double coalesce = flush ? 0 : g_conf->osd_mon_report_stats_coalesce;
+
   pg_stat_queue_lock.Lock();
 
   if (osd_stat_updated || !pg_stat_queue.empty()) {
-    last_pg_stats_sent = now;
+    bool send_osd_stat = osd_stat_updated;
     osd_stat_updated = false;
 
     dout(10) << "send_pg_stats - " << pg_stat_queue.size() << " pgs updated" << dendl;
@@ -2139,6 +2150,7 @@ void OSD::send_pg_stats(const utime_t &now)
     m->set_tid(++pg_stat_tid);
     m->osd_stat = cur_stat;
 
+    unsigned held = 0;
     xlist<PG*>::iterator p = pg_stat_queue.begin();
     while (!p.end()) {
       PG *pg = *p;
@@ -2149,20 +2161,47 @@ void OSD::send_pg_stats(const utime_t &now)
 	continue;
       }
       pg->pg_stats_lock.Lock();
-      if (pg->pg_stats_valid) {
+      if (!pg->pg_stats_valid) {
+	dout(25) << " NOT sending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << ", not valid" << dendl;
+      } else if (deltas && pg->pg_stats_sent_valid) {
+	pg_stat_delta_t d(pg->pg_stats_sent, pg->pg_stats_stable);
+	if (coalesce > 0 &&
+	    (d.fields & ~pg_stat_delta_t::F_COUNTERS) == 0 &&
+	    now - pg->pg_stats_sent_stamp < coalesce) {
+	  dout(25) << " holding " << pg->info.pgid << " " << pg->pg_stats_stable.reported
+		   << ", only counters changed" << dendl;
+	  held++;
+	} else {
+	  m->pg_stat_delta[pg->info.pgid] = d;
+	  pg->pg_stats_sent = pg->pg_stats_stable;
+	  pg->pg_stats_sent_stamp = now;
+	  pg->pg_stats_sent_delta_tid = pg_stat_tid;
+	  dout(25) << " sending " << pg->info.pgid << " " << pg->pg_stats_stable.reported
+		   << " as delta, fields " << hex << (int)d.fields << dec << dendl;
+	}
+      } else {
 	m->pg_stat[pg->info.pgid] = pg->pg_stats_stable;
+	pg->pg_stats_sent = pg->pg_stats_stable;
+	pg->pg_stats_sent_valid = deltas;
+	pg->pg_stats_sent_stamp = now;
+	pg->pg_stats_sent_delta_tid = 0;
 	dout(25) << " sending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << dendl;
-      } else {
-	dout(25) << " NOT sending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << ", not valid" << dendl;
       }
       pg->pg_stats_lock.Unlock();
     }
 
-    if (!outstanding_pg_stats) {
-      outstanding_pg_stats = true;
-      last_pg_stats_ack = ceph_clock_now(g_ceph_context);
+    if (held && !send_osd_stat && m->pg_stat.empty() && m->pg_stat_delta.empty()) {
+      dout(10) << "send_pg_stats - holding all " << held << " pgs" << dendl;
+      --pg_stat_tid;
+      m->put();
+    } else {
+      last_pg_stats_sent = now;
+      if (!outstanding_pg_stats) {
+	outstanding_pg_stats = true;
+	last_pg_stats_ack = ceph_clock_now(g_ceph_context);
+      }
+      monc->send_mon_message(m);
     }
-    monc->send_mon_message(m);
   }
 
   pg_stat_queue_lock.Unlock();
@@ -2198,13 +2237,27 @@ void OSD::handle_pg_stats_ack(MPGStatsAck *ack)
 	dout(25) << " ack on " << pg->info.pgid << " " << pg->pg_stats_stable.reported << dendl;
 	pg->stat_queue_item.remove_myself();
 	pg->put();
+      } else if (acked == eversion_t()) {
+	dout(10) << " mon couldn't apply delta for " << pg->info.pgid << ", will send full stats" << dendl;
+	pg->pg_stats_sent_valid = false;
       } else {
 	dout(25) << " still pending " << pg->info.pgid << " " << pg->pg_stats_stable.reported
 		 << " > acked " << acked << dendl;
       }
       pg->pg_stats_lock.Unlock();
-    } else
-      dout(30) << " still pending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << dendl;
+    } else {
+      pg->pg_stats_lock.Lock();
+      if (pg->pg_stats_sent_delta_tid &&
+	  pg->pg_stats_sent_delta_tid <= ack->get_tid()) {
+	// whoever handled it didn't know about deltas
+	dout(10) << " delta for " << pg->info.pgid << " went unacked, will send full stats" << dendl;
+	pg->pg_stats_sent_valid = false;
+	pg->pg_stats_sent_delta_tid = 0;
+      } else {
+	dout(30) << " still pending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << dendl;
+      }
+      pg->pg_stats_lock.Unlock();
+    }
   }
   
   if (!pg_stat_queue.size()) {
@@ -2220,7 +2273,7 @@ void OSD::flush_pg_stats()
 {
   dout(10) << "flush_pg_stats" << dendl;
   utime_t now = ceph_clock_now(cct);
-  send_pg_stats(now);
+  send_pg_stats(now, true);
 
   osd_lock.Unlock();
 
@@ -3184,13 +3237,13 @@ void OSD::handle_osd_map(MOSDMap *m)
   // requeue under osd_lock to preserve ordering of _dispatch() wrt incoming messages
   osd_lock.Lock();  
 
-  op_wq.lock();
+  list<PG*> pgs;
+  op_wq.dequeue_all(pgs);
 
   list<Message*> rq;
-  while (true) {
-    PG *pg = op_wq._dequeue();
-    if (!pg)
-      break;
+  for (list<PG*>::iterator p = pgs.begin(); p != pgs.end(); ++p) {
+    PG *pg = *p;
+    logger->set(l_osd_opq, op_queue_len.dec());
     pg->lock();
     Message *mess = pg->op_queue.front();
     pg->op_queue.pop_front();
@@ -3200,7 +3253,6 @@ void OSD::handle_osd_map(MOSDMap *m)
     rq.push_back(mess);
   }
   push_waiters(rq);  // requeue under osd_lock!
-  op_wq.unlock();
 
   recovery_tp.pause();
   disk_tp.pause_new();   // _process() may be waiting for a replica message
@@ -3209,6 +3261,7 @@ void OSD::handle_osd_map(MOSDMap *m)
 
   // store new maps: queue for disk and put in the osdmap cache
   epoch_t start = MAX(osdmap->get_epoch() + 1, first);
+  OSDMapRef lastmap = osdmap;  // to share pg mapping tables with
   for (epoch_t e = start; e <= last; e++) {
     map<epoch_t,bufferlist>::iterator p;
     p = m->maps.find(e);
@@ -3218,7 +3271,10 @@ void OSD::handle_osd_map(MOSDMap *m)
       bufferlist& bl = p->second;
       
       o->decode(bl);
-      add_map(o);
+      if (g_conf->osd_map_mapping_threads)
+	o->update_mapping(g_conf->osd_map_mapping_threads,
+			  lastmap && lastmap->get_epoch() == e - 1 ? lastmap.get() : NULL);
+      lastmap = add_map(o);
 
       hobject_t fulloid = get_osdmap_pobject_name(e);
       t.write(coll_t::META_COLL, fulloid, 0, bl.length(), bl);
@@ -3250,7 +3306,10 @@ void OSD::handle_osd_map(MOSDMap *m)
 	assert(0 == "bad fsid");
       }
 
-      add_map(o);
+      if (g_conf->osd_map_mapping_threads)
+	o->update_mapping(g_conf->osd_map_mapping_threads,
+			  lastmap && lastmap->get_epoch() == e - 1 ? lastmap.get() : NULL);
+      lastmap = add_map(o);
 
       bufferlist fbl;
       o->encode(fbl);
@@ -3704,28 +3763,22 @@ void OSD::send_incremental_map(epoch_t since, const entity_inst_t& inst, bool la
 
 bool OSD::get_map_bl(epoch_t e, bufferlist& bl)
 {
-  {
-    Mutex::Locker l(map_cache_lock);
-    map<epoch_t,bufferlist>::iterator p = map_bl.find(e);
-    if (p != map_bl.end()) {
-      bl = p->second;
-      return true;
-    }
-  }
-  return store->read(coll_t::META_COLL, get_osdmap_pobject_name(e), 0, 0, bl) >= 0;
+  if (map_bl_cache.lookup(e, &bl))
+    return true;
+  if (store->read(coll_t::META_COLL, get_osdmap_pobject_name(e), 0, 0, bl) < 0)
+    return false;
+  map_bl_cache.add(e, bl);
+  return true;
 }
 
 bool OSD::get_inc_map_bl(epoch_t e, bufferlist& bl)
 {
-  {
-    Mutex::Locker l(map_cache_lock);
-    map<epoch_t,bufferlist>::iterator p = map_inc_bl.find(e);
-    if (p != map_inc_bl.end()) {
-      bl = p->second;
-      return true;
-    }
-  }
-  return store->read(coll_t::META_COLL, get_inc_osdmap_pobject_name(e), 0, 0, bl) >= 0;
+  if (map_bl_inc_cache.lookup(e, &bl))
+    return true;
+  if (store->read(coll_t::META_COLL, get_inc_osdmap_pobject_name(e), 0, 0, bl) < 0)
+    return false;
+  map_bl_inc_cache.add(e, bl);
+  return true;
 }
 
 OSDMapRef OSD::add_map(OSDMap *o)
@@ -3743,16 +3796,14 @@ OSDMapRef OSD::add_map(OSDMap *o)
 
 void OSD::add_map_bl(epoch_t e, bufferlist& bl)
 {
-  Mutex::Locker l(map_cache_lock);
   dout(10) << "add_map_bl " << e << " " << bl.length() << " bytes" << dendl;
-  map_bl[e] = bl;
+  map_bl_cache.pin(e, bl);
 }
 
 void OSD::add_map_inc_bl(epoch_t e, bufferlist& bl)
 {
-  Mutex::Locker l(map_cache_lock);
   dout(10) << "add_map_inc_bl " << e << " " << bl.length() << " bytes" << dendl;
-  map_inc_bl[e] = bl;
+  map_bl_inc_cache.pin(e, bl);
 }
 
 OSDMapRef OSD::get_map(epoch_t epoch)
@@ -3780,12 +3831,10 @@ OSDMapRef OSD::get_map(epoch_t epoch)
 
 void OSD::trim_map_bl_cache(epoch_t oldest)
 {
-  Mutex::Locker l(map_cache_lock);
   dout(10) << "trim_map_bl_cache up to " << oldest << dendl;
-  while (!map_inc_bl.empty() && map_inc_bl.begin()->first < oldest)
-    map_inc_bl.erase(map_inc_bl.begin());
-  while (!map_bl.empty() && map_bl.begin()->first < oldest)
-    map_bl.erase(map_bl.begin());
+  // on disk now; they can age out of the lru like anything else
+  map_bl_inc_cache.clear_pinned(oldest - 1);
+  map_bl_cache.clear_pinned(oldest - 1);
 }
 
 void OSD::trim_map_cache(epoch_t oldest)
@@ -4984,6 +5033,12 @@ bool OSD::_recover_now()
     dout(15) << "_recover_now defer until " << defer_recovery_until << dendl;
     return false;
   }
+  if (recovery_throttle.should_wait(1)) {
+    // tick() kicks the queue, so we'll retry once the rate allows
+    dout(15) << "_recover_now over osd_recovery_max_ops_per_sec "
+	     << g_conf->osd_recovery_max_ops_per_sec << dendl;
+    return false;
+  }
 
   return true;
 }
@@ -5052,6 +5107,7 @@ void OSD::start_recovery_op(PG *pg, const hobject_t& soid)
 	   << dendl;
   assert(recovery_ops_active >= 0);
   recovery_ops_active++;
+  recovery_throttle.take(1);
 
 #ifdef DEBUG_RECOVERY_OIDS
   dout(20) << "  active was " << recovery_oids[pg->info.pgid] << dendl;
@@ -5073,6 +5129,7 @@ void OSD::finish_recovery_op(PG *pg, const hobject_t& soid, bool dequeue)
   // adjust count
   recovery_ops_active--;
   assert(recovery_ops_active >= 0);
+  recovery_throttle.put(1);
 
 #ifdef DEBUG_RECOVERY_OIDS
   dout(20) << "  active oids was " << recovery_oids[pg->info.pgid] << dendl;
@@ -5483,27 +5540,9 @@ void OSD::enqueue_op(PG *pg, Message *op)
   // add to pg's op_queue
   pg->op_queue.push_back(op);
   
-  op_wq.queue(pg);
-}
-
-bool OSD::OpWQ::_enqueue(PG *pg)
-{
   pg->get();
-  osd->op_queue.push_back(pg);
-  osd->op_queue_len++;
-  osd->logger->set(l_osd_opq, osd->op_queue_len);
-  return true;
-}
-
-PG *OSD::OpWQ::_dequeue()
-{
-  if (osd->op_queue.empty())
-    return NULL;
-  PG *pg = osd->op_queue.front();
-  osd->op_queue.pop_front();
-  osd->op_queue_len--;
-  osd->logger->set(l_osd_opq, osd->op_queue_len);
-  return pg;
+  logger->set(l_osd_opq, op_queue_len.inc());
+  op_wq.queue(pg);
 }
 
 /*
@@ -5547,6 +5586,8 @@ void OSD::dequeue_op(PG *pg)
 {
   Message *op = 0;
 
+  logger->set(l_osd_opq, op_queue_len.dec());
+
   osd_lock.Lock();
   {
     // lock pg and get pending op
@@ -24,11 +24,13 @@
 #include "common/Timer.h"
 #include "common/WorkQueue.h"
 #include "common/LogClient.h"
+#include "common/Throttle.h"
 
 #include "os/ObjectStore.h"
 #include "OSDCaps.h"
 
 #include "common/DecayCounter.h"
+#include "common/simple_cache.h"
 #include "osd/ClassHandler.h"
 
 #include "include/CompatSet.h"
@@ -323,27 +325,18 @@ private:
   void do_waiters();
   
   // -- op queue --
-  deque<PG*> op_queue;
-  int op_queue_len;
+  atomic_t op_queue_len;
 
-  struct OpWQ : public ThreadPool::WorkQueue<PG> {
+  struct OpWQ : public ThreadPool::ShardedWorkQueue<PG> {
     OSD *osd;
     OpWQ(OSD *o, time_t ti, ThreadPool *tp)
-      : ThreadPool::WorkQueue<PG>("OSD::OpWQ", ti, ti*10, tp), osd(o) {}
+      : ThreadPool::ShardedWorkQueue<PG>("OSD::OpWQ", ti, ti*10, tp), osd(o) {}
 
-    bool _enqueue(PG *pg);
-    void _dequeue(PG *pg) {
-      assert(0);
-    }
-    bool _empty() {
-      return osd->op_queue.empty();
-    }
-    PG *_dequeue();
     void _process(PG *pg) {
       osd->dequeue_op(pg);
     }
-    void _clear() {
-      assert(osd->op_queue.empty());
+    void _discard(PG *pg) {
+      assert(0);
     }
   } op_wq;
 
@@ -388,10 +381,13 @@ private:
 
   // osd map cache (past osd maps)
   map<epoch_t,OSDMapRef > map_cache;
-  map<epoch_t,bufferlist> map_inc_bl;
-  map<epoch_t,bufferlist> map_bl;
   Mutex map_cache_lock;
 
+  // encoded maps.  those not yet on disk are pinned; the rest are what
+  // we recently read back to share with peers.
+  SimpleLRU<epoch_t,bufferlist> map_bl_cache;
+  SimpleLRU<epoch_t,bufferlist> map_bl_inc_cache;
+
   OSDMapRef get_map(epoch_t e);
   OSDMapRef add_map(OSDMap *o);
   void add_map_bl(epoch_t e, bufferlist& bl);
@@ -530,7 +526,7 @@ protected:
   bool osd_stat_updated;
   uint64_t pg_stat_tid, pg_stat_tid_flushed;
 
-  void send_pg_stats(const utime_t &now);
+  void send_pg_stats(const utime_t &now, bool flush=false);
   void handle_pg_stats_ack(class MPGStatsAck *ack);
   void flush_pg_stats();
 
@@ -709,6 +705,7 @@ protected:
   xlist<PG*> recovery_queue;
   utime_t defer_recovery_until;
   int recovery_ops_active;
+  Throttle recovery_throttle;  // ops/s limit; count mirrors recovery_ops_active
 #ifdef DEBUG_RECOVERY_OIDS
   map<pg_t, set<hobject_t> > recovery_oids;
 #endif
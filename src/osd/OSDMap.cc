@@ -269,6 +269,7 @@ bool OSDMap::is_blacklisted(const entity_addr_t& a) const
 
 void OSDMap::set_max_osd(int m)
 {
+  mapping_current = false;
   int o = max_osd;
   max_osd = m;
   osd_state.resize(m);
@@ -310,6 +311,17 @@ void OSDMap::adjust_osd_weights(const map<int,double>& weights, Incremental& inc
   }
 }
 
+void OSDMap::update_mapping(int threads, const OSDMap *prev)
+{
+  const OSDMapMapping *old = mapping.get();
+  if (prev && prev->mapping)
+    old = prev->mapping.get();
+  OSDMapMapping *m = new OSDMapMapping;
+  m->update(*this, old, threads);
+  mapping.reset(m);
+  mapping_current = true;
+}
+
 int OSDMap::apply_incremental(Incremental &inc)
 {
   if (inc.epoch == 1)
@@ -320,6 +332,7 @@ int OSDMap::apply_incremental(Incremental &inc)
   assert(inc.epoch == epoch+1);
   epoch++;
   modified = inc.modified;
+  mapping_current = false;
 
   // full map?
   if (inc.fullmap.length()) {
@@ -546,6 +559,7 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
 
 void OSDMap::decode(bufferlist& bl)
 {
+  mapping_current = false;
   __u32 n, t;
   bufferlist::iterator p = bl.begin();
   __u16 v;
@@ -24,6 +24,7 @@
 #include "common/config.h"
 #include "include/types.h"
 #include "osd_types.h"
+#include "OSDMapMapping.h"
 #include "msg/Message.h"
 #include "common/Mutex.h"
 #include "common/Clock.h"
@@ -180,19 +181,27 @@ private:
   epoch_t cluster_snapshot_epoch;
   string cluster_snapshot;
 
+  // precomputed raw mappings; only used while mapping_current.  kept
+  // when stale so the next update_mapping() can share unchanged pools.
+  std::tr1::shared_ptr<const OSDMapMapping> mapping;
+  bool mapping_current;
+
  public:
-  CrushWrapper     crush;       // hierarchical map
+  CrushWrapper     crush;       // hierarchical map; call update_mapping() after
+				// changing it directly
 
   friend class OSDMonitor;
   friend class PGMonitor;
   friend class MDS;
+  friend class OSDMapMapping;
 
  public:
   OSDMap() : epoch(0), 
 	     pool_max(-1),
 	     flags(0),
 	     num_osd(0), max_osd(0),
-	     cluster_snapshot_epoch(0) { 
+	     cluster_snapshot_epoch(0),
+	     mapping_current(false) { 
     memset(&fsid, 0, sizeof(fsid));
   }
 
@@ -272,6 +281,7 @@ private:
   void set_weight(int o, unsigned w) {
     assert(o < max_osd);
     osd_weight[o] = w;
+    mapping_current = false;
     if (w)
       osd_state[o] |= CEPH_OSD_EXISTS;
   }
@@ -390,6 +400,18 @@ public:
 
 
   /****   mapping facilities   ****/
+
+  /**
+   * Precompute the raw pg mapping for this epoch with @a threads
+   * workers, sharing unchanged pools with @a prev (or with our own
+   * stale mapping).  Until the map next changes, pg_to_* lookups
+   * are a table index.
+   */
+  void update_mapping(int threads, const OSDMap *prev=NULL);
+  const OSDMapMapping *get_mapping() const {
+    return mapping_current ? mapping.get() : NULL;
+  }
+
   int object_locator_to_pg(const object_t& oid, const object_locator_t& loc, pg_t &pg) const {
     // calculate ps (placement seed)
     const pg_pool_t *pool = get_pg_pool(loc.get_pool());
@@ -445,6 +467,9 @@ public:
   // pg -> (osd list)
 private:
   int _pg_to_osds(const pg_pool_t& pool, pg_t pg, vector<int>& osds) const {
+    if (mapping_current && mapping->get_raw(pool, pg, osds))
+      return osds.size();
+
     // map to osds[]
     ps_t pps = pool.raw_pg_to_pps(pg);  // placement ps
     unsigned size = pool.get_size();
@@ -0,0 +1,186 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "OSDMapMapping.h"
+#include "OSDMap.h"
+
+#include "common/Thread.h"
+
+// rows per job; small enough to spread one big pool over all workers
+#define ROWS_PER_JOB 4096
+
+class OSDMapMapping::Worker : public Thread {
+public:
+  bufferlist crushbl;   // our own copy; shares the encoded buffers
+  const vector<__u32>& weight;
+  const vector<Job>& jobs;
+  unsigned first, step;
+
+  Worker(const bufferlist& c, const vector<__u32>& w, const vector<Job>& j,
+	 unsigned f, unsigned s)
+    : crushbl(c), weight(w), jobs(j), first(f), step(s) {}
+
+  void *entry() {
+    CrushWrapper crush;
+    bufferlist::iterator p = crushbl.begin();
+    crush.decode(p);
+    for (unsigned i = first; i < jobs.size(); i += step)
+      map_range(crush, weight, jobs[i]);
+    return 0;
+  }
+};
+
+void OSDMapMapping::get_inputs(const OSDMap& map, int64_t poolid,
+			       const pg_pool_t& pool, vector<int32_t>& inputs)
+{
+  const CrushWrapper& crush = map.crush;
+  inputs.push_back(poolid);
+  inputs.push_back(pool.get_type());
+  inputs.push_back(pool.get_size());
+  inputs.push_back(pool.get_crush_ruleset());
+  inputs.push_back(pool.get_pgp_num());
+  inputs.push_back(pool.get_pgp_num_mask());
+  inputs.push_back(crush.get_max_devices());
+
+  int ruleno = crush.find_rule(pool.get_crush_ruleset(), pool.get_type(),
+			       pool.get_size());
+  inputs.push_back(ruleno);
+  if (ruleno < 0)
+    return;
+
+  const crush_rule *rule = crush.crush->rules[ruleno];
+  vector<int> stack;
+  inputs.push_back(rule->len);
+  for (unsigned i = 0; i < rule->len; i++) {
+    inputs.push_back(rule->steps[i].op);
+    inputs.push_back(rule->steps[i].arg1);
+    inputs.push_back(rule->steps[i].arg2);
+    if (rule->steps[i].op == CRUSH_RULE_TAKE)
+      stack.push_back(rule->steps[i].arg1);
+  }
+
+  // everything reachable from the take steps
+  set<int> seen;
+  while (!stack.empty()) {
+    int item = stack.back();
+    stack.pop_back();
+    if (!seen.insert(item).second)
+      continue;
+    inputs.push_back(item);
+    if (item >= 0) {
+      inputs.push_back(item < (int)map.osd_weight.size() ? map.osd_weight[item] : 0);
+      continue;
+    }
+    if (!crush.bucket_exists(item)) {
+      inputs.push_back(-1);
+      continue;
+    }
+    int size = crush.get_bucket_size(item);
+    inputs.push_back(crush.get_bucket_type(item));
+    inputs.push_back(crush.get_bucket_alg(item));
+    inputs.push_back(crush.get_bucket_hash(item));
+    inputs.push_back(size);
+    for (int j = 0; j < size; j++) {
+      int child = crush.get_bucket_item(item, j);
+      inputs.push_back(child);
+      inputs.push_back(crush.get_bucket_item_weight(item, j));
+      stack.push_back(child);
+    }
+  }
+}
+
+void OSDMapMapping::map_range(const CrushWrapper& crush,
+			      const vector<__u32>& weight, const Job& job)
+{
+  const pg_pool_t& pool = *job.pool;
+  unsigned size = job.pm->size;
+  int ruleno = crush.find_rule(pool.get_crush_ruleset(), pool.get_type(), size);
+  vector<int> osds;
+  for (unsigned ps = job.begin; ps < job.end; ps++) {
+    int32_t *row = &job.pm->table[ps * (size + 1)];
+    osds.clear();
+    if (ruleno >= 0)
+      crush.do_rule(ruleno, pool.raw_pg_to_pps(pg_t(ps, job.poolid, -1)),
+		    osds, size, -1, weight);
+    row[0] = osds.size();
+    for (unsigned i = 0; i < osds.size(); i++)
+      row[i + 1] = osds[i];
+  }
+}
+
+void OSDMapMapping::update(const OSDMap& map, const OSDMapMapping *prev,
+			   int threads)
+{
+  assert(map.get_max_osd() >= map.crush.get_max_devices());
+
+  epoch = map.get_epoch();
+  pools.clear();
+  num_computed = num_shared = 0;
+
+  vector<Job> jobs;
+  for (std::map<int64_t,pg_pool_t>::const_iterator p = map.pools.begin();
+       p != map.pools.end();
+       ++p) {
+    vector<int32_t> inputs;
+    get_inputs(map, p->first, p->second, inputs);
+
+    if (prev) {
+      std::map<int64_t, std::tr1::shared_ptr<const PoolMapping> >::const_iterator q =
+	prev->pools.find(p->first);
+      if (q != prev->pools.end() && q->second->inputs == inputs) {
+	pools[p->first] = q->second;
+	num_shared++;
+	continue;
+      }
+    }
+
+    PoolMapping *pm = new PoolMapping;
+    pm->inputs.swap(inputs);
+    pm->size = p->second.get_size();
+    unsigned rows = p->second.get_pgp_num();
+    pm->table.resize(rows * (pm->size + 1));
+    pools[p->first].reset(pm);
+    num_computed++;
+
+    for (unsigned b = 0; b < rows; b += ROWS_PER_JOB) {
+      Job j;
+      j.poolid = p->first;
+      j.pool = &p->second;
+      j.pm = pm;
+      j.begin = b;
+      j.end = MIN(b + ROWS_PER_JOB, rows);
+      jobs.push_back(j);
+    }
+  }
+
+  if (threads <= 1 || jobs.size() <= 1) {
+    for (vector<Job>::iterator j = jobs.begin(); j != jobs.end(); ++j)
+      map_range(map.crush, map.osd_weight, *j);
+    return;
+  }
+
+  unsigned n = MIN((unsigned)threads, jobs.size());
+  bufferlist crushbl;
+  map.crush.encode(crushbl);
+  vector<Worker*> workers;
+  for (unsigned i = 0; i < n; i++) {
+    Worker *w = new Worker(crushbl, map.osd_weight, jobs, i, n);
+    w->create();
+    workers.push_back(w);
+  }
+  for (vector<Worker*>::iterator w = workers.begin(); w != workers.end(); ++w) {
+    (*w)->join();
+    delete *w;
+  }
+}
@@ -0,0 +1,106 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSDMAPMAPPING_H
+#define CEPH_OSDMAPMAPPING_H
+
+#include "include/types.h"
+#include "osd_types.h"
+
+#include <map>
+#include <vector>
+#include <tr1/memory>
+
+class OSDMap;
+class CrushWrapper;
+
+/*
+ * The raw (CRUSH) mapping of every pg in every pool of one OSDMap
+ * epoch, so that lookups are a table index instead of a crush_do_rule
+ * call.
+ *
+ * The raw mapping of a pg depends only on its placement seed, which
+ * is ps mod pgp_num, so each pool has one row per pgp.  Localized
+ * (preferred) pgs are not covered and go through CRUSH as before.
+ *
+ * Each pool's table also records everything CRUSH reads when mapping
+ * it: the pool's size, type, ruleset and pgp_num, the rule, and every
+ * bucket and device weight reachable from the rule's take steps.  A
+ * new epoch whose inputs match the previous one's for a pool shares
+ * that pool's table instead of recomputing it, so an epoch that only
+ * marks osds up or down, or reweights part of the hierarchy, costs
+ * little.
+ *
+ * Tables are built by a number of worker threads, each with a private
+ * copy of the crush map, because crush_do_rule caches permutations in
+ * the buckets.  Once built, a mapping is immutable and may be shared
+ * between threads and OSDMap copies.
+ */
+class OSDMapMapping {
+public:
+  OSDMapMapping() : epoch(0), num_computed(0), num_shared(0) {}
+
+  /**
+   * Build the tables for @a map using @a threads workers.  Pool tables
+   * in @a prev (may be NULL) whose inputs are unchanged are shared.
+   */
+  void update(const OSDMap& map, const OSDMapMapping *prev, int threads);
+
+  /// raw osds for @a pg, if it is covered
+  bool get_raw(const pg_pool_t& pool, pg_t pg, vector<int>& raw) const {
+    map<int64_t, std::tr1::shared_ptr<const PoolMapping> >::const_iterator p =
+      pools.find(pg.pool());
+    if (p == pools.end() || pg.preferred() >= 0)
+      return false;
+    const PoolMapping& pm = *p->second;
+    unsigned row = ceph_stable_mod(pg.ps(), pool.get_pgp_num(),
+				   pool.get_pgp_num_mask());
+    const int32_t *r = &pm.table[row * (pm.size + 1)];
+    raw.assign(r + 1, r + 1 + r[0]);
+    return true;
+  }
+
+  epoch_t get_epoch() const { return epoch; }
+  /// pools mapped through CRUSH by the last update()
+  unsigned get_num_computed() const { return num_computed; }
+  /// pools whose table was shared with the previous epoch
+  unsigned get_num_shared() const { return num_shared; }
+
+private:
+  struct PoolMapping {
+    vector<int32_t> inputs;  // everything CRUSH reads for this pool
+    unsigned size;
+    vector<int32_t> table;   // rows of [n, osd0 .. osd(size-1)]
+  };
+
+  struct Job {
+    int64_t poolid;
+    const pg_pool_t *pool;
+    PoolMapping *pm;
+    unsigned begin, end;
+  };
+
+  class Worker;
+
+  epoch_t epoch;
+  map<int64_t, std::tr1::shared_ptr<const PoolMapping> > pools;
+  unsigned num_computed, num_shared;
+
+  static void get_inputs(const OSDMap& map, int64_t poolid,
+			 const pg_pool_t& pool, vector<int32_t>& inputs);
+  static void map_range(const CrushWrapper& crush,
+			const vector<__u32>& weight, const Job& job);
+};
+
+#endif
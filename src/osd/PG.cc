@@ -1872,6 +1872,7 @@ void PG::update_stats()
     dout(15) << "update_stats " << pg_stats_stable.reported << dendl;
   } else {
     pg_stats_valid = false;
+    pg_stats_sent_valid = false;
     dout(15) << "update_stats -- not primary" << dendl;
   }
   pg_stats_lock.Unlock();
@@ -1885,6 +1886,7 @@ void PG::clear_stats()
   dout(15) << "clear_stats" << dendl;
   pg_stats_lock.Lock();
   pg_stats_valid = false;
+  pg_stats_sent_valid = false;
   pg_stats_lock.Unlock();
 
   osd->pg_stat_queue_dequeue(this);
@@ -1384,6 +1384,12 @@ protected:
   bool pg_stats_valid;
   pg_stat_t pg_stats_stable;
 
+  // what we last sent the mon; the next report can be a delta against it
+  bool pg_stats_sent_valid;
+  pg_stat_t pg_stats_sent;
+  utime_t pg_stats_sent_stamp;
+  uint64_t pg_stats_sent_delta_tid;   // message that last carried a delta
+
   // for ordering writes
   ObjectStore::Sequencer osr;
 
@@ -1568,6 +1574,8 @@ public:
     last_peering_reset(0),
     pg_stats_lock("PG::pg_stats_lock"),
     pg_stats_valid(false),
+    pg_stats_sent_valid(false),
+    pg_stats_sent_delta_tid(0),
     finish_sync_event(NULL),
     finalizing_scrub(false),
     scrub_reserved(false), scrub_reserve_failed(false),
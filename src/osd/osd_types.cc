@@ -518,6 +518,141 @@ ostream& operator<<(ostream& out, const pg_pool_t& p)
 
 
 
+// -- pg_stat_delta_t --
+
+pg_stat_delta_t::pg_stat_delta_t(const pg_stat_t& base, const pg_stat_t& cur)
+  : base_reported(base.reported), fields(0), stat(cur)
+{
+  if (cur.state != base.state)
+    fields |= F_STATE;
+  if (cur.log_start != base.log_start ||
+      cur.ondisk_log_start != base.ondisk_log_start ||
+      cur.log_size != base.log_size ||
+      cur.ondisk_log_size != base.ondisk_log_size)
+    fields |= F_LOG;
+  if (cur.created != base.created ||
+      cur.last_epoch_clean != base.last_epoch_clean ||
+      cur.parent != base.parent ||
+      cur.parent_split_bits != base.parent_split_bits)
+    fields |= F_HISTORY;
+  if (cur.last_scrub != base.last_scrub ||
+      cur.last_scrub_stamp != base.last_scrub_stamp)
+    fields |= F_SCRUB;
+  if (cur.stats.sum != base.stats.sum)
+    fields |= F_SUM;
+  if (cur.stats.cat_sum != base.stats.cat_sum)
+    fields |= F_CAT_SUM;
+  if (cur.up != base.up ||
+      cur.acting != base.acting)
+    fields |= F_MAPPING;
+}
+
+void pg_stat_delta_t::apply(pg_stat_t& s) const
+{
+  assert(s.reported == base_reported);
+  s.version = stat.version;
+  s.reported = stat.reported;
+  if (fields & F_STATE)
+    s.state = stat.state;
+  if (fields & F_LOG) {
+    s.log_start = stat.log_start;
+    s.ondisk_log_start = stat.ondisk_log_start;
+    s.log_size = stat.log_size;
+    s.ondisk_log_size = stat.ondisk_log_size;
+  }
+  if (fields & F_HISTORY) {
+    s.created = stat.created;
+    s.last_epoch_clean = stat.last_epoch_clean;
+    s.parent = stat.parent;
+    s.parent_split_bits = stat.parent_split_bits;
+  }
+  if (fields & F_SCRUB) {
+    s.last_scrub = stat.last_scrub;
+    s.last_scrub_stamp = stat.last_scrub_stamp;
+  }
+  if (fields & F_SUM)
+    s.stats.sum = stat.stats.sum;
+  if (fields & F_CAT_SUM)
+    s.stats.cat_sum = stat.stats.cat_sum;
+  if (fields & F_MAPPING) {
+    s.up = stat.up;
+    s.acting = stat.acting;
+  }
+}
+
+void pg_stat_delta_t::encode(bufferlist& bl) const
+{
+  __u8 v = 1;
+  ::encode(v, bl);
+  ::encode(base_reported, bl);
+  ::encode(fields, bl);
+  ::encode(stat.version, bl);
+  ::encode(stat.reported, bl);
+  if (fields & F_STATE)
+    ::encode(stat.state, bl);
+  if (fields & F_LOG) {
+    ::encode(stat.log_start, bl);
+    ::encode(stat.ondisk_log_start, bl);
+    ::encode(stat.log_size, bl);
+    ::encode(stat.ondisk_log_size, bl);
+  }
+  if (fields & F_HISTORY) {
+    ::encode(stat.created, bl);
+    ::encode(stat.last_epoch_clean, bl);
+    ::encode(stat.parent, bl);
+    ::encode(stat.parent_split_bits, bl);
+  }
+  if (fields & F_SCRUB) {
+    ::encode(stat.last_scrub, bl);
+    ::encode(stat.last_scrub_stamp, bl);
+  }
+  if (fields & F_SUM)
+    ::encode(stat.stats.sum, bl);
+  if (fields & F_CAT_SUM)
+    ::encode(stat.stats.cat_sum, bl);
+  if (fields & F_MAPPING) {
+    ::encode(stat.up, bl);
+    ::encode(stat.acting, bl);
+  }
+}
+
+void pg_stat_delta_t::decode(bufferlist::iterator& bl)
+{
+  __u8 v;
+  ::decode(v, bl);
+  ::decode(base_reported, bl);
+  ::decode(fields, bl);
+  ::decode(stat.version, bl);
+  ::decode(stat.reported, bl);
+  if (fields & F_STATE)
+    ::decode(stat.state, bl);
+  if (fields & F_LOG) {
+    ::decode(stat.log_start, bl);
+    ::decode(stat.ondisk_log_start, bl);
+    ::decode(stat.log_size, bl);
+    ::decode(stat.ondisk_log_size, bl);
+  }
+  if (fields & F_HISTORY) {
+    ::decode(stat.created, bl);
+    ::decode(stat.last_epoch_clean, bl);
+    ::decode(stat.parent, bl);
+    ::decode(stat.parent_split_bits, bl);
+  }
+  if (fields & F_SCRUB) {
+    ::decode(stat.last_scrub, bl);
+    ::decode(stat.last_scrub_stamp, bl);
+  }
+  if (fields & F_SUM)
+    ::decode(stat.stats.sum, bl);
+  if (fields & F_CAT_SUM)
+    ::decode(stat.stats.cat_sum, bl);
+  if (fields & F_MAPPING) {
+    ::decode(stat.up, bl);
+    ::decode(stat.acting, bl);
+  }
+}
+
+
 // -- OSDSuperblock --
 
 void OSDSuperblock::encode(bufferlist &bl) const
@@ -771,6 +771,24 @@ struct object_stat_sum_t {
 };
 WRITE_CLASS_ENCODER(object_stat_sum_t)
 
+inline bool operator==(const object_stat_sum_t& l, const object_stat_sum_t& r) {
+  return l.num_bytes == r.num_bytes &&
+    l.num_kb == r.num_kb &&
+    l.num_objects == r.num_objects &&
+    l.num_object_clones == r.num_object_clones &&
+    l.num_object_copies == r.num_object_copies &&
+    l.num_objects_missing_on_primary == r.num_objects_missing_on_primary &&
+    l.num_objects_degraded == r.num_objects_degraded &&
+    l.num_objects_unfound == r.num_objects_unfound &&
+    l.num_rd == r.num_rd &&
+    l.num_rd_kb == r.num_rd_kb &&
+    l.num_wr == r.num_wr &&
+    l.num_wr_kb == r.num_wr_kb;
+}
+inline bool operator!=(const object_stat_sum_t& l, const object_stat_sum_t& r) {
+  return !(l == r);
+}
+
 struct object_stat_collection_t {
   object_stat_sum_t sum;
   map<string,object_stat_sum_t> cat_sum;
@@ -978,6 +996,42 @@ struct pg_stat_t {
 };
 WRITE_CLASS_ENCODER(pg_stat_t)
 
+/*
+ * pg_stat_delta_t - a pg_stat_t relative to an earlier report
+ *
+ * Only the groups of fields that differ from the base (the last report
+ * the mon acked) are encoded; version and reported always are.  The
+ * receiver must hold the base, which it checks against base_reported.
+ */
+struct pg_stat_delta_t {
+  enum {
+    F_STATE   = 1 << 0,   // state
+    F_LOG     = 1 << 1,   // log_start, ondisk_log_start, log_size, ondisk_log_size
+    F_HISTORY = 1 << 2,   // created, last_epoch_clean, parent, parent_split_bits
+    F_SCRUB   = 1 << 3,   // last_scrub, last_scrub_stamp
+    F_SUM     = 1 << 4,   // stats.sum
+    F_CAT_SUM = 1 << 5,   // stats.cat_sum
+    F_MAPPING = 1 << 6,   // up, acting
+
+    // fields that change with ordinary i/o and can wait to be reported
+    F_COUNTERS = F_LOG | F_SUM | F_CAT_SUM,
+  };
+
+  eversion_t base_reported;
+  __u8 fields;
+  pg_stat_t stat;   // only fields (plus version and reported) are valid
+
+  pg_stat_delta_t() : fields(0) {}
+  pg_stat_delta_t(const pg_stat_t& base, const pg_stat_t& cur);
+
+  /// apply to the base this was made against
+  void apply(pg_stat_t& s) const;
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& bl);
+};
+WRITE_CLASS_ENCODER(pg_stat_delta_t)
+
 /*
  * summation over an entire pool
  */
@@ -1,9 +1,9 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*- 
 // vim: ts=8 sw=2 smarttab
 
-#include "msg/Messenger.h"
 #include "ObjectCacher.h"
-#include "Objecter.h"
+#include "WritebackHandler.h"
+#include "common/Cond.h"
 
 
 
@@ -14,17 +14,22 @@
 
 #define DOUT_SUBSYS objectcacher
 #undef dout_prefix
-#define dout_prefix *_dout << oc->objecter->messenger->get_myname() << ".objectcacher.object(" << oid << ") "
+#define dout_prefix *_dout << "objectcacher.object(" << oid << ") "
 
 ObjectCacher::
-ObjectCacher(CephContext *cct_, Objecter *o, Mutex& l, flush_set_callback_t flush_callback,
-	     void *flush_callback_arg) : 
-    cct(cct_), objecter(o), filer(o), lock(l),
+ObjectCacher(CephContext *cct_, WritebackHandler& wb, Mutex& l,
+	     flush_set_callback_t flush_callback,
+	     void *flush_callback_arg,
+	     uint64_t max_size, uint64_t max_dirty, uint64_t target_dirty,
+	     double max_dirty_age) :
+    cct(cct_), writeback_handler(wb), lock(l),
+    max_size(max_size), max_dirty(max_dirty), target_dirty(target_dirty),
     flush_set_callback(flush_callback), flush_set_callback_arg(flush_callback_arg),
     flusher_stop(false), flusher_thread(this),
     stat_waiter(0),
     stat_clean(0), stat_dirty(0), stat_rx(0), stat_tx(0), stat_missing(0) {
-  }
+  this->max_dirty_age.set_from_double(max_dirty_age);
+}
 
 ObjectCacher::BufferHead *ObjectCacher::Object::split(BufferHead *left, loff_t off)
 {
@@ -33,6 +38,7 @@ ObjectCacher::BufferHead *ObjectCacher::Object::split(BufferHead *left, loff_t o
   // split off right
   ObjectCacher::BufferHead *right = new BufferHead(this);
   right->last_write_tid = left->last_write_tid;
+  right->last_write = left->last_write;
   right->set_state(left->get_state());
   right->snapc = left->snapc;
   
@@ -94,6 +100,7 @@ void ObjectCacher::Object::merge_left(BufferHead *left, BufferHead *right)
   // version 
   // note: this is sorta busted, but should only be used for dirty buffers
   left->last_write_tid =  MAX( left->last_write_tid, right->last_write_tid );
+  // left keeps its place in the dirty list; see ObjectCacher::flush()
   left->last_write = MAX( left->last_write, right->last_write );
 
   // waiters
@@ -421,7 +428,7 @@ void ObjectCacher::Object::truncate(loff_t s)
 /*** ObjectCacher ***/
 
 #undef dout_prefix
-#define dout_prefix *_dout << objecter->messenger->get_myname() << ".objectcacher "
+#define dout_prefix *_dout << "objectcacher "
 
 /* private */
 
@@ -451,11 +458,10 @@ void ObjectCacher::bh_read(BufferHead *bh)
   ObjectSet *oset = bh->ob->oset;
 
   // go
-  objecter->read_trunc(bh->ob->get_oid(), bh->ob->get_oloc(), 
-		 bh->start(), bh->length(), bh->ob->get_snap(),
-		 &onfinish->bl, 0,
-		 oset->truncate_size, oset->truncate_seq,
-		 onfinish);
+  writeback_handler.read(bh->ob->get_oid(), bh->ob->get_oloc(),
+			 bh->start(), bh->length(), bh->ob->get_snap(),
+			 &onfinish->bl, oset->truncate_size, oset->truncate_seq,
+			 onfinish);
 }
 
 void ObjectCacher::bh_read_finish(int64_t poolid, sobject_t oid, loff_t start, uint64_t length, bufferlist &bl)
@@ -475,10 +481,10 @@ void ObjectCacher::bh_read_finish(int64_t poolid, sobject_t oid, loff_t start, u
     bl.push_back(bp);
   }
   
-  if (objects[poolid].count(oid) == 0) {
+  Object *ob = get_object_maybe(poolid, oid);
+  if (!ob) {
     ldout(cct, 7) << "bh_read_finish no object cache" << dendl;
   } else {
-    Object *ob = objects[poolid][oid];
     
     // apply to bh's!
     loff_t opos = start;
@@ -545,11 +551,11 @@ void ObjectCacher::bh_write(BufferHead *bh)
   ObjectSet *oset = bh->ob->oset;
 
   // go
-  tid_t tid = objecter->write_trunc(bh->ob->get_oid(), bh->ob->get_oloc(),
-			      bh->start(), bh->length(),
-			      bh->snapc, bh->bl, bh->last_write, 0,
-			      oset->truncate_size, oset->truncate_seq,
-				    NULL, oncommit);
+  tid_t tid = writeback_handler.write(bh->ob->get_oid(), bh->ob->get_oloc(),
+				      bh->start(), bh->length(),
+				      bh->snapc, bh->bl, bh->last_write,
+				      oset->truncate_size, oset->truncate_seq,
+				      oncommit);
 
   // set bh last_write_tid
   oncommit->tid = tid;
@@ -566,12 +572,11 @@ void ObjectCacher::lock_ack(int64_t poolid, list<sobject_t>& oids, tid_t tid)
        i++) {
     sobject_t oid = *i;
 
-    if (objects[poolid].count(oid) == 0) {
+    Object *ob = get_object_maybe(poolid, oid);
+    if (!ob) {
       ldout(cct, 7) << "lock_ack no object cache" << dendl;
       assert(0);
     } 
-    
-    Object *ob = objects[poolid][oid];
 
     list<Context*> ls;
 
@@ -630,10 +635,10 @@ void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
           << " tid " << tid
           << " " << start << "~" << length
           << dendl;
-  if (objects[poolid].count(oid) == 0) {
+  Object *ob = get_object_maybe(poolid, oid);
+  if (!ob) {
     ldout(cct, 7) << "bh_write_commit no object cache" << dendl;
   } else {
-    Object *ob = objects[poolid][oid];
     
     // apply to bh's!
     for (map<loff_t, BufferHead*>::iterator p = ob->data.lower_bound(start);
@@ -697,19 +702,19 @@ void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
 void ObjectCacher::flush(loff_t amount)
 {
   utime_t cutoff = ceph_clock_now(cct);
-  //cutoff.sec_ref() -= cct->_conf->client_oc_max_dirty_age;
 
   ldout(cct, 10) << "flush " << amount << dendl;
   
   /*
-   * NOTE: we aren't actually pulling things off the LRU here, just looking at the
-   * tail item.  Then we call bh_write, which moves it to the other LRU, so that we
-   * can call lru_dirty.lru_get_next_expire() again.
+   * NOTE: we aren't actually pulling things off dirty_bh here, just looking
+   * at the oldest item.  bh_write marks it tx, which takes it off the list.
+   * The list is in write order; a merged bh keeps the older bh's place, so
+   * at worst some of its data goes out a little early.
    */
   loff_t did = 0;
   while (amount == 0 || did < amount) {
-    BufferHead *bh = (BufferHead*) lru_dirty.lru_get_next_expire();
-    if (!bh) break;
+    if (dirty_bh.empty()) break;
+    BufferHead *bh = dirty_bh.front();
     if (bh->last_write > cutoff) break;
 
     did += bh->length();
@@ -721,7 +726,7 @@ void ObjectCacher::flush(loff_t amount)
 void ObjectCacher::trim(loff_t max)
 {
   if (max < 0) 
-    max = cct->_conf->client_oc_size;
+    max = max_size;
   
   ldout(cct, 10) << "trim  start: max " << max 
            << "  clean " << get_stat_clean()
@@ -885,7 +890,12 @@ int ObjectCacher::readx(OSDRead *rd, ObjectSet *oset, Context *onfinish)
        bhit++) 
     touch_bh(*bhit);
   
-  if (!success) return 0;  // wait!
+  if (!success) {
+    // nobody is going to retry a readahead; don't leak it.
+    if (!onfinish)
+      delete rd;
+    return 0;  // wait!
+  }
 
   // no misses... success!  do the read.
   assert(!hit_ls.empty());
@@ -981,13 +991,12 @@ int ObjectCacher::writex(OSDWrite *wr, ObjectSet *oset)
 bool ObjectCacher::wait_for_write(uint64_t len, Mutex& lock)
 {
   int blocked = 0;
-  const md_config_t *conf = cct->_conf;
 
   // wait for writeback?
-  while (get_stat_dirty() + get_stat_tx() >= conf->client_oc_max_dirty) {
+  while (get_stat_dirty() + get_stat_tx() >= max_dirty) {
     ldout(cct, 10) << "wait_for_write waiting on " << len << ", dirty|tx " 
 	     << (get_stat_dirty() + get_stat_tx()) 
-	     << " >= " << conf->client_oc_max_dirty 
+	     << " >= " << max_dirty 
 	     << dendl;
     flusher_cond.Signal();
     stat_waiter++;
@@ -998,9 +1007,9 @@ bool ObjectCacher::wait_for_write(uint64_t len, Mutex& lock)
   }
 
   // start writeback anyway?
-  if (get_stat_dirty() > conf->client_oc_target_dirty) {
+  if (get_stat_dirty() > target_dirty) {
     ldout(cct, 10) << "wait_for_write " << get_stat_dirty() << " > target "
-	     << conf->client_oc_target_dirty << ", nudging flusher" << dendl;
+	     << target_dirty << ", nudging flusher" << dendl;
     flusher_cond.Signal();
   }
   return blocked;
@@ -1008,36 +1017,35 @@ bool ObjectCacher::wait_for_write(uint64_t len, Mutex& lock)
 
 void ObjectCacher::flusher_entry()
 {
-  const md_config_t *conf = cct->_conf;
   ldout(cct, 10) << "flusher start" << dendl;
   lock.Lock();
   while (!flusher_stop) {
     while (!flusher_stop) {
       loff_t all = get_stat_tx() + get_stat_rx() + get_stat_clean() + get_stat_dirty();
       ldout(cct, 11) << "flusher "
-               << all << " / " << conf->client_oc_size << ":  "
+               << all << " / " << max_size << ":  "
                << get_stat_tx() << " tx, "
                << get_stat_rx() << " rx, "
                << get_stat_clean() << " clean, "
                << get_stat_dirty() << " dirty ("
-	       << conf->client_oc_target_dirty << " target, "
-	       << conf->client_oc_max_dirty << " max)"
+	       << target_dirty << " target, "
+	       << max_dirty << " max)"
                << dendl;
-      if (get_stat_dirty() > conf->client_oc_target_dirty) {
+      if (get_stat_dirty() > target_dirty) {
         // flush some dirty pages
         ldout(cct, 10) << "flusher " 
                  << get_stat_dirty() << " dirty > target "
-		 << conf->client_oc_target_dirty
+		 << target_dirty
                  << ", flushing some dirty bhs" << dendl;
-        flush(get_stat_dirty() - conf->client_oc_target_dirty);
+        flush(get_stat_dirty() - target_dirty);
       }
       else {
-        // check tail of lru for old dirty items
+        // check head of dirty list for old dirty items
         utime_t cutoff = ceph_clock_now(cct);
-        cutoff.sec_ref()--;
-        BufferHead *bh = 0;
-        while ((bh = (BufferHead*)lru_dirty.lru_get_next_expire()) != 0 &&
-               bh->last_write < cutoff) {
+        cutoff -= max_dirty_age;
+        while (!dirty_bh.empty() &&
+               dirty_bh.front()->last_write < cutoff) {
+          BufferHead *bh = dirty_bh.front();
           ldout(cct, 10) << "flusher flushing aged dirty bh " << *bh << dendl;
           bh_write(bh);
         }
@@ -1066,11 +1074,11 @@ int ObjectCacher::atomic_sync_readx(OSDRead *rd, ObjectSet *oset, Mutex& lock)
     Mutex flock("ObjectCacher::atomic_sync_readx flock 1");
     Cond cond;
     bool done = false;
-    objecter->read_trunc(rd->extents[0].oid, rd->extents[0].oloc, 
-		   rd->extents[0].offset, rd->extents[0].length,
-		   rd->snap, rd->bl, 0,
-		   oset->truncate_size, oset->truncate_seq,
-		   new C_SafeCond(&flock, &cond, &done));
+    writeback_handler.read(rd->extents[0].oid, rd->extents[0].oloc,
+			   rd->extents[0].offset, rd->extents[0].length,
+			   rd->snap, rd->bl,
+			   oset->truncate_size, oset->truncate_seq,
+			   new C_SafeCond(&flock, &cond, &done));
 
     // block
     while (!done) cond.Wait(flock);
@@ -1111,8 +1119,8 @@ int ObjectCacher::atomic_sync_readx(OSDRead *rd, ObjectSet *oset, Mutex& lock)
          ex_it != extents.end();
          ex_it++) {
       sobject_t soid(ex_it->oid, snapid);
-      assert(objects[oset->poolid].count(soid));
-      Object *o = objects[oset->poolid][soid];
+      Object *o = get_object_maybe(oset->poolid, soid);
+      assert(o);
       rdunlock(o);
     }
   }
@@ -1132,9 +1140,7 @@ int ObjectCacher::atomic_sync_writex(OSDWrite *wr, ObjectSet *oset, Mutex& lock)
     
     // make sure we aren't already locking/locked...
     sobject_t oid(wr->extents.front().oid, CEPH_NOSNAP);
-    Object *o = 0;
-    if (objects[oset->poolid].count(oid))
-      o = get_object(oid, oset, wr->extents.front().oloc);
+    Object *o = get_object_maybe(oset->poolid, oid);
     if (!o || 
         (o->lock_state != Object::LOCK_WRLOCK &&
          o->lock_state != Object::LOCK_WRLOCKING &&
@@ -1148,9 +1154,11 @@ int ObjectCacher::atomic_sync_writex(OSDWrite *wr, ObjectSet *oset, Mutex& lock)
       Mutex flock("ObjectCacher::atomic_sync_writex flock");
       Cond cond;
       bool done = false;
-      objecter->sg_write_trunc(wr->extents, wr->snapc, wr->bl, wr->mtime, 0,
-			 oset->truncate_size, oset->truncate_seq,
-			 new C_SafeCond(&flock, &cond, &done), 0);
+      ObjectExtent& ex = wr->extents.front();
+      writeback_handler.write(ex.oid, ex.oloc, ex.offset, ex.length,
+			      wr->snapc, wr->bl, wr->mtime,
+			      oset->truncate_size, oset->truncate_seq,
+			      new C_SafeCond(&flock, &cond, &done));
       
       // block
       while (!done) cond.Wait(flock);
@@ -1187,8 +1195,8 @@ int ObjectCacher::atomic_sync_writex(OSDWrite *wr, ObjectSet *oset, Mutex& lock)
        ex_it != extents.end();
        ex_it++) {
     sobject_t soid(ex_it->oid, CEPH_NOSNAP);
-    assert(objects[oset->poolid].count(soid));
-    Object *o = objects[oset->poolid][soid];
+    Object *o = get_object_maybe(oset->poolid, soid);
+    assert(o);
     
     wrunlock(o);
   }
@@ -1216,7 +1224,7 @@ void ObjectCacher::rdlock(Object *o)
     
     commit->tid = 
       ack->tid = 
-      o->last_write_tid = objecter->lock(o->get_oid(), o->get_oloc(), CEPH_OSD_OP_RDLOCK, 0, ack, commit);
+      o->last_write_tid = writeback_handler.lock(o->get_oid(), o->get_oloc(), CEPH_OSD_OP_RDLOCK, 0, ack, commit);
   }
   
   // stake our claim.
@@ -1261,7 +1269,7 @@ void ObjectCacher::wrlock(Object *o)
     
     commit->tid = 
       ack->tid = 
-      o->last_write_tid = objecter->lock(o->get_oid(), o->get_oloc(), op, 0, ack, commit);
+      o->last_write_tid = writeback_handler.lock(o->get_oid(), o->get_oloc(), op, 0, ack, commit);
   }
   
   // stake our claim.
@@ -1306,7 +1314,7 @@ void ObjectCacher::rdunlock(Object *o)
                                             o->get_soid(), 0, 0);
   commit->tid = 
     lockack->tid = 
-    o->last_write_tid = objecter->lock(o->get_oid(), o->get_oloc(), CEPH_OSD_OP_RDUNLOCK, 0, lockack, commit);
+    o->last_write_tid = writeback_handler.lock(o->get_oid(), o->get_oloc(), CEPH_OSD_OP_RDUNLOCK, 0, lockack, commit);
 }
 
 void ObjectCacher::wrunlock(Object *o)
@@ -1339,7 +1347,7 @@ void ObjectCacher::wrunlock(Object *o)
                                             o->get_soid(), 0, 0);
   commit->tid = 
     lockack->tid = 
-    o->last_write_tid = objecter->lock(o->get_oid(), o->get_oloc(), op, 0, lockack, commit);
+    o->last_write_tid = writeback_handler.lock(o->get_oid(), o->get_oloc(), op, 0, lockack, commit);
 }
 
 
@@ -1348,43 +1356,12 @@ void ObjectCacher::wrunlock(Object *o)
 
 bool ObjectCacher::set_is_cached(ObjectSet *oset)
 {
-  if (oset->objects.empty())
-    return false;
-  
-  for (xlist<Object*>::iterator p = oset->objects.begin();
-       !p.end(); ++p) {
-    Object *ob = *p;
-    for (map<loff_t,BufferHead*>::iterator q = ob->data.begin();
-         q != ob->data.end();
-         q++) {
-      BufferHead *bh = q->second;
-      if (!bh->is_dirty() && !bh->is_tx()) 
-        return true;
-    }
-  }
-
-  return false;
+  return oset->cached > 0;
 }
 
 bool ObjectCacher::set_is_dirty_or_committing(ObjectSet *oset)
 {
-  if (oset->objects.empty())
-    return false;
-  
-  for (xlist<Object*>::iterator i = oset->objects.begin();
-       !i.end(); ++i) {
-    Object *ob = *i;
-    
-    for (map<loff_t,BufferHead*>::iterator p = ob->data.begin();
-         p != ob->data.end();
-         p++) {
-      BufferHead *bh = p->second;
-      if (bh->is_dirty() || bh->is_tx()) 
-        return true;
-    }
-  }  
-  
-  return false;
+  return oset->dirty_or_tx > 0;
 }
 
 
@@ -1407,6 +1384,9 @@ void ObjectCacher::purge(Object *ob)
 // false if we wrote something.
 bool ObjectCacher::flush(Object *ob)
 {
+  if (ob->dirty_or_tx == 0)
+    return true;
+
   bool clean = true;
   for (map<loff_t,BufferHead*>::iterator p = ob->data.begin();
        p != ob->data.end();
@@ -1430,6 +1410,7 @@ bool ObjectCacher::flush_set(ObjectSet *oset, Context *onfinish)
 {
   if (oset->objects.empty()) {
     ldout(cct, 10) << "flush_set on " << oset << " dne" << dendl;
+    delete onfinish;
     return true;
   }
 
@@ -1649,9 +1630,9 @@ void ObjectCacher::truncate_set(ObjectSet *oset, vector<ObjectExtent>& exls)
        ++p) {
     ObjectExtent &ex = *p;
     sobject_t soid(ex.oid, CEPH_NOSNAP);
-    if (objects[oset->poolid].count(soid) == 0)
+    Object *ob = get_object_maybe(oset->poolid, soid);
+    if (!ob)
       continue;
-    Object *ob = objects[oset->poolid][soid];
     
     // purge or truncate?
     if (ex.offset == 0) {
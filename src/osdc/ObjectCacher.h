@@ -11,11 +11,11 @@
 #include "common/Cond.h"
 #include "common/Thread.h"
 
-#include "Objecter.h"
-#include "Filer.h"
+#include "osd/osd_types.h"
+
+#include "WritebackHandler.h"
 
 class CephContext;
-class Objecter;
 
 class ObjectCacher {
  public:
@@ -79,6 +79,7 @@ class ObjectCacher {
     tid_t last_write_tid;  // version of bh (if non-zero)
     utime_t last_write;
     SnapContext snapc;
+    xlist<BufferHead*>::item dirty_item;  // on ObjectCacher::dirty_bh
     
     map< loff_t, list<Context*> > waitfor_read;
     
@@ -88,7 +89,8 @@ class ObjectCacher {
       state(STATE_MISSING),
       ref(0),
       ob(o),
-      last_write_tid(0) {}
+      last_write_tid(0),
+      dirty_item(this) {}
   
     // extent
     loff_t start() const { return ex.start; }
@@ -258,29 +260,40 @@ class ObjectCacher {
     xlist<Object*> objects;
 
     int dirty_or_tx;
+    loff_t cached;  // bytes in clean, rx and missing bhs
 
     ObjectSet(void *p, int64_t _poolid, inodeno_t i)
       : parent(p), ino(i), truncate_seq(0),
-	truncate_size(0), poolid(_poolid), dirty_or_tx(0) {}
+	truncate_size(0), poolid(_poolid), dirty_or_tx(0), cached(0) {}
   };
 
 
   // ******* ObjectCacher *********
   // ObjectCacher fields
  public:
-  Objecter *objecter;
-  Filer filer;
+  WritebackHandler& writeback_handler;
 
  private:
   Mutex& lock;
+
+  // cache limits, in bytes; dirty data older than max_dirty_age is
+  // written back even when we are under target_dirty.
+  uint64_t max_size;
+  loff_t max_dirty, target_dirty;
+  utime_t max_dirty_age;
   
   flush_set_callback_t flush_set_callback;
   void *flush_set_callback_arg;
 
   vector<hash_map<sobject_t, Object*> > objects; // indexed by pool_id
 
-  set<BufferHead*>    dirty_bh;
-  LRU   lru_dirty, lru_rest;
+  /*
+   * Dirty bhs are kept in write order, oldest first, so writeback only
+   * ever looks at the bhs it is about to flush.  They are never
+   * expired, so only clean, rx and tx bhs sit on the lru.
+   */
+  xlist<BufferHead*>  dirty_bh;
+  LRU   lru_rest;
 
   Cond flusher_cond;
   bool flusher_stop;
@@ -297,25 +310,29 @@ class ObjectCacher {
   
 
   // objects
-  Object *get_object_maybe(sobject_t oid, object_locator_t &l) {
+  Object *get_object_maybe(int64_t poolid, const sobject_t& oid) {
     // have it?
-    if (((uint32_t)l.pool < objects.size()) &&
-        (objects[l.pool].count(oid)))
-      return objects[l.pool][oid];
-    return NULL;
+    if ((uint64_t)poolid >= objects.size())
+      return NULL;
+    hash_map<sobject_t, Object*>::iterator p = objects[poolid].find(oid);
+    if (p == objects[poolid].end())
+      return NULL;
+    return p->second;
+  }
+  Object *get_object_maybe(sobject_t oid, object_locator_t &l) {
+    return get_object_maybe(l.pool, oid);
   }
 
   Object *get_object(sobject_t oid, ObjectSet *oset, object_locator_t &l) {
     // have it?
-    if ((uint32_t)l.pool < objects.size()) {
-      if (objects[l.pool].count(oid))
-        return objects[l.pool][oid];
-    } else {
+    Object *o = get_object_maybe(l.pool, oid);
+    if (o)
+      return o;
+    if ((uint64_t)l.pool >= objects.size())
       objects.resize(l.pool+1);
-    }
 
     // create it.
-    Object *o = new Object(this, oid, oset, l);
+    o = new Object(this, oid, oset, l);
     objects[l.pool][oid] = o;
     return o;
   }
@@ -337,9 +354,11 @@ class ObjectCacher {
     switch (bh->get_state()) {
     case BufferHead::STATE_MISSING:
       stat_missing += bh->length();
+      bh->ob->oset->cached += bh->length();
       break;
     case BufferHead::STATE_CLEAN:
       stat_clean += bh->length();
+      bh->ob->oset->cached += bh->length();
       break;
     case BufferHead::STATE_DIRTY: 
       stat_dirty += bh->length(); 
@@ -353,6 +372,7 @@ class ObjectCacher {
       break;
     case BufferHead::STATE_RX:
       stat_rx += bh->length();
+      bh->ob->oset->cached += bh->length();
       break;
     }
     if (stat_waiter) stat_cond.Signal();
@@ -361,9 +381,11 @@ class ObjectCacher {
     switch (bh->get_state()) {
     case BufferHead::STATE_MISSING:
       stat_missing -= bh->length();
+      bh->ob->oset->cached -= bh->length();
       break;
     case BufferHead::STATE_CLEAN: 
       stat_clean -= bh->length();
+      bh->ob->oset->cached -= bh->length();
       break;
     case BufferHead::STATE_DIRTY: 
       stat_dirty -= bh->length(); 
@@ -377,6 +399,7 @@ class ObjectCacher {
       break;
     case BufferHead::STATE_RX:
       stat_rx -= bh->length();
+      bh->ob->oset->cached -= bh->length();
       break;
     }
   }
@@ -385,25 +408,22 @@ class ObjectCacher {
   loff_t get_stat_dirty() { return stat_dirty; }
   loff_t get_stat_clean() { return stat_clean; }
 
+  // reads don't reorder dirty bhs; only a new write does (mark_dirty)
   void touch_bh(BufferHead *bh) {
-    if (bh->is_dirty())
-      lru_dirty.lru_touch(bh);
-    else
+    if (!bh->is_dirty())
       lru_rest.lru_touch(bh);
   }
 
   // bh states
   void bh_set_state(BufferHead *bh, int s) {
-    // move between lru lists?
+    // move between lru and dirty list?
     if (s == BufferHead::STATE_DIRTY && bh->get_state() != BufferHead::STATE_DIRTY) {
       lru_rest.lru_remove(bh);
-      lru_dirty.lru_insert_top(bh);
-      dirty_bh.insert(bh);
+      dirty_bh.push_back(&bh->dirty_item);
     }
     if (s != BufferHead::STATE_DIRTY && bh->get_state() == BufferHead::STATE_DIRTY) {
-      lru_dirty.lru_remove(bh);
+      bh->dirty_item.remove_myself();
       lru_rest.lru_insert_top(bh);
-      dirty_bh.erase(bh);
     }
 
     // set state
@@ -422,28 +442,23 @@ class ObjectCacher {
   void mark_tx(BufferHead *bh) { bh_set_state(bh, BufferHead::STATE_TX); };
   void mark_dirty(BufferHead *bh) { 
     bh_set_state(bh, BufferHead::STATE_DIRTY); 
-    lru_dirty.lru_touch(bh);
-    //bh->set_dirty_stamp(ceph_clock_now(g_ceph_context));
+    dirty_bh.push_back(&bh->dirty_item);  // newest write goes last
   };
 
   void bh_add(Object *ob, BufferHead *bh) {
     ob->add_bh(bh);
-    if (bh->is_dirty()) {
-      lru_dirty.lru_insert_top(bh);
-      dirty_bh.insert(bh);
-    } else {
+    if (bh->is_dirty())
+      dirty_bh.push_back(&bh->dirty_item);
+    else
       lru_rest.lru_insert_top(bh);
-    }
     bh_stat_add(bh);
   }
   void bh_remove(Object *ob, BufferHead *bh) {
     ob->remove_bh(bh);
-    if (bh->is_dirty()) {
-      lru_dirty.lru_remove(bh);
-      dirty_bh.erase(bh);
-    } else {
+    if (bh->is_dirty())
+      bh->dirty_item.remove_myself();
+    else
       lru_rest.lru_remove(bh);
-    }
     bh_stat_sub(bh);
   }
 
@@ -515,9 +530,11 @@ class ObjectCacher {
 
 
  public:
-  ObjectCacher(CephContext *cct_, Objecter *o, Mutex& l,
+  ObjectCacher(CephContext *cct_, WritebackHandler& wb, Mutex& l,
 	       flush_set_callback_t flush_callback,
-	       void *flush_callback_arg);
+	       void *flush_callback_arg,
+	       uint64_t max_size, uint64_t max_dirty, uint64_t target_dirty,
+	       double max_dirty_age);
   ~ObjectCacher() {
     // we should be empty.
     for (vector<hash_map<sobject_t, Object *> >::iterator i = objects.begin();
@@ -525,7 +542,6 @@ class ObjectCacher {
         ++i)
       assert(!i->size());
     assert(lru_rest.lru_get_size() == 0);
-    assert(lru_dirty.lru_get_size() == 0);
     assert(dirty_bh.empty());
   }
 
@@ -591,59 +607,6 @@ class ObjectCacher {
   void kick_sync_writers(ObjectSet *oset);
   void kick_sync_readers(ObjectSet *oset);
 
-
-  // file functions
-
-  /*** async+caching (non-blocking) file interface ***/
-  int file_is_cached(ObjectSet *oset, ceph_file_layout *layout, snapid_t snapid,
-		     loff_t offset, uint64_t len) {
-    vector<ObjectExtent> extents;
-    filer.file_to_extents(oset->ino, layout, offset, len, extents);
-    return is_cached(oset, extents, snapid);
-  }
-
-  int file_read(ObjectSet *oset, ceph_file_layout *layout, snapid_t snapid,
-                loff_t offset, uint64_t len, 
-                bufferlist *bl,
-		int flags,
-                Context *onfinish) {
-    OSDRead *rd = prepare_read(snapid, bl, flags);
-    filer.file_to_extents(oset->ino, layout, offset, len, rd->extents);
-    return readx(rd, oset, onfinish);
-  }
-
-  int file_write(ObjectSet *oset, ceph_file_layout *layout, const SnapContext& snapc,
-                 loff_t offset, uint64_t len, 
-                 bufferlist& bl, utime_t mtime, int flags) {
-    OSDWrite *wr = prepare_write(snapc, bl, mtime, flags);
-    filer.file_to_extents(oset->ino, layout, offset, len, wr->extents);
-    return writex(wr, oset);
-  }
-
-
-
-  /*** sync+blocking file interface ***/
-
-  int file_atomic_sync_read(ObjectSet *oset, ceph_file_layout *layout, 
-			    snapid_t snapid,
-                            loff_t offset, uint64_t len, 
-                            bufferlist *bl, int flags,
-                            Mutex &lock) {
-    OSDRead *rd = prepare_read(snapid, bl, flags);
-    filer.file_to_extents(oset->ino, layout, offset, len, rd->extents);
-    return atomic_sync_readx(rd, oset, lock);
-  }
-
-  int file_atomic_sync_write(ObjectSet *oset, ceph_file_layout *layout, 
-			     const SnapContext& snapc,
-                             loff_t offset, uint64_t len, 
-                             bufferlist& bl, utime_t mtime, int flags,
-                             Mutex &lock) {
-    OSDWrite *wr = prepare_write(snapc, bl, mtime, flags);
-    filer.file_to_extents(oset->ino, layout, offset, len, wr->extents);
-    return atomic_sync_writex(wr, oset, lock);
-  }
-
 };
 
 
@@ -200,16 +200,20 @@ void Objecter::init()
   }
 
   schedule_tick();
+  rwlock.get_read();
   maybe_request_map();
+  rwlock.put_read();
 }
 
 void Objecter::shutdown() 
 {
+  rwlock.get_write();
   map<int,OSDSession*>::iterator p;
   while (!osd_sessions.empty()) {
     p = osd_sessions.begin();
     close_session(p->second);
   }
+  rwlock.put_write();
 
   if (tick_event) {
     timer.cancel_event(tick_event);
@@ -236,12 +240,16 @@ void Objecter::send_linger(LingerOp *info)
     o->snapid = info->snap;
 
     if (info->session) {
-      int r = recalc_op_target(o);
+      int osd;
+      int r = calc_op_target(o, &osd);
       if (r == RECALC_OP_TARGET_POOL_DNE) {
 	linger_check_for_latest_map(info);
       }
     }
-    op_submit(o, info->session);
+    // never block on the throttle with rwlock held
+    op_throttler.take(calc_op_budget(o));
+    o->tid = last_tid.inc();
+    _op_submit_wlocked(o, info->session);
     info->registering = true;
 
     logger->inc(l_osdc_linger_send);
@@ -253,29 +261,44 @@ void Objecter::send_linger(LingerOp *info)
 void Objecter::_linger_ack(LingerOp *info, int r) 
 {
   ldout(cct, 10) << "_linger_ack " << info->linger_id << dendl;
-  if (info->on_reg_ack) {
-    info->on_reg_ack->finish(r);
-    delete info->on_reg_ack;
-    info->on_reg_ack = NULL;
+  rwlock.get_write();
+  Context *fin = info->on_reg_ack;
+  info->on_reg_ack = NULL;
+  rwlock.put_write();
+
+  if (fin) {
+    fin->finish(r);
+    delete fin;
   }
 }
 
 void Objecter::_linger_commit(LingerOp *info, int r) 
 {
   ldout(cct, 10) << "_linger_commit " << info->linger_id << dendl;
-  if (info->on_reg_commit) {
-    info->on_reg_commit->finish(r);
-    delete info->on_reg_commit;
-    info->on_reg_commit = NULL;
-  }
+  rwlock.get_write();
+  Context *fin = info->on_reg_commit;
+  info->on_reg_commit = NULL;
 
   // only tell the user the first time we do this
   info->registered = true;
   info->registering = false;
   info->pobjver = NULL;
+  rwlock.put_write();
+
+  if (fin) {
+    fin->finish(r);
+    delete fin;
+  }
 }
 
 void Objecter::unregister_linger(uint64_t linger_id)
+{
+  rwlock.get_write();
+  _unregister_linger(linger_id);
+  rwlock.put_write();
+}
+
+void Objecter::_unregister_linger(uint64_t linger_id)
 {
   map<uint64_t, LingerOp*>::iterator iter = linger_ops.find(linger_id);
   if (iter != linger_ops.end()) {
@@ -307,14 +330,16 @@ tid_t Objecter::linger(const object_t& oid, const object_locator_t& oloc,
   info->on_reg_ack = onack;
   info->on_reg_commit = onfinish;
 
-  info->linger_id = ++max_linger_id;
+  rwlock.get_write();
+  tid_t linger_id = info->linger_id = ++max_linger_id;
   linger_ops[info->linger_id] = info;
 
   logger->set(l_osdc_linger_active, linger_ops.size());
 
   send_linger(info);
+  rwlock.put_write();
 
-  return info->linger_id;
+  return linger_id;
 }
 
 void Objecter::dispatch(Message *m)
@@ -357,6 +382,8 @@ void Objecter::handle_osd_map(MOSDMap *m)
     return;
   }
 
+  rwlock.get_write();
+
   bool was_pauserd = osdmap->test_flag(CEPH_OSDMAP_PAUSERD);
   bool was_pausewr = osdmap->test_flag(CEPH_OSDMAP_PAUSEWR) || osdmap->test_flag(CEPH_OSDMAP_FULL);
   
@@ -407,6 +434,20 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  continue;
 	}
 	logger->set(l_osdc_map_epoch, osdmap->get_epoch());
+
+	// osd addr changes?  closed sessions hand their ops back as
+	// homeless, so do this before retargeting anything.
+	for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
+	     p != osd_sessions.end(); ) {
+	  OSDSession *s = p->second;
+	  p++;
+	  if (osdmap->is_up(s->osd)) {
+	    if (s->con && s->con->get_peer_addr() != osdmap->get_inst(s->osd).addr)
+	      close_session(s);
+	  } else {
+	    close_session(s);
+	  }
+	}
 	
 	// check for changed linger mappings (_before_ regular ops)
 	for (map<tid_t,LingerOp*>::iterator p = linger_ops.begin();
@@ -431,10 +472,12 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	}
 
 	// check for changed request mappings
-	for (hash_map<tid_t,Op*>::iterator p = ops.begin();
-	     p != ops.end();
+	vector<Op*> all_ops;
+	_collect_ops(all_ops);
+	for (vector<Op*>::iterator p = all_ops.begin();
+	     p != all_ops.end();
 	     ++p) {
-	  Op *op = p->second;
+	  Op *op = *p;
 	  int r = recalc_op_target(op);
 	  if (skipped_map)
 	    r = RECALC_OP_TARGET_NEED_RESEND;
@@ -452,19 +495,6 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  }
 	}
 
-	// osd addr changes?
-	for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
-	     p != osd_sessions.end(); ) {
-	  OSDSession *s = p->second;
-	  p++;
-	  if (osdmap->is_up(s->osd)) {
-	    if (s->con && s->con->get_peer_addr() != osdmap->get_inst(s->osd).addr)
-	      close_session(s);
-	  } else {
-	    close_session(s);
-	  }
-	}
-
 	assert(e == osdmap->get_epoch());
       }
       
@@ -490,16 +520,19 @@ void Objecter::handle_osd_map(MOSDMap *m)
   
   // unpause requests?
   if ((was_pauserd && !pauserd) ||
-      (was_pausewr && !pausewr))
-    for (hash_map<tid_t,Op*>::iterator p = ops.begin();
-	 p != ops.end();
+      (was_pausewr && !pausewr)) {
+    vector<Op*> all_ops;
+    _collect_ops(all_ops);
+    for (vector<Op*>::iterator p = all_ops.begin();
+	 p != all_ops.end();
 	 p++) {
-      Op *op = p->second;
+      Op *op = *p;
       if (op->paused &&
 	  !((op->flags & CEPH_OSD_FLAG_READ) && pauserd) &&   // not still paused as a read
 	  !((op->flags & CEPH_OSD_FLAG_WRITE) && pausewr))    // not still paused as a write
 	need_resend[op->tid] = op;
     }
+  }
 
   // resend requests
   for (map<tid_t, Op*>::iterator p = need_resend.begin(); p != need_resend.end(); p++) {
@@ -517,13 +550,15 @@ void Objecter::handle_osd_map(MOSDMap *m)
     }
   }
 
-  dump_active();
+  _dump_active();
+  epoch_t epoch = osdmap->get_epoch();
+  rwlock.put_write();
   
   // finish any Contexts that were waiting on a map update
   map<epoch_t,list< pair< Context*, int > > >::iterator p =
     waiting_for_map.begin();
   while (p != waiting_for_map.end() &&
-	 p->first <= osdmap->get_epoch()) {
+	 p->first <= epoch) {
     //go through the list and call the onfinish methods
     for (list<pair<Context*, int> >::iterator i = p->second.begin();
 	 i != p->second.end(); ++i) {
@@ -535,7 +570,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 
   m->put();
 
-  monc->sub_got("osdmap", osdmap->get_epoch());
+  monc->sub_got("osdmap", epoch);
 }
 
 void Objecter::C_Op_Map_Latest::finish(int r)
@@ -544,26 +579,38 @@ void Objecter::C_Op_Map_Latest::finish(int r)
     return;
 
   Mutex::Locker l(objecter->client_lock);
+  objecter->rwlock.get_write();
 
   map<tid_t, Op*>::iterator iter =
     objecter->check_latest_map_ops.find(tid);
   if (iter == objecter->check_latest_map_ops.end()) {
+    objecter->rwlock.put_write();
     return;
   }
 
   Op *op = iter->second;
   objecter->check_latest_map_ops.erase(iter);
 
-  if (r == 0) { // we had the latest map
-    if (op->onack) {
-      op->onack->complete(-ENOENT);
-    }
-    if (op->oncommit) {
-      op->oncommit->complete(-ENOENT);
-    }
-    op->session_item.remove_myself();
-    objecter->ops.erase(op->tid);
-    delete op;
+  if (r != 0) {
+    objecter->rwlock.put_write();
+    return;
+  }
+
+  // we had the latest map
+  Context *onack = op->onack;
+  Context *oncommit = op->oncommit;
+  if (onack)
+    objecter->num_unacked.dec();
+  if (oncommit)
+    objecter->num_uncommitted.dec();
+  objecter->_finish_op(op);
+  objecter->rwlock.put_write();
+
+  if (onack) {
+    onack->complete(-ENOENT);
+  }
+  if (oncommit) {
+    oncommit->complete(-ENOENT);
   }
 }
 
@@ -573,24 +620,36 @@ void Objecter::C_Linger_Map_Latest::finish(int r)
     return;
 
   Mutex::Locker l(objecter->client_lock);
+  objecter->rwlock.get_write();
 
   map<uint64_t, LingerOp*>::iterator iter =
     objecter->check_latest_map_lingers.find(linger_id);
   if (iter == objecter->check_latest_map_lingers.end()) {
+    objecter->rwlock.put_write();
     return;
   }
 
   LingerOp *op = iter->second;
   objecter->check_latest_map_lingers.erase(iter);
 
-  if (r == 0) { // we had the latest map
-    if (op->on_reg_ack) {
-      op->on_reg_ack->complete(-ENOENT);
-    }
-    if (op->on_reg_commit) {
-      op->on_reg_commit->complete(-ENOENT);
-    }
-    objecter->unregister_linger(op->linger_id);
+  if (r != 0) {
+    objecter->rwlock.put_write();
+    return;
+  }
+
+  // we had the latest map
+  Context *on_reg_ack = op->on_reg_ack;
+  Context *on_reg_commit = op->on_reg_commit;
+  op->on_reg_ack = NULL;
+  op->on_reg_commit = NULL;
+  objecter->_unregister_linger(op->linger_id);
+  objecter->rwlock.put_write();
+
+  if (on_reg_ack) {
+    on_reg_ack->complete(-ENOENT);
+  }
+  if (on_reg_commit) {
+    on_reg_commit->complete(-ENOENT);
   }
 }
 
@@ -661,8 +720,21 @@ void Objecter::close_session(OSDSession *s)
     s->con->put();
     logger->inc(l_osdc_osd_session_close);
   }
+  // hand the ops back; clearing acting makes the next
+  // recalc_op_target() pick them up again
+  for (map<tid_t,Op*>::iterator p = s->ops.begin(); p != s->ops.end(); ++p) {
+    Op *op = p->second;
+    op->session = NULL;
+    op->acting.clear();
+    homeless_ops[op->tid] = op;
+  }
   s->ops.clear();
-  s->linger_ops.clear();
+  while (!s->linger_ops.empty()) {
+    LingerOp *op = s->linger_ops.front();
+    op->session = NULL;
+    op->acting.clear();
+    op->session_item.remove_myself();
+  }
   osd_sessions.erase(s->osd);
   delete s;
 
@@ -706,9 +778,9 @@ void Objecter::kick_requests(OSDSession *session)
   ldout(cct, 10) << "kick_requests for osd." << session->osd << dendl;
 
   // resend ops
-  for (xlist<Op*>::iterator p = session->ops.begin(); !p.end(); ++p) {
+  for (map<tid_t,Op*>::iterator p = session->ops.begin(); p != session->ops.end(); ++p) {
     logger->inc(l_osdc_op_resend);
-    send_op(*p);
+    send_op(p->second);
   }
 
   // resend lingers
@@ -741,20 +813,28 @@ void Objecter::tick()
   cutoff -= cct->_conf->objecter_timeout;  // timeout
 
   unsigned laggy_ops = 0;
-  for (hash_map<tid_t,Op*>::iterator p = ops.begin();
-       p != ops.end();
-       p++) {
-    Op *op = p->second;
-    if (op->session && op->stamp < cutoff) {
-      ldout(cct, 2) << " tid " << p->first << " on osd." << op->session->osd << " is laggy" << dendl;
-      toping.insert(op->session);
-      ++laggy_ops;
+  rwlock.get_read();
+  for (map<int,OSDSession*>::iterator i = osd_sessions.begin();
+       i != osd_sessions.end();
+       ++i) {
+    OSDSession *s = i->second;
+    s->lock.Lock();
+    for (map<tid_t,Op*>::iterator p = s->ops.begin();
+	 p != s->ops.end();
+	 p++) {
+      Op *op = p->second;
+      if (op->stamp < cutoff) {
+	ldout(cct, 2) << " tid " << p->first << " on osd." << s->osd << " is laggy" << dendl;
+	toping.insert(s);
+	++laggy_ops;
+      }
     }
+    s->lock.Unlock();
   }
   logger->set(l_osdc_op_laggy, laggy_ops);
   logger->set(l_osdc_osd_laggy, toping.size());
 
-  if (num_homeless_ops || !toping.empty())
+  if (!homeless_ops.empty() || !toping.empty())
     maybe_request_map();
 
   if (!toping.empty()) {
@@ -765,6 +845,7 @@ void Objecter::tick()
 	 i++)
       messenger->send_message(new MPing, (*i)->con);
   }
+  rwlock.put_read();
     
   // reschedule
   schedule_tick();
@@ -804,42 +885,161 @@ void Objecter::resend_mon_ops()
 
 tid_t Objecter::op_submit(Op *op, OSDSession *s)
 {
-  assert(client_lock.is_locked());
-
-  // throttle.  before we look at any state, because
-  // take_op_budget() may drop our lock while it blocks.
+  // throttle.  before we take any locks, because
+  // take_op_budget() may block.
   take_op_budget(op);
 
-  // pick tid
-  tid_t mytid = ++last_tid;
-  op->tid = mytid;
-  assert(client_inc >= 0);
+  if (!s)
+    return _op_submit(op);
+
+  tid_t tid = op->tid = last_tid.inc();
+  rwlock.get_write();
+  _op_submit_wlocked(op, s);
+  rwlock.put_write();
+  return tid;
+}
+
+/*
+ * Submit an op whose budget has already been taken.  The common case,
+ * an op for an osd we already have a session with, only needs rwlock
+ * for read; anything that has to open a session or queue a map check
+ * is retried with it held for write.
+ */
+tid_t Objecter::_op_submit(Op *op)
+{
+  // pick tid.  once the op is sent a reply may free it under us.
+  tid_t tid = op->tid = last_tid.inc();
+
+  rwlock.get_read();
+  bool sent = _op_submit_rlocked(op);
+  rwlock.put_read();
+
+  if (!sent) {
+    rwlock.get_write();
+    _op_submit_wlocked(op, NULL);
+    rwlock.put_write();
+  }
+  return tid;
+}
+
+bool Objecter::_op_submit_rlocked(Op *op)
+{
+  int osd;
+  int r = calc_op_target(op, &osd);
+  if (r == RECALC_OP_TARGET_POOL_DNE || osd < 0)
+    return false;
+  map<int,OSDSession*>::iterator p = osd_sessions.find(osd);
+  if (p == osd_sessions.end())
+    return false;
+
+  OSDSession *s = p->second;
+  s->lock.Lock();
+  _op_register(op, s);
+  _op_send(op, false);
+  s->lock.Unlock();
+  return true;
+}
 
-  // pick target
+void Objecter::_op_submit_wlocked(Op *op, OSDSession *s)
+{
   bool check_for_latest_map = false;
-  if (s) {
-    op->session = s;
-    s->ops.push_back(&op->session_item);
-  } else {
-    int r = recalc_op_target(op);
+  if (!s) {
+    int osd;
+    int r = calc_op_target(op, &osd);
     check_for_latest_map = (r == RECALC_OP_TARGET_POOL_DNE);
-    num_homeless_ops++;  // initially!
+    if (osd >= 0)
+      s = get_session(osd);
+  }
+  _op_register(op, s);
+  _op_send(op, check_for_latest_map);
+}
+
+/*
+ * Submit a batch of ops under a single read hold of rwlock.  Targets
+ * for the whole batch are computed first, and the messages are then
+ * sent grouped by OSD, taking each session lock once, so that each
+ * session sees its share of the batch back to back.  Ops within a
+ * group keep their relative order.
+ */
+void Objecter::op_submit_batch(vector<Op*>& batch)
+{
+  if (keep_balanced_budget) {
+    // throttle_op() may block until earlier ops complete; don't hold
+    // any of ours back while it does.
+    for (vector<Op*>::iterator p = batch.begin(); p != batch.end(); ++p)
+      op_submit(*p);
+    return;
+  }
+
+  for (vector<Op*>::iterator p = batch.begin(); p != batch.end(); ++p) {
+    take_op_budget(*p);
+    (*p)->tid = last_tid.inc();
+  }
+
+  map<int, vector<Op*> > by_osd;
+  vector<Op*> slow;
+
+  rwlock.get_read();
+  for (vector<Op*>::iterator p = batch.begin(); p != batch.end(); ++p) {
+    Op *op = *p;
+    int osd;
+    int r = calc_op_target(op, &osd);
+    if (r == RECALC_OP_TARGET_POOL_DNE || osd < 0 || !osd_sessions.count(osd))
+      slow.push_back(op);
+    else
+      by_osd[osd].push_back(op);
+  }
+
+  ldout(cct, 10) << "op_submit_batch " << batch.size() << " ops to "
+		 << by_osd.size() << " osds, " << slow.size() << " deferred" << dendl;
+
+  for (map<int, vector<Op*> >::iterator p = by_osd.begin();
+       p != by_osd.end();
+       ++p) {
+    OSDSession *s = osd_sessions.find(p->first)->second;
+    s->lock.Lock();
+    for (vector<Op*>::iterator q = p->second.begin();
+	 q != p->second.end();
+	 ++q) {
+      _op_register(*q, s);
+      _op_send(*q, false);
+    }
+    s->lock.Unlock();
   }
+  rwlock.put_read();
+
+  if (!slow.empty()) {
+    rwlock.get_write();
+    for (vector<Op*>::iterator p = slow.begin(); p != slow.end(); ++p)
+      _op_submit_wlocked(*p, NULL);
+    rwlock.put_write();
+  }
+}
+
+void Objecter::_op_register(Op *op, OSDSession *s)
+{
+  assert(client_inc >= 0);
+
+  op->session = s;
+  if (s)
+    s->ops[op->tid] = op;
+  else
+    homeless_ops[op->tid] = op;
 
   // add to gather set(s)
   if (op->onack) {
-    ++num_unacked;
+    num_unacked.inc();
   } else {
     ldout(cct, 20) << " note: not requesting ack" << dendl;
   }
   if (op->oncommit) {
-    ++num_uncommitted;
+    num_uncommitted.inc();
   } else {
     ldout(cct, 20) << " note: not requesting commit" << dendl;
   }
-  ops[op->tid] = op;
+  num_in_flight.inc();
 
-  logger->set(l_osdc_op_active, ops.size());
+  logger->set(l_osdc_op_active, num_in_flight.read());
 
   logger->inc(l_osdc_op);
   if ((op->flags & (CEPH_OSD_FLAG_READ|CEPH_OSD_FLAG_WRITE)) == (CEPH_OSD_FLAG_READ|CEPH_OSD_FLAG_WRITE))
@@ -883,7 +1083,10 @@ tid_t Objecter::op_submit(Op *op, OSDSession *s)
     if (code)
       logger->inc(code);
   }
+}
 
+void Objecter::_op_send(Op *op, bool check_for_latest_map)
+{
   // send?
   ldout(cct, 10) << "op_submit oid " << op->oid
            << " " << op->oloc 
@@ -895,17 +1098,17 @@ tid_t Objecter::op_submit(Op *op, OSDSession *s)
 
   if ((op->flags & CEPH_OSD_FLAG_WRITE) &&
       osdmap->test_flag(CEPH_OSDMAP_PAUSEWR)) {
-    ldout(cct, 10) << " paused modify " << op << " tid " << last_tid << dendl;
+    ldout(cct, 10) << " paused modify " << op << " tid " << op->tid << dendl;
     op->paused = true;
     maybe_request_map();
   } else if ((op->flags & CEPH_OSD_FLAG_READ) &&
 	     osdmap->test_flag(CEPH_OSDMAP_PAUSERD)) {
-    ldout(cct, 10) << " paused read " << op << " tid " << last_tid << dendl;
+    ldout(cct, 10) << " paused read " << op << " tid " << op->tid << dendl;
     op->paused = true;
     maybe_request_map();
   } else if ((op->flags & CEPH_OSD_FLAG_WRITE) &&
 	     osdmap->test_flag(CEPH_OSDMAP_FULL)) {
-    ldout(cct, 0) << " FULL, paused modify " << op << " tid " << last_tid << dendl;
+    ldout(cct, 0) << " FULL, paused modify " << op << " tid " << op->tid << dendl;
     op->paused = true;
     maybe_request_map();
   } else if (op->session) {
@@ -918,9 +1121,7 @@ tid_t Objecter::op_submit(Op *op, OSDSession *s)
     op_check_for_latest_map(op);
   }
 
-  ldout(cct, 5) << num_unacked << " unacked, " << num_uncommitted << " uncommitted" << dendl;
-  
-  return op->tid;
+  ldout(cct, 5) << num_unacked.read() << " unacked, " << num_uncommitted.read() << " uncommitted" << dendl;
 }
 
 bool Objecter::is_pg_changed(vector<int>& o, vector<int>& n, bool any_change)
@@ -936,8 +1137,15 @@ bool Objecter::is_pg_changed(vector<int>& o, vector<int>& n, bool any_change)
   return false;      // same primary (tho replicas may have changed)
 }
 
-int Objecter::recalc_op_target(Op *op)
+/*
+ * Work out where op should go under the current map without touching
+ * any session state; safe with rwlock held for read as long as nobody
+ * else can see op yet.  *posd is the target osd, or -1.
+ */
+int Objecter::calc_op_target(Op *op, int *posd)
 {
+  *posd = -1;
+
   vector<int> acting;
   pg_t pgid = op->pgid;
   if (op->oid.name.length()) {
@@ -947,56 +1155,108 @@ int Objecter::recalc_op_target(Op *op)
   }
   osdmap->pg_to_acting_osds(pgid, acting);
 
+  int r = RECALC_OP_TARGET_NO_ACTION;
   if (op->pgid != pgid || is_pg_changed(op->acting, acting, op->used_replica)) {
     op->pgid = pgid;
     op->acting = acting;
-    ldout(cct, 10) << "recalc_op_target tid " << op->tid
+    ldout(cct, 10) << "calc_op_target tid " << op->tid
 	     << " pgid " << pgid << " acting " << acting << dendl;
-
-    OSDSession *s = NULL;
-    op->used_replica = false;
-    if (acting.size()) {
-      int osd;
-      bool read = (op->flags & CEPH_OSD_FLAG_READ) && (op->flags & CEPH_OSD_FLAG_WRITE) == 0;
-      if (read && (op->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
-	int p = rand() % acting.size();
-	if (p)
+    r = RECALC_OP_TARGET_NEED_RESEND;
+  } else if (op->session) {
+    *posd = op->session->osd;
+    return r;
+  }
+
+  op->used_replica = false;
+  if (op->acting.size()) {
+    int osd;
+    bool read = (op->flags & CEPH_OSD_FLAG_READ) && (op->flags & CEPH_OSD_FLAG_WRITE) == 0;
+    if (read && (op->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
+      int p = rand() % op->acting.size();
+      if (p)
+	op->used_replica = true;
+      osd = op->acting[p];
+      ldout(cct, 10) << " chose random osd." << osd << " of " << op->acting << dendl;
+    } else if (read && (op->flags & CEPH_OSD_FLAG_LOCALIZE_READS)) {
+      // look for a local replica
+      int i;
+      /* loop through the OSD replicas and see if any are local to read from.
+       * We don't need to check the primary since we default to it. (Be
+       * careful to preserve that default, which is why we iterate in reverse
+       * order.) */
+      for (i = op->acting.size()-1; i > 0; --i) {
+	if (osdmap->get_addr(op->acting[i]).is_same_host(messenger->get_myaddr())) {
 	  op->used_replica = true;
-	osd = acting[p];
-	ldout(cct, 10) << " chose random osd." << osd << " of " << acting << dendl;
-      } else if (read && (op->flags & CEPH_OSD_FLAG_LOCALIZE_READS)) {
-	// look for a local replica
-	int i;
-	/* loop through the OSD replicas and see if any are local to read from.
-	 * We don't need to check the primary since we default to it. (Be
-         * careful to preserve that default, which is why we iterate in reverse
-         * order.) */
-	for (i = acting.size()-1; i > 0; --i) {
-	  if (osdmap->get_addr(acting[i]).is_same_host(messenger->get_myaddr())) {
-	    op->used_replica = true;
-	    ldout(cct, 10) << " chose local osd." << acting[i] << " of " << acting << dendl;
-	    break;
-	  }
+	  ldout(cct, 10) << " chose local osd." << op->acting[i] << " of " << op->acting << dendl;
+	  break;
 	}
-	osd = acting[i];
-      } else
-	osd = acting[0];
-      s = get_session(osd);
-    }
-
-    if (op->session != s) {
-      if (!op->session)
-	num_homeless_ops--;
-      op->session_item.remove_myself();
-      op->session = s;
-      if (s)
-	s->ops.push_back(&op->session_item);
-      else
-	num_homeless_ops++;
-    }
-    return RECALC_OP_TARGET_NEED_RESEND;
+      }
+      osd = op->acting[i];
+    } else
+      osd = op->acting[0];
+    *posd = osd;
   }
-  return RECALC_OP_TARGET_NO_ACTION;
+  return r;
+}
+
+int Objecter::recalc_op_target(Op *op)
+{
+  int osd;
+  int r = calc_op_target(op, &osd);
+  if (r == RECALC_OP_TARGET_NEED_RESEND) {
+    OSDSession *s = osd >= 0 ? get_session(osd) : NULL;
+    if (op->session != s)
+      _session_op_assign(s, op);
+  }
+  return r;
+}
+
+void Objecter::_session_op_assign(OSDSession *s, Op *op)
+{
+  _session_op_remove(op);
+  op->session = s;
+  if (s)
+    s->ops[op->tid] = op;
+  else
+    homeless_ops[op->tid] = op;
+}
+
+void Objecter::_session_op_remove(Op *op)
+{
+  if (op->session)
+    op->session->ops.erase(op->tid);
+  else
+    homeless_ops.erase(op->tid);
+  op->session = NULL;
+}
+
+/*
+ * Drop a finished op.  Needs op's session lock, or rwlock for write.
+ */
+void Objecter::_finish_op(Op *op)
+{
+  _session_op_remove(op);
+  put_op_budget(op);
+  num_in_flight.dec();
+  logger->set(l_osdc_op_active, num_in_flight.read());
+  if (op->con)
+    op->con->put();
+  delete op;
+}
+
+void Objecter::_collect_ops(vector<Op*>& ls)
+{
+  for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
+       p != osd_sessions.end();
+       ++p)
+    for (map<tid_t,Op*>::iterator q = p->second->ops.begin();
+	 q != p->second->ops.end();
+	 ++q)
+      ls.push_back(q->second);
+  for (map<tid_t,Op*>::iterator p = homeless_ops.begin();
+       p != homeless_ops.end();
+       ++p)
+    ls.push_back(p->second);
 }
 
 bool Objecter::recalc_linger_op_target(LingerOp *linger_op)
@@ -1103,26 +1363,34 @@ void Objecter::throttle_op(Op *op, int op_budget)
 {
   if (!op_budget)
     op_budget = calc_op_budget(op);
-  if (!op_throttler.get_or_fail(op_budget)) { //couldn't take right now
-    client_lock.Unlock();
-    op_throttler.get(op_budget);
-    client_lock.Lock();
-  }
+  // replies give budget back without client_lock, so there is no
+  // need to drop it here; callers just must not hold rwlock.
+  op_throttler.get(op_budget);
 }
 
 /* This function DOES put the passed message before returning */
 void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 {
-  assert(client_lock.is_locked());
   ldout(cct, 10) << "in handle_osd_op_reply" << dendl;
 
   // get pio
   tid_t tid = m->get_tid();
 
-  if (ops.count(tid) == 0) {
+  rwlock.get_read();
+  map<int,OSDSession*>::iterator sp = osd_sessions.find(m->get_source().num());
+  OSDSession *s = sp != osd_sessions.end() ? sp->second : NULL;
+  map<tid_t,Op*>::iterator p;
+  if (s) {
+    s->lock.Lock();
+    p = s->ops.find(tid);
+  }
+  if (!s || p == s->ops.end()) {
     ldout(cct, 7) << "handle_osd_op_reply " << tid
 	    << (m->is_ondisk() ? " ondisk":(m->is_onnvram() ? " onnvram":" ack"))
 	    << " ... stray" << dendl;
+    if (s)
+      s->lock.Unlock();
+    rwlock.put_read();
     m->put();
     return;
   }
@@ -1132,7 +1400,7 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 		<< " v " << m->get_version() << " in " << m->get_pg()
 		<< " attempt " << m->get_retry_attempt()
 		<< dendl;
-  Op *op = ops[tid];
+  Op *op = p->second;
 
   if (m->get_retry_attempt() >= 0) {
     if (m->get_retry_attempt() != (op->attempts - 1)) {
@@ -1140,6 +1408,8 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 		    << " from " << m->get_source_inst()
 		    << "; last attempt " << (op->attempts - 1) << " sent to "
 		    << op->session->con->get_peer_addr() << dendl;
+      s->lock.Unlock();
+      rwlock.put_read();
       m->put();
       return;
     }
@@ -1156,11 +1426,15 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 
   if (rc == -EAGAIN) {
     ldout(cct, 7) << " got -EAGAIN, resubmitting" << dendl;
+    _session_op_remove(op);
     if (op->onack)
-      num_unacked--;
+      num_unacked.dec();
     if (op->oncommit)
-      num_uncommitted--;
-    op_submit(op);
+      num_uncommitted.dec();
+    num_in_flight.dec();
+    s->lock.Unlock();
+    rwlock.put_read();
+    _op_submit(op);  // keeps the budget it already holds
     m->put();
     return;
   }
@@ -1184,30 +1458,27 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     op->version = m->get_version();
     onack = op->onack;
     op->onack = 0;  // only do callback once
-    num_unacked--;
+    num_unacked.dec();
     logger->inc(l_osdc_op_ack);
   }
   if (op->oncommit && (m->is_ondisk() || rc)) {
     ldout(cct, 15) << "handle_osd_op_reply safe" << dendl;
     oncommit = op->oncommit;
     op->oncommit = 0;
-    num_uncommitted--;
+    num_uncommitted.dec();
     logger->inc(l_osdc_op_commit);
   }
 
   // done with this tid?
   if (!op->onack && !op->oncommit) {
-    op->session_item.remove_myself();
     ldout(cct, 15) << "handle_osd_op_reply completed tid " << tid << dendl;
-    put_op_budget(op);
-    ops.erase(tid);
-    logger->set(l_osdc_op_active, ops.size());
-    if (op->con)
-      op->con->put();
-    delete op;
+    _finish_op(op);
   }
   
-  ldout(cct, 5) << num_unacked << " unacked, " << num_uncommitted << " uncommitted" << dendl;
+  ldout(cct, 5) << num_unacked.read() << " unacked, " << num_uncommitted.read() << " uncommitted" << dendl;
+
+  s->lock.Unlock();
+  rwlock.put_read();
 
   // do callbacks
   if (onack) {
@@ -1240,8 +1511,10 @@ void Objecter::list_objects(ListContext *list_context, Context *onfinish) {
     return;
   }
 
+  rwlock.get_read();
   const pg_pool_t *pool = osdmap->get_pg_pool(list_context->pool_id);
   int pg_num = pool->get_pg_num();
+  rwlock.put_read();
 
   if (list_context->starting_pg_num == 0) {     // there can't be zero pgs!
     list_context->starting_pg_num = pg_num;
@@ -1346,7 +1619,7 @@ int Objecter::create_pool_snap(int64_t pool, string& snapName, Context *onfinish
   PoolOp *op = new PoolOp;
   if (!op)
     return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = snapName;
   op->onfinish = onfinish;
@@ -1379,7 +1652,7 @@ int Objecter::allocate_selfmanaged_snap(int64_t pool, snapid_t *psnapid,
   ldout(cct, 10) << "allocate_selfmanaged_snap; pool: " << pool << dendl;
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   C_SelfmanagedSnap *fin = new C_SelfmanagedSnap(psnapid, onfinish);
   op->onfinish = fin;
@@ -1397,7 +1670,7 @@ int Objecter::delete_pool_snap(int64_t pool, string& snapName, Context *onfinish
   PoolOp *op = new PoolOp;
   if (!op)
     return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = snapName;
   op->onfinish = onfinish;
@@ -1415,7 +1688,7 @@ int Objecter::delete_selfmanaged_snap(int64_t pool, snapid_t snap,
 	   << snap << dendl;
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->onfinish = onfinish;
   op->pool_op = POOL_OP_DELETE_UNMANAGED_SNAP;
@@ -1434,7 +1707,7 @@ int Objecter::create_pool(string& name, Context *onfinish, uint64_t auid,
   PoolOp *op = new PoolOp;
   if (!op)
     return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = 0;
   op->name = name;
   op->onfinish = onfinish;
@@ -1454,7 +1727,7 @@ int Objecter::delete_pool(int64_t pool, Context *onfinish)
 
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = "delete";
   op->onfinish = onfinish;
@@ -1477,7 +1750,7 @@ int Objecter::change_pool_auid(int64_t pool, Context *onfinish, uint64_t auid)
   ldout(cct, 10) << "change_pool_auid " << pool << " to " << auid << dendl;
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = "change_pool_auid";
   op->onfinish = onfinish;
@@ -1554,7 +1827,7 @@ void Objecter::get_pool_stats(list<string>& pools, map<string,pool_stat_t> *resu
   ldout(cct, 10) << "get_pool_stats " << pools << dendl;
 
   PoolStatOp *op = new PoolStatOp;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pools = pools;
   op->pool_stats = result;
   op->onfinish = onfinish;
@@ -1606,7 +1879,7 @@ void Objecter::get_fs_stats(ceph_statfs& result, Context *onfinish)
   ldout(cct, 10) << "get_fs_stats" << dendl;
 
   StatfsOp *op = new StatfsOp;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->stats = &result;
   op->onfinish = onfinish;
   statfs_ops[op->tid] = op;
@@ -1779,6 +2052,7 @@ void Objecter::ms_handle_reset(Connection *con)
     int osd = osdmap->identify_osd(con->get_peer_addr());
     if (osd >= 0) {
       ldout(cct, 1) << "ms_handle_reset on osd." << osd << dendl;
+      rwlock.get_write();
       map<int,OSDSession*>::iterator p = osd_sessions.find(osd);
       if (p != osd_sessions.end()) {
 	OSDSession *session = p->second;
@@ -1786,6 +2060,7 @@ void Objecter::ms_handle_reset(Connection *con)
 	kick_requests(session);
 	maybe_request_map();
       }
+      rwlock.put_write();
     } else {
       ldout(cct, 10) << "ms_handle_reset on unknown osd addr " << con->get_peer_addr() << dendl;
     }
@@ -1803,10 +2078,29 @@ void Objecter::ms_handle_remote_reset(Connection *con)
 
 void Objecter::dump_active()
 {
-  ldout(cct, 20) << "dump_active .. " << num_homeless_ops << " homeless" << dendl;
-  for (hash_map<tid_t,Op*>::iterator p = ops.begin(); p != ops.end(); p++) {
+  rwlock.get_read();
+  _dump_active();
+  rwlock.put_read();
+}
+
+void Objecter::_dump_active()
+{
+  ldout(cct, 20) << "dump_active .. " << homeless_ops.size() << " homeless" << dendl;
+  for (map<int,OSDSession*>::iterator i = osd_sessions.begin();
+       i != osd_sessions.end();
+       ++i) {
+    OSDSession *s = i->second;
+    s->lock.Lock();
+    for (map<tid_t,Op*>::iterator p = s->ops.begin(); p != s->ops.end(); p++) {
+      Op *op = p->second;
+      ldout(cct, 20) << op->tid << "\t" << op->pgid << "\tosd." << s->osd
+	      << "\t" << op->oid << "\t" << op->ops << dendl;
+    }
+    s->lock.Unlock();
+  }
+  for (map<tid_t,Op*>::iterator p = homeless_ops.begin(); p != homeless_ops.end(); p++) {
     Op *op = p->second;
-    ldout(cct, 20) << op->tid << "\t" << op->pgid << "\tosd." << (op->session ? op->session->osd : -1)
+    ldout(cct, 20) << op->tid << "\t" << op->pgid << "\tosd.-1"
 	    << "\t" << op->oid << "\t" << op->ops << dendl;
   }
 }
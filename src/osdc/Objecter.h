@@ -16,12 +16,14 @@
 #define CEPH_OBJECTER_H
 
 #include "include/types.h"
+#include "include/atomic.h"
 #include "include/buffer.h"
 #include "include/xlist.h"
 
 #include "osd/OSDMap.h"
 #include "messages/MOSDOp.h"
 
+#include "common/RWLock.h"
 #include "common/Timer.h"
 
 #include <list>
@@ -317,11 +319,12 @@ class Objecter {
 
  
  private:
-  tid_t last_tid;
+  atomic_t last_tid;
   int client_inc;
   uint64_t max_linger_id;
-  int num_unacked;
-  int num_uncommitted;
+  atomic_t num_unacked;
+  atomic_t num_uncommitted;
+  atomic_t num_in_flight;
   int global_op_flags; // flags which are applied to each IO op
   bool keep_balanced_budget;
   bool honor_osdmap_full;
@@ -334,6 +337,24 @@ class Objecter {
   Mutex &client_lock;
   SafeTimer &timer;
 
+  /*
+   * Op submission and reply handling do not need client_lock:
+   *
+   *  rwlock         protects the osdmap, osd_sessions, homeless_ops,
+   *                 lingers and the map check tables.  Held for read to
+   *                 submit or complete an op; held for write by anything
+   *                 that retargets ops (new maps, resets, lingers).
+   *  session->lock  protects that session's ops and orders sends on its
+   *                 connection.  Only taken with rwlock held for read;
+   *                 rwlock held for write covers every session.
+   *
+   * Everything else still runs under client_lock, which is taken
+   * before rwlock.  New maps are applied holding both, so either one
+   * is enough to read the osdmap.  Op completions are called without
+   * any Objecter lock held.
+   */
+  RWLock rwlock;
+
   PerfCounters *logger;
   
   class C_Tick : public Context {
@@ -355,7 +376,6 @@ public:
 
   struct Op {
     OSDSession *session;
-    xlist<Op*>::item session_item;
     int incarnation;
     
     object_t oid;
@@ -391,7 +411,7 @@ public:
 
     Op(const object_t& o, const object_locator_t& ol, vector<OSDOp>& op,
        int f, Context *ac, Context *co, eversion_t *ov) :
-      session(NULL), session_item(this), incarnation(0),
+      session(NULL), incarnation(0),
       oid(o), oloc(ol),
       used_replica(false), con(NULL),
       snapid(CEPH_NOSNAP), outbl(0), flags(f), priority(0), onack(ac), oncommit(co), 
@@ -591,21 +611,21 @@ public:
 
   // -- osd sessions --
   struct OSDSession {
-    xlist<Op*> ops;
+    Mutex lock;
+    map<tid_t,Op*> ops;
     xlist<LingerOp*> linger_ops;
     int osd;
     int incarnation;
     Connection *con;
 
-    OSDSession(int o) : osd(o), incarnation(0), con(NULL) {}
+    OSDSession(int o) : lock("OSDSession::lock"), osd(o), incarnation(0), con(NULL) {}
   };
   map<int,OSDSession*> osd_sessions;
 
 
  private:
   // pending ops
-  hash_map<tid_t,Op*>       ops;
-  int                       num_homeless_ops;
+  map<tid_t,Op*>            homeless_ops;  // no target osd
   map<uint64_t, LingerOp*>  linger_ops;
   map<tid_t,PoolStatOp*>    poolstat_ops;
   map<tid_t,StatfsOp*>      statfs_ops;
@@ -625,10 +645,17 @@ public:
     RECALC_OP_TARGET_NEED_RESEND,
     RECALC_OP_TARGET_POOL_DNE,
   };
+  int calc_op_target(Op *op, int *posd);
   int recalc_op_target(Op *op);
+  void _session_op_assign(OSDSession *s, Op *op);
+  void _session_op_remove(Op *op);
+  void _finish_op(Op *op);
+  void _collect_ops(vector<Op*>& ls);
+  void _dump_active();
   bool recalc_linger_op_target(LingerOp *op);
 
   void send_linger(LingerOp *info);
+  void _unregister_linger(uint64_t linger_id);
   void _linger_ack(LingerOp *info, int r);
   void _linger_commit(LingerOp *info, int r);
 
@@ -652,7 +679,8 @@ public:
    * handle a budget for in-flight ops
    * budget is taken whenever an op goes into the ops map
    * and returned whenever an op is removed from the map
-   * If throttle_op needs to throttle it will unlock client_lock.
+   * If throttle_op needs to throttle it will block until replies
+   * return enough budget; never call it with rwlock held.
    */
   int calc_op_budget(Op *op);
   void throttle_op(Op *op, int op_size=0);
@@ -674,15 +702,14 @@ public:
 	   OSDMap *om, Mutex& l, SafeTimer& t) : 
     messenger(m), monc(mc), osdmap(om), cct(cct_),
     last_tid(0), client_inc(-1), max_linger_id(0),
-    num_unacked(0), num_uncommitted(0),
+    num_unacked(0), num_uncommitted(0), num_in_flight(0),
     global_op_flags(0),
     keep_balanced_budget(false), honor_osdmap_full(true),
     last_seen_osdmap_version(0),
     last_seen_pgmap_version(0),
-    client_lock(l), timer(t),
+    client_lock(l), timer(t), rwlock("Objecter::rwlock"),
     logger(NULL), tick_event(NULL),
-    num_homeless_ops(0),
-    op_throttler(cct->_conf->objecter_inflight_op_bytes)
+    op_throttler(cct, string(), cct->_conf->objecter_inflight_op_bytes)
   { }
   ~Objecter() {
     assert(!logger);
@@ -694,9 +721,9 @@ public:
   /**
    * Tell the objecter to throttle outgoing ops according to its
    * budget (in _conf). If you do this, ops can block, in
-   * which case it will unlock client_lock and sleep until
-   * incoming messages reduce the used budget low enough for
-   * the ops to continue going; then it will lock client_lock again.
+   * which case the submitter sleeps until incoming replies
+   * reduce the used budget low enough for the ops to continue
+   * going.  Don't submit with client_lock held if you do this.
    */
   void set_balanced_budget() { keep_balanced_budget = true; }
   void unset_balanced_budget() { keep_balanced_budget = false; }
@@ -714,11 +741,16 @@ public:
 private:
   // low-level
   tid_t op_submit(Op *op, OSDSession *s = NULL);
+  tid_t _op_submit(Op *op);
+  bool _op_submit_rlocked(Op *op);
+  void _op_submit_wlocked(Op *op, OSDSession *s);
+  void _op_register(Op *op, OSDSession *s);
+  void _op_send(Op *op, bool check_for_latest_map);
 
   // public interface
  public:
   bool is_active() {
-    return !(ops.empty() && linger_ops.empty() && poolstat_ops.empty() && statfs_ops.empty());
+    return !(num_in_flight.read() == 0 && linger_ops.empty() && poolstat_ops.empty() && statfs_ops.empty());
   }
   void dump_active();
 
@@ -737,15 +769,25 @@ private:
   /** Clear the passed flags from the global op flag set */
   void clear_global_op_flag(int flags) { global_op_flags &= ~flags; }
 
+  // batched submission; see prepare_mutate_op()
+  void op_submit_batch(vector<Op*>& batch);
+
   // mid-level helpers
-  tid_t mutate(const object_t& oid, const object_locator_t& oloc, 
-	       ObjectOperation& op,
-	       const SnapContext& snapc, utime_t mtime, int flags,
-	       Context *onack, Context *oncommit, eversion_t *objver = NULL) {
+  Op *prepare_mutate_op(const object_t& oid, const object_locator_t& oloc,
+			ObjectOperation& op,
+			const SnapContext& snapc, utime_t mtime, int flags,
+			Context *onack, Context *oncommit, eversion_t *objver = NULL) {
     Op *o = new Op(oid, oloc, op.ops, flags | global_op_flags | CEPH_OSD_FLAG_WRITE, onack, oncommit, objver);
     o->priority = op.priority;
     o->mtime = mtime;
     o->snapc = snapc;
+    return o;
+  }
+  tid_t mutate(const object_t& oid, const object_locator_t& oloc, 
+	       ObjectOperation& op,
+	       const SnapContext& snapc, utime_t mtime, int flags,
+	       Context *onack, Context *oncommit, eversion_t *objver = NULL) {
+    Op *o = prepare_mutate_op(oid, oloc, op, snapc, mtime, flags, onack, oncommit, objver);
     return op_submit(o);
   }
   tid_t read(const object_t& oid, const object_locator_t& oloc, 
@@ -0,0 +1,43 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_OSDC_WRITEBACKHANDLER_H
+#define CEPH_OSDC_WRITEBACKHANDLER_H
+
+#include "include/Context.h"
+#include "include/types.h"
+#include "osd/osd_types.h"
+
+/*
+ * The interface ObjectCacher uses to move data to and from the backing
+ * store.  Client drives it with the Objecter directly (ObjecterWriteback);
+ * librbd goes through librados.
+ *
+ * The ObjectCacher's completions (C_ReadFinish, C_WriteCommit, ...)
+ * expect the cache lock to be held, so the handler must take that lock
+ * before it completes them.
+ */
+class WritebackHandler {
+ public:
+  WritebackHandler() {}
+  virtual ~WritebackHandler() {}
+
+  virtual tid_t read(const object_t& oid, const object_locator_t& oloc,
+		     uint64_t off, uint64_t len, snapid_t snapid,
+		     bufferlist *pbl, uint64_t trunc_size, __u32 trunc_seq,
+		     Context *onfinish) = 0;
+  virtual tid_t write(const object_t& oid, const object_locator_t& oloc,
+		      uint64_t off, uint64_t len, const SnapContext& snapc,
+		      const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
+		      __u32 trunc_seq, Context *oncommit) = 0;
+
+  // object locking is only used by the atomic sync paths, which not
+  // every backend can provide.
+  virtual bool can_lock() { return false; }
+  virtual tid_t lock(const object_t& oid, const object_locator_t& oloc,
+		     int op, int flags, Context *onack, Context *oncommit) {
+    assert(0 == "lock not supported by this WritebackHandler");
+    return 0;
+  }
+};
+
+#endif
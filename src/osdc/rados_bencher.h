@@ -29,6 +29,7 @@ Mutex dataLock("data mutex");
 const int OP_WRITE     = 1;
 const int OP_SEQ_READ  = 2;
 const int OP_RAND_READ = 3;
+const int OP_WRITE_BATCH = 4;
 const char *BENCH_DATA = "benchmark_write_data";
 
 struct bench_data {
@@ -61,6 +62,9 @@ void generate_object_name(char *s, int objnum, int pid = 0)
 
 int write_bench(librados::Rados& rados, librados::IoCtx& io_ctx,
 		 int secondsToRun, int concurrentios, bench_data *data);
+int write_batch_bench(librados::Rados& rados, librados::IoCtx& io_ctx,
+		      int secondsToRun, int concurrentios, int batch_size,
+		      bench_data *data);
 int seq_read_bench(librados::Rados& rados, librados::IoCtx& io_ctx,
 		   int secondsToRun, int concurrentios, bench_data *data,
 		   int writePid);
@@ -68,7 +72,7 @@ void *status_printer(void * data_store);
 void sanitize_object_contents(bench_data *data, int length);
 
 int aio_bench(librados::Rados& rados, librados::IoCtx &io_ctx, int operation,
-	      int secondsToRun, int concurrentios, int op_size) {
+	      int secondsToRun, int concurrentios, int op_size, int batch_size = 16) {
   int object_size = op_size;
   int num_objects = 0;
   char* contentsChars = new char[op_size];
@@ -76,7 +80,7 @@ int aio_bench(librados::Rados& rados, librados::IoCtx &io_ctx, int operation,
   int prevPid = 0;
 
   //get data from previous write run, if available
-  if (operation != OP_WRITE) {
+  if (operation != OP_WRITE && operation != OP_WRITE_BATCH) {
     bufferlist object_data;
     r = io_ctx.read(BENCH_DATA, object_data, sizeof(int)*3, 0);
     if (r <= 0) {
@@ -114,6 +118,10 @@ int aio_bench(librados::Rados& rados, librados::IoCtx &io_ctx, int operation,
     r = write_bench(rados, io_ctx, secondsToRun, concurrentios, data);
     if (r != 0) goto out;
   }
+  else if (OP_WRITE_BATCH == operation) {
+    r = write_batch_bench(rados, io_ctx, secondsToRun, concurrentios, batch_size, data);
+    if (r != 0) goto out;
+  }
   else if (OP_SEQ_READ == operation) {
     r = seq_read_bench(rados, io_ctx, secondsToRun, concurrentios, data, prevPid);
     if (r != 0) goto out;
@@ -308,6 +316,143 @@ int write_bench(librados::Rados& rados, librados::IoCtx& io_ctx,
   return -5;
 }
 
+/*
+ * Like write_bench, but each of the concurrentios slots is a batch of
+ * batch_size whole-object writes submitted with IoCtx::aio_operate_batch.
+ * Latency is measured per batch; throughput counts objects.  The objects
+ * are named as write_bench names them, so seq can read them back.
+ */
+int write_batch_bench(librados::Rados& rados, librados::IoCtx& io_ctx,
+		      int secondsToRun, int concurrentios, int batch_size,
+		      bench_data *data) {
+  cout << "Maintaining " << concurrentios << " concurrent batches of "
+       << batch_size << " writes of " << data->object_size
+       << " bytes for at least " << secondsToRun << " seconds." << std::endl;
+
+  librados::AioCompletion* completions[concurrentios];
+  std::vector<int> rvals[concurrentios];
+  utime_t start_times[concurrentios];
+  double total_latency = 0;
+  int batches_started = 0, batches_finished = 0;
+  utime_t stopTime;
+  utime_t runtime;
+  utime_t timePassed;
+  int r = 0;
+  bufferlist b_write;
+  Cond cond;
+
+  pthread_t print_thread;
+  pthread_create(&print_thread, NULL, status_printer, (void *)data);
+  dataLock.Lock();
+  data->start_time = ceph_clock_now(g_ceph_context);
+  dataLock.Unlock();
+
+  runtime.set_from_double(secondsToRun);
+  stopTime = data->start_time + runtime;
+  while (batches_finished < batches_started ||
+	 ceph_clock_now(g_ceph_context) < stopTime) {
+    int slot = batches_started % concurrentios;
+    if (batches_started - batches_finished == concurrentios ||
+	(batches_started > batches_finished &&
+	 ceph_clock_now(g_ceph_context) >= stopTime)) {
+      // reap the oldest batch
+      slot = batches_finished % concurrentios;
+      completions[slot]->wait_for_safe();
+      r = completions[slot]->get_return_value();
+      completions[slot]->release();
+      ++batches_finished;
+      if (r != 0) {
+	cerr << "batch write got " << r << std::endl;
+	for (unsigned i = 0; i < rvals[slot].size(); ++i)
+	  if (rvals[slot][i] < 0)
+	    cerr << "  op " << i << " got " << rvals[slot][i] << std::endl;
+	goto ERR;
+      }
+      dataLock.Lock();
+      data->cur_latency = ceph_clock_now(g_ceph_context) - start_times[slot];
+      total_latency += data->cur_latency;
+      if (data->cur_latency > data->max_latency) data->max_latency = data->cur_latency;
+      if (data->cur_latency < data->min_latency) data->min_latency = data->cur_latency;
+      data->finished += batch_size;
+      data->in_flight -= batch_size;
+      data->avg_latency = total_latency / batches_finished;
+      dataLock.Unlock();
+      continue;
+    }
+
+    std::vector<std::string> names(batch_size);
+    std::vector<librados::ObjectWriteOperation*> ops(batch_size);
+    for (int i = 0; i < batch_size; ++i) {
+      char name[128];
+      generate_object_name(name, data->started + i);
+      names[i] = name;
+      snprintf(data->object_contents, data->object_size, "I'm the %dth object!",
+	       data->started + i);
+      bufferlist bl;
+      bl.append(data->object_contents, data->object_size);
+      ops[i] = new librados::ObjectWriteOperation;
+      ops[i]->write_full(bl);
+    }
+    start_times[slot] = ceph_clock_now(g_ceph_context);
+    completions[slot] = rados.aio_create_completion();
+    r = io_ctx.aio_operate_batch(names, ops, completions[slot], &rvals[slot]);
+    for (int i = 0; i < batch_size; ++i)
+      delete ops[i];
+    if (r < 0) {
+      completions[slot]->release();
+      goto ERR;
+    }
+    dataLock.Lock();
+    data->started += batch_size;
+    data->in_flight += batch_size;
+    dataLock.Unlock();
+    ++batches_started;
+  }
+
+  timePassed = ceph_clock_now(g_ceph_context) - data->start_time;
+  dataLock.Lock();
+  data->done = true;
+  dataLock.Unlock();
+
+  pthread_join(print_thread, NULL);
+
+  double bandwidth;
+  bandwidth = ((double)data->finished)*((double)data->object_size)/(double)timePassed;
+  bandwidth = bandwidth/(1024*1024); // we want it in MB/sec
+  char bw[20];
+  snprintf(bw, sizeof(bw), "%.3lf \n", bandwidth);
+
+  cout << "Total time run:        " << timePassed << std::endl
+       << "Total writes made:     " << data->finished << std::endl
+       << "Write size:            " << data->object_size << std::endl
+       << "Batch size:            " << batch_size << std::endl
+       << "Bandwidth (MB/sec):    " << bw << std::endl
+       << "Writes/sec:            " << (double)data->finished / (double)timePassed << std::endl
+       << "Average Latency:       " << data->avg_latency << std::endl
+       << "Max latency:           " << data->max_latency << std::endl
+       << "Min latency:           " << data->min_latency << std::endl;
+
+  //write object size/number data for read benchmarks
+  ::encode(data->object_size, b_write);
+  ::encode(data->finished, b_write);
+  ::encode(getpid(), b_write);
+  io_ctx.write(BENCH_DATA, b_write, sizeof(int)*3, 0);
+  return 0;
+
+ ERR:
+  // wait out whatever is still in flight before its buffers go away
+  while (batches_finished < batches_started) {
+    int slot = batches_finished++ % concurrentios;
+    completions[slot]->wait_for_safe();
+    completions[slot]->release();
+  }
+  dataLock.Lock();
+  data->done = 1;
+  dataLock.Unlock();
+  pthread_join(print_thread, NULL);
+  return -5;
+}
+
 int seq_read_bench(librados::Rados& rados, librados::IoCtx& io_ctx, int seconds_to_run,
 		   int concurrentios, bench_data *write_data, int pid) {
   bench_data *data = new bench_data();
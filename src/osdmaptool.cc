@@ -25,6 +25,7 @@ using namespace std;
 #include "common/config.h"
 
 #include "common/errno.h"
+#include "common/Clock.h"
 #include "osd/OSDMap.h"
 #include "mon/MonMap.h"
 #include "common/ceph_argparse.h"
@@ -36,6 +37,8 @@ void usage()
   cout << "   --export-crush <file>   write osdmap's crush map to <file>" << std::endl;
   cout << "   --import-crush <file>   replace osdmap's crush map with <file>" << std::endl;
   cout << "   --test-map-pg <pgid>    map a pgid to osds" << std::endl;
+  cout << "   --test-map-pgs          map every pg, timing CRUSH against the mapping table" << std::endl;
+  cout << "   --mapping-threads <n>   worker threads for the mapping table" << std::endl;
   exit(1);
 }
 
@@ -66,6 +69,8 @@ int main(int argc, const char **argv)
   std::string export_crush, import_crush, test_map_pg, test_map_object;
   list<entity_addr_t> add, rm;
   bool test_crush = false;
+  bool test_map_pgs = false;
+  int mapping_threads = g_conf->osd_map_mapping_threads;
 
   std::string val;
   std::ostringstream err;
@@ -115,6 +120,13 @@ int main(int argc, const char **argv)
       test_map_object = val;
     } else if (ceph_argparse_flag(args, i, "--test_crush", (char*)NULL)) {
       test_crush = true;
+    } else if (ceph_argparse_flag(args, i, "--test_map_pgs", (char*)NULL)) {
+      test_map_pgs = true;
+    } else if (ceph_argparse_withint(args, i, &mapping_threads, &err, "--mapping_threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
     } else {
       ++i;
     }
@@ -245,6 +257,50 @@ int main(int argc, const char **argv)
     osdmap.pg_to_up_acting_osds(pgid, up, acting);
     cout << pgid << " raw " << raw << " up " << up << " acting " << acting << std::endl;
   }
+  if (test_map_pgs) {
+    // every pg through CRUSH, the way we always have
+    vector<pg_t> pgs;
+    for (map<int64_t,pg_pool_t>::const_iterator p = osdmap.get_pools().begin();
+	 p != osdmap.get_pools().end();
+	 p++)
+      for (ps_t ps = 0; ps < p->second.get_pg_num(); ps++)
+	pgs.push_back(pg_t(ps, p->first, -1));
+    vector< vector<int> > plain(pgs.size());
+    utime_t start = ceph_clock_now(g_ceph_context);
+    for (unsigned i = 0; i < pgs.size(); i++)
+      osdmap.pg_to_osds(pgs[i], plain[i]);
+    utime_t crush_time = ceph_clock_now(g_ceph_context) - start;
+
+    // build the table, then look everything up again
+    start = ceph_clock_now(g_ceph_context);
+    osdmap.update_mapping(mapping_threads);
+    utime_t build_time = ceph_clock_now(g_ceph_context) - start;
+    start = ceph_clock_now(g_ceph_context);
+    osdmap.update_mapping(mapping_threads);
+    utime_t rebuild_time = ceph_clock_now(g_ceph_context) - start;
+    unsigned shared = osdmap.get_mapping()->get_num_shared();
+
+    int mismatch = 0;
+    vector<int> raw;
+    start = ceph_clock_now(g_ceph_context);
+    for (unsigned i = 0; i < pgs.size(); i++) {
+      osdmap.pg_to_osds(pgs[i], raw);
+      if (raw != plain[i] && mismatch++ < 10)
+	cerr << pgs[i] << " crush " << plain[i] << " table " << raw << std::endl;
+    }
+    utime_t lookup_time = ceph_clock_now(g_ceph_context) - start;
+
+    cout << pgs.size() << " pgs in " << osdmap.get_pools().size() << " pools\n"
+	 << "  crush:   " << crush_time << "s\n"
+	 << "  table:   " << build_time << "s to build with " << mapping_threads
+	 << " threads, " << lookup_time << "s to look up\n"
+	 << "  rebuild: " << rebuild_time << "s (" << shared << " pools unchanged)"
+	 << std::endl;
+    if (mismatch) {
+      cerr << me << ": " << mismatch << " pgs map differently through the table" << std::endl;
+      return 1;
+    }
+  }
   if (test_crush) {
     int pass = 0;
     while (1) {
@@ -278,7 +334,7 @@ int main(int argc, const char **argv)
 
   if (!print && !print_json && !tree && !modified && 
       export_crush.empty() && import_crush.empty() && 
-      test_map_pg.empty() && test_map_object.empty()) {
+      test_map_pg.empty() && test_map_object.empty() && !test_map_pgs) {
     cerr << me << ": no action specified?" << std::endl;
     usage();
   }
@@ -75,6 +75,9 @@ void usage(ostream& out)
 "   rollback <obj-name> <snap-name>  roll back object to snap <snap-name>\n\n"
 "   bench <seconds> write|seq|rand [-t concurrent_operations]\n"
 "                                    default is 16 concurrent IOs and 4 MB ops\n"
+"   bench <seconds> write-batch [-t concurrent_batches] [--batch-size n]\n"
+"                                    write n objects per batched aio call\n"
+"                                    (default 16)\n"
 "   load-gen [options]               generate load on the cluster\n"
 "\n"
 "IMPORT AND EXPORT\n"
@@ -569,6 +572,7 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   string oloc;
   int concurrent_ios = 16;
   int op_size = 1 << 22;
+  int batch_size = 16;
   const char *snapname = NULL;
   snap_t snapid = CEPH_NOSNAP;
   std::map<std::string, std::string>::const_iterator i;
@@ -611,6 +615,10 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   if (i != opts.end()) {
     op_size = strtol(i->second.c_str(), NULL, 10);
   }
+  i = opts.find("batch-size");
+  if (i != opts.end()) {
+    batch_size = strtol(i->second.c_str(), NULL, 10);
+  }
   i = opts.find("snap");
   if (i != opts.end()) {
     snapname = i->second.c_str();
@@ -1191,9 +1199,13 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
       operation = OP_SEQ_READ;
     else if (strcmp(nargs[2], "rand") == 0)
       operation = OP_RAND_READ;
+    else if (strcmp(nargs[2], "write-batch") == 0)
+      operation = OP_WRITE_BATCH;
     else
       usage_exit();
-    ret = aio_bench(rados, io_ctx, operation, seconds, concurrent_ios, op_size);
+    if (batch_size < 1)
+      usage_exit();
+    ret = aio_bench(rados, io_ctx, operation, seconds, concurrent_ios, op_size, batch_size);
     if (ret != 0)
       cerr << "error during benchmark: " << ret << std::endl;
   }
@@ -1305,6 +1317,8 @@ int main(int argc, const char **argv)
       opts["block-size"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-b", (char*)NULL)) {
       opts["block-size"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--batch-size", (char*)NULL)) {
+      opts["batch-size"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-s", "--snap", (char*)NULL)) {
       opts["snap"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-S", "--snapid", (char*)NULL)) {
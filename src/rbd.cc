@@ -69,10 +69,14 @@ void usage()
        << "  create <--order=bits> [--size MB] [name]  create an empty image\n"
        << "  resize [--size MB] [image-name]           resize (expand or contract) image\n"
        << "  rm [image-name]                           delete an image\n"
-       << "  export <--snap=name> [image-name] [path]  export image to file\n"
+       << "  export <--snap=name> [image-name] [path]  export image to file (\"-\"\n"
+       << "                                            for stdout)\n"
        << "  import [path] [dst-image]                 import image from file (dest defaults\n"
-       << "                                            as the filename part of file)\n"
+       << "                                            as the filename part of file; \"-\"\n"
+       << "                                            reads stdin)\n"
        << "  <cp | copy> <--snap=name> [src] [dest]    copy src image to dest\n"
+       << "  clone <--snap=name> [parent] [dest]       create dest as a copy-on-write\n"
+       << "                                            clone of a parent snapshot\n"
        << "  <mv | rename> [src] [dest]                rename src image to dest\n"
        << "  snap ls [image-name]                      dump list of image snapshots\n"
        << "  snap create <--snap=name> [image-name]    create a snapshot\n"
@@ -136,19 +140,19 @@ struct MyProgressContext : public librbd::ProgressContext {
   int update_progress(uint64_t offset, uint64_t total) {
     int pc = total ? (offset * 100ull / total) : 0;
     if (pc != last_pc) {
-      cout << "\r" << operation << ": "
+      cerr << "\r" << operation << ": "
 	//	   << offset << " / " << total << " "
 	   << pc << "% complete...";
-      cout.flush();
+      cerr.flush();
       last_pc = pc;
     }
     return 0;
   }
   void finish() {
-    cout << "\r" << operation << ": 100% complete...done." << std::endl;
+    cerr << "\r" << operation << ": 100% complete...done." << std::endl;
   }
   void fail() {
-    cout << "\r" << operation << ": " << last_pc << "% complete...failed." << std::endl;
+    cerr << "\r" << operation << ": " << last_pc << "% complete...failed." << std::endl;
   }
 };
 
@@ -173,6 +177,16 @@ static int do_create(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   return 0;
 }
 
+static int do_clone(librbd::RBD &rbd, librados::IoCtx& io_ctx,
+		    const char *p_name, const char *p_snapname,
+		    const char *c_name, int *c_order)
+{
+  int r = rbd.clone(io_ctx, p_name, p_snapname, c_name, c_order);
+  if (r < 0)
+    return r;
+  return 0;
+}
+
 static int do_rename(librbd::RBD &rbd, librados::IoCtx& io_ctx,
 		     const char *imgname, const char *destname)
 {
@@ -281,28 +295,39 @@ static int do_purge_snaps(librbd::Image& image)
 
 struct ExportContext {
   int fd;
+  bool stream;    // a pipe: holes must be written out as zeros, in order
+  uint64_t size;
   MyProgressContext pc;
 
-  ExportContext(int f) : fd(f), pc("Exporting image") {}
+  ExportContext(int f, bool s, uint64_t sz)
+    : fd(f), stream(s), size(sz), pc("Exporting image") {}
 };
 
 static int export_read_cb(uint64_t ofs, size_t len, const char *buf, void *arg)
 {
+  static char zeros[4096];
   ssize_t ret;
   ExportContext *ec = (ExportContext *)arg;
-  int fd = ec->fd;
 
-  if (!buf) /* a hole */
-    return 0;
+  ec->pc.update_progress(ofs, ec->size);
 
-  ret = lseek64(fd, ofs, SEEK_SET);
-  if (ret < 0)
-    return -errno;
-  ret = write(fd, buf, len);
-  if (ret < 0)
-    return -errno;
+  if (!ec->stream) {
+    if (!buf) /* a hole */
+      return 0;
+    ret = safe_pwrite(ec->fd, buf, len, ofs);
+    return ret < 0 ? ret : 0;
+  }
 
-  cerr << "writing " << len << " bytes at ofs " << ofs << std::endl;
+  // read_iterate hands us extents in order, so we can just append
+  if (buf)
+    return safe_write(ec->fd, buf, len);
+  while (len > 0) {
+    size_t l = MIN(len, sizeof(zeros));
+    ret = safe_write(ec->fd, zeros, l);
+    if (ret < 0)
+      return ret;
+    len -= l;
+  }
   return 0;
 }
 
@@ -311,26 +336,36 @@ static int do_export(librbd::Image& image, const char *path)
   int64_t r;
   librbd::image_info_t info;
   int fd;
+  bool to_stdout = (strcmp(path, "-") == 0);
 
   r = image.stat(info, sizeof(info));
   if (r < 0)
     return r;
 
-  fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
-  if (fd < 0)
-    return -errno;
+  if (to_stdout) {
+    fd = 1;
+  } else {
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+      return -errno;
+  }
 
-  ExportContext ec(fd);
+  ExportContext ec(fd, to_stdout, info.size);
   r = image.read_iterate(0, info.size, export_read_cb, (void *)&ec);
   if (r < 0)
     goto out;
 
-  r = ftruncate(fd, info.size);
-  if (r < 0)
-    goto out;
+  if (!to_stdout) {
+    r = ftruncate(fd, info.size);
+    if (r < 0) {
+      r = -errno;
+      goto out;
+    }
+  }
 
  out:
-  close(fd);
+  if (!to_stdout)
+    close(fd);
   if (r < 0)
     ec.pc.fail();
   else
@@ -400,30 +435,141 @@ done_img:
   update_snap_name(*new_img, snap);
 }
 
+/*
+ * Writes an import out to the image, keeping up to
+ * rbd_concurrent_management_ops writes in flight.  Chunks that are all
+ * zeros are skipped, so the image stays thin.
+ */
+struct ImportContext {
+  librbd::Image& image;
+  size_t max_inflight;
+  deque<librbd::RBD::AioCompletion*> inflight;
+
+  ImportContext(librbd::Image& i, int max)
+    : image(i), max_inflight(MAX(1, max)) {}
+
+  int write(uint64_t ofs, bufferlist& bl) {
+    if (bl.is_zero())
+      return 0;
+    librbd::RBD::AioCompletion *completion = new librbd::RBD::AioCompletion(NULL, NULL);
+    int r = image.aio_write(ofs, bl.length(), bl, completion);
+    if (r < 0) {
+      completion->release();
+      return r;
+    }
+    inflight.push_back(completion);
+    if (inflight.size() >= max_inflight)
+      return wait_for_oldest();
+    return 0;
+  }
+
+  int wait_for_oldest() {
+    librbd::RBD::AioCompletion *completion = inflight.front();
+    inflight.pop_front();
+    completion->wait_for_complete();
+    int r = completion->get_return_value();
+    completion->release();
+    return r;
+  }
+
+  int flush() {
+    int ret = 0;
+    while (!inflight.empty()) {
+      int r = wait_for_oldest();
+      if (r < 0 && !ret)
+	ret = r;
+    }
+    return ret;
+  }
+};
+
+/*
+ * Import from a pipe.  We don't know how big the image will be, so grow
+ * it (doubling) as data arrives and trim it to size at the end.
+ */
+static int import_stream(ImportContext& ic, int fd, uint64_t obj_size,
+			 MyProgressContext& pc)
+{
+  uint64_t pos = 0, image_size = 0;
+  int r;
+
+  while (true) {
+    bufferptr p(obj_size);
+    size_t len = 0;
+    while (len < obj_size) {
+      ssize_t rval = safe_read(fd, p.c_str() + len, obj_size - len);
+      if (rval < 0) {
+	cerr << "error reading input: " << cpp_strerror(rval) << std::endl;
+	return rval;
+      }
+      if (!rval)
+	break;
+      len += rval;
+    }
+    if (!len)
+      break;
+
+    if (pos + len > image_size) {
+      image_size = MAX(pos + len, image_size * 2);
+      r = ic.image.resize(image_size);
+      if (r < 0) {
+	cerr << "error resizing image: " << cpp_strerror(r) << std::endl;
+	return r;
+      }
+    }
+
+    bufferlist bl;
+    bl.append(p, 0, len);
+    r = ic.write(pos, bl);
+    if (r < 0) {
+      cerr << "error writing to image block" << std::endl;
+      return r;
+    }
+    pos += len;
+    pc.update_progress(pos, image_size);
+    if (len < obj_size)
+      break;
+  }
+
+  r = ic.flush();
+  if (r < 0)
+    return r;
+  if (image_size != pos)
+    r = ic.image.resize(pos);
+  return r;
+}
+
 static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
 		     const char *imgname, int *order, const char *path)
 {
-  int fd = open(path, O_RDONLY);
+  int fd;
   int r;
-  uint64_t size;
+  uint64_t size = 0;
   struct stat stat_buf;
   string md_oid;
-  struct fiemap *fiemap;
+  struct fiemap *fiemap = NULL;
+  librbd::image_info_t info;
+  bool from_stdin = (strcmp(path, "-") == 0);
   MyProgressContext pc("Importing image");
 
-  if (fd < 0) {
-    r = -errno;
-    cerr << "error opening " << path << std::endl;
-    return r;
-  }
+  if (from_stdin) {
+    fd = 0;
+  } else {
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      r = -errno;
+      cerr << "error opening " << path << std::endl;
+      return r;
+    }
 
-  r = fstat(fd, &stat_buf);
-  if (r < 0) {
-    r = -errno;
-    cerr << "stat error " << path << std::endl;
-    return r;
+    r = fstat(fd, &stat_buf);
+    if (r < 0) {
+      r = -errno;
+      cerr << "stat error " << path << std::endl;
+      return r;
+    }
+    size = (uint64_t)stat_buf.st_size;
   }
-  size = (uint64_t)stat_buf.st_size;
 
   assert(imgname);
 
@@ -441,6 +587,17 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     cerr << "failed to open image" << std::endl;
     return r;
   }
+  r = image.stat(info, sizeof(info));
+  if (r < 0)
+    return r;
+
+  ImportContext ic(image, g_conf->rbd_concurrent_management_ops);
+
+  if (from_stdin) {
+    r = import_stream(ic, fd, info.obj_size, pc);
+    goto done;
+  }
+
   fsync(fd); /* flush it first, otherwise extents information might not have been flushed yet */
   fiemap = read_fiemap(fd);
   if (fiemap && !fiemap->fm_mapped_extents) {
@@ -465,70 +622,58 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     fiemap->fm_extents[0].fe_flags = 0;
   }
 
-  uint64_t extent = 0;
+  {
+    uint64_t extent = 0;
 
-  while (extent < fiemap->fm_mapped_extents) {
-    off_t file_pos, end_ofs;
-    size_t extent_len = 0;
+    while (extent < fiemap->fm_mapped_extents) {
+      off_t file_pos, end_ofs;
+      size_t extent_len = 0;
 
-    file_pos = fiemap->fm_extents[extent].fe_logical; /* position within the file we're reading */
+      file_pos = fiemap->fm_extents[extent].fe_logical; /* position within the file we're reading */
 
-    do { /* try to merge consecutive extents */
+      do { /* try to merge consecutive extents */
 #define LARGE_ENOUGH_EXTENT (32 * 1024 * 1024)
-      if (extent_len &&
-          extent_len + fiemap->fm_extents[extent].fe_length > LARGE_ENOUGH_EXTENT)
-        break; /* don't try to merge if we're big enough */
-
-      extent_len += fiemap->fm_extents[extent].fe_length;  /* length of current extent */
-      end_ofs = MIN((off_t)size, file_pos + (off_t)extent_len);
-
-      extent++;
-      if (extent == fiemap->fm_mapped_extents)
-        break;
-      
-    } while (end_ofs == (off_t)fiemap->fm_extents[extent].fe_logical);
-
-    //cerr << "rbd import file_pos=" << file_pos << " extent_len=" << extent_len << std::endl;
-#define READ_BLOCK_LEN (4 * 1024 * 1024)
-    uint64_t left = end_ofs - file_pos;
-    while (left) {
-      pc.update_progress(file_pos, size);
-      uint64_t cur_seg = (left < READ_BLOCK_LEN ? left : READ_BLOCK_LEN);
-      while (cur_seg) {
-        bufferptr p(cur_seg);
-        //cerr << "reading " << cur_seg << " bytes at offset " << file_pos << std::endl;
-        ssize_t rval = TEMP_FAILURE_RETRY(::pread(fd, p.c_str(), cur_seg, file_pos));
-        if (rval < 0) {
-          r = -errno;
-          cerr << "error reading file: " << cpp_strerror(r) << std::endl;
-          goto done;
-        }
+	if (extent_len &&
+	    extent_len + fiemap->fm_extents[extent].fe_length > LARGE_ENOUGH_EXTENT)
+	  break; /* don't try to merge if we're big enough */
+
+	extent_len += fiemap->fm_extents[extent].fe_length;  /* length of current extent */
+	end_ofs = MIN((off_t)size, file_pos + (off_t)extent_len);
+
+	extent++;
+	if (extent == fiemap->fm_mapped_extents)
+	  break;
+
+      } while (end_ofs == (off_t)fiemap->fm_extents[extent].fe_logical);
+
+      // read in object-sized, object-aligned pieces so that zero
+      // objects can be skipped
+      uint64_t left = end_ofs - file_pos;
+      while (left) {
+	pc.update_progress(file_pos, size);
+	uint64_t cur_seg = MIN(left, info.obj_size - file_pos % info.obj_size);
+	bufferptr p(cur_seg);
+	ssize_t rval = safe_pread(fd, p.c_str(), cur_seg, file_pos);
+	if (rval < 0) {
+	  r = rval;
+	  cerr << "error reading file: " << cpp_strerror(r) << std::endl;
+	  goto done;
+	}
 	size_t len = rval;
-        if (!len) {
-          r = 0;
-          goto done;
-        }
-        bufferlist bl;
-        bl.append(p);
-        librbd::RBD::AioCompletion *completion = new librbd::RBD::AioCompletion(NULL, NULL);
-        if (!completion) {
-          r = -ENOMEM;
-          goto done;
-        }
-        r = image.aio_write(file_pos, len, bl, completion);
-        if (r < 0)
-          goto done;
-	completion->wait_for_complete();
-	r = completion->get_return_value();
-	completion->release();
-        if (r < 0) {
-          cerr << "error writing to image block" << std::endl;
-          goto done;
-        }
-
-        file_pos += len;
-        cur_seg -= len;
-        left -= len;
+	if (!len) {
+	  r = 0;
+	  goto done;
+	}
+	bufferlist bl;
+	bl.append(p, 0, len);
+	r = ic.write(file_pos, bl);
+	if (r < 0) {
+	  cerr << "error writing to image block" << std::endl;
+	  goto done;
+	}
+
+	file_pos += len;
+	left -= len;
       }
     }
   }
@@ -536,11 +681,20 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   r = 0;
 
  done:
+  {
+    int ret = ic.flush();
+    if (ret < 0 && r >= 0) {
+      cerr << "error writing to image block" << std::endl;
+      r = ret;
+    }
+  }
   if (r < 0)
     pc.fail();
   else
     pc.finish();
   free(fiemap);
+  if (!from_stdin)
+    close(fd);
 
   return r;
 }
@@ -830,6 +984,7 @@ enum {
   OPT_EXPORT,
   OPT_IMPORT,
   OPT_COPY,
+  OPT_CLONE,
   OPT_RENAME,
   OPT_SNAP_CREATE,
   OPT_SNAP_ROLLBACK,
@@ -863,6 +1018,8 @@ static int get_cmd(const char *cmd, bool snapcmd)
     if (strcmp(cmd, "copy") == 0 ||
         strcmp(cmd, "cp") == 0)
       return OPT_COPY;
+    if (strcmp(cmd, "clone") == 0)
+      return OPT_CLONE;
     if (strcmp(cmd, "rename") == 0 ||
         strcmp(cmd, "mv") == 0)
       return OPT_RENAME;
@@ -1017,6 +1174,7 @@ int main(int argc, const char **argv)
 	set_conf_param(v, &path, &destname);
 	break;
       case OPT_COPY:
+      case OPT_CLONE:
       case OPT_RENAME:
 	set_conf_param(v, &imgname, &destname);
 	break;
@@ -1041,8 +1199,13 @@ int main(int argc, const char **argv)
     usage_exit();
   }
 
-  if (opt_cmd == OPT_IMPORT && !destname)
+  if (opt_cmd == OPT_IMPORT && !destname) {
+    if (strcmp(path, "-") == 0) {
+      cerr << "error: destination image must be specified when importing from stdin" << std::endl;
+      usage_exit();
+    }
     destname = imgname_from_path(path);
+  }
 
   if (opt_cmd != OPT_LIST && opt_cmd != OPT_IMPORT && opt_cmd != OPT_UNMAP && opt_cmd != OPT_SHOWMAPPED &&
       !imgname) {
@@ -1057,12 +1220,12 @@ int main(int argc, const char **argv)
   if (snapname && opt_cmd != OPT_SNAP_CREATE && opt_cmd != OPT_SNAP_ROLLBACK &&
       opt_cmd != OPT_SNAP_REMOVE && opt_cmd != OPT_INFO &&
       opt_cmd != OPT_EXPORT && opt_cmd != OPT_COPY &&
-      opt_cmd != OPT_MAP) {
+      opt_cmd != OPT_CLONE && opt_cmd != OPT_MAP) {
     cerr << "error: snapname specified for a command that doesn't use it" << std::endl;
     usage_exit();
   }
   if ((opt_cmd == OPT_SNAP_CREATE || opt_cmd == OPT_SNAP_ROLLBACK ||
-       opt_cmd == OPT_SNAP_REMOVE) && !snapname) {
+       opt_cmd == OPT_SNAP_REMOVE || opt_cmd == OPT_CLONE) && !snapname) {
     cerr << "error: snap name was not specified" << std::endl;
     usage_exit();
   }
@@ -1077,11 +1240,16 @@ int main(int argc, const char **argv)
   if (opt_cmd == OPT_EXPORT && !path)
     path = imgname;
 
-  if (opt_cmd == OPT_COPY && !destname ) {
+  if ((opt_cmd == OPT_COPY || opt_cmd == OPT_CLONE) && !destname ) {
     cerr << "error: destination image name was not specified" << std::endl;
     usage_exit();
   }
 
+  if (opt_cmd == OPT_CLONE && strcmp(poolname, dest_poolname) != 0) {
+    cerr << "error: a clone must be in the same pool as its parent" << std::endl;
+    usage_exit();
+  }
+
   bool talk_to_cluster = (opt_cmd != OPT_MAP &&
 			  opt_cmd != OPT_UNMAP &&
 			  opt_cmd != OPT_SHOWMAPPED);
@@ -1166,6 +1334,19 @@ int main(int argc, const char **argv)
     }
     break;
 
+  case OPT_CLONE:
+    if (order && (order < 12 || order > 25)) {
+      cerr << "order must be between 12 (4 KB) and 25 (32 MB)" << std::endl;
+      usage();
+      exit(1);
+    }
+    r = do_clone(rbd, io_ctx, imgname, snapname, destname, &order);
+    if (r < 0) {
+      cerr << "clone error: " << cpp_strerror(-r) << std::endl;
+      exit(1);
+    }
+    break;
+
   case OPT_RENAME:
     r = do_rename(rbd, io_ctx, imgname, destname);
     if (r < 0) {
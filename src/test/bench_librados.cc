@@ -0,0 +1,211 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/rados/librados.hpp"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * bench_librados
+ *
+ * Measure small synchronous op rates against client thread count, all
+ * threads sharing one Rados handle.  Each thread works on its own
+ * object so the only thing they contend on is the client itself.
+ */
+
+using namespace librados;
+
+enum { OP_WRITE, OP_READ, OP_STAT };
+static const char *op_name[] = { "write", "read", "stat" };
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+struct BenchThread {
+  pthread_t thread;
+  IoCtx *io_ctx;
+  std::string oid;
+  int op;
+  int op_size;
+  double until;
+  uint64_t ops;
+  int err;
+
+  static void *entry(void *arg) {
+    BenchThread *t = (BenchThread *)arg;
+    t->run();
+    return NULL;
+  }
+
+  void run() {
+    bufferlist data;
+    data.append(std::string(op_size, 'x'));
+    while (now() < until) {
+      int r;
+      if (op == OP_WRITE) {
+	r = io_ctx->write(oid, data, op_size, 0);
+      } else if (op == OP_READ) {
+	bufferlist bl;
+	r = io_ctx->read(oid, bl, op_size, 0);
+      } else {
+	uint64_t size;
+	time_t mtime;
+	r = io_ctx->stat(oid, &size, &mtime);
+      }
+      if (r < 0) {
+	err = r;
+	return;
+      }
+      ops++;
+    }
+  }
+};
+
+static int run(IoCtx& io_ctx, int op, int threads, int op_size, int seconds,
+	       double *rate)
+{
+  std::vector<BenchThread> v(threads);
+  double start = now();
+  for (int i = 0; i < threads; i++) {
+    BenchThread& t = v[i];
+    std::ostringstream oss;
+    oss << "bench_librados_" << getpid() << "_" << i;
+    t.io_ctx = &io_ctx;
+    t.oid = oss.str();
+    t.op = op;
+    t.op_size = op_size;
+    t.until = start + seconds;
+    t.ops = 0;
+    t.err = 0;
+  }
+  for (int i = 0; i < threads; i++)
+    pthread_create(&v[i].thread, NULL, BenchThread::entry, &v[i]);
+
+  uint64_t ops = 0;
+  int err = 0;
+  for (int i = 0; i < threads; i++) {
+    pthread_join(v[i].thread, NULL);
+    ops += v[i].ops;
+    if (v[i].err)
+      err = v[i].err;
+  }
+  *rate = (double)ops / (now() - start);
+  return err;
+}
+
+void usage()
+{
+  std::cout << "usage: bench_librados [--max-threads n] [--seconds n] [--op-size n]\n"
+	    << "                      [--op write|read|stat] <pool>\n"
+	    << "  runs the op with 1..max-threads client threads sharing one\n"
+	    << "  cluster handle and reports the aggregate op rate" << std::endl;
+  exit(1);
+}
+
+int main(int argc, const char **argv)
+{
+  int max_threads = 16;
+  int seconds = 10;
+  int op_size = 4096;
+  int op = OP_WRITE;
+  const char *pool = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      usage();
+    } else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+      max_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--op-size") == 0 && i + 1 < argc) {
+      op_size = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc) {
+      const char *o = argv[++i];
+      for (op = OP_WRITE; op <= OP_STAT; op++)
+	if (strcmp(o, op_name[op]) == 0)
+	  break;
+      if (op > OP_STAT)
+	usage();
+    } else if (argv[i][0] == '-') {
+      ++i;  // leave ceph options to conf_parse_argv
+    } else {
+      pool = argv[i];
+    }
+  }
+  if (!pool || max_threads < 1 || seconds < 1 || op_size < 1)
+    usage();
+
+  Rados rados;
+  int r = rados.init(NULL);
+  if (r < 0) {
+    std::cerr << "couldn't initialize rados: " << strerror(-r) << std::endl;
+    return 1;
+  }
+  rados.conf_read_file(NULL);
+  rados.conf_parse_argv(argc, argv);
+  rados.conf_parse_env(NULL);
+  r = rados.connect();
+  if (r < 0) {
+    std::cerr << "couldn't connect to cluster: " << strerror(-r) << std::endl;
+    return 1;
+  }
+  IoCtx io_ctx;
+  r = rados.ioctx_create(pool, io_ctx);
+  if (r < 0) {
+    std::cerr << "couldn't open pool " << pool << ": " << strerror(-r) << std::endl;
+    rados.shutdown();
+    return 1;
+  }
+
+  // reads and stats need something there
+  if (op != OP_WRITE) {
+    double rate;
+    run(io_ctx, OP_WRITE, max_threads, op_size, 1, &rate);
+  }
+
+  std::cout << "op\tthreads\tops/sec" << std::endl;
+  for (int t = 1; t <= max_threads; t++) {
+    double rate;
+    r = run(io_ctx, op, t, op_size, seconds, &rate);
+    if (r < 0) {
+      std::cerr << op_name[op] << " failed: " << strerror(-r) << std::endl;
+      break;
+    }
+    std::cout << op_name[op] << "\t" << t << "\t" << (uint64_t)rate << std::endl;
+  }
+
+  for (int i = 0; i < max_threads; i++) {
+    std::ostringstream oss;
+    oss << "bench_librados_" << getpid() << "_" << i;
+    io_ctx.remove(oss.str());
+  }
+  io_ctx.close();
+  rados.shutdown();
+  return r < 0 ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "include/Context.h"
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/Mutex.h"
+#include "common/Timer.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <stdlib.h>
+
+/*
+ * bench_timer
+ *
+ * Measure the cost of SafeTimer add_event_at/cancel_event with an
+ * increasing number of pending events, next to the std::multimap
+ * scheme SafeTimer used to have.
+ */
+
+struct C_Nop : public Context {
+  void finish(int r) {}
+};
+
+static double elapsed_ns(utime_t start, int ops)
+{
+  utime_t end = ceph_clock_now(g_ceph_context);
+  end -= start;
+  return (double)end * 1000000000.0 / (double)ops;
+}
+
+static void bench_wheel(int pending, int ops, double horizon)
+{
+  Mutex lock("bench_timer::lock");
+  SafeTimer timer(g_ceph_context, lock);
+  timer.init();
+  lock.Lock();
+
+  utime_t now = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < pending; i++) {
+    utime_t when = now;
+    when += 60.0 + horizon * (double)rand() / (double)RAND_MAX;
+    timer.add_event_at(when, new C_Nop);
+  }
+
+  vector<Context*> cs(ops);
+  vector<utime_t> whens(ops);
+  for (int i = 0; i < ops; i++) {
+    cs[i] = new C_Nop;
+    whens[i] = now;
+    whens[i] += 60.0 + horizon * (double)rand() / (double)RAND_MAX;
+  }
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < ops; i++)
+    timer.add_event_at(whens[i], cs[i]);
+  double add = elapsed_ns(start, ops);
+
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < ops; i++)
+    timer.cancel_event(cs[i]);
+  double cancel = elapsed_ns(start, ops);
+
+  cout << "wheel\t" << pending << "\t" << add << "\t" << cancel << std::endl;
+  timer.shutdown();
+  lock.Unlock();
+}
+
+/* the old SafeTimer bookkeeping, for comparison */
+static void bench_multimap(int pending, int ops, double horizon)
+{
+  multimap<utime_t, Context*> schedule;
+  map<Context*, multimap<utime_t, Context*>::iterator> events;
+
+  utime_t now = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < pending; i++) {
+    utime_t when = now;
+    when += 60.0 + horizon * (double)rand() / (double)RAND_MAX;
+    Context *c = new C_Nop;
+    events[c] = schedule.insert(make_pair(when, c));
+  }
+
+  vector<Context*> cs(ops);
+  vector<utime_t> whens(ops);
+  for (int i = 0; i < ops; i++) {
+    cs[i] = new C_Nop;
+    whens[i] = now;
+    whens[i] += 60.0 + horizon * (double)rand() / (double)RAND_MAX;
+  }
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < ops; i++)
+    events[cs[i]] = schedule.insert(make_pair(whens[i], cs[i]));
+  double add = elapsed_ns(start, ops);
+
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < ops; i++) {
+    map<Context*, multimap<utime_t, Context*>::iterator>::iterator p = events.find(cs[i]);
+    delete p->first;
+    schedule.erase(p->second);
+    events.erase(p);
+  }
+  double cancel = elapsed_ns(start, ops);
+
+  cout << "multimap\t" << pending << "\t" << add << "\t" << cancel << std::endl;
+  for (map<Context*, multimap<utime_t, Context*>::iterator>::iterator p = events.begin();
+       p != events.end();
+       ++p)
+    delete p->first;
+}
+
+void usage()
+{
+  cout << "usage: bench_timer [--max-pending n] [--ops n] [--horizon seconds]" << std::endl;
+  cout << "  reports ns per add_event_at and cancel_event with 1000, 10000, ..." << std::endl;
+  cout << "  up to max-pending events already scheduled over the horizon" << std::endl;
+  exit(1);
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY,
+	      CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  int max_pending = 1000000;
+  int ops = 100000;
+  int horizon = 3600;
+
+  std::ostringstream err;
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage();
+    } else if (ceph_argparse_withint(args, i, &max_pending, &err, "--max-pending", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &ops, &err, "--ops", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &horizon, &err, "--horizon", (char*)NULL)) {
+    } else {
+      ++i;
+    }
+    if (!err.str().empty()) {
+      cerr << err.str() << std::endl;
+      usage();
+    }
+  }
+  if (max_pending < 1 || ops < 1 || horizon < 1)
+    usage();
+
+  cout << "impl\tpending\tadd_ns\tcancel_ns" << std::endl;
+  for (int pending = 1000; pending <= max_pending; pending *= 10) {
+    bench_multimap(pending, ops, horizon);
+    bench_wheel(pending, ops, horizon);
+  }
+  return 0;
+}
@@ -0,0 +1,181 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/WorkQueue.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+
+#include <iostream>
+#include <sstream>
+
+/*
+ * bench_workqueue
+ *
+ * Measure ThreadPool throughput against thread count, for the classic
+ * single-lock WorkQueue and for keyed queues with and without work
+ * stealing, using no-op and short (spinning) work items.
+ */
+
+static void spin(int us)
+{
+  if (!us)
+    return;
+  utime_t until = ceph_clock_now(g_ceph_context);
+  until += utime_t(0, us * 1000);
+  while (ceph_clock_now(g_ceph_context) < until)
+    ;
+}
+
+struct BenchItem {
+  uint64_t key;
+  BenchItem(uint64_t k) : key(k) {}
+};
+
+struct ClassicWQ : public ThreadPool::WorkQueue<BenchItem> {
+  deque<BenchItem*> q;
+  int work_us;
+  ClassicWQ(ThreadPool *tp, int us)
+    : ThreadPool::WorkQueue<BenchItem>("ClassicWQ", 60, 0, tp), work_us(us) {}
+  bool _enqueue(BenchItem *i) {
+    q.push_back(i);
+    return true;
+  }
+  void _dequeue(BenchItem *i) {
+    assert(0);
+  }
+  BenchItem *_dequeue() {
+    if (q.empty())
+      return NULL;
+    BenchItem *i = q.front();
+    q.pop_front();
+    return i;
+  }
+  bool _empty() {
+    return q.empty();
+  }
+  void _process(BenchItem *i) {
+    spin(work_us);
+  }
+  void _clear() {}
+};
+
+struct KeyedWQ : public ThreadPool::ShardedWorkQueue<BenchItem> {
+  int work_us;
+  KeyedWQ(ThreadPool *tp, int us)
+    : ThreadPool::ShardedWorkQueue<BenchItem>("KeyedWQ", 60, 0, tp), work_us(us) {}
+  uint64_t _get_key(BenchItem *i) {
+    return i->key;
+  }
+  void _process(BenchItem *i) {
+    spin(work_us);
+  }
+};
+
+enum { MODE_CLASSIC, MODE_KEYED, MODE_STEALING };
+static const char *mode_name[] = { "classic", "keyed", "stealing" };
+
+static double run(int mode, int threads, int items, int keys, int work_us)
+{
+  ThreadPool tp(g_ceph_context, "bench_tp", threads, mode == MODE_STEALING);
+  vector<BenchItem*> v;
+  for (int i = 0; i < items; i++)
+    v.push_back(new BenchItem(i % keys));
+
+  utime_t start, end;
+  if (mode == MODE_CLASSIC) {
+    ClassicWQ wq(&tp, work_us);
+    tp.start();
+    start = ceph_clock_now(g_ceph_context);
+    for (int i = 0; i < items; i++)
+      wq.queue(v[i]);
+    wq.drain();
+    end = ceph_clock_now(g_ceph_context);
+    tp.stop();
+  } else {
+    KeyedWQ wq(&tp, work_us);
+    tp.start();
+    start = ceph_clock_now(g_ceph_context);
+    for (int i = 0; i < items; i++)
+      wq.queue(v[i]);
+    wq.drain();
+    end = ceph_clock_now(g_ceph_context);
+    tp.stop();
+  }
+
+  for (int i = 0; i < items; i++)
+    delete v[i];
+  end -= start;
+  return (double)items / (double)end;
+}
+
+void usage()
+{
+  cout << "usage: bench_workqueue [--max-threads n] [--items n] [--keys n] [--work-us n]" << std::endl;
+  cout << "  runs each pool mode with 1..max-threads threads, once with no-op" << std::endl;
+  cout << "  items and once with items that spin for work-us microseconds" << std::endl;
+  exit(1);
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY,
+	      CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  int max_threads = 8;
+  int items = 200000;
+  int keys = 1024;
+  int work_us = 5;
+
+  std::ostringstream err;
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage();
+    } else if (ceph_argparse_withint(args, i, &max_threads, &err, "--max-threads", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &items, &err, "--items", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &keys, &err, "--keys", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &work_us, &err, "--work-us", (char*)NULL)) {
+    } else {
+      ++i;
+    }
+    if (!err.str().empty()) {
+      cerr << err.str() << std::endl;
+      usage();
+    }
+  }
+  if (max_threads < 1 || items < 1 || keys < 1 || work_us < 0)
+    usage();
+
+  int work[2] = { 0, work_us };
+  cout << "mode\twork_us\tthreads\titems/sec" << std::endl;
+  for (int w = 0; w < 2; w++) {
+    for (int mode = MODE_CLASSIC; mode <= MODE_STEALING; mode++) {
+      for (int t = 1; t <= max_threads; t++) {
+	double rate = run(mode, t, items, keys, work[w]);
+	cout << mode_name[mode] << "\t" << work[w] << "\t" << t << "\t"
+	     << (uint64_t)rate << std::endl;
+      }
+    }
+  }
+  return 0;
+}
@@ -75,3 +75,23 @@ TEST(BufferList, TestCopyAll) {
   bl2.copy(0, BIG_SZ, (char*)big2);
   ASSERT_EQ(memcmp(big.get(), big2, BIG_SZ), 0);
 }
+
+TEST(BufferList, IsZero) {
+  bufferlist bl;
+  ASSERT_TRUE(bl.is_zero());
+  bufferptr a(4096);
+  a.zero();
+  bl.append(a);
+  ASSERT_TRUE(bl.is_zero());
+  bufferptr b(1);
+  b.zero();
+  bl.append(b);
+  ASSERT_TRUE(bl.is_zero());
+  bl.append("x", 1);
+  ASSERT_FALSE(bl.is_zero());
+  a.c_str()[4095] = 1;
+  ASSERT_FALSE(a.is_zero());
+  a.c_str()[4095] = 0;
+  a.c_str()[0] = 1;
+  ASSERT_FALSE(a.is_zero());
+}
@@ -7,13 +7,25 @@
                            specify output for for (de)compilation
      --build --num_osds N layer1 ...
                            build a new map, where each 'layer' is
-                             'name (uniform|straw|list|tree) size'
+                             'name (uniform|straw|straw_tree|list|tree) size'
      -i mapfn --test       test a range of inputs on the map
         [--min-x x] [--max-x x] [--x x]
         [--min-rule r] [--max-rule r] [--rule r]
         [--num-rep n]
         [--weight|-w devno weight]
                            where weight is 0 to 1.0
+        [--compare mapfn]
+                           also map each input with another map, and
+                           report how much data moves and the time
+                           each map takes
+     -i mapfn --simulate edits
+        [--min-x x] [--max-x x] [--min-rule r] [--max-rule r] [--rule r]
+        [--num-rep n] [--weight|-w devno weight] [--threads n]
+        [--pg-bytes bytes] [--pg-sizes file]
+                           apply the edits in the given file to a copy
+                           of the map, map inputs (pgs) through both, and
+                           report data movement and device utilization
+                           as JSON
      -i mapfn --add-item id weight name [--loc type name ...]
                            insert an item into the hierarchy at the
                            given location
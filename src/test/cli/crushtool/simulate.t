@@ -0,0 +1,34 @@
+  $ crushtool -c "$TESTDIR/straw37.crush" -o straw37
+  $ cat > edits <<EOF2
+  > # a new, bigger device, and one taken out
+  > add 37 2.0 device37 host=host root=root
+  > weight 3 0
+  > EOF2
+  $ crushtool -i straw37 --simulate edits --num-rep 1 --max-x 9999 --threads 2 | grep -v 'mapping_time\|threads'
+  { "edits": [
+          "add 37 2.0 device37 host=host root=root",
+          "weight 3 0"],
+    "rules": [
+          { "rule": 0,
+            "name": "data",
+            "pgs": 10000,
+            "pgs_changed": 933,
+            "pgs_changed_fraction": "0.093300",
+            "replicas": 10000,
+            "replicas_moved": 933,
+            "replicas_moved_fraction": "0.093300",
+            "bytes": 10000,
+            "bytes_moved": 933,
+            "bytes_moved_fraction": "0.093300",
+            "before": { "devices": 37,
+                "utilization_mean": "0.987070",
+                "utilization_variance": "0.004971",
+                "utilization_stddev": "0.070504",
+                "utilization_min": "0.800000",
+                "utilization_max": "1.094400"},
+            "after": { "devices": 37,
+                "utilization_mean": "0.985853",
+                "utilization_variance": "0.005426",
+                "utilization_stddev": "0.073664",
+                "utilization_min": "0.805200",
+                "utilization_max": "1.108800"}}]}
@@ -0,0 +1,44 @@
+# these mappings were computed one hash at a time; the vectorized
+# straw hashing must reproduce them exactly
+  $ crushtool -c "$TESTDIR/straw37.crush" -o straw37
+  $ crushtool -i straw37 --test --num-rep 1 --max-x 9999 --weight 3 0.5
+  devices weights (hex): [10000,10000,10000,8000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000,10000]
+  rule 0 (data), x = 0..9999
+   device 0:\t327 (esc)
+   device 1:\t320 (esc)
+   device 2:\t298 (esc)
+   device 3:\t142 (esc)
+   device 4:\t332 (esc)
+   device 5:\t321 (esc)
+   device 6:\t341 (esc)
+   device 7:\t310 (esc)
+   device 8:\t344 (esc)
+   device 9:\t332 (esc)
+   device 10:\t161 (esc)
+   device 11:\t139 (esc)
+   device 12:\t142 (esc)
+   device 13:\t128 (esc)
+   device 14:\t141 (esc)
+   device 15:\t138 (esc)
+   device 16:\t154 (esc)
+   device 17:\t156 (esc)
+   device 18:\t131 (esc)
+   device 19:\t144 (esc)
+   device 20:\t308 (esc)
+   device 21:\t320 (esc)
+   device 22:\t340 (esc)
+   device 23:\t309 (esc)
+   device 24:\t312 (esc)
+   device 25:\t322 (esc)
+   device 26:\t320 (esc)
+   device 27:\t334 (esc)
+   device 28:\t344 (esc)
+   device 29:\t346 (esc)
+   device 30:\t301 (esc)
+   device 31:\t303 (esc)
+   device 32:\t323 (esc)
+   device 33:\t337 (esc)
+   device 34:\t321 (esc)
+   device 35:\t331 (esc)
+   device 36:\t328 (esc)
+   result size 1x:\t10000 (esc)
@@ -0,0 +1,10 @@
+  $ cp "$TESTDIR/straw_tree.crush" .
+  $ crushtool -c straw_tree.crush -o st.compiled
+  $ crushtool -d st.compiled -o st.conf
+  $ cmp straw_tree.crush st.conf
+
+# adding a device moves data to it, and a little between its new
+# siblings, but nowhere else
+  $ crushtool -i st.compiled --add-item 40 1.0 device40 --loc host host -o st.added > /dev/null
+  $ crushtool -i st.added --test --num-rep 1 --max-x 9999 --compare st.compiled | grep changed
+   compare changed 402/10000 inputs, moved 402/10000 replicas (4.02%)
@@ -4,4 +4,6 @@
      --export-crush <file>   write osdmap's crush map to <file>
      --import-crush <file>   replace osdmap's crush map with <file>
      --test-map-pg <pgid>    map a pgid to osds
+     --test-map-pgs          map every pg, timing CRUSH against the mapping table
+     --mapping-threads <n>   worker threads for the mapping table
   [1]
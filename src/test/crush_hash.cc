@@ -0,0 +1,49 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+extern "C" {
+#include "crush/hash.h"
+}
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+
+// the batched hash must match the scalar one for every length, so
+// every vector width and the scalar tail get exercised, and for
+// unaligned input
+TEST(CrushHash, ManyMatchesScalar)
+{
+  srand(1);
+  __u32 in[100], out[100];
+  for (int i = 0; i < 100; i++)
+    in[i] = rand() - RAND_MAX / 2;
+  for (int n = 0; n < 67; n++) {
+    for (int off = 0; off < 3; off++) {
+      __u32 a = rand(), c = rand() % 10;
+      crush_hash32_3_many(CRUSH_HASH_RJENKINS1, a, in + off, c, out, n);
+      for (int i = 0; i < n; i++)
+	ASSERT_EQ(crush_hash32_3(CRUSH_HASH_RJENKINS1, a, in[off + i], c), out[i])
+	  << "n " << n << " off " << off << " i " << i;
+    }
+  }
+}
+
+TEST(CrushHash, ManyUnknownType)
+{
+  __u32 in[5] = { 1, 2, 3, 4, 5 }, out[5];
+  crush_hash32_3_many(-1, 1, in, 2, out, 5);
+  for (int i = 0; i < 5; i++)
+    ASSERT_EQ(0u, out[i]);
+}
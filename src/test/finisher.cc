@@ -0,0 +1,121 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "include/Context.h"
+#include "common/Finisher.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "test/unit.h"
+
+#include <unistd.h>
+
+struct C_Append : public Context {
+  Mutex *lock;
+  vector<int> *out;
+  int n;
+  int *rval;
+  C_Append(Mutex *l, vector<int> *o, int n_, int *rv = NULL)
+    : lock(l), out(o), n(n_), rval(rv) {}
+  void finish(int r) {
+    Mutex::Locker l(*lock);
+    out->push_back(n);
+    if (rval)
+      *rval = r;
+  }
+};
+
+struct C_Block : public Context {
+  Mutex lock;
+  Cond cond;
+  bool started, go;
+  C_Block() : lock("C_Block::lock"), started(false), go(false) {}
+  void finish(int r) {
+    Mutex::Locker l(lock);
+    started = true;
+    cond.Signal();
+    while (!go)
+      cond.Wait(lock);
+  }
+  void wait_started() {
+    Mutex::Locker l(lock);
+    while (!started)
+      cond.Wait(lock);
+  }
+  void release() {
+    Mutex::Locker l(lock);
+    go = true;
+    cond.Signal();
+  }
+};
+
+TEST(Finisher, Order) {
+  Mutex lock("Finisher::Order::lock");
+  vector<int> out;
+  int rval = 0;
+  Finisher fin(g_ceph_context);
+  fin.start();
+  for (int i = 0; i < 1000; i++)
+    fin.queue(new C_Append(&lock, &out, i, &rval), i);
+  fin.wait_for_empty();
+  fin.stop();
+  ASSERT_EQ(1000u, out.size());
+  for (int i = 0; i < 1000; i++)
+    ASSERT_EQ(i, out[i]);
+  ASSERT_EQ(999, rval);
+}
+
+TEST(Finisher, KeyedOrder) {
+  Mutex lock("Finisher::KeyedOrder::lock");
+  const int keys = 16;
+  vector<int> out[keys];
+  Finisher fin(g_ceph_context, "test-keyed", 4);
+  fin.start();
+  for (int i = 0; i < 10000; i++) {
+    int k = i % keys;
+    fin.queue(new C_Append(&lock, &out[k], i), 0, k);
+  }
+  fin.wait_for_empty();
+  fin.stop();
+  for (int k = 0; k < keys; k++) {
+    ASSERT_EQ(10000u / keys, out[k].size());
+    for (unsigned i = 1; i < out[k].size(); i++)
+      ASSERT_LT(out[k][i-1], out[k][i]);
+  }
+}
+
+TEST(Finisher, HighFirst) {
+  Mutex lock("Finisher::HighFirst::lock");
+  vector<int> out;
+  Finisher fin(g_ceph_context);
+  fin.start();
+
+  // hold the thread so everything below is pending at once
+  C_Block *block = new C_Block;
+  fin.queue(block);
+  block->wait_started();
+  for (int i = 0; i < 10; i++)
+    fin.queue(new C_Append(&lock, &out, i));
+  for (int i = 10; i < 20; i++)
+    fin.queue(new C_Append(&lock, &out, i), 0, 0, Finisher::PRIO_HIGH);
+  block->release();
+
+  fin.wait_for_empty();
+  fin.stop();
+  ASSERT_EQ(20u, out.size());
+  for (int i = 0; i < 10; i++)
+    ASSERT_EQ(10 + i, out[i]);
+  for (int i = 10; i < 20; i++)
+    ASSERT_EQ(i - 10, out[i]);
+}
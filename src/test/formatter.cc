@@ -56,6 +56,33 @@ TEST(JsonFormatter, Empty) {
   ASSERT_EQ(oss.str(), "");
 }
 
+TEST(JsonFormatter, Stream) {
+  ostringstream oss;
+  JSONFormatter plain(false);
+  bufferlist bl;
+  JSONFormatter fmt(false);
+  fmt.set_flush_target(&bl, 100);
+  plain.open_array_section("a");
+  fmt.open_array_section("a");
+  for (int i = 0; i < 1000; i++) {
+    plain.open_object_section("o");
+    plain.dump_int("i", i);
+    plain.dump_stream("s") << "x" << i;
+    plain.close_section();
+    fmt.open_object_section("o");
+    fmt.dump_int("i", i);
+    fmt.dump_stream("s") << "x" << i;
+    fmt.close_section();
+    ASSERT_LT(fmt.get_len(), 100);
+  }
+  plain.close_section();
+  fmt.close_section();
+  plain.flush(oss);
+  ASSERT_GT(bl.length(), 0u);
+  fmt.flush(bl);
+  ASSERT_EQ(oss.str(), string(bl.c_str(), bl.length()));
+}
+
 TEST(XmlFormatter, Simple1) {
   ostringstream oss;
   XMLFormatter fmt(false);
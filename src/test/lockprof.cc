@@ -0,0 +1,120 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "common/Formatter.h"
+#include "common/Mutex.h"
+#include "common/RWLock.h"
+#include "common/Thread.h"
+#include "common/lockdep.h"
+#include "common/lockprof.h"
+#include "test/unit.h"
+
+#include <sstream>
+#include <unistd.h>
+
+struct Hammer : public Thread {
+  Mutex *m;
+  int n;
+  Hammer(Mutex *m_, int n_) : m(m_), n(n_) {}
+  void *entry() {
+    for (int i = 0; i < n; i++) {
+      m->Lock();
+      usleep(10);
+      m->Unlock();
+    }
+    return 0;
+  }
+};
+
+static string dump()
+{
+  JSONFormatter f;
+  lockprof_dump(&f, 10);
+  ostringstream ss;
+  f.flush(ss);
+  return ss.str();
+}
+
+TEST(LockProf, Contention) {
+  lockprof_reset();
+  g_lockprof = 1;
+
+  Mutex hot("LockProf::hot");
+  Mutex cold("LockProf::cold");
+  Hammer a(&hot, 500), b(&hot, 500);
+  a.create();
+  b.create();
+  for (int i = 0; i < 100; i++) {
+    cold.Lock();
+    cold.Unlock();
+  }
+  a.join();
+  b.join();
+
+  RWLock rw("LockProf::rw");
+  rw.get_write();
+  rw.unlock();
+
+  g_lockprof = 0;
+
+  string s = dump();
+  size_t h = s.find("LockProf::hot");
+  size_t c = s.find("LockProf::cold");
+  ASSERT_NE(string::npos, h);
+  ASSERT_NE(string::npos, c);
+  ASSERT_NE(string::npos, s.find("LockProf::rw"));
+  ASSERT_LT(h, c);   // the contended lock sorts first
+
+  lockprof_reset();
+  ASSERT_EQ(string::npos, dump().find("LockProf::hot"));
+}
+
+TEST(LockProf, Sampling) {
+  lockprof_reset();
+  g_lockprof = 10;
+  lockprof_countdown = 0;
+
+  Mutex m("LockProf::sampled");
+  for (int i = 0; i < 100; i++) {
+    m.Lock();
+    m.Unlock();
+  }
+  g_lockprof = 0;
+
+  ASSERT_NE(string::npos, dump().find("\"samples\":10,"));
+}
+
+TEST(Lockdep, Order) {
+  g_lockdep = 1;
+  {
+    Mutex a("Lockdep::a"), b("Lockdep::b");
+    a.Lock();
+    b.Lock();
+    b.Unlock();
+    a.Unlock();
+
+    // same order again is fine
+    a.Lock();
+    b.Lock();
+    b.Unlock();
+    a.Unlock();
+
+    ASSERT_DEATH({
+	b.Lock();
+	a.Lock();
+      }, "");
+  }
+  g_lockdep = 0;
+}
@@ -0,0 +1,74 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "msg/Message.h"
+#include "mon/Session.h"
+#include "messages/MMonCommand.h"
+#include "messages/MForward.h"
+#include "test/unit.h"
+
+static MMonCommand *make_request(unsigned features)
+{
+  uuid_d fsid;
+  MMonCommand *req = new MMonCommand(fsid, 0);
+  req->cmd.push_back("osd");
+  req->cmd.push_back("getmap");
+  Connection *c = new Connection;
+  c->set_features(features);
+  req->set_connection(c);
+  return req;
+}
+
+TEST(MForward, CarriesClientFeatures) {
+  unsigned features = CEPH_FEATURE_NOSRCADDR | CEPH_FEATURE_PGID64;
+  MMonCommand *req = make_request(features);
+  MForward *fwd = new MForward(1, req, MonCaps(), features);
+
+  bufferlist bl;
+  encode_message(g_ceph_context, fwd, bl);
+  fwd->put();
+
+  bufferlist::iterator p = bl.begin();
+  MForward *out = (MForward *)decode_message(g_ceph_context, p);
+  ASSERT_TRUE(out != NULL);
+  ASSERT_EQ(MSG_FORWARD, out->get_type());
+  ASSERT_EQ(features, out->con_features);
+  ASSERT_TRUE(out->msg != NULL);
+  ASSERT_EQ(MSG_MON_COMMAND, out->msg->get_type());
+  out->put();
+}
+
+TEST(MForward, OldSenderMeansAllFeatures) {
+  // what a mon that predates con_features puts on the wire
+  MMonCommand *req = make_request(0);
+  bufferlist payload;
+  uint64_t tid = 1;
+  entity_inst_t client;
+  ::encode(tid, payload);
+  ::encode(client, payload);
+  ::encode(MonCaps(), payload);
+  encode_message(g_ceph_context, req, payload);
+  req->put();
+
+  MForward *fwd = new MForward;
+  fwd->get_header().version = 1;
+  fwd->set_payload(payload);
+  fwd->decode_payload(g_ceph_context);
+
+  // features are unknown, so don't have the leader downgrade the
+  // encoding; the forwarding mon re-encodes the reply for its client
+  ASSERT_EQ((unsigned)-1, fwd->con_features);
+  ASSERT_TRUE(fwd->msg != NULL);
+  fwd->put();
+}
@@ -0,0 +1,205 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "common/config.h"
+#include "mon/MonitorStore.h"
+#include "mon/MonitorStoreLog.h"
+#include "test/unit.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define DIR "mon_store_test_temp_dir"
+#define LOG "mon_store_test_temp_log"
+
+static bufferlist make_bl(const char *s)
+{
+  bufferlist bl;
+  bl.append(s);
+  return bl;
+}
+
+static string get_str(MonitorStore& store, const char *a, const char *b)
+{
+  bufferlist bl;
+  if (store.get_bl_ss(bl, a, b) < 0)
+    return "(none)";
+  return string(bl.c_str(), bl.length());
+}
+
+static void check_store(const char *backend)
+{
+  md_config_t *conf = g_ceph_context->_conf;
+  ASSERT_EQ(0, conf->set_val("internal_safe_to_start_threads", "false"));
+  ASSERT_EQ(0, conf->set_val("mon_store_backend", backend));
+  conf->apply_changes(NULL);
+  ASSERT_EQ(0, conf->set_val("internal_safe_to_start_threads", "true"));
+  {
+    MonitorStore store(DIR);
+    ASSERT_EQ(0, store.mkfs());
+    ASSERT_EQ(0, store.mount());
+
+    store.put_int(42, "foo", "last_committed");
+    bufferlist bl = make_bl("one");
+    store.put_bl_sn(bl, "foo", 1);
+
+    store.start_transaction();
+    bl = make_bl("two");
+    store.put_bl_sn(bl, "foo", 2);
+    bl = make_bl("latest");
+    store.put_bl_ss(bl, "foo", "latest");
+    store.erase_sn("foo", 1);
+    ASSERT_FALSE(store.exists_bl_sn("foo", 1));  // reads see the transaction
+    ASSERT_EQ("two", get_str(store, "foo", "2"));
+    store.commit_transaction();
+
+    ASSERT_EQ(42u, store.get_int("foo", "last_committed"));
+    ASSERT_EQ(0u, store.get_int("foo", "nope"));
+    ASSERT_EQ(0, store.umount());
+  }
+
+  MonitorStore store(DIR);
+  ASSERT_EQ(0, store.mount());
+  ASSERT_EQ(42u, store.get_int("foo", "last_committed"));
+  ASSERT_FALSE(store.exists_bl_sn("foo", 1));
+  ASSERT_EQ("two", get_str(store, "foo", "2"));
+  ASSERT_EQ("latest", get_str(store, "foo", "latest"));
+  ASSERT_EQ("(none)", get_str(store, "foo", "3"));
+  ASSERT_EQ(0, store.umount());
+}
+
+TEST(MonitorStore, File)
+{
+  check_store("file");
+  struct stat st;
+  ASSERT_NE(0, ::stat(DIR "/store.log", &st));
+}
+
+TEST(MonitorStore, Log)
+{
+  check_store("log");
+  struct stat st;
+  ASSERT_EQ(0, ::stat(DIR "/store.log", &st));
+  ASSERT_NE(0, ::stat(DIR "/foo", &st));  // no file per key
+}
+
+TEST(MonitorStoreLog, TornTail)
+{
+  ASSERT_EQ(0, MonitorStoreLog::create(LOG));
+  {
+    MonitorStoreLog log(LOG);
+    ASSERT_EQ(0, log.open());
+    bufferlist bl = make_bl("a");
+    ASSERT_EQ(0, log.put("a", bl));
+    log.start_transaction();
+    bl = make_bl("b");
+    log.put("b", bl);
+    bl = make_bl("c");
+    log.put("c", bl);
+    ASSERT_EQ(0, log.commit_transaction());
+  }
+
+  // half of another transaction
+  struct stat st;
+  ASSERT_EQ(0, ::stat(LOG, &st));
+  uint64_t good = st.st_size;
+  int fd = ::open(LOG, O_WRONLY|O_APPEND);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(8, ::write(fd, "\x6d\x6f\x6e\x6c\x40\0\0\0", 8));
+  ::close(fd);
+
+  MonitorStoreLog log(LOG);
+  ASSERT_EQ(0, log.open());
+  ASSERT_EQ(good, log.get_size());
+  ASSERT_EQ(0, ::stat(LOG, &st));
+  ASSERT_EQ(good, (uint64_t)st.st_size);
+  bufferlist bl;
+  ASSERT_EQ(1, log.get("c", bl));
+  ASSERT_EQ('c', bl[0]);
+  ASSERT_EQ(3u, log.get_live());
+
+  // and it carries on from there
+  bl = make_bl("d");
+  ASSERT_EQ(0, log.put("d", bl));
+  log.close();
+  ASSERT_EQ(0, log.open());
+  ASSERT_TRUE(log.exists("d"));
+  ::unlink(LOG);
+}
+
+TEST(MonitorStoreLog, Compact)
+{
+  ASSERT_EQ(0, MonitorStoreLog::create(LOG));
+  MonitorStoreLog log(LOG);
+  ASSERT_EQ(0, log.open());
+  log.set_compaction(64 << 10, 2.0);
+
+  // overwrite a few keys over and over, like last_committed
+  bufferlist v;
+  v.append(string(1000, 'x'));
+  for (int i = 0; i < 1000; i++) {
+    char k[20];
+    snprintf(k, sizeof(k), "k%d", i % 10);
+    bufferlist bl = v;
+    ::encode(i, bl);
+    ASSERT_EQ(0, log.put(k, bl));
+    ASSERT_LT(log.get_size(), 64u << 10);
+  }
+  ASSERT_GT(log.get_num_compactions(), 0u);
+  ASSERT_EQ(10 * 1004u, log.get_live());
+
+  log.close();
+  ASSERT_EQ(0, log.open());
+  for (int i = 0; i < 10; i++) {
+    char k[20];
+    snprintf(k, sizeof(k), "k%d", i);
+    bufferlist bl;
+    ASSERT_EQ(1004, log.get(k, bl));
+    bufferlist::iterator p = bl.begin();
+    p.advance(1000);
+    int n;
+    ::decode(n, p);
+    ASSERT_EQ(990 + i, n);
+  }
+  ::unlink(LOG);
+}
+
+TEST(MonitorStoreLog, CompactSmallValues)
+{
+  ASSERT_EQ(0, MonitorStoreLog::create(LOG));
+  MonitorStoreLog log(LOG);
+  ASSERT_EQ(0, log.open());
+  log.set_compaction(1024, 2.0);
+
+  // the keys and encoding outweigh the values; a compacted log must not
+  // look like it is due for compaction again
+  for (int i = 0; i < 500; i++) {
+    char k[20];
+    snprintf(k, sizeof(k), "key%d", i % 100);
+    bufferlist bl = make_bl("v");
+    ASSERT_EQ(0, log.put(k, bl));
+  }
+  ASSERT_GT(log.get_num_compactions(), 0u);
+  ASSERT_LT(log.get_num_compactions(), 20u);
+  ASSERT_EQ(100u, log.get_live());
+
+  unsigned n = log.get_num_compactions();
+  ASSERT_EQ(0, log.compact());
+  bufferlist bl = make_bl("w");
+  ASSERT_EQ(0, log.put("key0", bl));
+  ASSERT_EQ(n + 1, log.get_num_compactions());
+  ::unlink(LOG);
+}
@@ -0,0 +1,242 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "include/Context.h"
+#include "common/Cond.h"
+#include "common/Finisher.h"
+#include "common/Mutex.h"
+#include "global/global_context.h"
+#include "osdc/ObjectCacher.h"
+#include "osdc/WritebackHandler.h"
+#include "test/unit.h"
+
+/*
+ * In-memory backend.  Like librbd, completions are delivered from a
+ * finisher thread that takes the cache lock first.
+ */
+class MemWriteback : public WritebackHandler {
+public:
+  map<object_t, bufferlist> store;
+  vector<object_t> write_order;
+  int reads, writes;
+
+  MemWriteback(Mutex& l)
+    : reads(0), writes(0), m_lock(l), m_tid(0), m_finisher(g_ceph_context) {
+    m_finisher.start();
+  }
+  ~MemWriteback() {
+    m_finisher.stop();
+  }
+
+  struct C_Locked : public Context {
+    Mutex& lock;
+    Context *ctx;
+    C_Locked(Mutex& l, Context *c) : lock(l), ctx(c) {}
+    void finish(int r) {
+      Mutex::Locker l(lock);
+      ctx->complete(r);
+    }
+  };
+
+  virtual tid_t read(const object_t& oid, const object_locator_t& oloc,
+		     uint64_t off, uint64_t len, snapid_t snapid,
+		     bufferlist *pbl, uint64_t trunc_size, __u32 trunc_seq,
+		     Context *onfinish) {
+    reads++;
+    bufferlist& o = store[oid];
+    if (off < o.length())
+      pbl->substr_of(o, off, MIN(len, o.length() - off));
+    m_finisher.queue(new C_Locked(m_lock, onfinish), pbl->length());
+    return ++m_tid;
+  }
+
+  virtual tid_t write(const object_t& oid, const object_locator_t& oloc,
+		      uint64_t off, uint64_t len, const SnapContext& snapc,
+		      const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
+		      __u32 trunc_seq, Context *oncommit) {
+    writes++;
+    write_order.push_back(oid);
+    bufferlist& o = store[oid];
+    if (o.length() < off + len) {
+      bufferptr bp(off + len - o.length());
+      bp.zero();
+      o.push_back(bp);
+    }
+    bufferlist n;
+    n.substr_of(o, 0, off);
+    n.append(bl);
+    if (off + len < o.length()) {
+      bufferlist tail;
+      tail.substr_of(o, off + len, o.length() - off - len);
+      n.claim_append(tail);
+    }
+    o.swap(n);
+    m_finisher.queue(new C_Locked(m_lock, oncommit), 0);
+    return ++m_tid;
+  }
+
+private:
+  Mutex& m_lock;
+  tid_t m_tid;
+  Finisher m_finisher;
+};
+
+class ObjectCacherTest : public ::testing::Test {
+public:
+  Mutex lock;
+  MemWriteback wb;
+  ObjectCacher *oc;
+  ObjectCacher::ObjectSet oset;
+
+  ObjectCacherTest()
+    : lock("ObjectCacherTest::lock"), wb(lock), oset(NULL, 0, 0) {
+    oc = new ObjectCacher(g_ceph_context, wb, lock, NULL, NULL,
+			  1 << 20, 256 << 10, 128 << 10, 30.0);
+    oc->start();
+  }
+  ~ObjectCacherTest() {
+    oc->stop();
+    lock.Lock();
+    flush();
+    oc->release_set(&oset);
+    lock.Unlock();
+    delete oc;
+  }
+
+  void extent(vector<ObjectExtent>& v, const char *oid, uint64_t off, uint64_t len) {
+    ObjectExtent ex(object_t(oid), off, len);
+    ex.oloc = object_locator_t(0);
+    ex.buffer_extents[0] = len;
+    v.push_back(ex);
+  }
+
+  void write(const char *oid, uint64_t off, uint64_t len, char c) {
+    bufferlist bl;
+    bufferptr bp(len);
+    memset(bp.c_str(), c, len);
+    bl.push_back(bp);
+    Mutex::Locker l(lock);
+    ObjectCacher::OSDWrite *wr = oc->prepare_write(SnapContext(), bl, utime_t(), 0);
+    extent(wr->extents, oid, off, len);
+    oc->wait_for_write(len, lock);
+    oc->writex(wr, &oset);
+  }
+
+  int read(const char *oid, uint64_t off, uint64_t len, bufferlist *pbl) {
+    Mutex flock("ObjectCacherTest::read");
+    Cond cond;
+    bool done = false;
+    int rval = 0;
+    Context *onfinish = new C_SafeCond(&flock, &cond, &done, &rval);
+    Mutex::Locker l(lock);
+    ObjectCacher::OSDRead *rd = oc->prepare_read(CEPH_NOSNAP, pbl, 0);
+    extent(rd->extents, oid, off, len);
+    int r = oc->readx(rd, &oset, onfinish);
+    if (r != 0) {
+      delete onfinish;
+      return r;
+    }
+    while (!done)
+      cond.Wait(lock);
+    return rval;
+  }
+
+  void flush() {
+    Mutex flock("ObjectCacherTest::flush");
+    Cond cond;
+    bool done = false;
+    if (!oc->flush_set(&oset, new C_SafeCond(&flock, &cond, &done)))
+      while (!done)
+	cond.Wait(lock);
+  }
+};
+
+TEST_F(ObjectCacherTest, WriteBack)
+{
+  write("a", 0, 4096, 'x');
+  write("a", 4096, 4096, 'y');
+
+  // still dirty; nothing has gone to the backend
+  {
+    Mutex::Locker l(lock);
+    ASSERT_EQ(0, wb.writes);
+    ASSERT_TRUE(oc->set_is_dirty_or_committing(&oset));
+  }
+
+  bufferlist bl;
+  ASSERT_EQ(8192, read("a", 0, 8192, &bl));
+  ASSERT_EQ(0, wb.reads);
+  ASSERT_EQ('x', bl[4095]);
+  ASSERT_EQ('y', bl[4096]);
+
+  Mutex::Locker l(lock);
+  flush();
+  ASSERT_FALSE(oc->set_is_dirty_or_committing(&oset));
+  ASSERT_EQ(1, wb.writes);  // adjacent writes were coalesced
+  ASSERT_EQ(8192u, wb.store[object_t("a")].length());
+}
+
+TEST_F(ObjectCacherTest, ReadMiss)
+{
+  bufferptr bp(100);
+  memset(bp.c_str(), 'z', 100);
+  wb.store[object_t("b")].push_back(bp);
+
+  // a short object reads back zero-filled
+  bufferlist bl;
+  ASSERT_EQ(200, read("b", 0, 200, &bl));
+  ASSERT_EQ(1, wb.reads);
+  ASSERT_EQ('z', bl[99]);
+  ASSERT_EQ(0, bl[100]);
+
+  // and is cached now
+  bufferlist bl2;
+  ASSERT_EQ(100, read("b", 50, 100, &bl2));
+  ASSERT_EQ(1, wb.reads);
+}
+
+TEST_F(ObjectCacherTest, MaxDirty)
+{
+  // more than max_dirty forces writeback without an explicit flush
+  for (int i = 0; i < 8; i++)
+    write("c", i << 16, 1 << 16, 'a' + i);
+  Mutex::Locker l(lock);
+  ASSERT_LT(0, wb.writes);
+}
+
+TEST_F(ObjectCacherTest, DirtyAgeOrder)
+{
+  write("a", 0, 64 << 10, 'a');
+  write("b", 0, 64 << 10, 'b');
+  {
+    Mutex::Locker l(lock);
+    ASSERT_TRUE(oc->set_is_dirty_or_committing(&oset));
+    ASSERT_FALSE(oc->set_is_cached(&oset));
+  }
+
+  // a read hit must not make a look younger than b
+  bufferlist bl;
+  ASSERT_EQ(64 << 10, read("a", 0, 64 << 10, &bl));
+
+  // going over target_dirty writes back the oldest data first
+  write("c", 0, 64 << 10, 'c');
+  Mutex::Locker l(lock);
+  while (wb.writes == 0) {
+    lock.Unlock();
+    usleep(1000);
+    lock.Lock();
+  }
+  ASSERT_EQ(object_t("a"), wb.write_order[0]);
+}
@@ -0,0 +1,122 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "osd/OSDMap.h"
+#include "test/unit.h"
+
+#include <stdlib.h>
+
+class OSDMapMappingTest : public ::testing::Test {
+public:
+  OSDMap osdmap;
+
+  OSDMapMappingTest() {
+    uuid_d fsid;
+    memset(&fsid, 0, sizeof(fsid));
+    OSDMap m;
+    m.build_simple(g_ceph_context, 1, fsid, 16, 6, 6, 0);
+    for (int i = 0; i < 16; i++)
+      m.set_weight(i, CEPH_OSD_IN);
+    // the crush map is only finalized by a round trip, like the mon's
+    bufferlist bl;
+    m.encode(bl);
+    osdmap.decode(bl);
+  }
+
+  // compare every pg, and a spread of raw pgs, against CRUSH
+  void check(const OSDMap& plain) {
+    ASSERT_TRUE(osdmap.get_mapping() != NULL);
+    ASSERT_TRUE(plain.get_mapping() == NULL);
+    srand(1);
+    for (map<int64_t,pg_pool_t>::const_iterator p = osdmap.get_pools().begin();
+	 p != osdmap.get_pools().end();
+	 ++p) {
+      for (ps_t ps = 0; ps < p->second.get_pg_num() * 2; ps++) {
+	pg_t pg(ps < p->second.get_pg_num() ? ps : rand(), p->first, -1);
+	vector<int> a, b;
+	osdmap.pg_to_osds(pg, a);
+	plain.pg_to_osds(pg, b);
+	ASSERT_EQ(b, a) << pg;
+      }
+    }
+  }
+
+  void apply(OSDMap::Incremental& inc) {
+    inc.fsid = osdmap.get_fsid();
+    inc.epoch = osdmap.get_epoch() + 1;
+    ASSERT_EQ(0, osdmap.apply_incremental(inc));
+  }
+
+  // a copy without the table
+  void get_plain(OSDMap& plain) {
+    bufferlist bl;
+    osdmap.encode(bl);
+    plain.decode(bl);
+  }
+};
+
+TEST_F(OSDMapMappingTest, MatchesCrush)
+{
+  OSDMap plain;
+  get_plain(plain);
+  osdmap.update_mapping(4);
+  ASSERT_EQ(osdmap.get_pools().size(), osdmap.get_mapping()->get_num_computed());
+  check(plain);
+
+  // one thread builds the same table
+  osdmap.update_mapping(1, &plain);
+  check(plain);
+}
+
+TEST_F(OSDMapMappingTest, Incremental)
+{
+  osdmap.update_mapping(4);
+
+  // osds going up doesn't change any raw mapping
+  OSDMap::Incremental inc;
+  for (int i = 0; i < 8; i++)
+    inc.new_state[i] = CEPH_OSD_UP;
+  apply(inc);
+  ASSERT_TRUE(osdmap.get_mapping() == NULL);  // stale until updated
+  osdmap.update_mapping(4);
+  ASSERT_EQ(0u, osdmap.get_mapping()->get_num_computed());
+  ASSERT_EQ(osdmap.get_pools().size(), osdmap.get_mapping()->get_num_shared());
+  OSDMap plain;
+  get_plain(plain);
+  check(plain);
+
+  // a reweight does
+  OSDMap::Incremental inc2;
+  inc2.new_weight[3] = CEPH_OSD_IN / 2;
+  apply(inc2);
+  osdmap.update_mapping(4);
+  ASSERT_EQ(osdmap.get_pools().size(), osdmap.get_mapping()->get_num_computed());
+  OSDMap plain2;
+  get_plain(plain2);
+  check(plain2);
+
+  // and so does a new pool, but only for itself
+  OSDMap::Incremental inc3;
+  inc3.new_pool_max = osdmap.get_pools().rbegin()->first + 1;
+  pg_pool_t pi = osdmap.get_pools().begin()->second;
+  inc3.new_pools[inc3.new_pool_max] = pi;
+  inc3.new_pool_names[inc3.new_pool_max] = "new";
+  apply(inc3);
+  osdmap.update_mapping(4);
+  ASSERT_EQ(1u, osdmap.get_mapping()->get_num_computed());
+  OSDMap plain3;
+  get_plain(plain3);
+  check(plain3);
+}
@@ -0,0 +1,201 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "mon/PGMap.h"
+#include "test/unit.h"
+
+static pg_stat_t make_stat(epoch_t e, version_t v)
+{
+  pg_stat_t s;
+  s.version = eversion_t(e, v);
+  s.reported = eversion_t(e, v);
+  s.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+  s.created = 1;
+  s.last_epoch_clean = e;
+  s.stats.sum.num_objects = v;
+  s.stats.sum.num_bytes = v << 20;
+  s.log_size = v;
+  s.up.push_back(0);
+  s.up.push_back(1);
+  s.acting = s.up;
+  return s;
+}
+
+static string encode_stat(const pg_stat_t& s)
+{
+  bufferlist bl;
+  ::encode(s, bl);
+  return string(bl.c_str(), bl.length());
+}
+
+TEST(PGStatDelta, CountersOnly)
+{
+  pg_stat_t base = make_stat(5, 10);
+  pg_stat_t cur = base;
+  cur.version = cur.reported = eversion_t(5, 11);
+  cur.stats.sum.num_objects++;
+  cur.stats.sum.num_wr++;
+  cur.log_size++;
+
+  pg_stat_delta_t d(base, cur);
+  ASSERT_EQ(base.reported, d.base_reported);
+  ASSERT_EQ((int)(pg_stat_delta_t::F_LOG | pg_stat_delta_t::F_SUM), (int)d.fields);
+  ASSERT_EQ(0, d.fields & ~pg_stat_delta_t::F_COUNTERS);
+
+  bufferlist bl;
+  ::encode(d, bl);
+  ASSERT_LT(bl.length(), encode_stat(cur).size());
+
+  bufferlist::iterator p = bl.begin();
+  pg_stat_delta_t d2;
+  ::decode(d2, p);
+  pg_stat_t s = base;
+  d2.apply(s);
+  ASSERT_EQ(encode_stat(cur), encode_stat(s));
+}
+
+TEST(PGStatDelta, Everything)
+{
+  pg_stat_t base = make_stat(5, 10);
+  pg_stat_t cur = make_stat(7, 12);
+  cur.state = PG_STATE_ACTIVE | PG_STATE_DEGRADED;
+  cur.parent = pg_t(1, 2, -1);
+  cur.parent_split_bits = 3;
+  cur.last_scrub = eversion_t(6, 1);
+  cur.last_scrub_stamp = utime_t(1000, 0);
+  cur.stats.cat_sum["foo"].num_objects = 2;
+  cur.acting.pop_back();
+
+  pg_stat_delta_t d(base, cur);
+  ASSERT_EQ(0x7f, (int)d.fields);
+  bufferlist bl;
+  ::encode(d, bl);
+  bufferlist::iterator p = bl.begin();
+  pg_stat_delta_t d2;
+  ::decode(d2, p);
+  pg_stat_t s = base;
+  d2.apply(s);
+  ASSERT_EQ(encode_stat(cur), encode_stat(s));
+
+  // nothing but reported
+  pg_stat_t again = cur;
+  again.reported = eversion_t(7, 13);
+  ASSERT_EQ(0, (int)pg_stat_delta_t(cur, again).fields);
+}
+
+TEST(PGMap, Columns)
+{
+  PGMap m;
+  PGMap::Incremental inc;
+  inc.version = 1;
+  for (int i = 0; i < 20; i++) {
+    pg_stat_t s = make_stat(10 + i, i);
+    s.stats.sum.num_rd = i * 3;
+    s.last_scrub_stamp = utime_t(100 + i, 0);
+    inc.pg_stat_updates[pg_t(i, 1, -1)] = s;
+  }
+  m.apply_incremental(inc);
+
+  bufferlist bl;
+  m.encode_pg_stats_columns(bl);
+  bufferlist::iterator p = bl.begin();
+  map<pg_t,pg_stat_t> pgs;
+  ASSERT_EQ(1u, PGMap::decode_pg_stats_columns(p, pgs));
+  ASSERT_TRUE(p.end());
+  ASSERT_EQ(20u, pgs.size());
+  for (map<pg_t,pg_stat_t>::iterator q = pgs.begin(); q != pgs.end(); ++q) {
+    const pg_stat_t& s = m.pg_stat[q->first];
+    ASSERT_EQ(s.state, q->second.state);
+    ASSERT_EQ(s.reported, q->second.reported);
+    ASSERT_EQ(s.last_epoch_clean, q->second.last_epoch_clean);
+    ASSERT_EQ(s.last_scrub_stamp, q->second.last_scrub_stamp);
+    ASSERT_EQ(s.log_size, q->second.log_size);
+    ASSERT_EQ(s.stats.sum.num_bytes, q->second.stats.sum.num_bytes);
+    ASSERT_EQ(s.stats.sum.num_rd, q->second.stats.sum.num_rd);
+    ASSERT_EQ(s.acting, q->second.acting);
+  }
+}
+
+TEST(PGMap, Aggregates)
+{
+  PGMap m;
+  m.full_ratio = .9;
+  m.nearfull_ratio = .8;
+
+  PGMap::Incremental inc;
+  inc.version = 1;
+  for (int i = 0; i < 8; i++) {
+    pg_stat_t s = make_stat(10 + i, 1);
+    s.acting.clear();
+    s.acting.push_back(i % 4);
+    s.acting.push_back((i + 1) % 4);
+    inc.pg_stat_updates[pg_t(i, 0, -1)] = s;
+  }
+  for (int i = 0; i < 4; i++) {
+    osd_stat_t os;
+    os.kb = 100;
+    os.kb_used = i == 0 ? 95 : (i == 1 ? 85 : 10);
+    os.kb_avail = os.kb - os.kb_used;
+    inc.osd_stat_updates[i] = os;
+  }
+  m.apply_incremental(inc);
+
+  ASSERT_EQ(8, m.num_pg);
+  ASSERT_EQ(4, m.num_osd);
+  ASSERT_EQ(10u, m.calc_min_last_epoch_clean());
+  for (int i = 0; i < 4; i++)
+    ASSERT_EQ(4, m.num_pg_by_osd[i]);
+  ASSERT_EQ(1u, m.full_osds.size());
+  ASSERT_EQ(1u, m.full_osds.count(0));
+  ASSERT_EQ(1u, m.nearfull_osds.count(1));
+
+  // update, remove
+  PGMap::Incremental inc2;
+  inc2.version = 2;
+  pg_stat_t s = m.pg_stat[pg_t(0, 0, -1)];
+  s.last_epoch_clean = 30;
+  s.acting.clear();
+  s.acting.push_back(3);
+  inc2.pg_stat_updates[pg_t(0, 0, -1)] = s;
+  inc2.pg_remove.insert(pg_t(1, 0, -1));
+  osd_stat_t os = m.osd_stat[1];
+  os.kb_used = 95;
+  inc2.osd_stat_updates[1] = os;
+  inc2.osd_stat_rm.insert(0);
+  m.apply_incremental(inc2);
+
+  ASSERT_EQ(7, m.num_pg);
+  ASSERT_EQ(3, m.num_osd);
+  ASSERT_EQ(12u, m.calc_min_last_epoch_clean());
+  ASSERT_EQ(3, m.num_pg_by_osd[0]);
+  ASSERT_EQ(2, m.num_pg_by_osd[1]);
+  ASSERT_EQ(3, m.num_pg_by_osd[2]);
+  ASSERT_EQ(5, m.num_pg_by_osd[3]);
+  ASSERT_EQ(1u, m.full_osds.size());
+  ASSERT_EQ(1u, m.full_osds.count(1));
+  ASSERT_EQ(0u, m.nearfull_osds.size());
+
+  // a decoded map agrees
+  bufferlist bl;
+  m.encode(bl);
+  PGMap m2;
+  bufferlist::iterator p = bl.begin();
+  m2.decode(p);
+  ASSERT_EQ(m.num_pg, m2.num_pg);
+  ASSERT_EQ(m.calc_min_last_epoch_clean(), m2.calc_min_last_epoch_clean());
+  ASSERT_EQ(m.num_pg_by_osd.size(), m2.num_pg_by_osd.size());
+  ASSERT_EQ(m.full_osds, m2.full_osds);
+  ASSERT_EQ(m.pg_sum.stats.sum.num_objects, m2.pg_sum.stats.sum.num_objects);
+}
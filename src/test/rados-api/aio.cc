@@ -691,3 +691,138 @@ TEST(LibRadosAio, RoundTripWriteFullPP) {
   delete my_completion2;
   delete my_completion3;
 }
+
+TEST(LibRadosAio, OperateBatchPP) {
+  AioTestDataPP test_data;
+  ASSERT_EQ("", test_data.init());
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  ASSERT_EQ(0, test_data.m_ioctx.write_full("exists", bl1));
+
+  std::vector<std::string> oids;
+  std::vector<ObjectWriteOperation*> ops;
+  for (int i = 0; i < 8; ++i) {
+    ostringstream oss;
+    oss << "batch" << i;
+    oids.push_back(oss.str());
+    ObjectWriteOperation *op = new ObjectWriteOperation;
+    op->write_full(bl1);
+    ops.push_back(op);
+  }
+  // the last op fails; the others still apply
+  oids.push_back("exists");
+  ObjectWriteOperation *op = new ObjectWriteOperation;
+  op->create(true);
+  ops.push_back(op);
+
+  std::vector<int> rvals;
+  AioCompletion *my_completion = test_data.m_cluster.aio_create_completion(
+	  (void*)&test_data, set_completion_complete, set_completion_safe);
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(oids, ops, my_completion,
+						   &rvals));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, my_completion->wait_for_safe());
+  }
+  ASSERT_EQ(-EEXIST, my_completion->get_return_value());
+  ASSERT_EQ(oids.size(), rvals.size());
+  for (unsigned i = 0; i < oids.size() - 1; ++i) {
+    ASSERT_EQ(0, rvals[i]);
+    bufferlist bl2;
+    ASSERT_EQ((int)sizeof(buf), test_data.m_ioctx.read(oids[i], bl2, sizeof(buf), 0));
+    ASSERT_EQ(0, memcmp(bl2.c_str(), buf, sizeof(buf)));
+  }
+  ASSERT_EQ(-EEXIST, rvals.back());
+  for (unsigned i = 0; i < ops.size(); ++i)
+    delete ops[i];
+  delete my_completion;
+}
+
+TEST(LibRadosAio, MetadataPP) {
+  AioTestDataPP test_data;
+  ASSERT_EQ("", test_data.init());
+  IoCtx& ioctx = test_data.m_ioctx;
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  ASSERT_EQ(0, ioctx.write_full("foo", bl1));
+
+  AioCompletion *c = test_data.m_cluster.aio_create_completion();
+  uint64_t size;
+  time_t mtime;
+  ASSERT_EQ(0, ioctx.aio_stat("foo", c, &size, &mtime));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, c->wait_for_complete());
+  }
+  ASSERT_EQ(0, c->get_return_value());
+  ASSERT_EQ(sizeof(buf), size);
+  ASSERT_NE(0, mtime);
+  c->release();
+
+  bufferlist val;
+  val.append("bar", 3);
+  c = test_data.m_cluster.aio_create_completion();
+  ASSERT_EQ(0, ioctx.aio_setxattr("foo", c, "attr", val));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, c->wait_for_safe());
+  }
+  ASSERT_EQ(0, c->get_return_value());
+  c->release();
+
+  bufferlist got;
+  c = test_data.m_cluster.aio_create_completion();
+  ASSERT_EQ(0, ioctx.aio_getxattr("foo", c, "attr", &got));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, c->wait_for_complete());
+  }
+  ASSERT_EQ(3, c->get_return_value());
+  ASSERT_EQ(0, memcmp(got.c_str(), "bar", 3));
+  c->release();
+
+  std::map<std::string, bufferlist> attrs;
+  c = test_data.m_cluster.aio_create_completion();
+  ASSERT_EQ(0, ioctx.aio_getxattrs("foo", c, &attrs));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, c->wait_for_complete());
+  }
+  ASSERT_EQ(0, c->get_return_value());
+  ASSERT_EQ(1u, attrs.size());
+  ASSERT_EQ(1u, attrs.count("attr"));
+  c->release();
+
+  c = test_data.m_cluster.aio_create_completion();
+  ASSERT_EQ(0, ioctx.aio_trunc("foo", c, 16));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, c->wait_for_safe());
+  }
+  ASSERT_EQ(0, c->get_return_value());
+  c->release();
+  ASSERT_EQ(0, ioctx.stat("foo", &size, NULL));
+  ASSERT_EQ(16u, size);
+
+  c = test_data.m_cluster.aio_create_completion();
+  ASSERT_EQ(0, ioctx.aio_remove("foo", c));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, c->wait_for_safe());
+  }
+  ASSERT_EQ(0, c->get_return_value());
+  c->release();
+
+  c = test_data.m_cluster.aio_create_completion();
+  ASSERT_EQ(0, ioctx.aio_stat("foo", c, &size, NULL));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, c->wait_for_complete());
+  }
+  ASSERT_EQ(-ENOENT, c->get_return_value());
+  c->release();
+}
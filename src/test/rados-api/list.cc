@@ -4,6 +4,7 @@
 
 #include "gtest/gtest.h"
 #include <errno.h>
+#include <set>
 #include <string>
 
 using namespace librados;
@@ -47,3 +48,44 @@ TEST(LibRadosList, ListObjectsPP) {
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
 }
+
+TEST(LibRadosList, AioListObjectsPP) {
+  std::string pool_name = get_temp_pool_name();
+  Rados cluster;
+  ASSERT_EQ("", create_one_pool_pp(pool_name, cluster));
+  IoCtx ioctx;
+  cluster.ioctx_create(pool_name.c_str(), ioctx);
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  std::set<std::string> written;
+  for (int i = 0; i < 10; ++i) {
+    char oid[32];
+    snprintf(oid, sizeof(oid), "foo%d", i);
+    ASSERT_EQ(0, ioctx.write_full(oid, bl1));
+    written.insert(oid);
+  }
+  AioObjectList *list = ioctx.aio_objects_list_open();
+  std::set<std::string> seen;
+  while (true) {
+    std::list<std::pair<std::string, std::string> > entries;
+    AioCompletion *c = cluster.aio_create_completion();
+    ASSERT_EQ(0, list->next(c, &entries, 3));
+    ASSERT_EQ(0, c->wait_for_complete());
+    int r = c->get_return_value();
+    c->release();
+    ASSERT_LE(0, r);
+    ASSERT_EQ((size_t)r, entries.size());
+    if (r == 0)
+      break;
+    for (std::list<std::pair<std::string, std::string> >::iterator p = entries.begin();
+	 p != entries.end(); ++p)
+      seen.insert(p->first);
+  }
+  ASSERT_TRUE(list->at_end());
+  ASSERT_TRUE(written == seen);
+  delete list;
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
+}
@@ -0,0 +1,176 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/Readahead.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+
+typedef vector<Readahead::extent_t> extents_t;
+
+static const uint64_t LIMIT = 1ull << 40;
+
+TEST(Readahead, Disabled)
+{
+  Readahead ra;
+  extents_t v;
+  for (uint64_t off = 0; off < 1 << 20; off += 4096)
+    ra.update(off, 4096, LIMIT, v);
+  ASSERT_TRUE(v.empty());
+}
+
+TEST(Readahead, Sequential)
+{
+  Readahead ra;
+  ra.set_window(64 << 10, 1 << 20);
+
+  extents_t v;
+  ra.update(0, 4096, LIMIT, v);
+  ASSERT_TRUE(v.empty());  // one read is not a stream
+
+  ra.update(4096, 4096, LIMIT, v);
+  ASSERT_EQ(1u, v.size());
+  ASSERT_EQ(8192u, v[0].first);
+  ASSERT_EQ(64u << 10, v[0].second);
+
+  // keep reading; prefetches are contiguous and the window grows
+  uint64_t end = v[0].first + v[0].second;
+  for (uint64_t off = 8192; off < 8 << 20; off += 4096) {
+    v.clear();
+    ra.update(off, 4096, LIMIT, v);
+    for (extents_t::iterator p = v.begin(); p != v.end(); ++p) {
+      ASSERT_EQ(end, p->first);
+      end += p->second;
+    }
+    ASSERT_GT(end, off + 4096);  // always ahead of the reader
+  }
+  ASSERT_EQ(1u << 20, ra.get_window());
+  ASSERT_EQ(0u, ra.get_waste());
+}
+
+TEST(Readahead, Random)
+{
+  Readahead ra;
+  ra.set_window(64 << 10, 1 << 20);
+  srand(1);
+  uint64_t bytes = 0;
+  for (int i = 0; i < 10000; i++) {
+    extents_t v;
+    ra.update((uint64_t)(rand() % 100000) * 4096, 4096, LIMIT, v);
+    for (extents_t::iterator p = v.begin(); p != v.end(); ++p)
+      bytes += p->second;
+  }
+  // only the odd accidentally adjacent pair prefetches anything
+  ASSERT_LT(bytes, 10000ull * 4096 / 100);
+}
+
+TEST(Readahead, ShortRunsShrink)
+{
+  Readahead ra;
+  ra.set_window(64 << 10, 1 << 20);
+
+  // a long run opens the window up
+  extents_t v;
+  uint64_t off = 0;
+  for (; off < 8 << 20; off += 4096)
+    ra.update(off, 4096, LIMIT, v);
+  ASSERT_EQ(1u << 20, ra.get_window());
+
+  // then pairs of reads scattered around waste most of each prefetch
+  for (int i = 1; i < 50; i++) {
+    off = (uint64_t)i << 30;
+    ra.update(off, 4096, LIMIT, v);
+    ra.update(off + 4096, 4096, LIMIT, v);
+  }
+  ASSERT_EQ(64u << 10, ra.get_window());
+  ASSERT_GT(ra.get_waste(), ra.get_hits());
+}
+
+TEST(Readahead, Strided)
+{
+  Readahead ra;
+  ra.set_window(64 << 10, 1 << 20);
+
+  // 4k records every 64k
+  extents_t v;
+  ra.update(0, 4096, LIMIT, v);
+  ra.update(65536, 4096, LIMIT, v);
+  ASSERT_TRUE(v.empty());
+  ra.update(131072, 4096, LIMIT, v);
+  ASSERT_TRUE(ra.is_strided());
+  ASSERT_FALSE(v.empty());
+  for (unsigned i = 0; i < v.size(); i++) {
+    ASSERT_EQ(131072u + (i + 1) * 65536, v[i].first);
+    ASSERT_EQ(4096u, v[i].second);
+  }
+
+  // each later record was prefetched
+  uint64_t next = v.back().first + 65536;
+  for (uint64_t off = 196608; off < 64 << 20; off += 65536) {
+    v.clear();
+    ra.update(off, 4096, LIMIT, v);
+    for (extents_t::iterator p = v.begin(); p != v.end(); ++p) {
+      ASSERT_EQ(next, p->first);
+      next += 65536;
+    }
+    ASSERT_GT(next, off + 65536);
+  }
+  ASSERT_EQ(0u, ra.get_waste());
+}
+
+TEST(Readahead, Align)
+{
+  Readahead ra;
+  ra.set_window(1 << 20, 1 << 20);
+  vector<uint64_t> align;
+  align.push_back(64 << 10);
+  align.push_back(4 << 20);
+  ra.set_alignments(align);
+
+  extents_t v;
+  ra.update(1000, 1000, LIMIT, v);
+  ra.update(2000, 1000, LIMIT, v);
+  ASSERT_EQ(1u, v.size());
+  ASSERT_EQ(3000u, v[0].first);
+  // 3000 + 1M is trimmed back to a 64k boundary; 4M is too far back
+  ASSERT_EQ(0u, (v[0].first + v[0].second) % (64 << 10));
+  ASSERT_EQ(1u << 20, v[0].first + v[0].second);
+
+  // reading on to just short of 4M ends the prefetch there
+  Readahead ra2;
+  ra2.set_window(1 << 20, 1 << 20);
+  ra2.set_alignments(align);
+  v.clear();
+  uint64_t off = (4 << 20) - (1 << 20);
+  ra2.update(off, 4096, LIMIT, v);
+  ra2.update(off + 4096, 4096, LIMIT, v);
+  ASSERT_EQ(1u, v.size());
+  ASSERT_EQ(4u << 20, v[0].first + v[0].second);
+}
+
+TEST(Readahead, Limit)
+{
+  Readahead ra;
+  ra.set_window(64 << 10, 1 << 20);
+  extents_t v;
+  ra.update(0, 4096, 10000, v);
+  ra.update(4096, 4096, 10000, v);
+  ASSERT_EQ(1u, v.size());
+  ASSERT_EQ(10000u, v[0].first + v[0].second);
+
+  // nothing left to prefetch
+  v.clear();
+  ra.update(8192, 1808, 10000, v);
+  ASSERT_TRUE(v.empty());
+}
@@ -0,0 +1,74 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "common/simple_cache.h"
+#include "test/unit.h"
+
+TEST(SimpleLRU, Evict)
+{
+  SimpleLRU<int,int> c(3);
+  for (int i = 0; i < 3; i++)
+    c.add(i, i * 10);
+  int v;
+  ASSERT_TRUE(c.lookup(0, &v));   // 0 is now the most recent
+  ASSERT_EQ(0, v);
+  c.add(3, 30);
+  ASSERT_FALSE(c.lookup(1, &v));
+  ASSERT_TRUE(c.lookup(0, &v));
+  ASSERT_TRUE(c.lookup(2, &v));
+  ASSERT_TRUE(c.lookup(3, &v));
+  ASSERT_EQ(30, v);
+
+  c.add(3, 31);
+  ASSERT_EQ(3u, c.size());
+  ASSERT_TRUE(c.lookup(3, &v));
+  ASSERT_EQ(31, v);
+
+  c.set_size(1);
+  ASSERT_EQ(1u, c.size());
+  ASSERT_TRUE(c.lookup(3, &v));
+}
+
+TEST(SimpleLRU, Pinned)
+{
+  SimpleLRU<int,int> c(1);
+  for (int i = 0; i < 4; i++)
+    c.pin(i, i);
+  ASSERT_EQ(4u, c.size());
+  int v;
+  ASSERT_TRUE(c.lookup(2, &v));
+  c.clear_pinned(1);   // 0 and 1 go to the lru, which only keeps one
+  ASSERT_EQ(3u, c.size());
+  ASSERT_FALSE(c.lookup(0, &v));
+  ASSERT_TRUE(c.lookup(1, &v));
+  ASSERT_TRUE(c.lookup(3, &v));
+  c.clear_pinned(3);
+  ASSERT_EQ(1u, c.size());
+  ASSERT_TRUE(c.lookup(3, &v));
+}
+
+TEST(SimpleLRU, SharedBuffers)
+{
+  SimpleLRU<int,bufferlist> c(2);
+  bufferlist bl;
+  bl.append("osdmap");
+  c.add(1, bl);
+  bufferlist a, b;
+  ASSERT_TRUE(c.lookup(1, &a));
+  ASSERT_TRUE(c.lookup(1, &b));
+  ASSERT_EQ(a.c_str(), b.c_str());   // no copies
+  a.clear();
+  ASSERT_EQ("osdmap", string(b.c_str(), b.length()));
+}
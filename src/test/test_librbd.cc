@@ -843,3 +843,149 @@ TEST(LibRBD, TestIOToSnapshot)
 }
 
 
+
+TEST(LibRBD, TestObjectMapPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+  ASSERT_EQ(0, rados.conf_set("rbd_object_map", "true"));
+
+  {
+    librbd::RBD rbd;
+    librbd::Image image;
+    int order = 20;
+    const char *name = "testimg";
+    uint64_t size = 4 << 20;
+
+    ASSERT_EQ(0, rbd.create(ioctx, name, size, &order));
+    ASSERT_EQ(0, rbd.open(ioctx, image, name, NULL));
+
+    librbd::image_info_t info;
+    ASSERT_EQ(0, image.stat(info, sizeof(info)));
+    string prefix = info.block_name_prefix;
+    string map_oid = prefix + ".map";
+
+    // only the block we write shows up, in the image and in the map
+    bufferlist bl;
+    bl.append(string(4096, 'x'));
+    ASSERT_EQ(4096, image.write((2 << 20) + 100, 4096, bl));
+    uint64_t map_size;
+    time_t mtime;
+    ASSERT_EQ(0, ioctx.stat(map_oid, &map_size, &mtime));
+    ASSERT_EQ(3u, map_size);
+    ASSERT_EQ(-ENOENT, ioctx.stat(prefix + ".000000000000", NULL, NULL));
+    ASSERT_EQ(0, ioctx.stat(prefix + ".000000000002", NULL, NULL));
+
+    // holes read back as zeros, data as data
+    bufferlist rbl;
+    ASSERT_EQ(4 << 20, image.read(0, 4 << 20, rbl));
+    ASSERT_EQ(string(4096, 'x'), string(rbl.c_str() + (2 << 20) + 100, 4096));
+    ASSERT_EQ(string(100, '\0'), string(rbl.c_str() + (2 << 20), 100));
+    ASSERT_EQ(string(4096, '\0'), string(rbl.c_str(), 4096));
+
+    // shrinking forgets the trimmed blocks
+    ASSERT_EQ(0, image.resize(1 << 20));
+    ASSERT_EQ(0, ioctx.stat(map_oid, &map_size, &mtime));
+    ASSERT_EQ(1u, map_size);
+    ASSERT_EQ(-ENOENT, ioctx.stat(prefix + ".000000000002", NULL, NULL));
+  }
+
+  librbd::RBD rbd;
+  ASSERT_EQ(0, rbd.remove(ioctx, "testimg"));
+  ASSERT_EQ(0, rados.conf_set("rbd_object_map", "false"));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(LibRBD, TestClonePP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  int order = 20;
+  uint64_t size = 4 << 20;
+  ASSERT_EQ(0, rbd.create(ioctx, "parent", size, &order));
+
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    bufferlist bl;
+    bl.append(string(2 << 20, 'p'));
+    ASSERT_EQ(2 << 20, parent.write(1 << 20, 2 << 20, bl));
+    ASSERT_EQ(0, parent.snap_create("snap"));
+
+    // later writes to the parent head are not seen by clones
+    bufferlist bl2;
+    bl2.append(string(4096, 'h'));
+    ASSERT_EQ(4096, parent.write(1 << 20, 4096, bl2));
+  }
+
+  int c_order = 0;
+  ASSERT_EQ(-EINVAL, rbd.clone(ioctx, "parent", NULL, "clone", &c_order));
+  ASSERT_EQ(0, rbd.clone(ioctx, "parent", "snap", "clone", &c_order));
+  ASSERT_EQ(20, c_order);
+
+  {
+    librbd::Image clone;
+    ASSERT_EQ(0, rbd.open(ioctx, clone, "clone", NULL));
+    librbd::image_info_t info;
+    ASSERT_EQ(0, clone.stat(info, sizeof(info)));
+    ASSERT_EQ(size, info.size);
+    ASSERT_EQ(string("parent@snap"), string(info.parent_name));
+
+    bufferlist rbl;
+    ASSERT_EQ((ssize_t)size, clone.read(0, size, rbl));
+    ASSERT_EQ(string(1 << 20, '\0'), string(rbl.c_str(), 1 << 20));
+    ASSERT_EQ(string(2 << 20, 'p'), string(rbl.c_str() + (1 << 20), 2 << 20));
+
+    // a partial write copies up the rest of the block
+    bufferlist bl;
+    bl.append(string(100, 'c'));
+    ASSERT_EQ(100, clone.write((2 << 20) + 10, 100, bl));
+    bufferlist rbl2;
+    ASSERT_EQ(1 << 20, clone.read(2 << 20, 1 << 20, rbl2));
+    ASSERT_EQ(string(10, 'p'), string(rbl2.c_str(), 10));
+    ASSERT_EQ(string(100, 'c'), string(rbl2.c_str() + 10, 100));
+    ASSERT_EQ(string((1 << 20) - 110, 'p'), string(rbl2.c_str() + 110, (1 << 20) - 110));
+
+    // aio reads fall through as well
+    bufferlist abl;
+    librbd::RBD::AioCompletion *comp = new librbd::RBD::AioCompletion(NULL, NULL);
+    ASSERT_LE(0, clone.aio_read(1 << 20, 4096, abl, comp));
+    comp->wait_for_complete();
+    ASSERT_EQ(4096, comp->get_return_value());
+    comp->release();
+    ASSERT_EQ(string(4096, 'p'), string(abl.c_str(), 4096));
+  }
+
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", "snap"));
+    bufferlist rbl;
+    ASSERT_EQ(100, parent.read((2 << 20) + 10, 100, rbl));
+    ASSERT_EQ(string(100, 'p'), string(rbl.c_str(), 100));
+    ASSERT_EQ(-EBUSY, parent.snap_remove("snap"));
+  }
+  ASSERT_EQ(-EBUSY, rbd.rename(ioctx, "parent", "parent2"));
+
+  ASSERT_EQ(0, rbd.remove(ioctx, "clone"));
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    ASSERT_EQ(0, parent.snap_remove("snap"));
+  }
+  ASSERT_EQ(0, rbd.remove(ioctx, "parent"));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
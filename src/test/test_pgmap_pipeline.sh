@@ -0,0 +1,114 @@
+#!/bin/bash -x
+
+#
+# Test pgmap updates with more than one paxos value in flight
+#
+# Pool creation and osd out/in go through PGMonitor::check_osd_map and
+# register_new_pgs while pg stats keep the pgmap pipeline busy.  Killing
+# the leader part way through makes the new leader recover the values
+# that were still in flight.  Afterwards every pg must exist exactly once
+# and none may have been reset back to creating.
+#
+
+# Includes
+source "`dirname $0`/test_common.sh"
+
+# Functions
+setup() {
+        export CEPH_NUM_MON=3
+        export CEPH_NUM_OSD=$1
+
+        # Start ceph
+        ./stop.sh
+
+        ./vstart.sh -d -n -o 'paxos max inflight = 4
+        osd mon report interval max = 5
+        osd mon report interval min = 1' || die "vstart failed"
+}
+
+num_pgs() {
+        ./ceph -c ./ceph.conf pg stat -o - | sed -n 's/^v[0-9]*: \([0-9]*\) pgs:.*/\1/p'
+}
+
+pg_version() {
+        ./ceph -c ./ceph.conf -m $1 pg stat -o - | sed -n 's/^v\([0-9]*\):.*/\1/p'
+}
+
+stop_mon() {
+        pidfile="out/mon.$1.pid"
+        [ -e $pidfile ] || die "ceph-mon $1 is not running"
+        kill `cat $pidfile`
+}
+
+restart_mon() {
+        ./ceph-mon -i $1 -c ceph.conf
+}
+
+wait_for_no_creating() {
+        t=0
+        while [ $t -lt 180 ]; do
+                ./ceph -c ./ceph.conf pg stat -o - | grep -q creating || return 0
+                sleep 3
+                t=$(($t+3))
+        done
+        die "pgs stuck creating"
+}
+
+churn() {
+        first=$1
+        last=$2
+        for i in `seq $first $last`; do
+                ./ceph -c ./ceph.conf osd pool create pipe$i 8 || die "pool create failed"
+                ./ceph -c ./ceph.conf osd out $(($i % $CEPH_NUM_OSD))
+                ./ceph -c ./ceph.conf osd in $(($i % $CEPH_NUM_OSD))
+        done
+}
+
+pipeline1_impl() {
+        poll_cmd "./ceph -c ./ceph.conf osd stat -o -" "$CEPH_NUM_OSD up, $CEPH_NUM_OSD in" 5 240
+        [ $? -eq 1 ] || die "didn't start $CEPH_NUM_OSD osds"
+        wait_for_no_creating
+        base=`num_pgs`
+
+        churn 1 10
+        wait_for_no_creating
+
+        # lose the leader with pgmap values in flight
+        churn 11 15 &
+        sleep 2
+        stop_mon a
+        wait
+        churn 16 20
+        restart_mon a
+        wait_for_no_creating
+
+        # more osdmap changes must not re-register what's there
+        churn 21 25
+        wait_for_no_creating
+        ./ceph -c ./ceph.conf osd out 0
+        ./ceph -c ./ceph.conf osd in 0
+        sleep 10
+        ./ceph -c ./ceph.conf pg stat -o - | grep creating && \
+            die "existing pgs were registered again"
+
+        [ `num_pgs` -eq $(($base + 25 * 8)) ] || die "wrong number of pgs"
+
+        # every mon ends up with the same pgmap
+        sleep 10
+        va=`pg_version $IP:6789`
+        vb=`pg_version $IP:6790`
+        vc=`pg_version $IP:6791`
+        [ "$va" = "$vb" -a "$vb" = "$vc" ] || die "mons disagree: $va $vb $vc"
+}
+
+pipeline1() {
+        setup 3
+        IP=`grep 'mon addr' ceph.conf | head -1 | sed 's/.*= *\([^:]*\):.*/\1/'`
+        pipeline1_impl
+}
+
+run() {
+        pipeline1 || die "test failed"
+}
+
+$@
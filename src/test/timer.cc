@@ -0,0 +1,179 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "include/Context.h"
+#include "common/Clock.h"
+#include "common/Mutex.h"
+#include "common/Timer.h"
+#include "test/unit.h"
+
+#include <unistd.h>
+
+struct C_Record : public Context {
+  vector<int> *out;
+  int n;
+  utime_t when;
+  bool *early;
+  C_Record(vector<int> *o, int n_, utime_t w, bool *e)
+    : out(o), n(n_), when(w), early(e) {}
+  void finish(int r) {
+    if (ceph_clock_now(g_ceph_context) < when)
+      *early = true;
+    out->push_back(n);
+  }
+};
+
+TEST(SafeTimer, Order) {
+  Mutex lock("SafeTimer::Order::lock");
+  SafeTimer timer(g_ceph_context, lock);
+  timer.init();
+
+  vector<int> out;
+  bool early = false;
+  utime_t now = ceph_clock_now(g_ceph_context);
+  lock.Lock();
+  // insert out of order, with several events per tick
+  int order[] = { 5, 1, 9, 3, 7, 2, 8, 0, 6, 4 };
+  for (int i = 0; i < 10; i++) {
+    utime_t when = now;
+    when += (double)order[i] * .0003 + .05;
+    timer.add_event_at(when, new C_Record(&out, order[i], when, &early));
+  }
+  lock.Unlock();
+
+  usleep(200000);
+  lock.Lock();
+  ASSERT_EQ(0u, timer.get_num_events());
+  ASSERT_EQ(10u, out.size());
+  for (int i = 0; i < 10; i++)
+    ASSERT_EQ(i, out[i]);
+  ASSERT_FALSE(early);
+  timer.shutdown();
+  lock.Unlock();
+}
+
+TEST(SafeTimer, Cancel) {
+  Mutex lock("SafeTimer::Cancel::lock");
+  SafeTimer timer(g_ceph_context, lock);
+  timer.init();
+
+  vector<int> out;
+  bool early = false;
+  utime_t now = ceph_clock_now(g_ceph_context);
+  lock.Lock();
+  vector<Context*> cs;
+  for (int i = 0; i < 1000; i++) {
+    utime_t when = now;
+    when += (double)(i % 10) * .01 + .02;
+    Context *c = new C_Record(&out, i, when, &early);
+    cs.push_back(c);
+    timer.add_event_at(when, c);
+  }
+  // cancel the odd ones
+  for (int i = 1; i < 1000; i += 2)
+    ASSERT_TRUE(timer.cancel_event(cs[i]));
+  ASSERT_FALSE(timer.cancel_event(cs[1]));
+  ASSERT_EQ(500u, timer.get_num_events());
+  lock.Unlock();
+
+  usleep(300000);
+  lock.Lock();
+  ASSERT_EQ(500u, out.size());
+  for (unsigned i = 0; i < out.size(); i++)
+    ASSERT_EQ(0, out[i] % 2);
+  ASSERT_FALSE(early);
+  timer.shutdown();
+  lock.Unlock();
+}
+
+TEST(SafeTimer, FarFuture) {
+  Mutex lock("SafeTimer::FarFuture::lock");
+  SafeTimer timer(g_ceph_context, lock);
+  timer.init();
+
+  vector<int> out;
+  bool early = false;
+  utime_t now = ceph_clock_now(g_ceph_context);
+  lock.Lock();
+  // one event in each wheel level, plus one beyond the outermost
+  double delays[] = { .1, 10, 1000, 100000, 100000000 };
+  for (int i = 0; i < 5; i++) {
+    utime_t when = now;
+    when += delays[i];
+    timer.add_event_at(when, new C_Record(&out, i, when, &early));
+  }
+  lock.Unlock();
+
+  usleep(300000);
+  lock.Lock();
+  ASSERT_EQ(1u, out.size());
+  ASSERT_EQ(4u, timer.get_num_events());
+  timer.shutdown();  // cancels the rest
+  ASSERT_EQ(0u, timer.get_num_events());
+  lock.Unlock();
+}
+
+struct C_Chain : public Context {
+  SafeTimer *timer;
+  int *left;
+  C_Chain(SafeTimer *t, int *l) : timer(t), left(l) {}
+  void finish(int r) {
+    if (--(*left) > 0)
+      timer->add_event_after(.001, new C_Chain(timer, left));
+  }
+};
+
+TEST(SafeTimer, Rearm) {
+  Mutex lock("SafeTimer::Rearm::lock");
+  SafeTimer timer(g_ceph_context, lock);
+  timer.init();
+
+  int left = 20;
+  lock.Lock();
+  timer.add_event_after(0, new C_Chain(&timer, &left));
+  lock.Unlock();
+
+  usleep(500000);
+  lock.Lock();
+  ASSERT_EQ(0, left);
+  timer.shutdown();
+  lock.Unlock();
+}
+
+TEST(SafeTimer, Random) {
+  Mutex lock("SafeTimer::Random::lock");
+  SafeTimer timer(g_ceph_context, lock);
+  timer.init();
+
+  vector<int> out;
+  bool early = false;
+  utime_t now = ceph_clock_now(g_ceph_context);
+  lock.Lock();
+  // spread across level 0 and level 1 so that cascading is exercised
+  for (int i = 0; i < 2000; i++) {
+    utime_t when = now;
+    when += (double)(rand() % 1500) / 1000.0;
+    timer.add_event_at(when, new C_Record(&out, i, when, &early));
+  }
+  lock.Unlock();
+
+  usleep(1700000);
+  lock.Lock();
+  ASSERT_EQ(2000u, out.size());
+  ASSERT_EQ(0u, timer.get_num_events());
+  ASSERT_FALSE(early);
+  timer.shutdown();
+  lock.Unlock();
+}
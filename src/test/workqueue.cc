@@ -0,0 +1,122 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "common/WorkQueue.h"
+#include "common/Mutex.h"
+#include "test/unit.h"
+
+#include <map>
+#include <unistd.h>
+
+struct Item {
+  int key;
+  int seq;
+  Item(int k, int s) : key(k), seq(s) {}
+};
+
+struct KeyedWQ : public ThreadPool::ShardedWorkQueue<Item> {
+  Mutex lock;
+  map<int,int> last_seq;   // per key
+  map<int,int> running;    // per key
+  int done;
+  bool overlap, misordered;
+
+  KeyedWQ(ThreadPool *tp)
+    : ThreadPool::ShardedWorkQueue<Item>("KeyedWQ", 60, 0, tp),
+      lock("KeyedWQ::lock"), done(0), overlap(false), misordered(false) {}
+
+  uint64_t _get_key(Item *i) {
+    return i->key;
+  }
+  void _process(Item *i) {
+    lock.Lock();
+    if (running[i->key]++)
+      overlap = true;
+    if (last_seq.count(i->key) && last_seq[i->key] + 1 != i->seq)
+      misordered = true;
+    last_seq[i->key] = i->seq;
+    lock.Unlock();
+
+    usleep(10);
+
+    lock.Lock();
+    running[i->key]--;
+    done++;
+    lock.Unlock();
+    delete i;
+  }
+  void _discard(Item *i) {
+    delete i;
+  }
+};
+
+static void run_keyed(bool steal)
+{
+  ThreadPool tp(g_ceph_context, "keyed_tp", 4, steal);
+  KeyedWQ wq(&tp);
+  tp.start();
+  for (int s = 0; s < 200; s++)
+    for (int k = 0; k < 8; k++)
+      wq.queue(new Item(k, s));
+  wq.drain();
+  ASSERT_TRUE(wq.empty());
+  ASSERT_EQ(1600, wq.done);
+  ASSERT_FALSE(wq.overlap);
+  ASSERT_FALSE(wq.misordered);
+  tp.stop();
+}
+
+TEST(WorkQueue, ShardedSerialPerKey) {
+  run_keyed(false);
+}
+
+TEST(WorkQueue, WorkStealingSerialPerKey) {
+  run_keyed(true);
+}
+
+TEST(WorkQueue, WorkStealingPause) {
+  ThreadPool tp(g_ceph_context, "pause_tp", 3, true);
+  KeyedWQ wq(&tp);
+  tp.start();
+  tp.pause();
+  for (int k = 0; k < 10; k++)
+    wq.queue(new Item(k, 0));
+  usleep(100000);
+  ASSERT_EQ(0, wq.done);
+
+  list<Item*> ls;
+  wq.dequeue_all(ls);
+  ASSERT_EQ(10u, ls.size());
+  ASSERT_TRUE(wq.empty());
+  for (list<Item*>::iterator p = ls.begin(); p != ls.end(); ++p)
+    wq.queue(*p);
+
+  tp.unpause();
+  wq.drain();
+  ASSERT_EQ(10, wq.done);
+  tp.stop();
+}
+
+TEST(WorkQueue, WorkStealingStopDiscards) {
+  ThreadPool tp(g_ceph_context, "stop_tp", 2, true);
+  KeyedWQ wq(&tp);
+  tp.start();
+  tp.pause_new();
+  for (int k = 0; k < 10; k++)
+    wq.queue(new Item(k, 0));
+  tp.stop();
+  ASSERT_EQ(0, wq.done);
+  ASSERT_TRUE(wq.empty());
+}